@@ -0,0 +1,443 @@
+#include "analytics.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ANA_X86
+#include <immintrin.h>
+#endif
+
+//-------------------------------------------------------------------- ANAlytics
+
+/// Samples per pass of the SIMD sums: an int32 lane adds at most
+/// ANA_CHUNK / 4 values of ANA_MAX_VALUE before it is added to the int64 sums
+#define ANA_CHUNK (16384u)
+
+static const char *const kernelNames[ANA_NOF_KERNELS] = {"scalar", "sse4.1", "avx2"};
+
+/// Kernel in use, -1 until the first call
+static _Atomic int kernel = -1;
+
+//---------------------------------------------------------------------- scalar
+
+/// Adds samples [from, to) of series to sums, the scalar reference.
+static void sumRange(const anaSeries_t *series, uint32_t from, uint32_t to,
+                     anaSums_t *sums)
+{
+   for (uint32_t i = from; i < to; i++)
+   {
+      int32_t v = series->speed[i];
+      int32_t g = series->incline[i];
+      uint64_t climb = (uint64_t)(v > 0 ? v : 0) * (uint64_t)(g > 0 ? g : 0);
+
+      if (v > sums->maxSpeed)
+      {
+         sums->maxSpeed = v;
+      }
+      if (g > sums->maxIncline)
+      {
+         sums->maxIncline = g;
+      }
+      sums->speed += v;
+      sums->incline += g;
+      sums->climb += climb;
+      if (v > 0)
+      {
+         sums->moving++;
+      }
+      if (v >= ANA_RUN_SPEED)
+      {
+         sums->running++;
+         sums->runSpeed += v;
+         sums->runClimb += climb;
+      }
+   }
+}
+
+/// Moving average of [from, to), sum is the window sum before from.
+/// \return the window sum at to - 1.
+static int32_t averageRange(const int32_t in[], uint32_t from, uint32_t to,
+                            uint32_t window, int32_t sum, float out[])
+{
+   for (uint32_t i = from; i < to; i++)
+   {
+      sum += in[i];
+      if (i >= window)
+      {
+         sum -= in[i - window];
+      }
+      out[i] = (float)sum / (float)((i < window) ? i + 1 : window);
+   }
+   return sum;
+}
+
+//------------------------------------------------------------------------ x86
+
+#ifdef ANA_X86
+
+/// Adds the int32 lanes of a chunk to the int64 sums.
+static int64_t addLanes(const int32_t lanes[], int n)
+{
+   int64_t sum = 0;
+
+   for (int l = 0; l < n; l++)
+   {
+      sum += lanes[l];
+   }
+   return sum;
+}
+
+__attribute__((target("avx2")))
+static void sumAvx2(const anaSeries_t *series, anaSums_t *sums)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i walkMax = _mm256_set1_epi32(ANA_RUN_SPEED - 1);
+   __m256i maxSpeed = _mm256_set1_epi32(INT32_MIN);
+   __m256i maxIncline = _mm256_set1_epi32(INT32_MIN);
+   __m256i climb = zero;          // 4 x uint64
+   __m256i runClimb = zero;
+   const uint32_t end = series->n & ~7u;
+   uint32_t i = 0;
+
+   while (i < end)
+   {
+      const uint32_t chunkEnd = (end - i > ANA_CHUNK) ? i + ANA_CHUNK : end;
+      __m256i speed = zero;
+      __m256i incline = zero;
+      __m256i runSpeed = zero;
+      __m256i moving = zero;
+      __m256i running = zero;
+
+      for (; i < chunkEnd; i += 8)
+      {
+         __m256i v = _mm256_loadu_si256((const __m256i *)&series->speed[i]);
+         __m256i g = _mm256_loadu_si256((const __m256i *)&series->incline[i]);
+         __m256i run = _mm256_cmpgt_epi32(v, walkMax);
+
+         maxSpeed = _mm256_max_epi32(maxSpeed, v);
+         maxIncline = _mm256_max_epi32(maxIncline, g);
+         speed = _mm256_add_epi32(speed, v);
+         incline = _mm256_add_epi32(incline, g);
+         runSpeed = _mm256_add_epi32(runSpeed, _mm256_and_si256(run, v));
+         moving = _mm256_sub_epi32(moving, _mm256_cmpgt_epi32(v, zero));
+         running = _mm256_sub_epi32(running, run);
+
+         // The products are up to 30 bit, multiplied to 64 bit per even
+         // and per odd lane
+         __m256i vp = _mm256_max_epi32(v, zero);
+         __m256i gp = _mm256_max_epi32(g, zero);
+         __m256i vr = _mm256_and_si256(run, vp);
+         __m256i gOdd = _mm256_srli_epi64(gp, 32);
+         climb = _mm256_add_epi64(climb, _mm256_mul_epu32(vp, gp));
+         climb = _mm256_add_epi64(climb, _mm256_mul_epu32(_mm256_srli_epi64(vp, 32), gOdd));
+         runClimb = _mm256_add_epi64(runClimb, _mm256_mul_epu32(vr, gp));
+         runClimb = _mm256_add_epi64(runClimb, _mm256_mul_epu32(_mm256_srli_epi64(vr, 32), gOdd));
+      }
+
+      int32_t lanes[8];
+      _mm256_storeu_si256((__m256i *)lanes, speed);
+      sums->speed += addLanes(lanes, 8);
+      _mm256_storeu_si256((__m256i *)lanes, incline);
+      sums->incline += addLanes(lanes, 8);
+      _mm256_storeu_si256((__m256i *)lanes, runSpeed);
+      sums->runSpeed += addLanes(lanes, 8);
+      _mm256_storeu_si256((__m256i *)lanes, moving);
+      sums->moving += (uint32_t)addLanes(lanes, 8);
+      _mm256_storeu_si256((__m256i *)lanes, running);
+      sums->running += (uint32_t)addLanes(lanes, 8);
+   }
+
+   int32_t lanes[8];
+   uint64_t products[4];
+   _mm256_storeu_si256((__m256i *)lanes, maxSpeed);
+   for (int l = 0; l < 8; l++)
+   {
+      sums->maxSpeed = (lanes[l] > sums->maxSpeed) ? lanes[l] : sums->maxSpeed;
+   }
+   _mm256_storeu_si256((__m256i *)lanes, maxIncline);
+   for (int l = 0; l < 8; l++)
+   {
+      sums->maxIncline = (lanes[l] > sums->maxIncline) ? lanes[l] : sums->maxIncline;
+   }
+   _mm256_storeu_si256((__m256i *)products, climb);
+   sums->climb += products[0] + products[1] + products[2] + products[3];
+   _mm256_storeu_si256((__m256i *)products, runClimb);
+   sums->runClimb += products[0] + products[1] + products[2] + products[3];
+
+   sumRange(series, end, series->n, sums);
+}
+
+__attribute__((target("sse4.1")))
+static void sumSse41(const anaSeries_t *series, anaSums_t *sums)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i walkMax = _mm_set1_epi32(ANA_RUN_SPEED - 1);
+   __m128i maxSpeed = _mm_set1_epi32(INT32_MIN);
+   __m128i maxIncline = _mm_set1_epi32(INT32_MIN);
+   __m128i climb = zero;          // 2 x uint64
+   __m128i runClimb = zero;
+   const uint32_t end = series->n & ~3u;
+   uint32_t i = 0;
+
+   while (i < end)
+   {
+      const uint32_t chunkEnd = (end - i > ANA_CHUNK) ? i + ANA_CHUNK : end;
+      __m128i speed = zero;
+      __m128i incline = zero;
+      __m128i runSpeed = zero;
+      __m128i moving = zero;
+      __m128i running = zero;
+
+      for (; i < chunkEnd; i += 4)
+      {
+         __m128i v = _mm_loadu_si128((const __m128i *)&series->speed[i]);
+         __m128i g = _mm_loadu_si128((const __m128i *)&series->incline[i]);
+         __m128i run = _mm_cmpgt_epi32(v, walkMax);
+
+         maxSpeed = _mm_max_epi32(maxSpeed, v);
+         maxIncline = _mm_max_epi32(maxIncline, g);
+         speed = _mm_add_epi32(speed, v);
+         incline = _mm_add_epi32(incline, g);
+         runSpeed = _mm_add_epi32(runSpeed, _mm_and_si128(run, v));
+         moving = _mm_sub_epi32(moving, _mm_cmpgt_epi32(v, zero));
+         running = _mm_sub_epi32(running, run);
+
+         __m128i vp = _mm_max_epi32(v, zero);
+         __m128i gp = _mm_max_epi32(g, zero);
+         __m128i vr = _mm_and_si128(run, vp);
+         __m128i gOdd = _mm_srli_epi64(gp, 32);
+         climb = _mm_add_epi64(climb, _mm_mul_epu32(vp, gp));
+         climb = _mm_add_epi64(climb, _mm_mul_epu32(_mm_srli_epi64(vp, 32), gOdd));
+         runClimb = _mm_add_epi64(runClimb, _mm_mul_epu32(vr, gp));
+         runClimb = _mm_add_epi64(runClimb, _mm_mul_epu32(_mm_srli_epi64(vr, 32), gOdd));
+      }
+
+      int32_t lanes[4];
+      _mm_storeu_si128((__m128i *)lanes, speed);
+      sums->speed += addLanes(lanes, 4);
+      _mm_storeu_si128((__m128i *)lanes, incline);
+      sums->incline += addLanes(lanes, 4);
+      _mm_storeu_si128((__m128i *)lanes, runSpeed);
+      sums->runSpeed += addLanes(lanes, 4);
+      _mm_storeu_si128((__m128i *)lanes, moving);
+      sums->moving += (uint32_t)addLanes(lanes, 4);
+      _mm_storeu_si128((__m128i *)lanes, running);
+      sums->running += (uint32_t)addLanes(lanes, 4);
+   }
+
+   int32_t lanes[4];
+   uint64_t products[2];
+   _mm_storeu_si128((__m128i *)lanes, maxSpeed);
+   for (int l = 0; l < 4; l++)
+   {
+      sums->maxSpeed = (lanes[l] > sums->maxSpeed) ? lanes[l] : sums->maxSpeed;
+   }
+   _mm_storeu_si128((__m128i *)lanes, maxIncline);
+   for (int l = 0; l < 4; l++)
+   {
+      sums->maxIncline = (lanes[l] > sums->maxIncline) ? lanes[l] : sums->maxIncline;
+   }
+   _mm_storeu_si128((__m128i *)products, climb);
+   sums->climb += products[0] + products[1];
+   _mm_storeu_si128((__m128i *)products, runClimb);
+   sums->runClimb += products[0] + products[1];
+
+   sumRange(series, end, series->n, sums);
+}
+
+/// The window sums of 8 samples at once: the changes in[i] - in[i - window]
+/// are added up within the vector (prefix sum) and to the sum before it.
+/// The partial sums may wrap around, the window sums do not.
+__attribute__((target("avx2")))
+static void averageAvx2(const int32_t in[], uint32_t n, uint32_t window, float out[])
+{
+   uint32_t i = (window < n) ? window : n;
+   int32_t sum = averageRange(in, 0, i, window, 0, out);
+   const __m256 divisor = _mm256_set1_ps((float)window);
+   __m256i carry = _mm256_set1_epi32(sum);
+
+   for (; i + 8 <= n; i += 8)
+   {
+      __m256i x = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)&in[i]),
+                                   _mm256_loadu_si256((const __m256i *)&in[i - window]));
+
+      x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+      x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+      // Last of the low half to all of the high half
+      __m256i low = _mm256_permute2x128_si256(x, x, 0x08);
+      x = _mm256_add_epi32(x, _mm256_shuffle_epi32(low, _MM_SHUFFLE(3, 3, 3, 3)));
+      x = _mm256_add_epi32(x, carry);
+      carry = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+      _mm256_storeu_ps(&out[i], _mm256_div_ps(_mm256_cvtepi32_ps(x), divisor));
+   }
+   sum = _mm_cvtsi128_si32(_mm256_castsi256_si128(carry));
+   averageRange(in, i, n, window, sum, out);
+}
+
+__attribute__((target("sse4.1")))
+static void averageSse41(const int32_t in[], uint32_t n, uint32_t window, float out[])
+{
+   uint32_t i = (window < n) ? window : n;
+   int32_t sum = averageRange(in, 0, i, window, 0, out);
+   const __m128 divisor = _mm_set1_ps((float)window);
+   __m128i carry = _mm_set1_epi32(sum);
+
+   for (; i + 4 <= n; i += 4)
+   {
+      __m128i x = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)&in[i]),
+                                _mm_loadu_si128((const __m128i *)&in[i - window]));
+
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi32(x, carry);
+      carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+      _mm_storeu_ps(&out[i], _mm_div_ps(_mm_cvtepi32_ps(x), divisor));
+   }
+   sum = _mm_cvtsi128_si32(carry);
+   averageRange(in, i, n, window, sum, out);
+}
+
+static bool supported(anaKernel_t k)
+{
+   __builtin_cpu_init();
+   switch (k)
+   {
+   case ANA_SCALAR:
+      return true;
+   case ANA_SSE41:
+      return __builtin_cpu_supports("sse4.1");
+   case ANA_AVX2:
+      return __builtin_cpu_supports("avx2");
+   default:
+      return false;
+   }
+}
+
+#else
+
+static bool supported(anaKernel_t k)
+{
+   return k == ANA_SCALAR;
+}
+
+#endif
+
+//------------------------------------------------------------------------- API
+
+anaKernel_t ANAbestKernel(void)
+{
+   for (int k = ANA_NOF_KERNELS - 1; k > ANA_SCALAR; k--)
+   {
+      if (supported((anaKernel_t)k))
+      {
+         return (anaKernel_t)k;
+      }
+   }
+   return ANA_SCALAR;
+}
+
+bool ANAsetKernel(anaKernel_t k)
+{
+   if ((int)k < 0 || k >= ANA_NOF_KERNELS || !supported(k))
+   {
+      return false;
+   }
+   atomic_store_explicit(&kernel, (int)k, memory_order_relaxed);
+   return true;
+}
+
+anaKernel_t ANAgetKernel(void)
+{
+   int k = atomic_load_explicit(&kernel, memory_order_relaxed);
+
+   if (k < 0)
+   {
+      k = (int)ANAbestKernel();
+      atomic_store_explicit(&kernel, k, memory_order_relaxed);
+   }
+   return (anaKernel_t)k;
+}
+
+const char *ANAkernelText(anaKernel_t k)
+{
+   return ((int)k >= 0 && k < ANA_NOF_KERNELS) ? kernelNames[k] : "unknown";
+}
+
+void ANAsum(const anaSeries_t *series, anaSums_t *sums)
+{
+   memset(sums, 0, sizeof(*sums));
+   sums->samples = series->n;
+   sums->maxSpeed = INT32_MIN;
+   sums->maxIncline = INT32_MIN;
+
+   switch (ANAgetKernel())
+   {
+#ifdef ANA_X86
+   case ANA_AVX2:
+      sumAvx2(series, sums);
+      break;
+   case ANA_SSE41:
+      sumSse41(series, sums);
+      break;
+#endif
+   default:
+      sumRange(series, 0, series->n, sums);
+      break;
+   }
+
+   if (series->n == 0)
+   {
+      sums->maxSpeed = 0;
+      sums->maxIncline = 0;
+   }
+}
+
+void ANAmovingAverage(const int32_t in[], uint32_t n, uint32_t window, float out[])
+{
+   if (window == 0 || window > ANA_MAX_WINDOW)
+   {
+      return;
+   }
+   switch (ANAgetKernel())
+   {
+#ifdef ANA_X86
+   case ANA_AVX2:
+      averageAvx2(in, n, window, out);
+      break;
+   case ANA_SSE41:
+      averageSse41(in, n, window, out);
+      break;
+#endif
+   default:
+      averageRange(in, 0, n, window, 0, out);
+      break;
+   }
+}
+
+void ANAreport(const anaSums_t *sums, uint32_t intervalMs, double massKg,
+               anaReport_t *report)
+{
+   const double dt = intervalMs / 1000.0;
+
+   // v in 0.01 km/h is v / 360 m/s, or v / 6 m/min; g in 0.01 % is a grade
+   // of g / 10000
+   report->durationS = sums->samples * dt;
+   report->movingS = sums->moving * dt;
+   report->distanceM = (double)sums->speed / 360.0 * dt;
+   report->averageSpeed = sums->moving ? (double)sums->speed / 100.0 / sums->moving : 0.0;
+   report->maxSpeed = sums->maxSpeed / 100.0;
+   report->averageIncline = sums->samples ? (double)sums->incline / 100.0 / sums->samples : 0.0;
+   report->paceS = (report->distanceM > 0.0) ? report->movingS * 1000.0 / report->distanceM : 0.0;
+   report->climbM = (double)sums->climb / 3.6e6 * dt;
+   report->workJ = massKg * ANA_GRAVITY * report->climbM;
+
+   // ACSM, VO2 in ml/kg/min: walking 3.5 + 0.1 S + 1.8 S G,
+   // running 3.5 + 0.2 S + 0.9 S G, S in m/min
+   double walkSpeed = (double)(sums->speed - sums->runSpeed);
+   double walkClimb = (double)(sums->climb - sums->runClimb);
+   double vo2 = 3.5 * sums->samples +
+                (0.1 * walkSpeed + 0.2 * (double)sums->runSpeed) / 6.0 +
+                (1.8 * walkClimb + 0.9 * (double)sums->runClimb) / 60000.0;
+   report->kcal = vo2 * dt / 60.0 * massKg / 1000.0 * 5.0;
+}
@@ -0,0 +1,102 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//-------------------------------------------------------------------- ANAlytics
+
+/// Workout analytics over the sampled series of a session (the recorder
+/// columns, see RECgetColumns()) or of many sessions for a fleet report:
+/// sums and extremes, distance, climb, an energy model and moving averages.
+///
+/// The series are structure of arrays: one int32 array per column in HAL
+/// units, a fixed sample interval. The kernels run 8 samples at a time with
+/// AVX2, 4 with SSE4.1 or one at a time (the scalar reference), chosen at
+/// run time for the CPU, or set with ANAsetKernel().
+///
+/// All kernels give the same results bit for bit: the sums are integers,
+/// a moving average is an integer window sum divided once in float, and
+/// the energy model is evaluated once, in double, from the integer sums.
+/// The values must be within +-ANA_MAX_VALUE.
+
+#define ANA_MAX_VALUE   (32767)    ///< |value| of a sample
+#define ANA_MAX_WINDOW  (65536)    ///< Samples in a moving average
+#define ANA_RUN_SPEED   (800)      ///< 0.01 km/h, running equation from here
+#define ANA_GRAVITY     (9.81)     ///< m/s^2
+
+/// Kernel implementation.
+typedef enum {
+   ANA_SCALAR,
+   ANA_SSE41,
+   ANA_AVX2,
+   ANA_NOF_KERNELS
+} anaKernel_t;
+
+/// Sampled workout, n samples every intervalMs.
+typedef struct
+{
+   const int32_t *speed;      ///< 0.01 km/h
+   const int32_t *incline;    ///< 0.01 %
+   uint32_t n;
+   uint32_t intervalMs;
+} anaSeries_t;
+
+/// Integer sums of a series, the input of the models.
+typedef struct
+{
+   uint32_t samples;
+   uint32_t moving;           ///< Samples with speed > 0
+   uint32_t running;          ///< Samples with speed >= ANA_RUN_SPEED
+   int32_t maxSpeed;          ///< 0 without samples
+   int32_t maxIncline;
+   int64_t speed;             ///< Sum of speed
+   int64_t incline;           ///< Sum of incline
+   int64_t runSpeed;          ///< Sum of speed of the running samples
+   uint64_t climb;            ///< Sum of speed * incline, both clamped at 0
+   uint64_t runClimb;         ///< Sum of climb of the running samples
+} anaSums_t;
+
+/// Workout figures of a series.
+typedef struct
+{
+   double durationS;
+   double movingS;            ///< Time with speed > 0
+   double distanceM;
+   double averageSpeed;       ///< km/h, of the moving time
+   double maxSpeed;           ///< km/h
+   double averageIncline;     ///< %
+   double paceS;              ///< s per km of the moving time, 0 without distance
+   double climbM;             ///< Height climbed
+   double workJ;              ///< Work done lifting the runner
+   double kcal;               ///< Energy used by the runner, ACSM equations
+} anaReport_t;
+
+/// \return the best kernel of this CPU.
+anaKernel_t ANAbestKernel(void);
+
+/// Uses kernel from now on, e.g. ANA_SCALAR to compare.
+/// \return false if the CPU or the build does not support it.
+bool ANAsetKernel(anaKernel_t kernel);
+
+/// \return the kernel in use.
+anaKernel_t ANAgetKernel(void);
+
+/// \return name of kernel, e.g. "avx2".
+const char *ANAkernelText(anaKernel_t kernel);
+
+/// Sums and extremes of series.
+void ANAsum(const anaSeries_t *series, anaSums_t *sums);
+
+/// Moving average of n values over window samples: out[i] is the average
+/// of in[i - window + 1] to in[i], of in[0] to in[i] for the first ones.
+/// window is 1 to ANA_MAX_WINDOW.
+void ANAmovingAverage(const int32_t in[], uint32_t n, uint32_t window, float out[]);
+
+/// Workout figures of sums sampled every intervalMs, for a runner of
+/// massKg. The energy is VO2 of the ACSM walking equation below
+/// ANA_RUN_SPEED and the running equation from it, at 5 kcal per l O2.
+void ANAreport(const anaSums_t *sums, uint32_t intervalMs, double massKg,
+               anaReport_t *report);
+
+#endif
@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include "clock.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+//------------------------------------------------------------------------ CLocK
+
+static clkSource_t source = CLK_REAL;
+static _Atomic uint64_t virtualNs = 0;
+
+/// Active timers in a binary heap on (dueNs, order): starting or stopping
+/// one of n timers costs O(log n), also with a fleet of treadmills.
+static clkTimer_t **heap = NULL;
+static uint32_t nTimers = 0;
+static uint32_t capacity = 0;
+static uint64_t nextOrder = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed;
+static pthread_t thread;
+static bool running = false;
+
+void CLKsetSource(clkSource_t newSource)
+{
+   source = newSource;
+}
+
+clkSource_t CLKgetSource(void)
+{
+   return source;
+}
+
+uint64_t CLKrealNs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * CLK_NS_PER_S + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t CLKnowNs(void)
+{
+   if (source == CLK_VIRTUAL)
+   {
+      return atomic_load_explicit(&virtualNs, memory_order_acquire);
+   }
+   return CLKrealNs();
+}
+
+/// \return true if timer a expires before b, in start order if equal.
+static bool before(const clkTimer_t *a, const clkTimer_t *b)
+{
+   return a->dueNs < b->dueNs || (a->dueNs == b->dueNs && a->order < b->order);
+}
+
+static void place(clkTimer_t *timer, uint32_t i)
+{
+   heap[i] = timer;
+   timer->index = i;
+}
+
+/// Moves the timer at i up or down to its place in the heap.
+/// Caller holds the mutex.
+static void sift(uint32_t i)
+{
+   clkTimer_t *timer = heap[i];
+
+   while (i > 0 && before(timer, heap[(i - 1) / 2]))
+   {
+      place(heap[(i - 1) / 2], i);
+      i = (i - 1) / 2;
+   }
+   for (;;)
+   {
+      uint32_t child = 2 * i + 1;
+
+      if (child >= nTimers)
+      {
+         break;
+      }
+      if (child + 1 < nTimers && before(heap[child + 1], heap[child]))
+      {
+         child++;
+      }
+      if (!before(heap[child], timer))
+      {
+         break;
+      }
+      place(heap[child], i);
+      i = child;
+   }
+   place(timer, i);
+}
+
+/// Removes timer from the heap. Caller holds the mutex.
+static void unlinkTimer(clkTimer_t *timer)
+{
+   uint32_t i = timer->index;
+
+   nTimers--;
+   if (i != nTimers)
+   {
+      place(heap[nTimers], i);
+      sift(i);
+   }
+   timer->active = false;
+}
+
+/// Adds timer to the heap, after the timers with the same dueNs.
+/// Caller holds the mutex.
+/// \return false if the heap cannot grow.
+static bool insert(clkTimer_t *timer)
+{
+   if (nTimers == capacity)
+   {
+      uint32_t newCapacity = capacity ? 2 * capacity : 64;
+      clkTimer_t **newHeap = realloc(heap, newCapacity * sizeof(heap[0]));
+
+      if (newHeap == NULL)
+      {
+         return false;
+      }
+      heap = newHeap;
+      capacity = newCapacity;
+   }
+   timer->order = nextOrder++;
+   place(timer, nTimers++);
+   sift(timer->index);
+   timer->active = true;
+   return true;
+}
+
+/// Takes the first timer if it expired at or before nowNs and reschedules it
+/// if it is periodic. Caller holds the mutex.
+/// \return the expired timer, or NULL.
+static clkTimer_t *takeExpired(uint64_t nowNs, uint64_t *dueNs,
+                               void (**callback)(void *, uint64_t), void **ctx)
+{
+   clkTimer_t *timer = (nTimers > 0) ? heap[0] : NULL;
+
+   if (timer == NULL || timer->dueNs > nowNs)
+   {
+      return NULL;
+   }
+
+   *dueNs = timer->dueNs;
+   *callback = timer->callback;
+   *ctx = timer->ctx;
+   unlinkTimer(timer);
+
+   if (timer->periodNs != 0)
+   {
+      timer->dueNs += timer->periodNs;
+      if (source == CLK_REAL && timer->dueNs + timer->periodNs <= nowNs)
+      {
+         // More than a period behind: skip periods instead of a burst
+         uint64_t skip = (nowNs - timer->dueNs) / timer->periodNs;
+         timer->missed += skip;
+         timer->dueNs += skip * timer->periodNs;
+      }
+      insert(timer);
+   }
+   return timer;
+}
+
+static void *clockThread(void *arg)
+{
+   (void)arg;
+
+   pthread_mutex_lock(&mutex);
+   while (running)
+   {
+      uint64_t due;
+      void (*callback)(void *, uint64_t);
+      void *ctx;
+
+      if (takeExpired(CLKrealNs(), &due, &callback, &ctx) != NULL)
+      {
+         pthread_mutex_unlock(&mutex);
+         callback(ctx, due);
+         pthread_mutex_lock(&mutex);
+      }
+      else if (nTimers == 0)
+      {
+         pthread_cond_wait(&changed, &mutex);
+      }
+      else
+      {
+         struct timespec ts =
+         {
+            .tv_sec = (time_t)(heap[0]->dueNs / CLK_NS_PER_S),
+            .tv_nsec = (long)(heap[0]->dueNs % CLK_NS_PER_S),
+         };
+         pthread_cond_timedwait(&changed, &mutex, &ts);
+      }
+   }
+   pthread_mutex_unlock(&mutex);
+
+   return NULL;
+}
+
+bool CLKstart(void)
+{
+   pthread_condattr_t attr;
+
+   if (source != CLK_REAL || running)
+   {
+      return true;
+   }
+
+   // Timed waits on the monotonic clock, like the timers
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&changed, &attr);
+   pthread_condattr_destroy(&attr);
+
+   running = true;
+   if (pthread_create(&thread, NULL, clockThread, NULL) != 0)
+   {
+      running = false;
+      return false;
+   }
+   return true;
+}
+
+void CLKstop(void)
+{
+   pthread_mutex_lock(&mutex);
+   bool wasRunning = running;
+   running = false;
+   if (wasRunning)
+   {
+      pthread_cond_signal(&changed);
+   }
+   pthread_mutex_unlock(&mutex);
+
+   if (wasRunning)
+   {
+      pthread_join(thread, NULL);
+   }
+}
+
+void CLKtimerStart(clkTimer_t *timer, uint64_t delayNs, uint64_t periodNs,
+                   void (*callback)(void *ctx, uint64_t dueNs), void *ctx)
+{
+   pthread_mutex_lock(&mutex);
+   if (timer->active)
+   {
+      unlinkTimer(timer);
+   }
+   timer->dueNs = CLKnowNs() + delayNs;
+   timer->periodNs = periodNs;
+   timer->callback = callback;
+   timer->ctx = ctx;
+   timer->missed = 0;
+   insert(timer);
+   if (running)
+   {
+      pthread_cond_signal(&changed);
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+void CLKtimerStop(clkTimer_t *timer)
+{
+   pthread_mutex_lock(&mutex);
+   if (timer->active)
+   {
+      unlinkTimer(timer);
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+uint64_t CLKadvance(uint64_t durationNs)
+{
+   uint64_t fired = 0;
+
+   if (source != CLK_VIRTUAL)
+   {
+      return 0;
+   }
+
+   const uint64_t end = atomic_load(&virtualNs) + durationNs;
+
+   pthread_mutex_lock(&mutex);
+   for (;;)
+   {
+      uint64_t due;
+      void (*callback)(void *, uint64_t);
+      void *ctx;
+
+      if (takeExpired(end, &due, &callback, &ctx) == NULL)
+      {
+         break;
+      }
+      // Jump to the expiry, the callback sees its own time as now
+      atomic_store_explicit(&virtualNs, due, memory_order_release);
+      pthread_mutex_unlock(&mutex);
+      callback(ctx, due);
+      fired++;
+      pthread_mutex_lock(&mutex);
+   }
+   atomic_store_explicit(&virtualNs, end, memory_order_release);
+   pthread_mutex_unlock(&mutex);
+
+   return fired;
+}
+
+uint64_t CLKnextDueNs(void)
+{
+   pthread_mutex_lock(&mutex);
+   uint64_t due = (nTimers > 0) ? heap[0]->dueNs : UINT64_MAX;
+   pthread_mutex_unlock(&mutex);
+
+   return due;
+}
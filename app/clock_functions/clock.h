@@ -0,0 +1,70 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//------------------------------------------------------------------------ CLocK
+
+#define CLK_NS_PER_US (1000ULL)       ///< Nanoseconds in one microsecond
+#define CLK_NS_PER_MS (1000000ULL)    ///< Nanoseconds in one millisecond
+#define CLK_NS_PER_S  (1000000000ULL) ///< Nanoseconds in one second
+
+/// Clock sources for the simulation time.
+typedef enum {
+   CLK_REAL,    ///< Monotonic clock, timers run in the clock thread
+   CLK_VIRTUAL  ///< Time only moves with CLKadvance(), timers run in its caller
+} clkSource_t;
+
+/// A one shot or periodic timer. The memory is owned by the user of the
+/// timer, it must stay valid while the timer is active.
+typedef struct clkTimer
+{
+   uint64_t dueNs;                             ///< Next expiry time
+   uint64_t periodNs;                          ///< 0 for a one shot timer
+   void (*callback)(void *ctx, uint64_t dueNs);
+   void *ctx;
+   uint64_t missed;                            ///< Periods skipped (real clock)
+   bool active;
+   uint32_t index;                             ///< Position in the timer heap
+   uint64_t order;                             ///< Start order, for equal dueNs
+} clkTimer_t;
+
+/// Selects the clock source. Must be called before timers are started.
+void CLKsetSource(clkSource_t source);
+
+/// \return the selected clock source.
+clkSource_t CLKgetSource(void);
+
+/// \return simulation time in nanoseconds, from the selected source.
+/// Timers, the physics and the distance accounting use this time.
+uint64_t CLKnowNs(void);
+
+/// \return monotonic time in nanoseconds, also in virtual mode.
+/// Use this time for measuring execution times and latencies.
+uint64_t CLKrealNs(void);
+
+/// Starts the clock thread that executes the timers (real clock only).
+/// \return false if the thread cannot be started.
+bool CLKstart(void);
+
+/// Stops the clock thread.
+void CLKstop(void);
+
+/// Starts timer: callback(ctx, dueNs) is called delayNs from now, and then
+/// every periodNs if periodNs is not 0. A running timer is restarted.
+void CLKtimerStart(clkTimer_t *timer, uint64_t delayNs, uint64_t periodNs,
+                   void (*callback)(void *ctx, uint64_t dueNs), void *ctx);
+
+/// Stops timer. The callback may still be running in the clock thread.
+void CLKtimerStop(clkTimer_t *timer);
+
+/// Virtual clock: moves the time durationNs forward. The time jumps from
+/// one timer expiry to the next, all expired timers are executed in order.
+/// \return number of executed timer callbacks.
+uint64_t CLKadvance(uint64_t durationNs);
+
+/// \return the expiry time of the first active timer, UINT64_MAX if none.
+uint64_t CLKnextDueNs(void);
+
+#endif
@@ -8,22 +8,56 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define DCS_LINE_SIZE (80) ///< Max length of an input line in raw mode
+
 void DCSinitialise(void)
 {
    DSPinitialise();
+   DSPshowDisplay();
    KYBinitialise();
    DCSdebugSystemInfo("Development Console: initialised");
 }
 
+/// Raw keyboard: waits for one of the keys in chrs, no Enter needed.
+/// Letters are accepted in lower and upper case.
+/// \return the upper case key, or '\0' if a bound key posted an event.
+static char waitForKey(const char chrs[])
+{
+   for (;;)
+   {
+      fflush(stdout);
+      int key = KYBwaitKey();
+
+      if (key == KYB_KEY_NONE || key == KYB_KEY_EOF)
+      {
+         return '\0';
+      }
+      if (key < KYB_KEY_UP && strchr(chrs, toupper(key)) != NULL)
+      {
+         putchar(toupper(key));
+         return (char)toupper(key);
+      }
+      printf("** AGAIN ");
+   }
+}
+
 int DCSsimulationSystemInputYN(const char questionText[])
 {
    char input = '\0';
    int again = 0;
 
+   LOGflush();
+   if (KYBrawEnabled())
+   {
+      printf("\n-- SIMULATION  %s [y/n]? ", questionText);
+      return (waitForKey("YN") == 'Y');
+   }
    do
    {
       printf("\n-- SIMULATION  %s [y/n]? ", questionText);
+      KYBwaitBegin();
       int nOK = scanf(" %c", &input);
+      KYBwaitEnd();
       input = toupper(input);
 
       again = (nOK != 1 || (strchr("YN", input) == NULL));
@@ -42,9 +76,22 @@ char DCSsimulationSystemInputChar(const char text[], const char chrs[])
    char input = '\0';
    int again = 0;
 
+   if (KYBrawEnabled())
+   {
+      LOGflush();
+      printf("\n-- SIMULATION  %s ", text);
+      return waitForKey(chrs);
+   }
+
    do
    {
       int nOK = DCSsimulationSystemInput(text, " %c", &input);
+      if (KYBwoken())
+      {
+         // Another thread posted an event while we waited, e.g. a fault
+         KYBclear();
+         return '\0';
+      }
       again = (nOK != 1 || (strchr(chrs, input) == NULL));
       if (again)
       {
@@ -80,40 +127,54 @@ int DCSsimulationSystemInput(const char text[], const char fmt[], ...)
    int nArgsOK = 0;
    va_list arg;
 
+   // Pending log messages must be visible before the user is asked for input
+   LOGflush();
    printf("\n-- SIMULATION  %s ", text);
    va_start(arg, fmt);
-   nArgsOK = vfscanf(stdin, fmt, arg);
+   if (KYBrawEnabled())
+   {
+      // No line discipline in the terminal, the keyboard edits the line
+      char line[DCS_LINE_SIZE];
+
+      fflush(stdout);
+      nArgsOK = KYBgetline(line, sizeof(line)) ? vsscanf(line, fmt, arg) : EOF;
+   }
+   else
+   {
+      KYBwaitBegin();
+      nArgsOK = vfscanf(stdin, fmt, arg);
+      KYBwaitEnd();
+   }
    va_end(arg);
 
    return nArgsOK;
 }
 
-void DCSdebugSystemInfo(const char fmt[], ...)
+// The names are between parentheses, they can be macros (LOG_LEVEL_COMPILED)
+
+void (DCSdebugSystemInfo)(const char fmt[], ...)
 {
    va_list arg;
 
-   printf("\n-- DEBUG  ");
    va_start(arg, fmt);
-   vfprintf(stdout, fmt, arg);
+   LOGvwrite(LOG_LEVEL_DEBUG, fmt, arg);
    va_end(arg);
 }
 
-void DCSsimulationSystemInfo(const char fmt[], ...)
+void (DCSsimulationSystemInfo)(const char fmt[], ...)
 {
    va_list arg;
 
-   printf("\n-- SIMULATION  ");
    va_start(arg, fmt);
-   vfprintf(stdout, fmt, arg);
+   LOGvwrite(LOG_LEVEL_SIMULATION, fmt, arg);
    va_end(arg);
 }
 
-void DCSshowSystemError(const char fmt[], ...)
+void (DCSshowSystemError)(const char fmt[], ...)
 {
    va_list arg;
 
-   printf("\n-- SYSTEM ERROR  ");
    va_start(arg, fmt);
-   vfprintf(stdout, fmt, arg);
+   LOGvwrite(LOG_LEVEL_ERROR, fmt, arg);
    va_end(arg);
 }
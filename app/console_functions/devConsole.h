@@ -1,6 +1,8 @@
 #ifndef DEVCONSOLE_H
 #define DEVCONSOLE_H
 
+#include "log_functions/logger.h"
+
 /// Initialises the Development ConSole subsystem.
 /// \todo Is DCS a subsystem? It is part of a development system.
 void DCSinitialise(void);
@@ -12,7 +14,9 @@ int DCSsimulationSystemInputYN(const char questionText[]);
 
 /// Shows text, user can enter a char. If this char is not in chrs then the user
 /// gets the same text extended with AGAIN.
-/// \return char value.
+/// With a raw keyboard one key press is enough, no Enter needed.
+/// \return char value, or '\0' if a bound key (see KYBbindKey()) or another
+/// thread (see KYBwake()) posted an event in the meantime.
 char DCSsimulationSystemInputChar(const char text[], const char chrs[]);
 
 /// Shows text, user can enter an integer value. If this value is not >= min
@@ -26,7 +30,8 @@ int DCSsimulationSystemInputInteger(const char text[], int min, int max);
 int DCSsimulationSystemInput(const char text[], const char fmt[], ...);
 
 /// Shows debug related message, below the display.
-/// Has printf() interface.
+/// Has printf() interface. The message is printed by the logger, fmt must be
+/// a string literal.
 void DCSdebugSystemInfo(const char fmt[], ...);
 
 /// Shows simulation related text, below the display.
@@ -40,4 +45,16 @@ void DCSsimulationSystemInfo(const char fmt[], ...);
 /// performance (graceful degradation).
 void DCSshowSystemError(const char fmt[], ...);
 
+/// Messages above LOG_LEVEL_COMPILED are removed at compile time, their
+/// arguments are not evaluated either.
+#if LOG_LEVEL_COMPILED < LOG_LEVEL_DEBUG
+#define DCSdebugSystemInfo(...) ((void)0)
+#endif
+#if LOG_LEVEL_COMPILED < LOG_LEVEL_SIMULATION
+#define DCSsimulationSystemInfo(...) ((void)0)
+#endif
+#if LOG_LEVEL_COMPILED < LOG_LEVEL_ERROR
+#define DCSshowSystemError(...) ((void)0)
+#endif
+
 #endif
@@ -1,9 +1,12 @@
 #include "display.h"
 #include "appInfo.h"
 #include "devConsole.h"
+#include "keyboard.h"
 #include "systemErrors.h"
+#include "trace_functions/trace.h"
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +18,7 @@
 
 static char display[DSP_HEIGHT][DSP_WIDTH + 1] = {{0}};
 static char topDisplay[DSP_WIDTH] = {0};
+static bool batch = false; ///< No terminal clear and no waiting for <Enter>
 
 void DSPinitialise(void)
 {
@@ -30,12 +34,29 @@ void DSPinitialise(void)
    }
    strncpy(&display[1][1], " " APP " v" VERSION, DSP_WIDTH - 5);
 
-   DSPshowDisplay();
    DCSdebugSystemInfo("Display %dx%d: initialised", DSP_WIDTH, DSP_HEIGHT);
 }
 
+void DSPsetBatchMode(bool on)
+{
+   batch = on;
+}
+
+const char *DSPgetRow(int row)
+{
+   if (row < 0 || row >= DSP_HEIGHT)
+   {
+      return "";
+   }
+   return display[row];
+}
+
 void DSPclear(void)
 {
+   if (batch)
+   {
+      return;
+   }
    if (!system(NULL))
    {
       printf("\nERROR command processor is not available\n\n");
@@ -71,6 +92,9 @@ void DSPshowSystemErrorBits(void)
 
 void DSPshowDisplay(void)
 {
+   // Print pending log messages before they are cleared from the terminal
+   LOGflush();
+   TRC_PROBE1(display, render_start, batch);
    DSPclear();
    for (int row = 0; row < DSP_HEIGHT; row++)
    {
@@ -78,6 +102,7 @@ void DSPshowDisplay(void)
    }
    DSPshowSystemErrorBits();
    puts("\nDevelopment Console:");
+   TRC_PROBE1(display, render_end, batch);
 }
 
 void DSPshow(int row, const char fmt[], ...)
@@ -85,8 +110,12 @@ void DSPshow(int row, const char fmt[], ...)
    va_list arg;
 
 #ifndef NOWAIT
-   DCSdebugSystemInfo("** Press <Enter>, for update display **");
-   getchar();
+   if (!batch)
+   {
+      DCSdebugSystemInfo("** Press <Enter>, for update display **");
+      LOGflush();
+      KYBgetchar();
+   }
 #endif
 
    DSPclearLine(row);
@@ -102,8 +131,12 @@ void DSPshowDelete(int row, const char fmt[], ...)
 {
    va_list arg;
 #ifndef NOWAIT
-   DCSdebugSystemInfo("** Press <Enter>, for update display **");
-   getchar();
+   if (!batch)
+   {
+      DCSdebugSystemInfo("** Press <Enter>, for update display **");
+      LOGflush();
+      KYBgetchar();
+   }
 #endif
    for (int r = row; r < DSP_HEIGHT - 1; r++)
    {
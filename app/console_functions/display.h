@@ -1,12 +1,21 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <stdbool.h>
+
 //---------------------------------------------------------------------- DiSPlay
 
-/// Initialises the Display (DSP) subsystem and draws an empty display
-/// (no text).
+/// Initialises the Display (DSP) subsystem: an empty display (no text).
+/// It is drawn by the next DSPshow() or DSPshowDisplay().
 void DSPinitialise(void);
 
+/// Batch mode (scripts): the terminal is not cleared and DSPshow() does not
+/// wait for \<Enter\>.
+void DSPsetBatchMode(bool on);
+
+/// \return text of display row, "" if row is out of range.
+const char *DSPgetRow(int row);
+
 /// Clears full display (terminal) by executing a terminal command.
 void DSPclear(void);
 
@@ -1,39 +1,556 @@
+#define _GNU_SOURCE
 #include "keyboard.h"
 #include "devConsole.h"
 #include "display.h"
+#include "clock_functions/clock.h"
 
 #include <ctype.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 
 //--------------------------------------------------------------------- Keyboard
 
+#define KYB_BUFFER_SIZE  (64) ///< Bytes read with one read() call
+#define KYB_MAX_BINDINGS (8)
+#define KYB_ESCAPE_MS    (25) ///< Wait for the rest of an escape sequence
+
+typedef struct
+{
+   int key;
+   event_t event;
+   void (*action)(void);
+} kybBinding_t;
+
+static kybBinding_t bindings[KYB_MAX_BINDINGS];
+static int nBindings = 0;
+
+static bool raw = false;
+static bool detached = false;        ///< KYBdetach(), stdin is not read
+static unsigned char buffer[KYB_BUFFER_SIZE];
+static int bufferHead = 0;
+static int bufferCount = 0;
+static uint64_t bufferReadNs = 0;   ///< CLKrealNs() of the last read()
+static kybStats_t stats = {0};
+
+#ifndef _WIN32
+static struct termios savedTermios;
+static int wakePipe[2] = {-1, -1};   ///< KYBwake() makes KYBwaitKey() return
+#endif
+static atomic_bool woken = false;     ///< KYBwake() since the last KYBwoken()
+static void (*waitBeginHook)(void) = NULL;
+static void (*waitEndHook)(void) = NULL;
+static int sourceFd = -1;            ///< KYBsetEventSource()
+static bool (*sourceDrain)(void) = NULL;
+#ifndef _WIN32
+
+static void restoreOnSignal(int sig)
+{
+   tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+   signal(sig, SIG_DFL);
+   raise(sig);
+}
+#endif
+
 void KYBinitialise(void)
 {
-   DCSdebugSystemInfo("Keyboard: initialised");
+#ifndef _WIN32
+   if (wakePipe[0] < 0 && pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK) != 0)
+   {
+      wakePipe[0] = wakePipe[1] = -1;
+   }
+#endif
+   if (detached)
+   {
+      DCSdebugSystemInfo("Keyboard: initialised (detached)");
+      return;
+   }
+   KYBrawEnable();
+   DCSdebugSystemInfo("Keyboard: initialised (%s mode)", raw ? "raw" : "line");
+}
+
+bool KYBrawEnable(void)
+{
+#ifndef _WIN32
+   struct termios t;
+
+   if (raw)
+   {
+      return true;
+   }
+   // stdin can be replaced by a script (fileno() is -1 then)
+   if (fileno(stdin) != STDIN_FILENO || !isatty(STDIN_FILENO) ||
+       tcgetattr(STDIN_FILENO, &savedTermios) != 0)
+   {
+      return false;
+   }
+
+   // No line buffering and no echo, read() returns immediately.
+   // Signals (Ctrl-C) and CR to NL translation stay enabled.
+   t = savedTermios;
+   t.c_lflag &= ~(ICANON | ECHO);
+   t.c_cc[VMIN] = 0;
+   t.c_cc[VTIME] = 0;
+   if (tcsetattr(STDIN_FILENO, TCSANOW, &t) != 0)
+   {
+      return false;
+   }
+
+   raw = true;
+   atexit(KYBrawDisable);
+   signal(SIGINT, restoreOnSignal);
+   signal(SIGTERM, restoreOnSignal);
+   return true;
+#else
+   return false;
+#endif
+}
+
+void KYBrawDisable(void)
+{
+#ifndef _WIN32
+   if (raw)
+   {
+      tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+      raw = false;
+   }
+#endif
+}
+
+bool KYBrawEnabled(void)
+{
+   // Detached, the prompts wait like in raw mode but no key ever comes
+   return raw || detached;
+}
+
+void KYBdetach(void)
+{
+   KYBrawDisable();
+   detached = true;
+}
+
+void KYBsetEventSource(int fd, bool (*drain)(void))
+{
+   sourceFd = fd;
+   sourceDrain = drain;
+}
+
+void KYBbindKey(int key, event_t event, void (*action)(void))
+{
+   if (nBindings < KYB_MAX_BINDINGS)
+   {
+      bindings[nBindings++] = (kybBinding_t){key, event, action};
+   }
+}
+
+/// Fills the buffer with one read() call if it is empty.
+/// \return false if no bytes are available, *eof is set at end of input
+/// (read() returns 0 without raw mode, in raw mode it means no input).
+static bool fillBuffer(bool *eof)
+{
+   *eof = false;
+   if (bufferCount > 0)
+   {
+      return true;
+   }
+   if (detached)
+   {
+      return false;
+   }
+#ifndef _WIN32
+   ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+
+   if (n > 0)
+   {
+      bufferReadNs = CLKrealNs();
+      bufferHead = 0;
+      bufferCount = (int)n;
+      stats.reads++;
+      stats.bytes += (uint64_t)n;
+      return true;
+   }
+   if (n == 0 && !raw)
+   {
+      *eof = true;
+   }
+#endif
+   return false;
+}
+
+static int nextByte(void)
+{
+   if (bufferCount == 0)
+   {
+      return -1;
+   }
+   bufferCount--;
+   return buffer[bufferHead++];
+}
+
+/// Next byte of an escape sequence, which a terminal may split over reads.
+/// \return -1 if none comes within KYB_ESCAPE_MS.
+static int sequenceByte(void)
+{
+#ifndef _WIN32
+   if (bufferCount == 0 && !detached)
+   {
+      struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+      bool eof;
+
+      // Waiting for the user, like KYBwaitKey()
+      KYBwaitBegin();
+      int n = poll(&pfd, 1, KYB_ESCAPE_MS);
+      KYBwaitEnd();
+      if (n > 0)
+      {
+         (void)fillBuffer(&eof);
+      }
+   }
+#endif
+   return nextByte();
+}
+
+/// Decodes one key from the buffer. Escape sequences of the cursor keys
+/// become cursor keys, other complete CSI (ESC [) and SS3 (ESC O) sequences
+/// and Alt+key (ESC key) are discarded. Only an ESC that nothing follows
+/// within KYB_ESCAPE_MS is KYB_KEY_ESCAPE.
+static int decodeKey(void)
+{
+   static const int cursorKeys[] =
+   {
+      KYB_KEY_UP, KYB_KEY_DOWN, KYB_KEY_RIGHT, KYB_KEY_LEFT
+   };
+   int c = nextByte();
+
+   if (c == '\b')
+   {
+      return KYB_KEY_BACKSPACE;
+   }
+   if (c != KYB_KEY_ESCAPE)
+   {
+      return c;
+   }
+
+   int introducer = sequenceByte();
+   int final = -1;
+   bool parameters = false;
+
+   switch (introducer)
+   {
+   case -1:
+      return KYB_KEY_ESCAPE;
+   case '[':
+      // Parameter and intermediate bytes up to the final byte, 0x40 to 0x7E
+      for (c = sequenceByte(); c >= 0x20 && c <= 0x3F; c = sequenceByte())
+      {
+         parameters = true;
+      }
+      final = c;
+      break;
+   case 'O':
+      final = sequenceByte();
+      break;
+   default:
+      // Alt+key
+      return KYB_KEY_NONE;
+   }
+   if (!parameters && final >= 'A' && final <= 'D')
+   {
+      return cursorKeys[final - 'A'];
+   }
+   return KYB_KEY_NONE;
+}
+
+/// Posts the event of a bound key.
+/// \return true if the key was handled.
+static bool postBoundEvent(int key)
+{
+   for (int b = 0; b < nBindings; b++)
+   {
+      if (bindings[b].key == key &&
+          FSM_HasTransition(FSM_GetState(), bindings[b].event))
+      {
+         if (bindings[b].action != NULL)
+         {
+            bindings[b].action();
+         }
+         FSM_AddEvent(bindings[b].event);
+
+         uint64_t latency = CLKrealNs() - bufferReadNs;
+         stats.events++;
+         stats.latencySumNs += latency;
+         if (latency > stats.latencyMaxNs)
+         {
+            stats.latencyMaxNs = latency;
+         }
+         return true;
+      }
+   }
+   return false;
+}
+
+/// Reads one key. *posted is set if a bound key posted an event.
+static int readKey(bool *posted, bool *eof)
+{
+   *posted = false;
+   if (!fillBuffer(eof))
+   {
+      return KYB_KEY_NONE;
+   }
+
+   // Discarded escape sequences decode as KYB_KEY_NONE
+   int key;
+   do
+   {
+      key = decodeKey();
+   } while (key == KYB_KEY_NONE && bufferCount > 0);
+   if (key == KYB_KEY_NONE)
+   {
+      return KYB_KEY_NONE;
+   }
+   stats.keys++;
+   if (postBoundEvent(key))
+   {
+      *posted = true;
+      return KYB_KEY_NONE;
+   }
+   return key;
+}
+
+int KYBpollKey(void)
+{
+   bool posted;
+   bool eof;
+   int key;
+
+   do
+   {
+      key = readKey(&posted, &eof);
+   } while (posted);
+
+   return key;
+}
+
+int KYBwaitKey(void)
+{
+#ifndef _WIN32
+   // poll() skips the negative descriptors
+   struct pollfd pfd[3] =
+   {
+      {.fd = detached ? -1 : STDIN_FILENO, .events = POLLIN},
+      {.fd = wakePipe[0], .events = POLLIN},
+      {.fd = sourceFd, .events = POLLIN},
+   };
+
+   for (;;)
+   {
+      bool posted;
+      bool eof;
+      int key = readKey(&posted, &eof);
+
+      if (posted || key != KYB_KEY_NONE)
+      {
+         return key;
+      }
+      if (eof)
+      {
+         return KYB_KEY_EOF;
+      }
+      // Events of other processes, also when the source rang
+      if (sourceDrain != NULL && sourceDrain())
+      {
+         stats.sourceEvents++;
+         return KYB_KEY_NONE;
+      }
+      // Sleep until the terminal has input or another thread wakes us
+      KYBwaitBegin();
+      int n = poll(pfd, 3, -1);
+      KYBwaitEnd();
+      if (n < 0 || (pfd[0].revents & (POLLHUP | POLLERR)))
+      {
+         return KYB_KEY_EOF;
+      }
+      if (pfd[1].revents & POLLIN)
+      {
+         char drain[16];
+         while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+         {
+         }
+         stats.wakeups++;
+         atomic_store(&woken, false);
+         return KYB_KEY_NONE;
+      }
+   }
+#else
+   return KYB_KEY_EOF;
+#endif
+}
+
+void KYBsetWaitHooks(void (*begin)(void), void (*end)(void))
+{
+   waitBeginHook = begin;
+   waitEndHook = end;
+}
+
+void KYBwaitBegin(void)
+{
+   if (waitBeginHook != NULL)
+   {
+      waitBeginHook();
+   }
+}
+
+void KYBwaitEnd(void)
+{
+   if (waitEndHook != NULL)
+   {
+      waitEndHook();
+   }
+}
+
+void KYBwake(void)
+{
+   atomic_store(&woken, true);
+#ifndef _WIN32
+   // A full pipe already wakes the reader
+   if (wakePipe[1] >= 0 && write(wakePipe[1], "w", 1) < 0)
+   {
+      return;
+   }
+#endif
+}
+
+bool KYBwoken(void)
+{
+   return atomic_exchange(&woken, false);
 }
 
 void KYBclear(void)
 {
-   while ((getchar()) != '\n')
+   int c;
+
+   if (raw || detached)
+   {
+      // Drop the undecoded bytes, there is no line to finish
+      bufferCount = 0;
+      return;
+   }
+   KYBwaitBegin();
+   while ((c = getchar()) != '\n' && c != EOF)
    {
       // Remove all remaining buffered input chars
    }
+   KYBwaitEnd();
 }
 
 char KYBgetchar(void)
 {
-   char c = getchar();
-   KYBclear();
-   return c;
+   if (raw || detached)
+   {
+      return (char)KYBwaitKey();
+   }
+
+   KYBwaitBegin();
+   int c = getchar();
+   KYBwaitEnd();
+   if (c != '\n' && c != EOF)
+   {
+      KYBclear();
+   }
+   return (char)c;
+}
+
+bool KYBgetline(char line[], int size)
+{
+   int n = 0;
+
+   if (detached)
+   {
+      // No one types
+      line[0] = '\0';
+      return false;
+   }
+   if (!raw)
+   {
+      KYBwaitBegin();
+      char *result = fgets(line, size, stdin);
+      KYBwaitEnd();
+      if (result == NULL)
+      {
+         return false;
+      }
+      line[strcspn(line, "\n")] = '\0';
+      return true;
+   }
+
+   // The prompt has no newline
+   fflush(stdout);
+   for (;;)
+   {
+      int key = KYBwaitKey();
+
+      if (key == KYB_KEY_EOF)
+      {
+         line[n] = '\0';
+         return false;
+      }
+      if (key == KYB_KEY_ENTER)
+      {
+         putchar('\n');
+         break;
+      }
+      if (key == KYB_KEY_BACKSPACE && n > 0)
+      {
+         n--;
+         fputs("\b \b", stdout);
+      }
+      else if (key > 0 && key < KYB_KEY_BACKSPACE && isprint(key) && n < size - 1)
+      {
+         line[n++] = (char)key;
+         putchar(key);
+      }
+      fflush(stdout);
+   }
+   line[n] = '\0';
+   return true;
+}
+
+/// Raw mode replacement of scanf() followed by KYBclear().
+static int scanLine(const char fmt[], void *value)
+{
+   char line[KYB_BUFFER_SIZE];
+
+   if (!KYBgetline(line, sizeof(line)))
+   {
+      return EOF;
+   }
+   return sscanf(line, fmt, value);
 }
 
 int KYBgetint(int ifWrongValue)
 {
    int input = 0;
-   // scanf reads input buffer until space, tab or enter.
-   int nOk = scanf(" %d", &input);
+   int nOk;
 
-   KYBclear();
+   if (raw || detached)
+   {
+      nOk = scanLine(" %d", &input);
+   }
+   else
+   {
+      // scanf reads input buffer until space, tab or enter.
+      nOk = scanf(" %d", &input);
+      KYBclear();
+   }
    // Check if input is an int (nOk == 1), if not return ifWrongValue
    if (nOk != 1)
    {
@@ -45,10 +562,18 @@ int KYBgetint(int ifWrongValue)
 double KYBgetdouble(double ifWrongValue)
 {
    double input = 0.0;
-   // scanf reads input buffer until space, tab or enter.
-   int nOk = scanf(" %lf", &input);
+   int nOk;
 
-   KYBclear();
+   if (raw || detached)
+   {
+      nOk = scanLine(" %lf", &input);
+   }
+   else
+   {
+      // scanf reads input buffer until space, tab or enter.
+      nOk = scanf(" %lf", &input);
+      KYBclear();
+   }
    // Check if input is an double (nOk == 1), if not return ifWrongValue
    if (nOk != 1)
    {
@@ -56,3 +581,8 @@ double KYBgetdouble(double ifWrongValue)
    }
    return input;
 }
+
+void KYBgetStats(kybStats_t *s)
+{
+   *s = stats;
+}
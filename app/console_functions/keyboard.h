@@ -1,11 +1,98 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fsm_functions/fsm.h"
+
 //--------------------------------------------------------------------- KeYBoard
 
+/// Decoded keys in raw mode. Printable keys are their ASCII value.
+typedef enum {
+   KYB_KEY_NONE = 0,       ///< No key available
+   KYB_KEY_ENTER = '\n',
+   KYB_KEY_BACKSPACE = 127,
+   KYB_KEY_ESCAPE = 27,    ///< ESC alone, other escape sequences are discarded
+   KYB_KEY_UP = 0x100,     ///< Cursor keys (escape sequences)
+   KYB_KEY_DOWN,
+   KYB_KEY_RIGHT,
+   KYB_KEY_LEFT,
+   KYB_KEY_EOF             ///< Input is closed
+} kybKey_t;
+
+/// Keyboard counters, only updated in raw mode.
+typedef struct
+{
+   uint64_t reads;         ///< read() calls that returned data
+   uint64_t bytes;         ///< Bytes read
+   uint64_t keys;          ///< Decoded keys
+   uint64_t events;        ///< Events posted by bound keys
+   uint64_t latencySumNs;  ///< Sum of read to event posted latencies
+   uint64_t latencyMaxNs;  ///< Max read to event posted latency
+   uint64_t wakeups;       ///< Waits ended by KYBwake()
+   uint64_t sourceEvents;  ///< Waits ended by an event of the event source
+} kybStats_t;
+
 /// Initialises the keyboard (KYB) subsystem.
+/// If stdin is a terminal, the terminal is switched to raw mode: keys are
+/// available without pressing Enter and without echo.
 void KYBinitialise(void);
 
+/// Switches the terminal to raw, non-blocking mode.
+/// \return false if stdin is not a terminal, the keyboard stays line buffered.
+bool KYBrawEnable(void);
+
+/// Restores the terminal settings of before KYBrawEnable().
+void KYBrawDisable(void);
+
+/// \return true if the keyboard is in raw mode or detached, the prompts
+/// wait with KYBwaitKey() then.
+bool KYBrawEnabled(void);
+
+/// Binds a key to a button event. When the key is read and the current FSM
+/// state has a transition for event, action() is executed (if not NULL) and
+/// event is posted in the FSM queue directly. Otherwise the key is returned
+/// like any other key.
+void KYBbindKey(int key, event_t event, void (*action)(void));
+
+/// Raw mode: reads the next key without blocking.
+/// \return decoded key or KYB_KEY_NONE if there is no unbound key available.
+int KYBpollKey(void);
+
+/// Raw mode: waits for the next key.
+/// \return decoded key, or KYB_KEY_NONE if a bound key posted an event or
+/// KYBwake() was called.
+int KYBwaitKey(void);
+
+/// Makes a waiting KYBwaitKey() return KYB_KEY_NONE, so the FSM handles an
+/// event posted by another thread. Safe from any thread. Line mode input
+/// is not interrupted, the event is handled after the next Enter.
+void KYBwake(void);
+
+/// Sets functions that are called when the keyboard starts and stops
+/// waiting for the user, e.g. to pause a watchdog. Calls may nest.
+void KYBsetWaitHooks(void (*begin)(void), void (*end)(void));
+
+/// Detaches the keyboard from stdin, e.g. in a daemon. KYBwaitKey() only
+/// returns for KYBwake() and the event source, the prompts of the console
+/// take that as a button that posted an event. Call before KYBinitialise().
+void KYBdetach(void);
+
+/// Sets a source of events for KYBwaitKey(), e.g. other processes: drain()
+/// is called in the waiting thread before KYBwaitKey() sleeps and when fd
+/// is readable. If drain() returns true (it posted an event), KYBwaitKey()
+/// returns KYB_KEY_NONE.
+void KYBsetEventSource(int fd, bool (*drain)(void));
+
+/// Call the wait hooks around other blocking reads of stdin.
+void KYBwaitBegin(void);
+void KYBwaitEnd(void);
+
+/// Line mode: checks whether KYBwake() was called during the last input.
+/// \return true once per KYBwake().
+bool KYBwoken(void);
+
 /// Empty input buffer (stdin).
 void KYBclear(void);
 
@@ -15,6 +102,11 @@ void KYBclear(void);
 /// \return First read character.
 char KYBgetchar(void);
 
+/// Reads one line of at most size-1 characters, without the newline.
+/// Works in raw mode (with echo and backspace) and in line mode.
+/// \return false at end of input.
+bool KYBgetline(char line[], int size);
+
 /// Read one integer value, remaining buffered characters will be deleted.
 /// \return the read in integer value, or if input is not an integer
 /// ifWrongValue will be returned.
@@ -25,4 +117,7 @@ int KYBgetint(int ifWrongValue);
 /// will be returned.
 double KYBgetdouble(double ifWrongValue);
 
+/// Copies the keyboard counters in stats.
+void KYBgetStats(kybStats_t *stats);
+
 #endif
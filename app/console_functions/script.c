@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include "script.h"
+#include "devConsole.h"
+#include "display.h"
+#include "clock_functions/clock.h"
+#include "fault_functions/faultMonitor.h"
+#include "fsm_functions/fsm.h"
+#include "simulation_functions/physics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//----------------------------------------------------------------------- SCRipt
+
+#define SCR_MAX_LINE   (256) ///< Max length of a script line
+#define SCR_MAX_STATES (64)  ///< Max states between two "states" checks
+
+typedef enum {
+   SCR_INPUT,
+   SCR_STATE,
+   SCR_STATES,
+   SCR_DISPLAY,
+   SCR_ADVANCE,
+   SCR_DISTANCE,
+   SCR_FAULT
+} scrCommandType_t;
+
+typedef struct
+{
+   scrCommandType_t type;
+   int lineNumber;
+   int row;                   ///< SCR_DISPLAY
+   int nStates;               ///< SCR_STATE, SCR_STATES
+   double value;              ///< SCR_ADVANCE (s), SCR_DISTANCE (m), SCR_FAULT (bit)
+   double tolerance;          ///< SCR_DISTANCE (m)
+   state_t states[SCR_MAX_STATES];
+   char text[SCR_MAX_LINE];   ///< SCR_INPUT, SCR_DISPLAY
+} scrCommand_t;
+
+extern char * stateEnumToText[];
+
+static const char *scriptPath = NULL;
+static scrCommand_t *commands = NULL;
+static int nCommands = 0;
+static int next = 0;
+
+static state_t entered[SCR_MAX_STATES];
+static int nEntered = 0;
+static int nEnteredLost = 0;
+
+static int nInputs = 0;
+static int nChecks = 0;
+static int nFailed = 0;
+static uint64_t startNs = 0;
+
+/// Pending part of the current input line.
+static const char *pending = NULL;
+static size_t pendingLength = 0;
+
+static void recordState(state_t from, event_t event, state_t to)
+{
+   (void)from;
+   (void)event;
+
+   if (nEntered < SCR_MAX_STATES)
+   {
+      entered[nEntered++] = to;
+   }
+   else
+   {
+      nEnteredLost++;
+   }
+}
+
+static bool stateFromText(const char *text, state_t *state)
+{
+   for (int s = 0; s < NOF_STATES; s++)
+   {
+      if (strcmp(text, stateEnumToText[s]) == 0)
+      {
+         *state = (state_t)s;
+         return true;
+      }
+   }
+   return false;
+}
+
+static void fail(const scrCommand_t *c, const char *fmt, const char *expected,
+                 const char *actual)
+{
+   nFailed++;
+   fprintf(stderr, "%s:%d: ", scriptPath, c->lineNumber);
+   fprintf(stderr, fmt, expected, actual);
+   fputc('\n', stderr);
+}
+
+/// Writes the names of n states in text, as many as fit in size.
+static void listStates(char *text, size_t size, const state_t states[], int n)
+{
+   size_t length = 0;
+
+   text[0] = '\0';
+   for (int i = 0; i < n && length < size; i++)
+   {
+      int written = snprintf(text + length, size - length, "%s ", stateEnumToText[states[i]]);
+      if (written < 0)
+      {
+         break;
+      }
+      length += (size_t)written;
+   }
+}
+
+static void check(const scrCommand_t *c)
+{
+   if (c->type == SCR_ADVANCE)
+   {
+      // Not a check: timers and the belt simulation run up to the new time
+      CLKadvance((uint64_t)(c->value * CLK_NS_PER_S));
+      return;
+   }
+   if (c->type == SCR_FAULT)
+   {
+      FLTraise((error_t)c->value);
+      return;
+   }
+   nChecks++;
+
+   switch (c->type)
+   {
+   case SCR_STATE:
+   {
+      state_t state = FSM_GetState();
+      if (state != c->states[0])
+      {
+         fail(c, "expected state %s, got %s", stateEnumToText[c->states[0]],
+              stateEnumToText[state]);
+      }
+      break;
+   }
+   case SCR_STATES:
+   {
+      bool equal = (c->nStates == nEntered && nEnteredLost == 0);
+
+      for (int i = 0; equal && i < nEntered; i++)
+      {
+         equal = (c->states[i] == entered[i]);
+      }
+      if (!equal)
+      {
+         char expected[SCR_MAX_LINE];
+         char actual[SCR_MAX_LINE];
+
+         listStates(expected, sizeof(expected), c->states, c->nStates);
+         listStates(actual, sizeof(actual), entered, nEntered);
+         fail(c, "expected states %s, got %s", expected, actual);
+      }
+      nEntered = 0;
+      nEnteredLost = 0;
+      break;
+   }
+   case SCR_DISPLAY:
+      if (strstr(DSPgetRow(c->row), c->text) == NULL)
+      {
+         fail(c, "expected display text \"%s\", got \"%s\"", c->text,
+              DSPgetRow(c->row));
+      }
+      break;
+   case SCR_DISTANCE:
+   {
+      phyState_t belt;
+      char expected[32];
+      char actual[32];
+
+      PHYgetState(&belt);
+      if (belt.distance < c->value - c->tolerance ||
+          belt.distance > c->value + c->tolerance)
+      {
+         snprintf(expected, sizeof(expected), "%.2f +- %.2f", c->value,
+                  c->tolerance);
+         snprintf(actual, sizeof(actual), "%.2f", belt.distance);
+         fail(c, "expected distance %s m, got %s m", expected, actual);
+      }
+      break;
+   }
+   default:
+      break;
+   }
+}
+
+/// Script finished: report and stop the application.
+static void finish(void)
+{
+   double ms = (double)(CLKrealNs() - startNs) / 1e6;
+
+   fprintf(stderr, "%s: %s, %d inputs, %d checks, %d failed, %.3f ms",
+           scriptPath, nFailed ? "FAILED" : "passed", nInputs, nChecks,
+           nFailed, ms);
+   if (CLKgetSource() == CLK_VIRTUAL)
+   {
+      fprintf(stderr, ", %.1f s simulated",
+              (double)CLKnowNs() / CLK_NS_PER_S);
+   }
+   fputc('\n', stderr);
+   exit(nFailed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/// The application needs input: do the checks up to the next input line.
+static void checkpoint(void)
+{
+   LOGflush();
+   while (next < nCommands && commands[next].type != SCR_INPUT)
+   {
+      check(&commands[next++]);
+   }
+   if (next == nCommands)
+   {
+      finish();
+   }
+
+   scrCommand_t *c = &commands[next++];
+   pending = c->text;
+   pendingLength = strlen(c->text);
+   nInputs++;
+}
+
+#ifdef __GLIBC__
+/// Read function of the stdin replacement, gives the next line when the
+/// application has consumed the previous one.
+static ssize_t readScript(void *cookie, char *buf, size_t size)
+{
+   (void)cookie;
+
+   if (pendingLength == 0)
+   {
+      checkpoint();
+   }
+
+   size_t n = (pendingLength < size) ? pendingLength : size;
+   memcpy(buf, pending, n);
+   pending += n;
+   pendingLength -= n;
+
+   return (ssize_t)n;
+}
+#endif
+
+/// Parses one script line.
+/// \return false if the line has an error.
+static bool parseLine(char *line, int lineNumber, scrCommand_t *c)
+{
+   char *p = line + strspn(line, " \t");
+
+   c->lineNumber = lineNumber;
+   c->nStates = 0;
+
+   if (*p == '>')
+   {
+      p++;
+      if (*p == ' ')
+      {
+         p++;
+      }
+      c->type = SCR_INPUT;
+      snprintf(c->text, sizeof(c->text), "%s\n", p);
+      return true;
+   }
+   if (strncmp(p, "display ", 8) == 0)
+   {
+      char *text;
+
+      c->type = SCR_DISPLAY;
+      c->row = (int)strtol(p + 8, &text, 10);
+      text += strspn(text, " \t");
+      snprintf(c->text, sizeof(c->text), "%s", text);
+      return true;
+   }
+   if (strncmp(p, "advance ", 8) == 0)
+   {
+      char *end;
+
+      c->type = SCR_ADVANCE;
+      c->value = strtod(p + 8, &end);
+      return end != p + 8 && c->value >= 0.0 && CLKgetSource() == CLK_VIRTUAL;
+   }
+   if (strncmp(p, "fault ", 6) == 0)
+   {
+      char *end;
+
+      c->type = SCR_FAULT;
+      c->value = (double)strtol(p + 6, &end, 10);
+      return end != p + 6 && c->value >= 0 && c->value < NOF_ERRORS;
+   }
+   if (strncmp(p, "distance ", 9) == 0)
+   {
+      c->type = SCR_DISTANCE;
+      c->tolerance = 0.0;
+      return sscanf(p + 9, "%lf %lf", &c->value, &c->tolerance) >= 1;
+   }
+   if (strncmp(p, "state ", 6) == 0 || strncmp(p, "states", 6) == 0)
+   {
+      bool sequence = (p[5] == 's');
+
+      c->type = sequence ? SCR_STATES : SCR_STATE;
+      for (char *name = strtok(p + 6, " \t"); name != NULL;
+           name = strtok(NULL, " \t"))
+      {
+         if (c->nStates == SCR_MAX_STATES ||
+             !stateFromText(name, &c->states[c->nStates]))
+         {
+            return false;
+         }
+         c->nStates++;
+      }
+      return sequence || c->nStates == 1;
+   }
+   return false;
+}
+
+bool SCRinitialise(const char path[])
+{
+   FILE *stream = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+   char line[SCR_MAX_LINE];
+   int lineNumber = 0;
+   int capacity = 0;
+   bool ok = true;
+
+   scriptPath = path;
+   if (stream == NULL)
+   {
+      perror(path);
+      return false;
+   }
+
+   while (fgets(line, sizeof(line), stream) != NULL)
+   {
+      lineNumber++;
+      line[strcspn(line, "\r\n")] = '\0';
+
+      char *p = line + strspn(line, " \t");
+      if (*p == '\0' || *p == '#')
+      {
+         continue;
+      }
+      if (nCommands == capacity)
+      {
+         capacity = capacity ? 2 * capacity : 64;
+         commands = realloc(commands, (size_t)capacity * sizeof(scrCommand_t));
+         if (commands == NULL)
+         {
+            return false;
+         }
+      }
+      if (!parseLine(line, lineNumber, &commands[nCommands]))
+      {
+         fprintf(stderr, "%s:%d: invalid script line\n", path, lineNumber);
+         ok = false;
+      }
+      nCommands++;
+   }
+   if (stream != stdin)
+   {
+      fclose(stream);
+   }
+   if (!ok)
+   {
+      return false;
+   }
+
+#ifdef __GLIBC__
+   FILE *input = fopencookie(NULL, "r", (cookie_io_functions_t){.read = readScript});
+   if (input == NULL)
+   {
+      return false;
+   }
+   stdin = input;
+#else
+   fprintf(stderr, "script mode needs glibc (fopencookie)\n");
+   return false;
+#endif
+
+   DSPsetBatchMode(true);
+   FSM_SetTransitionHook(recordState);
+   startNs = CLKrealNs();
+
+   return true;
+}
@@ -0,0 +1,32 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+
+//----------------------------------------------------------------------- SCRipt
+
+/// Script mode: console input is read from a script instead of the user,
+/// and the script checks the display and the FSM states.
+///
+/// Script lines (leading spaces are ignored, # starts a comment):
+/// - "> text"           input line, ">" alone is an empty line (Enter)
+/// - "state S_NAME"     the current FSM state must be S_NAME
+/// - "states S_A S_B"   the states entered since the previous "states" line
+///                      (or the start) must be exactly S_A S_B
+/// - "display row text" display row must contain text
+/// - "advance seconds"  moves the virtual clock forward, see CLKadvance()
+/// - "distance m [tol]" the belt distance must be m meter, +- tol
+/// - "fault bit"        raises system error bit (error_t), see FLTraise()
+///
+/// Checks are done when the application asks for the next input, so they
+/// see the result of all previous input lines. When the script has no input
+/// left, the result is reported on stderr and the application exits with
+/// EXIT_SUCCESS if all checks passed.
+
+/// Reads the script from path ("-" is stdin) and replaces stdin by the
+/// script input. The display is switched to batch mode. "advance" lines
+/// need the virtual clock, select it with CLKsetSource() first.
+/// \return false if the script cannot be read or has errors.
+bool SCRinitialise(const char path[]);
+
+#endif
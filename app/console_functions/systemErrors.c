@@ -1,38 +1,48 @@
 #include "systemErrors.h"
 
+#include <stdatomic.h>
 #include <stddef.h>
 
-static systemErrors_t systemErrorBits = 0b00000000; // 0b prefix is not standard
-static char systemErrorBitsString[sizeof(systemErrorBits) * 8 + 1] = "00000000";
+static _Atomic systemErrors_t systemErrorBits = 0;
+static char systemErrorBitsString[sizeof(systemErrors_t) * 8 + 1] =
+   "00000000000000000000000000000000";
+static systemErrors_t stringBits = 0;   // bits shown in systemErrorBitsString
 
 int setSystemErrorBit(error_t err)
 {
-   int systemErrorBit = getSystemErrorBit(err);
+   systemErrors_t previous = atomic_fetch_or(&systemErrorBits, 1u << err);
 
-   systemErrorBits |= 0x01 << err;
+   return (previous & (1u << err)) != 0;
+}
+
+int clearSystemErrorBit(error_t err)
+{
+   systemErrors_t previous = atomic_fetch_and(&systemErrorBits, ~(1u << err));
 
-   return systemErrorBit;
+   return (previous & (1u << err)) != 0;
 }
 
 int getSystemErrorBit(error_t err)
 {
-   return (systemErrorBits & (0x01 << err)) != 0;
+   return (atomic_load(&systemErrorBits) & (1u << err)) != 0;
 }
 
 systemErrors_t getSystemErrorBits(void)
 {
-   return systemErrorBits;
+   return atomic_load(&systemErrorBits);
 }
 
 const char *getSystemErrorBitsString(void)
 {
-   for (size_t i = 0; i < sizeof(systemErrorBits) * 8; i++)
+   systemErrors_t bits = atomic_load(&systemErrorBits);
+
+   if (bits != stringBits)
    {
-      systemErrorBitsString[i] = '0';
-      if (getSystemErrorBit(i))
+      for (size_t i = 0; i < sizeof(systemErrors_t) * 8; i++)
       {
-         systemErrorBitsString[i] = '1';
+         systemErrorBitsString[i] = (bits & (1u << i)) ? '1' : '0';
       }
+      stringBits = bits;
    }
    return systemErrorBitsString;
 }
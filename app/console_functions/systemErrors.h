@@ -1,21 +1,33 @@
 #ifndef SYSTEMERRORS_H
 #define SYSTEMERRORS_H
 
+#include <stdint.h>
+
 /// \brief Error bit index values.
 typedef enum {
-   ERR_INIT_CNA, ///< Initialisation error Coin Acceptor selftest
-   ERR_INIT_CLD,  ///< Initialisation error Cola Dispenser selftest
-   ERR_INIT_CHD   ///< Initialisation error Change Dispenser selftest
+   ERR_INIT_HAL,       ///< Initialisation error HAL register selftest
+   ERR_INIT_MOTORS,    ///< Initialisation error motor control or belt simulation
+   ERR_INIT_TELEMETRY, ///< Initialisation error telemetry shared memory
+   ERR_MOTOR_SPEED,    ///< Band speed motor does not follow its setpoint
+   ERR_MOTOR_INCLINE,  ///< Incline motor does not follow its setpoint
+   ERR_WATCHDOG,       ///< A state handler overran its time budget
+   NOF_ERRORS
 } error_t;
 
-/// Type name for bit mapped errors: 8 bits.
-typedef unsigned char systemErrors_t;
+/// Type name for bit mapped errors: 32 bits.
+/// The bits are atomic, any thread may set and clear them.
+typedef uint32_t systemErrors_t;
 
 /// Set error bit.
 /// \param err error bit index.
 /// \return previous value error bit.
 int setSystemErrorBit(error_t err);
 
+/// Clear error bit.
+/// \param err error bit index.
+/// \return previous value error bit.
+int clearSystemErrorBit(error_t err);
+
 /// Set error bit.
 /// \param err error bit index.
 /// \return boolean value 0 or 1.
@@ -24,8 +36,9 @@ int getSystemErrorBit(error_t err);
 /// \return value of systemErrorBits.
 systemErrors_t getSystemErrorBits(void);
 
-/// \return string showing 8 error bits in binary format.
-/// Example: "11000000"
+/// \return string showing 32 error bits in binary format, bit 0 first.
+/// The string is only rebuilt when the bits have changed.
+/// Example: "11000000000000000000000000000000"
 const char *getSystemErrorBitsString(void);
 
-#endif
\ No newline at end of file
+#endif
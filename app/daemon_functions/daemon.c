@@ -0,0 +1,471 @@
+#define _GNU_SOURCE
+#include "daemon.h"
+#include "events.h"
+#include "ipc_functions/ipc.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------- Daemon
+
+#define DMN_RING_MASK (DMN_RING_SIZE - 1)
+#if (DMN_RING_SIZE & DMN_RING_MASK)
+#error DMN_RING_SIZE is not a power of two
+#endif
+
+/// Daemon side.
+static dmnShared_t *daemonShared = NULL;
+static bool (*postEvent)(event_t event) = NULL;
+static int memFd = -1;
+static int doorbellFd = -1;
+static int listenFd = -1;
+static pthread_t acceptThread;
+static atomic_bool accepting = false;
+static _Atomic uint32_t nClients = 0;
+static bool sleepAnnounced = false;   ///< DMNdrain() left sleeping set
+static bool doorbellPending = false;  ///< A client rang, not read yet
+
+/// Client side.
+static dmnShared_t *clientShared = NULL;
+static int clientDoorbellFd = -1;
+
+/// The segment of this process, the daemon side first.
+static dmnShared_t *segment(void)
+{
+   return (daemonShared != NULL) ? daemonShared : clientShared;
+}
+
+void DMNgetStats(dmnStats_t *stats)
+{
+   dmnShared_t *s = segment();
+
+   memset(stats, 0, sizeof(*stats));
+   if (s == NULL)
+   {
+      return;
+   }
+   stats->posted = atomic_load(&s->head);
+   stats->taken = atomic_load(&s->tail);
+   stats->full = atomic_load(&s->full);
+   stats->rejected = atomic_load(&s->rejected);
+   stats->doorbells = atomic_load(&s->doorbells);
+   stats->changes = atomic_load(&s->changes);
+   stats->clients = atomic_load(&nClients);
+}
+
+state_t DMNgetState(void)
+{
+   dmnShared_t *s = segment();
+
+   return (s != NULL) ? (state_t)atomic_load_explicit(&s->state, memory_order_acquire) : S_NO;
+}
+
+#ifdef __linux__
+
+/// Hands the segment and the doorbell to a new client.
+static void serveClient(int sock)
+{
+   const int fds[2] = {memFd, doorbellFd};
+   char data = 'D';
+   char control[CMSG_SPACE(sizeof(fds))];
+   struct iovec iov = {.iov_base = &data, .iov_len = 1};
+   struct msghdr msg =
+   {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+   };
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+   if (sendmsg(sock, &msg, MSG_NOSIGNAL) == 1)
+   {
+      atomic_fetch_add(&nClients, 1);
+   }
+   close(sock);
+}
+
+static void *connectionThread(void *arg)
+{
+   struct pollfd pfd = {.fd = listenFd, .events = POLLIN};
+
+   (void)arg;
+   while (atomic_load(&accepting))
+   {
+      if (poll(&pfd, 1, 100) <= 0)
+      {
+         continue;
+      }
+      int sock = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+      if (sock >= 0)
+      {
+         serveClient(sock);
+      }
+   }
+   return NULL;
+}
+
+bool DMNstart(unsigned int machineId, bool (*post)(event_t event))
+{
+   struct sockaddr_un addr;
+   socklen_t length = IPCsocketAddress(&addr, DMN_SOCKET_NAME, machineId);
+
+   if (daemonShared != NULL)
+   {
+      return true;
+   }
+   memFd = memfd_create("fsm-treadmill-fsm", MFD_CLOEXEC);
+   if (memFd < 0 || ftruncate(memFd, sizeof(dmnShared_t)) != 0)
+   {
+      DMNstop();
+      return false;
+   }
+   void *p = mmap(NULL, sizeof(dmnShared_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, memFd, 0);
+   if (p == MAP_FAILED)
+   {
+      DMNstop();
+      return false;
+   }
+   daemonShared = p;
+   for (uint32_t i = 0; i < DMN_RING_SIZE; i++)
+   {
+      atomic_init(&daemonShared->slots[i].sequence, i);
+   }
+   atomic_store(&daemonShared->state, (uint32_t)S_NO);
+   daemonShared->size = sizeof(dmnShared_t);
+   daemonShared->magic = DMN_MAGIC;
+   postEvent = post;
+
+   doorbellFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (doorbellFd < 0 || listenFd < 0 ||
+       bind(listenFd, (struct sockaddr *)&addr, length) != 0 ||
+       listen(listenFd, 8) != 0)
+   {
+      DMNstop();
+      return false;
+   }
+
+   atomic_store(&accepting, true);
+   if (pthread_create(&acceptThread, NULL, connectionThread, NULL) != 0)
+   {
+      atomic_store(&accepting, false);
+      DMNstop();
+      return false;
+   }
+   return true;
+}
+
+void DMNstop(void)
+{
+   int *fds[] = {&memFd, &doorbellFd, &listenFd};
+
+   if (atomic_exchange(&accepting, false))
+   {
+      pthread_join(acceptThread, NULL);
+   }
+   if (daemonShared != NULL)
+   {
+      munmap(daemonShared, sizeof(dmnShared_t));
+      daemonShared = NULL;
+   }
+   for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+   {
+      if (*fds[i] >= 0)
+      {
+         close(*fds[i]);
+         *fds[i] = -1;
+      }
+   }
+}
+
+int DMNgetDoorbell(void)
+{
+   return doorbellFd;
+}
+
+bool DMNdrain(void)
+{
+   dmnShared_t *s = daemonShared;
+   uint64_t count;
+
+   if (s == NULL)
+   {
+      return false;
+   }
+   // A client rings only when it clears sleeping, a busy FSM thread does
+   // not pay the read() for every look at the ring. The write() of the
+   // client can come after our read(), then the next call reads it.
+   if (sleepAnnounced && atomic_load(&s->sleeping) == 0)
+   {
+      doorbellPending = true;
+   }
+   if (doorbellPending && read(doorbellFd, &count, sizeof(count)) == sizeof(count))
+   {
+      doorbellPending = false;
+   }
+
+   // Announce the sleep before the last look at the ring: a client that
+   // posts after this look sees it and rings
+   atomic_store(&s->sleeping, 1);
+   atomic_thread_fence(memory_order_seq_cst);
+   sleepAnnounced = true;
+
+   for (;;)
+   {
+      uint32_t position = atomic_load_explicit(&s->tail, memory_order_relaxed);
+      dmnSlot_t *slot = &s->slots[position & DMN_RING_MASK];
+
+      if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1)
+      {
+         // Empty, or a client is still writing the slot and rings after it
+         return false;
+      }
+      uint32_t event = slot->event;
+      atomic_store_explicit(&slot->sequence, position + DMN_RING_SIZE,
+                            memory_order_release);
+      atomic_store_explicit(&s->tail, position + 1, memory_order_relaxed);
+
+      if (event < NOF_EVENTS && postEvent != NULL && postEvent((event_t)event))
+      {
+         atomic_store(&s->sleeping, 0);
+         sleepAnnounced = false;
+         return true;
+      }
+      atomic_fetch_add_explicit(&s->rejected, 1, memory_order_relaxed);
+   }
+}
+
+void DMNpublish(state_t state, event_t event)
+{
+   dmnShared_t *s = daemonShared;
+
+   if (s == NULL)
+   {
+      return;
+   }
+   atomic_store_explicit(&s->state, (uint32_t)state, memory_order_relaxed);
+   atomic_store_explicit(&s->event, (uint32_t)event, memory_order_relaxed);
+   atomic_fetch_add_explicit(&s->changes, 1, memory_order_release);
+
+   // Shared futex, the waiters are in other processes
+   syscall(SYS_futex, &s->changes, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+bool DMNconnect(unsigned int machineId)
+{
+   struct sockaddr_un addr;
+   socklen_t length = IPCsocketAddress(&addr, DMN_SOCKET_NAME, machineId);
+   int fds[2];
+   char data;
+   char control[CMSG_SPACE(sizeof(fds))];
+   struct iovec iov = {.iov_base = &data, .iov_len = 1};
+   struct msghdr msg =
+   {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+   };
+
+   if (clientShared != NULL)
+   {
+      return true;
+   }
+   int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (sock < 0)
+   {
+      return false;
+   }
+   if (connect(sock, (struct sockaddr *)&addr, length) != 0 ||
+       recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+   {
+      close(sock);
+      return false;
+   }
+   close(sock);
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+   {
+      return false;
+   }
+   memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+   void *p = mmap(NULL, sizeof(dmnShared_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fds[0], 0);
+   close(fds[0]);
+   dmnShared_t *s = p;
+   if (p == MAP_FAILED || s->magic != DMN_MAGIC || s->size != sizeof(dmnShared_t))
+   {
+      if (p != MAP_FAILED)
+      {
+         munmap(p, sizeof(dmnShared_t));
+      }
+      close(fds[1]);
+      return false;
+   }
+   clientShared = s;
+   clientDoorbellFd = fds[1];
+   return true;
+}
+
+void DMNdisconnect(void)
+{
+   if (clientShared == NULL)
+   {
+      return;
+   }
+   munmap(clientShared, sizeof(dmnShared_t));
+   close(clientDoorbellFd);
+   clientShared = NULL;
+   clientDoorbellFd = -1;
+}
+
+bool DMNpost(event_t event)
+{
+   dmnShared_t *s = clientShared;
+
+   if (s == NULL)
+   {
+      return false;
+   }
+
+   // Reserve a slot, other clients may post at the same time
+   uint32_t position = atomic_load_explicit(&s->head, memory_order_relaxed);
+   dmnSlot_t *slot;
+   for (;;)
+   {
+      slot = &s->slots[position & DMN_RING_MASK];
+      int32_t lag = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+
+      if (lag == 0)
+      {
+         if (atomic_compare_exchange_weak_explicit(&s->head, &position, position + 1,
+                                                   memory_order_relaxed,
+                                                   memory_order_relaxed))
+         {
+            break;
+         }
+      }
+      else if (lag < 0)
+      {
+         // The FSM did not take the event of the previous round yet
+         atomic_fetch_add_explicit(&s->full, 1, memory_order_relaxed);
+         return false;
+      }
+      else
+      {
+         position = atomic_load_explicit(&s->head, memory_order_relaxed);
+      }
+   }
+
+   // Write the event in place and hand the slot to the FSM thread
+   slot->event = (uint32_t)event;
+   atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+   // Only one client rings a sleeping FSM thread, a busy one drains the
+   // ring before it sleeps
+   atomic_thread_fence(memory_order_seq_cst);
+   if (atomic_load_explicit(&s->sleeping, memory_order_relaxed) &&
+       atomic_exchange(&s->sleeping, 0))
+   {
+      uint64_t one = 1;
+
+      if (write(clientDoorbellFd, &one, sizeof(one)) == sizeof(one))
+      {
+         atomic_fetch_add_explicit(&s->doorbells, 1, memory_order_relaxed);
+      }
+   }
+   return true;
+}
+
+uint32_t DMNwaitChange(uint32_t seen, int timeoutMs)
+{
+   dmnShared_t *s = segment();
+   struct timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+
+   if (s == NULL)
+   {
+      return seen;
+   }
+   if (atomic_load(&s->changes) == seen)
+   {
+      syscall(SYS_futex, &s->changes, FUTEX_WAIT, seen,
+              (timeoutMs < 0) ? NULL : &timeout, NULL, 0);
+   }
+   return atomic_load(&s->changes);
+}
+
+#else
+
+bool DMNstart(unsigned int machineId, bool (*post)(event_t event))
+{
+   (void)machineId;
+   (void)post;
+   return false;
+}
+
+void DMNstop(void)
+{
+}
+
+int DMNgetDoorbell(void)
+{
+   return -1;
+}
+
+bool DMNdrain(void)
+{
+   return false;
+}
+
+void DMNpublish(state_t state, event_t event)
+{
+   (void)state;
+   (void)event;
+}
+
+bool DMNconnect(unsigned int machineId)
+{
+   (void)machineId;
+   return false;
+}
+
+void DMNdisconnect(void)
+{
+}
+
+bool DMNpost(event_t event)
+{
+   (void)event;
+   return false;
+}
+
+uint32_t DMNwaitChange(uint32_t seen, int timeoutMs)
+{
+   (void)timeoutMs;
+   return seen;
+}
+
+#endif
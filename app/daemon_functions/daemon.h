@@ -0,0 +1,120 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "fsm_functions/fsm.h"
+
+//----------------------------------------------------------------------- Daemon
+
+/// FSM daemon: event posting and state queries for other processes.
+///
+/// The daemon (fsm-treadmill --daemon) creates a shared memory segment with
+/// an event ring and the published state, and an eventfd doorbell. A client
+/// (a UI, a sensor simulator, a test driver, see tools/fsmctl) connects to
+/// the abstract UNIX socket of the machine and receives both with
+/// SCM_RIGHTS, after that no socket or copy is involved:
+/// - DMNpost() reserves a ring slot with a compare-and-swap and writes the
+///   event in place, as FSM_AddEvent() does in the process. The doorbell
+///   is only rung when the FSM thread sleeps.
+/// - DMNgetState() reads the state, DMNwaitChange() sleeps on a futex in
+///   the segment until the next state change.
+///
+/// The FSM thread takes the events from the ring with DMNdrain(), in
+/// daemon mode the keyboard calls it when it waits for input
+/// (KYBsetEventSource()). A taken event is handed to the post function of
+/// DMNstart(), the menu choices of the console do the same.
+
+#define DMN_MAGIC       (0x314E4D44u)              ///< "DMN1" in memory order
+#define DMN_SOCKET_NAME "fsm-treadmill-fsm-%u"     ///< Abstract socket per machine
+#define DMN_RING_SIZE   (256)                      ///< Power of two
+
+/// Event ring slot. sequence tells the owner of the slot: producer at
+/// position p if p, consumer if p + 1.
+typedef struct
+{
+   _Atomic uint32_t sequence;
+   uint32_t event;
+} dmnSlot_t;
+
+/// Shared memory layout. The ring indices are free running, producer and
+/// consumer data are on separate cache lines.
+typedef struct
+{
+   uint32_t magic;
+   uint32_t size;                               ///< sizeof(dmnShared_t)
+   _Alignas(64) _Atomic uint32_t head;          ///< Next position to post, events posted
+   _Alignas(64) _Atomic uint32_t tail;          ///< Next position to take, events taken
+   _Atomic uint32_t sleeping;                   ///< FSM thread waits for the doorbell
+   _Alignas(64) _Atomic uint32_t changes;       ///< State changes, futex word
+   _Atomic uint32_t state;
+   _Atomic uint32_t event;                      ///< Event of the last state change
+   _Atomic uint64_t full;                       ///< DMNpost() on a full ring
+   _Atomic uint64_t rejected;                   ///< Taken, not accepted in the state
+   _Atomic uint64_t doorbells;
+   _Alignas(64) dmnSlot_t slots[DMN_RING_SIZE];
+} dmnShared_t;
+
+/// Counters of the segment.
+typedef struct
+{
+   uint32_t posted;
+   uint32_t taken;
+   uint64_t full;
+   uint64_t rejected;
+   uint64_t doorbells;      ///< DMNpost() that woke the FSM thread
+   uint32_t changes;
+   uint32_t clients;       ///< Connections served, daemon side only
+} dmnStats_t;
+
+/// Daemon side.
+
+/// Creates the segment, the doorbell and the socket of machineId and starts
+/// the thread that serves connections. post() is called in the FSM thread
+/// by DMNdrain() for every event of a client.
+/// \return false if the daemon cannot be started, e.g. it runs already.
+bool DMNstart(unsigned int machineId, bool (*post)(event_t event));
+
+/// Stops the connection thread, removes the socket and releases the segment.
+void DMNstop(void);
+
+/// The doorbell eventfd, -1 if the daemon is not started.
+int DMNgetDoorbell(void);
+
+/// Takes events from the ring and hands them to post() until it accepts
+/// one, the next event may depend on the new state. Events that post()
+/// rejects are dropped and counted. The FSM thread calls it before it
+/// sleeps and when the doorbell rings; if no event was accepted, the next
+/// DMNpost() rings the doorbell.
+/// \return true if post() accepted an event.
+bool DMNdrain(void);
+
+/// Publishes a state change for DMNgetState() and wakes DMNwaitChange().
+void DMNpublish(state_t state, event_t event);
+
+/// Client side.
+
+/// Connects to the daemon of machineId.
+/// \return false if no daemon runs for machineId.
+bool DMNconnect(unsigned int machineId);
+
+/// Releases the segment and the doorbell.
+void DMNdisconnect(void);
+
+/// Posts event to the FSM of the daemon.
+/// \return false if the ring is full.
+bool DMNpost(event_t event);
+
+/// \return the current state of the daemon.
+state_t DMNgetState(void);
+
+/// Waits at most timeoutMs (-1: forever) for a state change after the
+/// change with number seen (dmnStats_t.changes).
+/// \return the number of the last state change, seen on a time-out.
+uint32_t DMNwaitChange(uint32_t seen, int timeoutMs);
+
+/// Copies the counters of the segment in stats, daemon or client side.
+void DMNgetStats(dmnStats_t *stats);
+
+#endif
@@ -13,5 +13,6 @@ char * eventEnumToText[] =
     "E_PAUSE",
     "E_RESUME",
     "E_EMERGENCY_START",
-    "E_EMERGENCY_STOP"
+    "E_EMERGENCY_STOP",
+    "E_PROGRAM_STEP"
 };
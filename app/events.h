@@ -14,7 +14,10 @@ typedef enum {
     E_PAUSE,
     E_RESUME,
     E_EMERGENCY_START,
-    E_EMERGENCY_STOP
+    E_EMERGENCY_STOP,
+    E_PROGRAM_STEP
 } event_t;
 
+#define NOF_EVENTS (E_PROGRAM_STEP + 1)   ///< Number of events
+
 #endif
@@ -0,0 +1,101 @@
+#include "faultMonitor.h"
+#include "clock_functions/clock.h"
+#include "console_functions/keyboard.h"
+#include "fsm_functions/fsm.h"
+
+#include <stdatomic.h>
+
+//----------------------------------------------------------------------- FauLTs
+
+static _Atomic systemErrors_t critical = FLT_DEFAULT_CRITICAL;
+
+/// CLKrealNs() of the critical fault that posted the pending emergency.
+static _Atomic uint64_t pendingNs = 0;
+
+static _Atomic uint64_t nRaised = 0;
+static _Atomic uint64_t nEmergencies = 0;
+static _Atomic uint64_t latencySumNs = 0;
+static _Atomic uint64_t latencyMaxNs = 0;
+
+void FLTsetCritical(systemErrors_t mask)
+{
+   atomic_store(&critical, mask);
+}
+
+/// Sets the bit of err, a critical fault posts the emergency.
+static bool raiseFault(error_t err, bool isCritical)
+{
+   if (setSystemErrorBit(err))
+   {
+      return false;
+   }
+   atomic_fetch_add(&nRaised, 1);
+
+   if (!isCritical || !FSM_HasTransition(FSM_GetState(), E_EMERGENCY_START))
+   {
+      return true;
+   }
+
+   // Only the first of simultaneous faults posts the emergency. A pending
+   // emergency that S_EMERGENCY did not take in time was lost (dropped from
+   // a full queue, or the state changed first), this fault posts it again.
+   uint64_t now = CLKrealNs();
+   uint64_t pending = atomic_load(&pendingNs);
+   if (pending != 0 && now - pending < FLT_PENDING_TIMEOUT_MS * CLK_NS_PER_MS)
+   {
+      return true;
+   }
+   if (!atomic_compare_exchange_strong(&pendingNs, &pending, now))
+   {
+      return true;
+   }
+   fsm_add_result_t result = FSM_AddEvent(E_EMERGENCY_START);
+   if (result == FSM_EVENT_DROPPED || result == FSM_EVENT_REJECTED)
+   {
+      // Not posted, the next critical fault tries again
+      atomic_compare_exchange_strong(&pendingNs, &now, 0);
+      return true;
+   }
+   atomic_fetch_add(&nEmergencies, 1);
+   KYBwake();
+   return true;
+}
+
+bool FLTraise(error_t err)
+{
+   return raiseFault(err, (atomic_load(&critical) & (1u << err)) != 0);
+}
+
+bool FLTescalate(error_t err)
+{
+   return raiseFault(err, true);
+}
+
+void FLTclear(error_t err)
+{
+   clearSystemErrorBit(err);
+}
+
+void FLTemergencyEntered(void)
+{
+   uint64_t raisedNs = atomic_exchange(&pendingNs, 0);
+
+   if (raisedNs == 0)
+   {
+      return;
+   }
+   uint64_t latency = CLKrealNs() - raisedNs;
+   atomic_fetch_add(&latencySumNs, latency);
+   if (latency > atomic_load(&latencyMaxNs))
+   {
+      atomic_store(&latencyMaxNs, latency);
+   }
+}
+
+void FLTgetStats(fltStats_t *stats)
+{
+   stats->raised = atomic_load(&nRaised);
+   stats->emergencies = atomic_load(&nEmergencies);
+   stats->latencySumNs = atomic_load(&latencySumNs);
+   stats->latencyMaxNs = atomic_load(&latencyMaxNs);
+}
@@ -0,0 +1,53 @@
+#ifndef FAULTMONITOR_H
+#define FAULTMONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "console_functions/systemErrors.h"
+
+//----------------------------------------------------------------------- FauLTs
+
+/// Fault monitor on top of the system error bits.
+/// Any thread may raise a fault. Raising a critical fault posts
+/// E_EMERGENCY_START when the current state has a transition for it, and
+/// wakes the keyboard wait so the FSM handles the event at once (raw mode).
+/// The latency from raising the fault to entering S_EMERGENCY is measured.
+
+/// Critical faults by default.
+#define FLT_DEFAULT_CRITICAL ((1u << ERR_MOTOR_SPEED) | (1u << ERR_MOTOR_INCLINE))
+
+/// A posted emergency not entered within this time counts as lost, the
+/// next critical fault posts it again.
+#define FLT_PENDING_TIMEOUT_MS (500)
+
+/// Fault monitor counters.
+typedef struct
+{
+   uint64_t raised;           ///< Faults raised (bit was clear)
+   uint64_t emergencies;      ///< E_EMERGENCY_START events posted
+   uint64_t latencySumNs;     ///< Sum of fault to S_EMERGENCY latencies
+   uint64_t latencyMaxNs;     ///< Max fault to S_EMERGENCY latency
+} fltStats_t;
+
+/// Sets the system error bits that stop the treadmill.
+void FLTsetCritical(systemErrors_t mask);
+
+/// Sets the error bit of err.
+/// \return true if the bit was clear.
+bool FLTraise(error_t err);
+
+/// Sets the error bit of err and handles it as critical, whatever the
+/// critical mask says.
+/// \return true if the bit was clear.
+bool FLTescalate(error_t err);
+
+/// Clears the error bit of err.
+void FLTclear(error_t err);
+
+/// Call on entry of S_EMERGENCY, ends the latency measurement.
+void FLTemergencyEntered(void);
+
+/// Copies the counters in stats.
+void FLTgetStats(fltStats_t *stats);
+
+#endif
@@ -0,0 +1,125 @@
+#include "fixedpoint.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+//------------------------------------------------------------------ FiXed Point
+
+#define FXP_MAX_DECIMALS (6)                         ///< Further decimals are below the resolution
+#define FXP_MAX_WHOLE    (INT64_MAX >> FXP_FRACTION_BITS) ///< Integer part of the range
+
+fxpQ_t FXPparseQ(const char *text)
+{
+   bool negative = false;
+   int64_t whole = 0;
+   int64_t fraction = 0;
+   int64_t scale = 1;
+   int decimals = 0;
+
+   while (isspace((unsigned char)*text))
+   {
+      text++;
+   }
+   if (*text == '-' || *text == '+')
+   {
+      negative = (*text == '-');
+      text++;
+   }
+   for (; isdigit((unsigned char)*text); text++)
+   {
+      // Beyond the range the digits no longer matter, the result is clamped
+      if (whole <= FXP_MAX_WHOLE)
+      {
+         whole = whole * 10 + (*text - '0');
+      }
+   }
+   if (*text == '.')
+   {
+      for (text++; isdigit((unsigned char)*text); text++)
+      {
+         if (decimals < FXP_MAX_DECIMALS)
+         {
+            fraction = fraction * 10 + (*text - '0');
+            scale *= 10;
+            decimals++;
+         }
+      }
+   }
+
+   if (whole >= FXP_MAX_WHOLE)
+   {
+      return negative ? -INT64_MAX : INT64_MAX;
+   }
+   fxpQ_t q = whole * FXP_ONE + (fraction * FXP_ONE + scale / 2) / scale;
+   return negative ? -q : q;
+}
+
+char *FXPformatQ(fxpQ_t value, char *text, size_t size)
+{
+   bool negative = (value < 0);
+   uint64_t v = negative ? -(uint64_t)value : (uint64_t)value;
+
+   // The fraction is rounded to tenths, halves to even like printf(), which
+   // can carry into the whole part
+   uint64_t whole = v >> FXP_FRACTION_BITS;
+   uint64_t fraction = (v & (FXP_ONE - 1)) * 10;
+   uint64_t tenths = fraction >> FXP_FRACTION_BITS;
+   uint64_t rest = fraction & (FXP_ONE - 1);
+   if (rest > FXP_ONE / 2 || (rest == FXP_ONE / 2 && (tenths & 1u)))
+   {
+      tenths++;
+   }
+   if (tenths == 10)
+   {
+      whole++;
+      tenths = 0;
+   }
+   snprintf(text, size, "%s%llu.%llu", negative ? "-" : "",
+            (unsigned long long)whole, (unsigned long long)tenths);
+   return text;
+}
+
+fxpQ_t FXPfromMilliQ(int64_t milli)
+{
+   // Whole units and the rest apart, milli * FXP_ONE could overflow
+   int64_t whole = milli / 1000;
+   int64_t rest = milli % 1000 * FXP_ONE;
+
+   if (whole > FXP_MAX_WHOLE - 1)
+   {
+      return INT64_MAX;
+   }
+   if (whole < -FXP_MAX_WHOLE + 1)
+   {
+      return -INT64_MAX;
+   }
+   return whole * FXP_ONE + (rest + (rest < 0 ? -500 : 500)) / 1000;
+}
+
+int64_t FXPtoMilliQ(fxpQ_t value)
+{
+   // value * 1000 could overflow, the whole part times 1000 cannot
+   int64_t whole = value / FXP_ONE;
+   int64_t fraction = value % FXP_ONE * 1000;
+
+   return whole * 1000 + (fraction + (fraction < 0 ? -FXP_ONE / 2 : FXP_ONE / 2)) / FXP_ONE;
+}
+
+void FXPintegrateQ(fxpIntegralQ_t *integral, int32_t rate, uint32_t dt,
+                   uint32_t divisor)
+{
+   // The whole units of the step apart, so that nothing is multiplied by
+   // FXP_ONE that could overflow
+   int64_t product = (int64_t)rate * dt;
+   int64_t rest = product % (int64_t)divisor * FXP_ONE + integral->remainder;
+
+   integral->value += product / (int64_t)divisor * FXP_ONE + rest / (int64_t)divisor;
+   integral->remainder = rest % (int64_t)divisor;
+}
+
+char *FXPformatFloat(float value, char *text, size_t size)
+{
+   snprintf(text, size, "%.1f", value);
+   return text;
+}
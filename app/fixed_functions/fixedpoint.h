@@ -0,0 +1,99 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+//------------------------------------------------------------------ FiXed Point
+
+/// Number representation of the treadmill values (speed, incline, distance)
+/// for targets with and without an FPU.
+///
+/// By default the values are float, parsed with atof() and formatted with
+/// "%.1f". With FXP_FIXED_POINT they are Q47.16 fixed point in 64 bits:
+/// parsing, formatting, odometer conversion and the distance integration of
+/// the belt simulation use integer arithmetic only. The resolution of 1/65536 keeps a setpoint like 0.8 km/h
+/// to 3e-6 km/h, the 47 integer bits keep any distance, so its precision
+/// does not depend on the length of the session. On a 32 bit controller an
+/// addition or a compare is two integer instructions. Floats are only made
+/// where a float API is called (FXPtoFloat()).
+///
+/// Can be set in the .pro file: DEFINES += FXP_FIXED_POINT
+///
+/// The Q functions are always available, tools/bench compares them with the
+/// float path.
+
+#define FXP_FRACTION_BITS (16)
+#define FXP_ONE           ((int64_t)1 << FXP_FRACTION_BITS)
+#define FXP_TEXT_SIZE     (24)     ///< Formatted value, any value fits
+
+/// Q47.16 value.
+typedef int64_t fxpQ_t;
+
+/// Integral of an integer rate in Q47.16. The remainder of every step is
+/// carried to the next one, so the integral is exact to 1/65536 however
+/// long it runs.
+typedef struct
+{
+   fxpQ_t value;
+   int64_t remainder;
+} fxpIntegralQ_t;
+
+/// Q47.16 of x, rounded. For constants, which the compiler folds, and for
+/// the results of float APIs.
+#define FXP_Q(x) ((fxpQ_t)((x) * FXP_ONE + ((x) < 0 ? -0.5 : 0.5)))
+
+/// Parses a decimal number like atof(), e.g. "-12.75", without floating
+/// point. Leading white space is skipped, the number ends at the first
+/// other character (no exponents), the digits are rounded to 1/65536 and clamped to the
+/// range. Text without a number is 0.
+fxpQ_t FXPparseQ(const char *text);
+
+/// Formats value with one decimal, rounded like "%.1f".
+/// \return text.
+char *FXPformatQ(fxpQ_t value, char *text, size_t size);
+
+/// \return milli units (e.g. the mm of the odometer) as Q47.16, clamped to
+/// the range.
+fxpQ_t FXPfromMilliQ(int64_t milli);
+
+/// \return value in milli units, rounded. Any value fits.
+int64_t FXPtoMilliQ(fxpQ_t value);
+
+/// Adds rate * dt / divisor to integral. rate is an integer in its own
+/// unit, e.g. the HAL speed in 0.01 km/h with dt in ms and divisor 360000
+/// gives meters. The product rate * dt must fit 63 bits.
+void FXPintegrateQ(fxpIntegralQ_t *integral, int32_t rate, uint32_t dt,
+                   uint32_t divisor);
+
+/// Formats a float with one decimal, the float path of FXPformat().
+char *FXPformatFloat(float value, char *text, size_t size);
+
+/// fxpValue_t is the representation of the build, with the same operations
+/// in both.
+#ifdef FXP_FIXED_POINT
+typedef fxpQ_t fxpValue_t;
+#define FXP_CONSTANT(x)            FXP_Q(x)
+#define FXPparse(text)             FXPparseQ(text)
+#define FXPformat(value, text, n)  FXPformatQ((value), (text), (n))
+#define FXPfromMilli(milli)        FXPfromMilliQ(milli)
+#define FXPtoMilli(value)          FXPtoMilliQ(value)
+#define FXPfromFloat(f)            FXP_Q(f)
+#define FXPtoFloat(value)          ((float)(value) / FXP_ONE)
+#else
+typedef float fxpValue_t;
+#define FXP_CONSTANT(x)            ((float)(x))
+#define FXPparse(text)             ((float)atof(text))
+#define FXPformat(value, text, n)  FXPformatFloat((value), (text), (n))
+#define FXPfromMilli(milli)        ((milli) / 1000.0f)
+#define FXPtoMilli(value)          ((int64_t)((value) * 1000))
+#define FXPfromFloat(f)            (f)
+#define FXPtoFloat(value)          (value)
+#endif
+
+/// Formats value in a buffer that lives until the end of the enclosing
+/// block, e.g. printf("%s km/h", FXP_TEXT(speed)).
+#define FXP_TEXT(value) FXPformat((value), (char[FXP_TEXT_SIZE]){""}, FXP_TEXT_SIZE)
+
+#endif
@@ -4,24 +4,76 @@ CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += \
+        analytics_functions/analytics.c \
+        clock_functions/clock.c \
         console_functions/devConsole.c \
         console_functions/display.c \
         console_functions/keyboard.c \
+        console_functions/script.c \
         console_functions/systemErrors.c \
+        daemon_functions/daemon.c \
         events.c \
+        fixed_functions/fixedpoint.c \
+        fault_functions/faultMonitor.c \
         fsm_functions/fsm.c \
+        gym_functions/gym.c \
+        hal_functions/hal.c \
+        history_functions/history.c \
+        ipc_functions/ipc.c \
+        log_functions/logbinary.c \
+        log_functions/logformat.c \
+        log_functions/logger.c \
         main.c \
-        states.c
+        metrics_functions/metrics.c \
+        program_functions/program.c \
+        recorder_functions/recorder.c \
+        simulation_functions/physics.c \
+        startup_functions/startup.c \
+        states.c \
+        subsystem_functions/pid.c \
+        subsystem_functions/subsystems.c \
+        telemetry_functions/telemetry.c \
+        watchdog_functions/watchdog.c
 
 HEADERS += \
+   analytics_functions/analytics.h \
    appInfo.h \
+   clock_functions/clock.h \
    console_functions/devConsole.h \
    console_functions/display.h \
    console_functions/keyboard.h \
+   console_functions/script.h \
    console_functions/systemErrors.h \
+   daemon_functions/daemon.h \
    events.h \
+   fault_functions/faultMonitor.h \
+   fixed_functions/fixedpoint.h \
    fsm.h \
    fsm_functions/fsm.h \
+   gym_functions/gym.h \
+   hal_functions/hal.h \
+   history_functions/history.h \
+   ipc_functions/ipc.h \
+   log_functions/logbinary.h \
+   log_functions/logformat.h \
+   log_functions/logger.h \
+   metrics_functions/metrics.h \
+   program_functions/program.h \
    prototypes.h \
+   recorder_functions/recorder.h \
+   simulation_functions/physics.h \
+   startup_functions/startup.h \
    states.h \
-   variables.h
+   subsystem_functions/pid.h \
+   subsystem_functions/subsystems.h \
+   sync_functions/seqlock.h \
+   telemetry_functions/telemetry.h \
+   trace_functions/trace.h \
+   variables.h \
+   watchdog_functions/watchdog.h
+
+# Q47.16 fixed point values for targets without an FPU, see fixedpoint.h
+# DEFINES += FXP_FIXED_POINT
+
+unix: LIBS += -lpthread -lm
+unix:!macx: LIBS += -lrt
@@ -1,91 +1,314 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "fsm.h"
 #include "events.h"
 #include "states.h"
 #include "appInfo.h"
+#include "trace_functions/trace.h"
 
-#define MAX_EVENTS_IN_BUFFER_MASK (MAX_EVENTS_IN_BUFFER - 1)
-#if (MAX_EVENTS_IN_BUFFER & MAX_EVENTS_IN_BUFFER_MASK)
+#if (FSM_QUEUE_CAPACITY & (FSM_QUEUE_CAPACITY - 1))
 #error events size is not a power of two
 #endif
 
 // Global variables
 state_funcs_t state_funcs[MAX_STATES] = {0};
 
-transition_t transitions[MAX_TRANSITIONS];
-static volatile uint8_t transition_cnt = 0;
-
-event_t events[MAX_EVENTS_IN_BUFFER];
-static volatile uint8_t head = 0;
-static volatile uint8_t tail = 0;
+// The transition matrix. FSM_AddTransition() builds the first one in
+// place, FSM_SwapModel() replaces it RCU style: readers take the model
+// pointer once, a lookup uses the old matrix or the new one, never a mix.
+// The old one is freed after all readers that could have it are done.
+typedef struct
+{
+   uint8_t count;
+   transition_t transitions[MAX_TRANSITIONS];
+}fsm_model_t;
+
+static fsm_model_t builtinModel;
+static fsm_model_t *_Atomic model = &builtinModel;
+static bool stateAdded[MAX_STATES];
+
+// Readers count themselves in the counter of the current epoch, a swap
+// waits until the counters of both epochs were zero once. Readers never wait.
+static atomic_uint readers[2];
+static atomic_uint epoch = 0;
+static atomic_flag swapping = ATOMIC_FLAG_INIT;
+static _Atomic uint32_t modelVersion = 0;
+static atomic_ullong swapFailures = 0;
+static _Atomic uint64_t graceMaxNs = 0;
+
+// Multiple producers, one consumer (the FSM thread), a bounded queue after
+// D. Vyukov. head and tail are free running positions, so the capacity is
+// not limited by their width. The sequence of a cell tells for which lap
+// it is free: (position & ~mask) when free, + 1 when filled. A zeroed cell
+// is free for the first lap. A producer that drops the oldest event takes
+// it like the consumer does, so tail is moved with a compare and exchange.
+typedef struct
+{
+   _Atomic uint32_t sequence;
+   event_t event;
+}fsm_cell_t;
+
+static fsm_cell_t defaultCells[FSM_QUEUE_CAPACITY];
+static fsm_cell_t *cells = defaultCells;
+static uint32_t capacity = FSM_QUEUE_CAPACITY;
+static uint32_t mask = FSM_QUEUE_CAPACITY - 1;
+static _Atomic fsm_queue_policy_t policy = FSM_QUEUE_DROP_NEWEST;
+static _Atomic uint32_t head = 0;  // Next position to fill
+static _Atomic uint32_t tail = 0;  // Next position to take
+
+// Set in the thread that takes the events, it must never wait for itself
+static _Thread_local bool consumer = false;
+
+static _Atomic uint32_t highWater = 0;
+static atomic_ullong overflows = 0;
+static atomic_ullong dropped = 0;
+static atomic_ullong rejected = 0;
+static atomic_ullong blocked = 0;
+
+// FSM_SetCoalescing(), and which of these events are in the queue
+static atomic_bool coalescing[NOF_EVENTS];
+static atomic_bool pending[NOF_EVENTS];
+static atomic_ullong coalesced = 0;
 
 static volatile bool flush_event = 0;
 
+// Called for every transition, before the onEntry() of the new state
+static void (*transition_hook)(state_t from, event_t event, state_t to) = NULL;
+
+// Called before (begin true) and after every onEntry() and onExit()
+static void (*handler_hook)(state_t state, bool begin) = NULL;
+
+// Compiled model (fsm.hpp), replaces the lookup in the transition matrix
+static bool (*_Atomic dispatcher)(state_t state, event_t event) = NULL;
+
 int numOfStates;
-int numOfTransitions;
 
 // Update for version 0.2 ORO
-static state_t state;  // contains always the current state. can be obtained via state_t FSM_GetState(void)
+static _Atomic state_t state;  // contains always the current state. can be obtained via state_t FSM_GetState(void)
+
+// Dispatch counters, written by the FSM thread only: plain load and store,
+// no lock and no read-modify-write. Readers may see them a bit apart.
+static _Atomic uint64_t dispatched = 0;
+static _Atomic uint64_t unexpected = 0;
+static _Atomic uint64_t stateEntries[MAX_STATES];
+static _Atomic uint64_t stateTimeNs[MAX_STATES];
+static _Atomic uint64_t stateSinceNs = 0;
+
+// The time per state does not need more than the tick resolution, the
+// coarse clock costs a few ns per transition instead of a TSC read
+#ifdef CLOCK_MONOTONIC_COARSE
+#define FSM_STATE_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define FSM_STATE_CLOCK CLOCK_MONOTONIC
+#endif
+
+static uint64_t monotonicNs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(FSM_STATE_CLOCK, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void countIncrement(_Atomic uint64_t *counter, uint64_t n)
+{
+   atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                         memory_order_relaxed);
+}
 
 // Local function to solve a bug
-void FSM_SetState(state_t newstate);
 void FSM_SetState(state_t newstate)
 {
+    uint64_t now = monotonicNs();
+    uint64_t since = atomic_load_explicit(&stateSinceNs, memory_order_relaxed);
+    state_t old = state;
+
+    if(since != 0 && old < MAX_STATES)
+    {
+       countIncrement(&stateTimeNs[old], now - since);
+    }
+    if(newstate < MAX_STATES)
+    {
+       countIncrement(&stateEntries[newstate], 1);
+    }
+    atomic_store_explicit(&stateSinceNs, now, memory_order_relaxed);
     state = newstate;
 }
 
+void FSM_GetDispatchStats(fsm_dispatch_stats_t *stats)
+{
+   state_t current = state;
+   uint64_t since = atomic_load_explicit(&stateSinceNs, memory_order_relaxed);
+
+   stats->events = atomic_load_explicit(&dispatched, memory_order_relaxed);
+   stats->unexpected = atomic_load_explicit(&unexpected, memory_order_relaxed);
+   stats->state = current;
+   for(int s = 0; s < MAX_STATES; s++)
+   {
+      stats->entries[s] = atomic_load_explicit(&stateEntries[s], memory_order_relaxed);
+      stats->timeNs[s] = atomic_load_explicit(&stateTimeNs[s], memory_order_relaxed);
+   }
+   // The current state counts until now
+   if(since != 0 && current < MAX_STATES)
+   {
+      uint64_t now = monotonicNs();
+      stats->timeNs[current] += (now > since) ? now - since : 0;
+   }
+}
+
 state_t FSM_GetState(void)
 {
     return state;
 }
 
+static unsigned modelReadLock(void)
+{
+   unsigned e = atomic_load(&epoch) & 1;
+
+   atomic_fetch_add(&readers[e], 1);
+   return e;
+}
+
+static void modelReadUnlock(unsigned e)
+{
+   atomic_fetch_sub_explicit(&readers[e], 1, memory_order_release);
+}
+
+// Looks up the transition of event in state in one version of the model
+static bool findTransition(const state_t state, const event_t event, transition_t *found)
+{
+   unsigned e = modelReadLock();
+   const fsm_model_t *m = atomic_load(&model);
+   bool has = false;
+
+   for(uint8_t i=0; i < m->count; ++i)
+   {
+      if(m->transitions[i].from == state && m->transitions[i].event == event)
+      {
+         if(found != NULL)
+         {
+            *found = m->transitions[i];
+         }
+         has = true;
+         break;
+      }
+   }
+   modelReadUnlock(e);
+   return has;
+}
+
+bool FSM_HasTransition(const state_t state, const event_t event)
+{
+   return findTransition(state, event, NULL);
+}
+
 state_t FSM_EventHandler(const state_t state, const event_t event)
 {
    state_t nextState = state;
+   transition_t transition;
+   bool (*dispatch)(state_t, event_t) = atomic_load_explicit(&dispatcher, memory_order_relaxed);
+
+   countIncrement(&dispatched, 1);
+   TRC_PROBE2(fsm, dispatch_start, state, event);
 
-   // Check all transitions in the transition matrix
-   for(uint8_t i=0; i <= transition_cnt; ++i)
+   // A compiled model executes its transitions inline. Without a transition
+   // the matrix has none either, the same model was installed.
+   if(dispatch != NULL)
    {
-      // Is the state equal to the from state?
-      if(transitions[i].from == state)
+      if(dispatch(state, event))
       {
-         // And is the event equal to the event?
-         if(transitions[i].event == event)
-         {
-            // Execute the from state onExit() function
-            if(state_funcs[transitions[i].from].onExit != NULL)
-            {
-               state_funcs[transitions[i].from].onExit();
-            }
+         nextState = FSM_GetState();
+         TRC_PROBE3(fsm, dispatch_end, state, event, nextState);
+         return nextState;
+      }
+   }
+   // Check all transitions in the transition matrix, the handlers run
+   // after the lookup, a swap of the matrix does not wait for them
+   else if(findTransition(state, event, &transition))
+   {
+      // Execute the from state onExit() function
+      if(state_funcs[transition.from].onExit != NULL)
+      {
+         if(handler_hook != NULL) handler_hook(state, true);
+         state_funcs[transition.from].onExit();
+         if(handler_hook != NULL) handler_hook(state, false);
+      }
 
-            // Set the next state
-            // Update for version 0.2 ORO
-            FSM_SetState(transitions[i].to);  // required, so the state variable is up to date.
+      // Set the next state
+      // Update for version 0.2 ORO
+      FSM_SetState(transition.to);  // required, so the state variable is up to date.
 
-            nextState = transitions[i].to;
+      nextState = transition.to;
 
-            // Execute the to state onEntry() function
-            if(state_funcs[transitions[i].to].onEntry != NULL)
-            {
-               state_funcs[transitions[i].to].onEntry();
-            }
+      TRC_PROBE3(fsm, transition, state, event, nextState);
+      if(transition_hook != NULL)
+      {
+         transition_hook(state, event, nextState);
+      }
 
-            return nextState;
-         }
+      // Execute the to state onEntry() function
+      if(state_funcs[transition.to].onEntry != NULL)
+      {
+         if(handler_hook != NULL) handler_hook(nextState, true);
+         state_funcs[transition.to].onEntry();
+         if(handler_hook != NULL) handler_hook(nextState, false);
       }
+
+      TRC_PROBE3(fsm, dispatch_end, state, event, nextState);
+      return nextState;
    }
 
    // Still here, so the event is unexpected in the current state. Remain in
    // current state. Optionally, return the event back in the event buffer.
+   countIncrement(&unexpected, 1);
+   TRC_PROBE2(fsm, unexpected, state, event);
    if(!flush_event)
    {
       FSM_AddEvent(event);
    }
 
+   TRC_PROBE3(fsm, dispatch_end, state, event, nextState);
    return nextState;
 }
 
+void FSM_SetTransitionHook(void (*hook)(state_t from, event_t event, state_t to))
+{
+   transition_hook = hook;
+}
+
+void FSM_SetHandlerHook(void (*hook)(state_t state, bool begin))
+{
+   handler_hook = hook;
+}
+
+void FSM_SetDispatcher(bool (*dispatch)(state_t state, event_t event))
+{
+   dispatcher = dispatch;
+}
+
+void FSM_CallHandlerHook(state_t state, bool begin)
+{
+   if(handler_hook != NULL)
+   {
+      handler_hook(state, begin);
+   }
+}
+
+void FSM_CallTransitionHook(state_t from, event_t event, state_t to)
+{
+   TRC_PROBE3(fsm, transition, from, event, to);
+   if(transition_hook != NULL)
+   {
+      transition_hook(from, event, to);
+   }
+}
+
 void FSM_FlushEnexpectedEvents(const bool flush)
 {
    flush_event = flush;
@@ -101,32 +324,404 @@ void FSM_AddState(const state_t state, const state_funcs_t *funcs)
 
    // Copy the state and save locally
    memcpy(&state_funcs[state], funcs, sizeof(state_funcs_t));
+   stateAdded[state] = true;
    numOfStates++;
 }
 
 void FSM_AddTransition(const transition_t *transition)
 {	
-   if(transition_cnt == MAX_TRANSITIONS)
+   if(builtinModel.count == MAX_TRANSITIONS)
    {
       // Error, too many transitions
       return;
    }
 
    // Copy the transition and save locally
-   memcpy(&transitions[transition_cnt], transition, sizeof(transition_t));
+   memcpy(&builtinModel.transitions[builtinModel.count], transition, sizeof(transition_t));
+
+   ++builtinModel.count;
+}
+
+static uint64_t nowNs(void)
+{
+   struct timespec ts;
+
+   timespec_get(&ts, TIME_UTC);
+   return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool modelError(char *error, size_t size, const char *text, const transition_t *t)
+{
+   extern char * stateEnumToText[];
+   extern char * eventEnumToText[];
+
+   if(error != NULL && size > 0)
+   {
+      if(t != NULL)
+      {
+         snprintf(error, size, "%s: %s %s %s", text, stateEnumToText[t->from],
+                  eventEnumToText[t->event], stateEnumToText[t->to]);
+      }
+      else
+      {
+         snprintf(error, size, "%s", text);
+      }
+   }
+   atomic_fetch_add(&swapFailures, 1);
+   return false;
+}
+
+bool FSM_SwapModel(const transition_t *newTransitions, uint8_t count, char *error, size_t errorSize)
+{
+   if(count == 0 || count > MAX_TRANSITIONS)
+   {
+      return modelError(error, errorSize, "no transitions or more than MAX_TRANSITIONS", NULL);
+   }
+
+   // Validate before anything changes
+   for(uint8_t i = 0; i < count; i++)
+   {
+      const transition_t *t = &newTransitions[i];
+      bool leaves = false;
+
+      if(t->from >= NOF_STATES || t->to >= NOF_STATES || (unsigned)t->event >= NOF_EVENTS)
+      {
+         return modelError(error, errorSize, "unknown state or event", NULL);
+      }
+      if(!stateAdded[t->from] || !stateAdded[t->to])
+      {
+         return modelError(error, errorSize, "state without FSM_AddState()", t);
+      }
+      for(uint8_t j = 0; j < count; j++)
+      {
+         if(j != i && newTransitions[j].from == t->from && newTransitions[j].event == t->event)
+         {
+            return modelError(error, errorSize, "duplicate or conflicting transition", t);
+         }
+         leaves |= (newTransitions[j].from == t->to);
+      }
+      if(!leaves)
+      {
+         return modelError(error, errorSize, "no transition out of the target state", t);
+      }
+   }
+
+   // The running machine must not get stuck where it is
+   state_t current = FSM_GetState();
+   bool leaves = (current == S_NO);
+   for(uint8_t j = 0; j < count; j++)
+   {
+      leaves |= (newTransitions[j].from == current);
+   }
+   if(!leaves)
+   {
+      return modelError(error, errorSize, "no transition out of the current state", NULL);
+   }
+
+   fsm_model_t *next = malloc(sizeof(fsm_model_t));
+   if(next == NULL)
+   {
+      return modelError(error, errorSize, "no memory", NULL);
+   }
+   next->count = count;
+   memcpy(next->transitions, newTransitions, count * sizeof(transition_t));
+
+   if(atomic_flag_test_and_set(&swapping))
+   {
+      free(next);
+      return modelError(error, errorSize, "another swap is in progress", NULL);
+   }
+
+   // A compiled model (fsm.hpp) is the old matrix
+   atomic_store(&dispatcher, NULL);
+   fsm_model_t *old = atomic_exchange(&model, next);
+   atomic_fetch_add(&modelVersion, 1);
+
+   // Grace period: a reader counted in an epoch may still have old. Two
+   // flips, a reader that took the epoch just before the first one is
+   // counted in the other counter.
+   uint64_t t0 = nowNs();
+   for(int flip = 0; flip < 2; flip++)
+   {
+      unsigned e = atomic_fetch_add(&epoch, 1) & 1;
+
+      while(atomic_load(&readers[e]) != 0)
+      {
+         sched_yield();
+      }
+   }
+   uint64_t grace = nowNs() - t0;
+   if(grace > atomic_load(&graceMaxNs))
+   {
+      atomic_store(&graceMaxNs, grace);
+   }
+
+   if(old != &builtinModel)
+   {
+      free(old);
+   }
+   atomic_flag_clear(&swapping);
+   return true;
+}
+
+// Index of name in names, with or without the prefix, -1 if unknown
+static int lookupName(const char *name, char *names[], int n, const char *prefix)
+{
+   size_t length = strlen(prefix);
+
+   for(int i = 1; i < n; i++)
+   {
+      if(strcmp(name, names[i]) == 0 ||
+         (strncmp(names[i], prefix, length) == 0 && strcmp(name, names[i] + length) == 0))
+      {
+         return i;
+      }
+   }
+   return -1;
+}
+
+bool FSM_LoadModel(const char *path, char *error, size_t errorSize)
+{
+   extern char * stateEnumToText[];
+   extern char * eventEnumToText[];
+   transition_t loaded[MAX_TRANSITIONS];
+   uint8_t count = 0;
+   char line[160];
+   int lineNumber = 0;
+   FILE *file = fopen(path, "r");
+
+   if(file == NULL)
+   {
+      return modelError(error, errorSize, "cannot open the model file", NULL);
+   }
+
+   while(fgets(line, sizeof(line), file) != NULL)
+   {
+      char from[40], event[40], to[40], extra;
+      char *text = line;
+
+      lineNumber++;
+      while(isspace((unsigned char)*text))
+      {
+         text++;
+      }
+      if(*text == '\0' || *text == '#')
+      {
+         continue;
+      }
+
+      int f = -1, e = -1, t = -1;
+      if(sscanf(text, "%39s %39s %39s %c", from, event, to, &extra) == 3)
+      {
+         f = lookupName(from, stateEnumToText, NOF_STATES, "S_");
+         e = lookupName(event, eventEnumToText, NOF_EVENTS, "E_");
+         t = lookupName(to, stateEnumToText, NOF_STATES, "S_");
+      }
+      if(f < 0 || e < 0 || t < 0 || count == MAX_TRANSITIONS)
+      {
+         fclose(file);
+         if(error != NULL && errorSize > 0)
+         {
+            snprintf(error, errorSize, "%s:%d: %s", path, lineNumber,
+                     (count == MAX_TRANSITIONS) ? "more than MAX_TRANSITIONS" :
+                     "expected: from_state event to_state");
+         }
+         atomic_fetch_add(&swapFailures, 1);
+         return false;
+      }
+      loaded[count++] = (transition_t){(state_t)f, (event_t)e, (state_t)t};
+   }
+   fclose(file);
+
+   return FSM_SwapModel(loaded, count, error, errorSize);
+}
+
+void FSM_GetModelStats(fsm_model_stats_t *stats)
+{
+   unsigned e = modelReadLock();
+
+   stats->transitions = atomic_load(&model)->count;
+   modelReadUnlock(e);
+   stats->version = atomic_load(&modelVersion);
+   stats->failures = atomic_load(&swapFailures);
+   stats->graceMaxNs = atomic_load(&graceMaxNs);
+}
+
+// Fills the cell at head. Returns false if the queue is full.
+static bool putEvent(const event_t event)
+{
+   uint32_t position = atomic_load_explicit(&head, memory_order_relaxed);
+
+   while(1)
+   {
+      fsm_cell_t *cell = &cells[position & mask];
+      uint32_t lap = position & ~mask;
+      int32_t diff = (int32_t)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - lap);
+
+      if(diff == 0)
+      {
+         // Free for this lap, reserve it. Other threads may add events at the same time
+         if(atomic_compare_exchange_weak_explicit(&head, &position, position + 1,
+                                                  memory_order_relaxed, memory_order_relaxed))
+         {
+            cell->event = event;
+            atomic_store_explicit(&cell->sequence, lap + 1, memory_order_release);
+            TRC_PROBE2(fsm, enqueue, event, position);
+            break;
+         }
+      }
+      else if(diff < 0)
+      {
+         // The event of the previous lap is not taken yet
+         return false;
+      }
+      else
+      {
+         // Reserved by another producer
+         position = atomic_load_explicit(&head, memory_order_relaxed);
+      }
+   }
+
+   // Depth after this event, an estimate while other threads add and take
+   uint32_t depth = position + 1 - atomic_load_explicit(&tail, memory_order_relaxed);
+   uint32_t max = atomic_load_explicit(&highWater, memory_order_relaxed);
+   while(depth > max && depth <= capacity &&
+         !atomic_compare_exchange_weak_explicit(&highWater, &max, depth,
+                                                memory_order_relaxed, memory_order_relaxed))
+   {;}
+   return true;
+}
+
+// Takes the event at tail. Returns false if the queue is empty.
+static bool takeEvent(event_t *event)
+{
+   uint32_t position = atomic_load_explicit(&tail, memory_order_relaxed);
+
+   while(1)
+   {
+      fsm_cell_t *cell = &cells[position & mask];
+      uint32_t lap = position & ~mask;
+      int32_t diff = (int32_t)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - (lap + 1));
+
+      if(diff == 0)
+      {
+         if(atomic_compare_exchange_weak_explicit(&tail, &position, position + 1,
+                                                  memory_order_relaxed, memory_order_relaxed))
+         {
+            *event = cell->event;
+            TRC_PROBE2(fsm, dequeue, *event, position);
+            // From now on the same event is added again, its handler runs later
+            if((unsigned)*event < NOF_EVENTS &&
+               atomic_load_explicit(&coalescing[*event], memory_order_relaxed))
+            {
+               atomic_store_explicit(&pending[*event], false, memory_order_release);
+            }
+            // Free for the next lap
+            atomic_store_explicit(&cell->sequence, lap + capacity, memory_order_release);
+            return true;
+         }
+      }
+      else if(diff < 0 && atomic_load_explicit(&head, memory_order_acquire) == position)
+      {
+         return false;
+      }
+      else
+      {
+         // The cell is reserved, wait until the producer has written it.
+         // Or a producer that drops the oldest event took it.
+         position = atomic_load_explicit(&tail, memory_order_relaxed);
+      }
+   }
+}
+
+bool FSM_SetEventQueue(uint32_t newCapacity, fsm_queue_policy_t newPolicy)
+{
+   uint32_t size = 2;
+
+   if(newCapacity > FSM_QUEUE_MAX_CAPACITY)
+   {
+      return false;
+   }
+   while(size < newCapacity)
+   {
+      size <<= 1;
+   }
+
+   if(size != capacity)
+   {
+      if(!FSM_NoEvents())
+      {
+         return false;
+      }
 
-   ++transition_cnt;
-   numOfTransitions++;
+      fsm_cell_t *newCells = defaultCells;
+      if(size != FSM_QUEUE_CAPACITY)
+      {
+         newCells = calloc(size, sizeof(fsm_cell_t));
+         if(newCells == NULL)
+         {
+            return false;
+         }
+      }
+      else
+      {
+         memset(defaultCells, 0, sizeof(defaultCells));
+      }
+      if(cells != defaultCells)
+      {
+         free(cells);
+      }
+
+      // The zeroed cells are free for the first lap
+      cells = newCells;
+      capacity = size;
+      mask = size - 1;
+      atomic_store(&head, 0);
+      atomic_store(&tail, 0);
+      atomic_store(&highWater, 0);
+   }
+   atomic_store(&policy, newPolicy);
+   return true;
+}
+
+void FSM_GetQueueStats(fsm_queue_stats_t *stats)
+{
+   stats->capacity = capacity;
+   stats->policy = atomic_load(&policy);
+   stats->added = atomic_load(&head);
+   stats->taken = atomic_load(&tail);
+   stats->queued = stats->added - stats->taken;
+   stats->highWater = atomic_load(&highWater);
+   stats->overflows = atomic_load(&overflows);
+   stats->dropped = atomic_load(&dropped);
+   stats->rejected = atomic_load(&rejected);
+   stats->blocked = atomic_load(&blocked);
+   stats->coalesced = atomic_load(&coalesced);
+}
+
+void FSM_SetCoalescing(const event_t event, const bool coalesce)
+{
+   if((unsigned)event < NOF_EVENTS)
+   {
+      atomic_store(&coalescing[event], coalesce);
+   }
 }
 
 event_t FSM_PeekForEvent(void)
 {
-   return events[head];
+   uint32_t position = atomic_load_explicit(&tail, memory_order_relaxed);
+   fsm_cell_t *cell = &cells[position & mask];
+
+   if(atomic_load_explicit(&cell->sequence, memory_order_acquire) != (position & ~mask) + 1)
+   {
+      return E_NO;
+   }
+   return cell->event;
 }
 
 bool FSM_NoEvents(void)
 {
-   return (head == tail);
+   return (atomic_load(&head) == atomic_load(&tail));
 }
 
 event_t FSM_WaitForEvent(void)
@@ -137,53 +732,93 @@ event_t FSM_WaitForEvent(void)
    return FSM_GetEvent();
 }
 
-uint8_t FSM_NofEvents(void)
+uint32_t FSM_NofEvents(void)
 {
-   if(head == tail)
-      return 0;
-   else if(head > tail)
-      return head - tail;
-   else
-      return MAX_EVENTS_IN_BUFFER - tail + head;
+   uint32_t t = atomic_load(&tail);
+
+   return atomic_load(&head) - t;
 }
 
-void FSM_AddEvent(const event_t event)
+fsm_add_result_t FSM_AddEvent(const event_t event)
 {
-   uint8_t tmpHead;
-
-   // Calculate index
-   tmpHead = (head + 1) & MAX_EVENTS_IN_BUFFER_MASK;
-
-   // Check if queue is full
-   if(tmpHead == tail)
+   fsm_add_result_t result = FSM_EVENT_QUEUED;
+   bool full = false;
+   bool waited = false;
+   bool coalesce = (unsigned)event < NOF_EVENTS &&
+                   atomic_load_explicit(&coalescing[event], memory_order_relaxed);
+   event_t oldest;
+
+   // The pending event stands for this one
+   if(coalesce && atomic_exchange_explicit(&pending[event], true, memory_order_acq_rel))
    {
-      // Queue is full, flush the event
-      return;
+      atomic_fetch_add_explicit(&coalesced, 1, memory_order_relaxed);
+      return FSM_EVENT_COALESCED;
    }
 
-   // Store the event in the queue
-   events[tmpHead] = event;
+   while(!putEvent(event))
+   {
+      if(!full)
+      {
+         atomic_fetch_add_explicit(&overflows, 1, memory_order_relaxed);
+         TRC_PROBE2(fsm, queue_full, event, atomic_load_explicit(&policy, memory_order_relaxed));
+         full = true;
+      }
 
-   // Save the new index
-   head = tmpHead;
+      switch(atomic_load_explicit(&policy, memory_order_relaxed))
+      {
+      case FSM_QUEUE_DROP_OLDEST:
+         // Make room, the FSM thread may have taken an event in between
+         if(takeEvent(&oldest))
+         {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            result = FSM_EVENT_REPLACED;
+         }
+         break;
+
+      case FSM_QUEUE_BLOCK:
+         if(!consumer)
+         {
+            if(!waited)
+            {
+               atomic_fetch_add_explicit(&blocked, 1, memory_order_relaxed);
+               waited = true;
+            }
+            sched_yield();
+            break;
+         }
+         // The FSM thread would wait for itself
+         // fall through
+
+      case FSM_QUEUE_REJECT:
+         atomic_fetch_add_explicit(&rejected, 1, memory_order_relaxed);
+         result = FSM_EVENT_REJECTED;
+         break;
+
+      default:
+         atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+         result = FSM_EVENT_DROPPED;
+         break;
+      }
+
+      if(result == FSM_EVENT_REJECTED || result == FSM_EVENT_DROPPED)
+      {
+         // Not pending, the next one is added
+         if(coalesce)
+         {
+            atomic_store_explicit(&pending[event], false, memory_order_release);
+         }
+         return result;
+      }
+   }
+   return result;
 }
 
 event_t FSM_GetEvent(void)
 {
    event_t event = E_NO;
-   uint8_t tmpTail;
 
-   if(!FSM_NoEvents())
-   {
-      // Calculate index
-      tmpTail = (tail + 1) & MAX_EVENTS_IN_BUFFER_MASK;
-
-      // Get the event from the queue
-      event = events[tmpTail];
-
-      // Store the new index
-      tail = tmpTail;
-   }
+   consumer = true;
+   (void)takeEvent(&event);
    return event;
 }
 
@@ -196,7 +831,7 @@ void FSM_RunStateMachine(state_t init_state, event_t start_event)
    // Removed, since it is a global variable.
    // state_t state;
 
-   state = init_state;  // Important, otherwise the statetransitions won't work;
+   FSM_SetState(init_state);  // Important, otherwise the statetransitions won't work;
    FSM_AddEvent(start_event);    // Machine is switched on
 
    while(1)
@@ -213,20 +848,21 @@ void FSM_RunStateMachine(state_t init_state, event_t start_event)
 void FSM_RevertModel(void)
 {
    extern int numOfStates;
-   extern int numOfTransitions;
-   extern transition_t transitions[];
    extern char * stateEnumToText[];
    extern char * eventEnumToText[];
+   unsigned e = modelReadLock();
+   const fsm_model_t *m = atomic_load(&model);
 
-   printf("Transition count: %i\n", numOfTransitions);
+   printf("Transition count: %i\n", m->count);
    printf("States count: %i\n", numOfStates);
 
    printf("@startuml\n");
-   printf("[*] --> %s : %s\n", stateEnumToText[transitions[0].to],eventEnumToText[transitions[0].event]);
+   printf("[*] --> %s : %s\n", stateEnumToText[m->transitions[0].to],eventEnumToText[m->transitions[0].event]);
 
-   for (int i = 1; i < numOfTransitions; i++)
+   for (int i = 1; i < m->count; i++)
    {
-      printf("%s --> %s : %s\n", stateEnumToText[transitions[i].from],stateEnumToText[transitions[i].to],eventEnumToText[transitions[i].event]);
+      printf("%s --> %s : %s\n", stateEnumToText[m->transitions[i].from],stateEnumToText[m->transitions[i].to],eventEnumToText[m->transitions[i].event]);
    }
    printf("@enduml\n");
+   modelReadUnlock(e);
 }
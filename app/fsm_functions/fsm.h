@@ -38,9 +38,66 @@
 #include "states.h"
 #include "events.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define MAX_STATES           (20)
 #define MAX_TRANSITIONS      (20)
-#define MAX_EVENTS_IN_BUFFER (128) // 2,4,8,16,32,64,128 or 256
+#define FSM_QUEUE_CAPACITY   (128)       // Default capacity of the event queue, power of two
+#define FSM_QUEUE_MAX_CAPACITY (1u << 30)
+
+// What FSM_AddEvent() does when the event queue is full
+typedef enum
+{
+   FSM_QUEUE_DROP_NEWEST,  // The new event is lost (default)
+   FSM_QUEUE_DROP_OLDEST,  // The oldest queued event is lost, the new one is queued
+   FSM_QUEUE_BLOCK,        // Wait until the FSM thread takes an event, rejects in the FSM thread
+   FSM_QUEUE_REJECT        // Not queued, the caller decides
+} fsm_queue_policy_t;
+
+// Return value of FSM_AddEvent()
+typedef enum
+{
+   FSM_EVENT_QUEUED,
+   FSM_EVENT_COALESCED,    // Not queued, the same event is pending (FSM_SetCoalescing())
+   FSM_EVENT_REPLACED,     // Queued, the oldest event was dropped
+   FSM_EVENT_DROPPED,      // Lost, the queue is full
+   FSM_EVENT_REJECTED      // Not queued, the queue is full
+} fsm_add_result_t;
+
+typedef struct
+{
+   uint32_t capacity;
+   fsm_queue_policy_t policy;
+   uint32_t queued;        // Events in the queue now
+   uint32_t highWater;     // Max events in the queue
+   uint32_t added;         // Events queued, wraps
+   uint32_t taken;         // Events taken, wraps
+   uint64_t overflows;     // FSM_AddEvent() calls on a full queue
+   uint64_t dropped;       // Events lost, the new (drop newest) or the oldest (drop oldest)
+   uint64_t rejected;      // FSM_EVENT_REJECTED returned
+   uint64_t blocked;       // FSM_AddEvent() calls that waited
+   uint64_t coalesced;     // Events merged with a pending one, queue entries and dispatches saved
+}fsm_queue_stats_t;
+
+typedef struct
+{
+   uint32_t version;       // Swaps of the transition matrix
+   uint8_t  transitions;   // Transitions in the matrix now
+   uint64_t failures;      // Models that were not swapped in
+   uint64_t graceMaxNs;    // Longest wait of a swap for the readers of the old matrix
+}fsm_model_stats_t;
+
+// Counters of the FSM thread, updated without locks
+typedef struct
+{
+   uint64_t events;                  // Events dispatched
+   uint64_t unexpected;              // Events without a transition in the state
+   state_t  state;                   // Current state
+   uint64_t entries[MAX_STATES];     // Transitions into the state
+   uint64_t timeNs[MAX_STATES];      // Time in the state, monotonic clock
+}fsm_dispatch_stats_t;
 
 typedef struct 
 {
@@ -99,16 +156,80 @@ state_t FSM_EventHandler(const state_t state, const event_t event);
 void    FSM_FlushEnexpectedEvents(const bool flush);
 void    FSM_AddState(const state_t state, const state_funcs_t *funcs);
 void    FSM_AddTransition(const transition_t *transition);
-void    FSM_AddEvent(const event_t event);
+fsm_add_result_t FSM_AddEvent(const event_t event);   // Any thread may add events
 void    FSM_RunStateMachine(state_t init_state, event_t start_event);
 state_t FSM_GetState(void);
+bool    FSM_HasTransition(const state_t state, const event_t event);
+void    FSM_SetTransitionHook(void (*hook)(state_t from, event_t event, state_t to));
+void    FSM_SetHandlerHook(void (*hook)(state_t state, bool begin));
+
+/*!
+ * Replaces the transition matrix at runtime, the states and their handlers
+ * stay. The model is validated first: all states added with FSM_AddState(),
+ * no two transitions for the same state and event, a way out of every
+ * target state and of the current state. A dispatch uses the old matrix
+ * or the new one, never a mix, and never waits for the swap. The swap
+ * waits until no lookup uses the old matrix and frees it. A compiled model
+ * (FSM_SetDispatcher()) is removed.
+ *
+ * FSM_LoadModel() reads the transitions from a file, one per line:
+ *
+ *       S_STANDBY  E_RUNNING_START  S_DEFAULT   # comment
+ *
+ * The S_ and E_ prefixes are optional, the first transition is the start.
+ *
+ *    Return value:
+ *
+ *       false and the reason in *error* if the model is not valid
+ */
+bool    FSM_SwapModel(const transition_t *transitions, uint8_t count, char *error, size_t errorSize);
+bool    FSM_LoadModel(const char *path, char *error, size_t errorSize);
+void    FSM_GetModelStats(fsm_model_stats_t *stats);
+void    FSM_GetDispatchStats(fsm_dispatch_stats_t *stats);
+
+/*!
+ * Replaces the lookup in the transition matrix by a compiled model, see
+ * fsm.hpp. dispatch() executes the transition of *event* in *state* like
+ * FSM_EventHandler() does, with FSM_SetState() and the hooks, and returns
+ * true, or returns false if there is no transition. NULL restores the lookup.
+ */
+void    FSM_SetDispatcher(bool (*dispatch)(state_t state, event_t event));
+void    FSM_SetState(state_t newstate);
+void    FSM_CallHandlerHook(state_t state, bool begin);
+void    FSM_CallTransitionHook(state_t from, event_t event, state_t to);
+
+/*!
+ * Sets the capacity of the event queue, rounded up to a power of two, and
+ * the policy when it is full. The capacity can only be changed while the
+ * queue is empty and no other thread adds events, e.g. before
+ * FSM_RunStateMachine(). The policy can be changed at any time.
+ *
+ *    Return value:
+ *
+ *       false if the capacity is out of range, the queue is not empty or
+ *       there is no memory
+ */
+bool    FSM_SetEventQueue(uint32_t capacity, fsm_queue_policy_t policy);
+void    FSM_GetQueueStats(fsm_queue_stats_t *stats);
+
+/*!
+ * Marks *event* as latest value wins, e.g. a setpoint change. While the
+ * event is in the queue, FSM_AddEvent() of the same event returns
+ * FSM_EVENT_COALESCED instead of adding it again. The handler must read
+ * the value when it runs, the events carry no data.
+ */
+void    FSM_SetCoalescing(const event_t event, const bool coalesce);
 
 event_t FSM_GetEvent(void);
 event_t FSM_WaitForEvent(void);
 event_t FSM_PeekForEvent(void);
 bool    FSM_NoEvents(void);
-uint8_t FSM_NofEvents(void);
+uint32_t FSM_NofEvents(void);
 
 void    FSM_RevertModel(void);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // FSM_H_
@@ -0,0 +1,176 @@
+#ifndef FSM_HPP
+#define FSM_HPP
+
+#include "fsm_functions/fsm.h"
+
+//--------------------------------------------------------------------- FSM C++
+
+/// Optional C++17 front end of the FSM: a model that is fixed at build time
+/// is declared as types instead of FSM_AddState() and FSM_AddTransition()
+/// calls.
+///
+///    using Treadmill = fsm::Model<
+///       fsm::States<fsm::State<S_STANDBY, S_standbyOnEntry>,
+///                   fsm::State<S_DEFAULT, S_defaultOnEntry>>,
+///       fsm::Transitions<fsm::Transition<S_STANDBY, E_RUNNING_START, S_DEFAULT>,
+///                        fsm::Transition<S_DEFAULT, E_RUNNING_STOP, S_STANDBY>>>;
+///
+///    Treadmill::install();
+///    FSM_RunStateMachine(S_STANDBY, E_NO);
+///
+/// The compiler rejects a model with two transitions for the same state and
+/// event (a duplicate, or a conflict of which only the first would ever
+/// fire), a state that is declared twice and a transition to or from a
+/// state that is not declared.
+///
+/// Model::dispatch() is a chain of constant compares with the handlers
+/// called directly, no table lookup and no function pointers. install()
+/// makes it the dispatcher of the C FSM (FSM_SetDispatcher()), so the model
+/// is driven with FSM_AddEvent() and FSM_RunStateMachine() as before. The
+/// matrix is also installed, FSM_HasTransition() and FSM_RevertModel() use it.
+
+namespace fsm
+{
+
+using handler_t = void (*)(void);
+
+/// A state with its onEntry() and onExit() handlers, nullptr if none.
+template <state_t Id, handler_t OnEntry = nullptr, handler_t OnExit = nullptr>
+struct State
+{
+   static constexpr state_t id = Id;
+   static constexpr handler_t onEntry = OnEntry;
+   static constexpr handler_t onExit = OnExit;
+};
+
+/// A transition of the model.
+template <state_t From, event_t Event, state_t To>
+struct Transition
+{
+   static constexpr state_t from = From;
+   static constexpr event_t event = Event;
+   static constexpr state_t to = To;
+};
+
+template <typename... S> struct States {};
+template <typename... T> struct Transitions {};
+
+/// Compile time checks of one state and one transition. They are separate
+/// templates, so the compiler names the offending state or transition.
+template <typename St, typename StateList> struct StateCheck;
+
+template <typename St, typename... S>
+struct StateCheck<St, States<S...>>
+{
+   static_assert(St::id < MAX_STATES, "fsm::Model: state out of range (MAX_STATES)");
+   static_assert(((S::id == St::id) + ... + 0) == 1,
+                 "fsm::Model: this state is declared more than once");
+   static constexpr bool ok = true;
+};
+
+template <typename Tr, typename StateList, typename TransitionList> struct TransitionCheck;
+
+template <typename Tr, typename... S, typename... T>
+struct TransitionCheck<Tr, States<S...>, Transitions<T...>>
+{
+   static_assert(((S::id == Tr::from) || ...),
+                 "fsm::Model: the from state of this transition is not declared");
+   static_assert(((S::id == Tr::to) || ...),
+                 "fsm::Model: the to state of this transition is not declared");
+   static_assert(((T::from == Tr::from && T::event == Tr::event) + ... + 0) == 1,
+                 "fsm::Model: more than one transition for the state and event of this "
+                 "transition (duplicate or conflicting)");
+   static constexpr bool ok = true;
+};
+
+template <typename StateList, typename TransitionList> class Model;
+
+template <typename... S, typename... T>
+class Model<States<S...>, Transitions<T...>>
+{
+   static_assert(sizeof...(T) <= MAX_TRANSITIONS, "fsm::Model: too many transitions (MAX_TRANSITIONS)");
+   static_assert((StateCheck<S, States<S...>>::ok && ...));
+   static_assert((TransitionCheck<T, States<S...>, Transitions<T...>>::ok && ...));
+
+   static constexpr handler_t entryOf(state_t state)
+   {
+      handler_t handler = nullptr;
+      ((S::id == state ? (void)(handler = S::onEntry) : (void)0), ...);
+      return handler;
+   }
+
+   static constexpr handler_t exitOf(state_t state)
+   {
+      handler_t handler = nullptr;
+      ((S::id == state ? (void)(handler = S::onExit) : (void)0), ...);
+      return handler;
+   }
+
+   /// The same steps as FSM_EventHandler(), with the handlers known.
+   template <typename Tr>
+   static void execute()
+   {
+      constexpr handler_t onExit = exitOf(Tr::from);
+      constexpr handler_t onEntry = entryOf(Tr::to);
+
+      if constexpr (onExit != nullptr)
+      {
+         FSM_CallHandlerHook(Tr::from, true);
+         onExit();
+         FSM_CallHandlerHook(Tr::from, false);
+      }
+      FSM_SetState(Tr::to);
+      FSM_CallTransitionHook(Tr::from, Tr::event, Tr::to);
+      if constexpr (onEntry != nullptr)
+      {
+         FSM_CallHandlerHook(Tr::to, true);
+         onEntry();
+         FSM_CallHandlerHook(Tr::to, false);
+      }
+   }
+
+   template <typename Tr>
+   static bool fire(state_t state, event_t event)
+   {
+      if (state != Tr::from || event != Tr::event)
+      {
+         return false;
+      }
+      execute<Tr>();
+      return true;
+   }
+
+public:
+   /// \return true if the model has a transition for event in state.
+   static constexpr bool has(state_t state, event_t event)
+   {
+      return ((T::from == state && T::event == event) || ...);
+   }
+
+   /// Executes the transition of event in state.
+   /// \return false if there is none.
+   static bool dispatch(state_t state, event_t event)
+   {
+      return (fire<T>(state, event) || ...);
+   }
+
+   /// Installs the model in the C FSM.
+   static void install()
+   {
+      ([]
+      {
+         const state_funcs_t funcs = {S::onEntry, S::onExit};
+         FSM_AddState(S::id, &funcs);
+      }(), ...);
+      ([]
+      {
+         const transition_t transition = {T::from, T::event, T::to};
+         FSM_AddTransition(&transition);
+      }(), ...);
+      FSM_SetDispatcher(dispatch);
+   }
+};
+
+}
+
+#endif
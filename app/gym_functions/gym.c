@@ -0,0 +1,400 @@
+#define _GNU_SOURCE
+#include "gym.h"
+#include "clock_functions/clock.h"
+#include "ipc_functions/ipc.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//-------------------------------------------------------------------------- GYM
+
+/// One batch: the datagram, its header and frames.
+typedef struct
+{
+   size_t length;                ///< Bytes of the datagram
+   gymHeader_t header;
+   uint8_t frames[GYM_MAX_DATAGRAM - sizeof(gymHeader_t)];
+} gymQueued_t;
+
+/// Closed batches and the open one (the last), guarded by mutex.
+static gymQueued_t queue[GYM_MAX_BATCHES + 1];
+static int nClosed = 0;
+static uint32_t sequence = 0;
+static unsigned int machine = 0;
+static bool started = false;          ///< Between GYMinitialise() and GYMclose()
+static gymStats_t stats;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int sock = -1;
+static uint64_t connectNs = 0;      ///< CLKrealNs() of the last connect
+static clkTimer_t timer;
+static uint32_t ticks = 0;
+static void (*telemetrySample)(gymTelemetryFrame_t *frame) = NULL;
+
+/// Starts the open batch with its header. Caller holds the mutex.
+static void openBatch(void)
+{
+   gymQueued_t *q = &queue[nClosed];
+
+   q->header = (gymHeader_t){.magic = GYM_MAGIC, .machineId = machine};
+   q->length = sizeof(q->header);
+}
+
+#ifdef __linux__
+
+/// Connects to the aggregator, at most once a second. Caller holds the mutex.
+static bool connectAggregator(void)
+{
+   struct sockaddr_un addr;
+   socklen_t length = IPCsocketAddress(&addr, GYM_SOCKET_NAME, 0);
+   uint64_t now = CLKrealNs();
+
+   if (sock >= 0)
+   {
+      return true;
+   }
+   if (connectNs != 0 && now - connectNs < CLK_NS_PER_S)
+   {
+      return false;
+   }
+   connectNs = now;
+
+   sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+   if (sock >= 0 && connect(sock, (struct sockaddr *)&addr, length) != 0)
+   {
+      close(sock);
+      sock = -1;
+   }
+   stats.connected = (sock >= 0);
+   return stats.connected;
+}
+
+/// Sends the closed batches with sendmmsg(). Caller holds the mutex.
+static void sendClosed(void)
+{
+   struct mmsghdr msgs[GYM_MAX_BATCHES + 1];
+   struct iovec iov[GYM_MAX_BATCHES + 1];
+   int sent = 0;
+
+   if (nClosed == 0)
+   {
+      return;
+   }
+   if (!connectAggregator())
+   {
+      for (int i = 0; i < nClosed; i++)
+      {
+         stats.dropped += queue[i].header.nFrames;
+      }
+      sent = nClosed;
+   }
+
+   memset(msgs, 0, sizeof(msgs));
+   for (int i = 0; i < nClosed; i++)
+   {
+      iov[i] = (struct iovec){.iov_base = &queue[i].header, .iov_len = queue[i].length};
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+   }
+   while (sent < nClosed)
+   {
+      int n = sendmmsg(sock, msgs + sent, (unsigned int)(nClosed - sent), 0);
+
+      stats.sendCalls++;
+      if (n <= 0)
+      {
+         // Full receive buffer (EAGAIN) or the aggregator stopped: drop
+         for (int i = sent; i < nClosed; i++)
+         {
+            stats.dropped += queue[i].header.nFrames;
+         }
+         if (n < 0 && errno != EAGAIN)
+         {
+            close(sock);
+            sock = -1;
+            stats.connected = false;
+         }
+         break;
+      }
+      for (int i = sent; i < sent + n; i++)
+      {
+         stats.datagrams++;
+         stats.bytes += queue[i].length;
+      }
+      sent += n;
+   }
+
+   // The open batch moves to the front
+   if (nClosed > 0)
+   {
+      memcpy(&queue[0], &queue[nClosed],
+             offsetof(gymQueued_t, header) + queue[nClosed].length);
+      nClosed = 0;
+   }
+}
+
+#else
+
+static void sendClosed(void)
+{
+   for (int i = 0; i < nClosed; i++)
+   {
+      stats.dropped += queue[i].header.nFrames;
+   }
+   memcpy(&queue[0], &queue[nClosed], sizeof(queue[0]));
+   nClosed = 0;
+}
+
+#endif
+
+/// Closes the open batch if it has frames. Caller holds the mutex.
+static void closeBatch(void)
+{
+   gymQueued_t *q = &queue[nClosed];
+
+   if (q->header.nFrames == 0)
+   {
+      return;
+   }
+   q->header.sequence = sequence++;
+   nClosed++;
+   openBatch();
+}
+
+void GYMaddFrame(gymFrameType_t type, const void *payload, uint16_t length)
+{
+   gymFrame_t frame = {.length = length, .type = (uint8_t)type};
+   size_t size = sizeof(frame) + length;
+
+   if (size > GYM_MAX_DATAGRAM - sizeof(gymHeader_t))
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&mutex);
+   if (!started)
+   {
+      // No batch is open, e.g. a script run without the aggregator link
+      pthread_mutex_unlock(&mutex);
+      return;
+   }
+   gymQueued_t *q = &queue[nClosed];
+   if (q->length + size > GYM_MAX_DATAGRAM)
+   {
+      closeBatch();
+      if (nClosed == GYM_MAX_BATCHES)
+      {
+         // The timer is late, send now instead of dropping
+         sendClosed();
+      }
+      q = &queue[nClosed];
+   }
+   uint8_t *p = q->frames + (q->length - sizeof(q->header));
+   memcpy(p, &frame, sizeof(frame));
+   memcpy(p + sizeof(frame), payload, length);
+   q->length += size;
+   q->header.nFrames++;
+   stats.frames++;
+   pthread_mutex_unlock(&mutex);
+}
+
+void GYMstateChange(uint8_t from, uint8_t event, uint8_t to)
+{
+   gymStateFrame_t frame =
+   {
+      .timeNs = CLKnowNs(),
+      .from = from,
+      .event = event,
+      .to = to,
+   };
+
+   GYMaddFrame(GYM_FRAME_STATE, &frame, sizeof(frame));
+}
+
+void GYMflush(void)
+{
+   pthread_mutex_lock(&mutex);
+   closeBatch();
+   sendClosed();
+   pthread_mutex_unlock(&mutex);
+}
+
+/// Clock timer: telemetry frame and sending.
+static void flushTick(void *ctx, uint64_t dueNs)
+{
+   (void)ctx;
+   (void)dueNs;
+
+   if (telemetrySample != NULL &&
+       ticks++ % (GYM_TELEMETRY_INTERVAL_MS / GYM_FLUSH_INTERVAL_MS) == 0)
+   {
+      gymTelemetryFrame_t frame = {.timeNs = CLKnowNs()};
+
+      telemetrySample(&frame);
+      GYMaddFrame(GYM_FRAME_TELEMETRY, &frame, sizeof(frame));
+   }
+   GYMflush();
+}
+
+bool GYMinitialise(unsigned int machineId,
+                   void (*telemetry)(gymTelemetryFrame_t *frame))
+{
+   bool connected;
+
+   pthread_mutex_lock(&mutex);
+   machine = machineId;
+   nClosed = 0;
+   openBatch();
+   started = true;
+#ifdef __linux__
+   connected = connectAggregator();
+#else
+   connected = false;
+#endif
+   pthread_mutex_unlock(&mutex);
+
+   telemetrySample = telemetry;
+   CLKtimerStart(&timer, GYM_FLUSH_INTERVAL_MS * CLK_NS_PER_MS,
+                 GYM_FLUSH_INTERVAL_MS * CLK_NS_PER_MS, flushTick, NULL);
+   return connected;
+}
+
+void GYMclose(void)
+{
+   CLKtimerStop(&timer);
+   GYMflush();
+
+   pthread_mutex_lock(&mutex);
+#ifdef __linux__
+   if (sock >= 0)
+   {
+      close(sock);
+      sock = -1;
+   }
+#endif
+   stats.connected = false;
+   started = false;
+   pthread_mutex_unlock(&mutex);
+}
+
+void GYMgetStats(gymStats_t *s)
+{
+   pthread_mutex_lock(&mutex);
+   *s = stats;
+   pthread_mutex_unlock(&mutex);
+}
+
+const uint8_t *GYMnextFrame(const uint8_t datagram[], size_t length,
+                            size_t *offset, gymFrame_t *frame)
+{
+   if (*offset == 0)
+   {
+      gymHeader_t header;
+
+      if (length < sizeof(header))
+      {
+         return NULL;
+      }
+      memcpy(&header, datagram, sizeof(header));
+      if (header.magic != GYM_MAGIC)
+      {
+         return NULL;
+      }
+      *offset = sizeof(header);
+   }
+   if (*offset + sizeof(*frame) > length)
+   {
+      return NULL;
+   }
+   memcpy(frame, datagram + *offset, sizeof(*frame));
+   if (*offset + sizeof(*frame) + frame->length > length)
+   {
+      return NULL;
+   }
+
+   const uint8_t *payload = datagram + *offset + sizeof(*frame);
+   *offset += sizeof(*frame) + frame->length;
+   return payload;
+}
+
+#ifdef __linux__
+
+int GYMserverOpen(void)
+{
+   struct sockaddr_un addr;
+   socklen_t length = IPCsocketAddress(&addr, GYM_SOCKET_NAME, 0);
+   int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+   int size = 4 * 1024 * 1024;
+
+   if (fd < 0)
+   {
+      return -1;
+   }
+   // Room for the bursts of many treadmills
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+   if (bind(fd, (struct sockaddr *)&addr, length) != 0)
+   {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+int GYMreceive(int fd, gymBatch_t *batch, int timeoutMs)
+{
+   struct mmsghdr msgs[GYM_RECEIVE_BATCH];
+   struct iovec iov[GYM_RECEIVE_BATCH];
+   struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+   batch->count = 0;
+   int ready = poll(&pfd, 1, timeoutMs);
+   if (ready <= 0)
+   {
+      return (ready < 0 && errno != EINTR) ? -1 : 0;
+   }
+
+   memset(msgs, 0, sizeof(msgs));
+   for (int i = 0; i < GYM_RECEIVE_BATCH; i++)
+   {
+      iov[i] = (struct iovec){.iov_base = batch->data[i], .iov_len = GYM_MAX_DATAGRAM};
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+   }
+   int n = recvmmsg(fd, msgs, GYM_RECEIVE_BATCH, MSG_DONTWAIT, NULL);
+   if (n < 0)
+   {
+      return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+   }
+   for (int i = 0; i < n; i++)
+   {
+      batch->length[i] = msgs[i].msg_len;
+   }
+   batch->count = n;
+   return n;
+}
+
+#else
+
+int GYMserverOpen(void)
+{
+   return -1;
+}
+
+int GYMreceive(int fd, gymBatch_t *batch, int timeoutMs)
+{
+   (void)fd;
+   (void)timeoutMs;
+   batch->count = 0;
+   return -1;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef GYM_H
+#define GYM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//-------------------------------------------------------------------------- GYM
+
+/// Gym link: the treadmills of a gym report to one aggregator process
+/// (tools/gymaggregator) over the UNIX datagram socket GYM_SOCKET_NAME.
+///
+/// A datagram is a batch: a gymHeader_t followed by frames, each frame is a
+/// gymFrame_t with the length of its payload. The treadmill adds frames to
+/// the open batch and a clock timer sends all closed batches every
+/// GYM_FLUSH_INTERVAL_MS with one sendmmsg() call. The aggregator receives
+/// up to GYM_RECEIVE_BATCH datagrams with one recvmmsg() call.
+/// Integers are in host byte order, both ends run on the same machine.
+///
+/// Without an aggregator the frames are dropped; the treadmill connects
+/// again once a second, an aggregator may start later. The treadmill never
+/// waits for the aggregator: when its socket queue is full (Linux queues
+/// net.unix.max_dgram_qlen datagrams, 10 by default) the frames are dropped
+/// and counted.
+
+#define GYM_SOCKET_NAME        "fsm-treadmill-gym"  ///< Abstract socket
+#define GYM_MAGIC              (0x314D5947u)        ///< "GYM1" in memory order
+#define GYM_MAX_DATAGRAM       (4096)  ///< Bytes of one batch
+#define GYM_MAX_BATCHES        (16)    ///< Batches waiting for the timer
+#define GYM_RECEIVE_BATCH      (64)    ///< Datagrams per GYMreceive()
+#define GYM_FLUSH_INTERVAL_MS  (100)   ///< Send interval of the batches
+#define GYM_TELEMETRY_INTERVAL_MS (1000)  ///< Telemetry frame interval
+
+/// Header of a datagram.
+typedef struct
+{
+   uint32_t magic;
+   uint32_t machineId;
+   uint32_t sequence;      ///< Datagram number, a gap is a lost datagram
+   uint32_t nFrames;
+} gymHeader_t;
+
+typedef enum {
+   GYM_FRAME_STATE = 1,    ///< gymStateFrame_t
+   GYM_FRAME_TELEMETRY,    ///< gymTelemetryFrame_t
+} gymFrameType_t;
+
+/// Frame header, the payload of length bytes follows.
+typedef struct
+{
+   uint16_t length;
+   uint8_t type;           ///< gymFrameType_t
+   uint8_t reserved;
+} gymFrame_t;
+
+/// State change of the FSM.
+typedef struct
+{
+   uint64_t timeNs;        ///< CLKnowNs() of the transition
+   uint8_t from;           ///< state_t
+   uint8_t event;          ///< event_t
+   uint8_t to;             ///< state_t
+   uint8_t reserved;
+} gymStateFrame_t;
+
+/// Measured values, in HAL register units.
+typedef struct
+{
+   uint64_t timeNs;
+   int32_t speed;          ///< 0.01 km/h
+   int32_t incline;        ///< 0.01 %
+   int32_t distance;       ///< mm
+   uint32_t errorBits;     ///< System error bits
+   uint8_t state;          ///< state_t
+   uint8_t reserved[7];
+} gymTelemetryFrame_t;
+
+/// Treadmill counters.
+typedef struct
+{
+   uint64_t frames;        ///< Frames added
+   uint64_t datagrams;     ///< Datagrams sent
+   uint64_t sendCalls;     ///< sendmmsg() calls
+   uint64_t dropped;       ///< Frames dropped: no aggregator or queue full
+   uint64_t bytes;         ///< Bytes sent
+   bool connected;
+} gymStats_t;
+
+/// Datagrams of one GYMreceive() call.
+typedef struct
+{
+   int count;
+   size_t length[GYM_RECEIVE_BATCH];
+   uint8_t data[GYM_RECEIVE_BATCH][GYM_MAX_DATAGRAM];
+} gymBatch_t;
+
+//------------------------------------------------------------------- treadmill
+
+/// Starts the link of machineId: connects to the aggregator and starts the
+/// flush timer. If telemetry is not NULL, the timer calls it every
+/// GYM_TELEMETRY_INTERVAL_MS (in the clock thread) to fill a telemetry frame.
+/// \return false if no aggregator runs yet.
+bool GYMinitialise(unsigned int machineId,
+                   void (*telemetry)(gymTelemetryFrame_t *frame));
+
+/// Stops the timer, sends the frames and closes the socket.
+void GYMclose(void);
+
+/// Adds a state change frame. Any thread may add frames.
+void GYMstateChange(uint8_t from, uint8_t event, uint8_t to);
+
+/// Adds a frame of type with payload. Frames are ignored outside
+/// GYMinitialise() and GYMclose().
+void GYMaddFrame(gymFrameType_t type, const void *payload, uint16_t length);
+
+/// Sends the closed batches and the open one now.
+void GYMflush(void);
+
+/// Copies the counters in stats.
+void GYMgetStats(gymStats_t *stats);
+
+//------------------------------------------------------------------ aggregator
+
+/// Creates the aggregator socket.
+/// \return the socket, -1 if the name is in use or on an error.
+int GYMserverOpen(void);
+
+/// Receives up to GYM_RECEIVE_BATCH datagrams, waits at most timeoutMs for
+/// the first one.
+/// \return the number of datagrams, 0 at a timeout, -1 on an error.
+int GYMreceive(int fd, gymBatch_t *batch, int timeoutMs);
+
+/// Iterates the frames of a datagram, start with *offset 0. The header of
+/// the next frame is copied in frame, the payload may be unaligned.
+/// \return the payload of the next frame, NULL at the end or if the datagram
+/// is corrupt.
+const uint8_t *GYMnextFrame(const uint8_t datagram[], size_t length,
+                            size_t *offset, gymFrame_t *frame);
+
+#endif
@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include "hal.h"
+#include "clock_functions/clock.h"
+#include "ipc_functions/ipc.h"
+#include "simulation_functions/physics.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//-------------------------------------------------------------------------- HAL
+
+/// Local register file, used without a hardware simulator.
+static halRegisterFile_t localRegisters;
+static halRegisterFile_t *registers = &localRegisters;
+static bool external = false;
+
+static void (*irqHandler)(uint32_t irqBits) = NULL;
+
+static _Atomic uint64_t nReads = 0;
+static _Atomic uint64_t nWrites = 0;
+static _Atomic uint64_t nDoorbells = 0;
+static _Atomic uint64_t nInterrupts = 0;
+static _Atomic uint64_t irqLatencySumNs = 0;
+static _Atomic uint64_t irqLatencyMaxNs = 0;
+
+static int doorbellFd = -1;
+static int irqFd = -1;
+static pthread_t irqThread;
+static atomic_bool irqRunning = false;
+
+/// Device side.
+static halRegisterFile_t *deviceRegisters = NULL;
+static int deviceMemFd = -1;
+static int deviceDoorbellFd = -1;
+static int deviceIrqFd = -1;
+static int deviceListenFd = -1;
+
+static uint32_t toFixed(double value, double scale)
+{
+   return (uint32_t)(int32_t)lround(value * scale);
+}
+
+/// Without a hardware simulator the belt simulation plays the devices:
+/// refreshes a device register before it is read.
+static void localRead(halRegister_t reg)
+{
+   phyState_t belt;
+
+   if (reg != HAL_REG_SPEED && reg != HAL_REG_INCLINE && reg != HAL_REG_DISTANCE)
+   {
+      return;
+   }
+   PHYgetState(&belt);
+   atomic_store_explicit(&registers->reg[HAL_REG_SPEED],
+                         toFixed(belt.speed, 100.0), memory_order_relaxed);
+   atomic_store_explicit(&registers->reg[HAL_REG_INCLINE],
+                         toFixed(belt.incline, 100.0), memory_order_relaxed);
+   atomic_store_explicit(&registers->reg[HAL_REG_DISTANCE],
+                         (uint32_t)llround(belt.distance * 1000.0),
+                         memory_order_relaxed);
+}
+
+/// Applies a command register write to the belt simulation.
+static void localWrite(halRegister_t reg, uint32_t value)
+{
+   switch (reg)
+   {
+   case HAL_REG_SPEED_CMD:
+   case HAL_REG_INCLINE_CMD:
+      PHYsetTarget((int32_t)atomic_load(&registers->reg[HAL_REG_SPEED_CMD]) / 100.0f,
+                   (int32_t)atomic_load(&registers->reg[HAL_REG_INCLINE_CMD]) / 100.0f);
+      break;
+   case HAL_REG_BRAKE_CMD:
+      atomic_store(&registers->reg[HAL_REG_BRAKE], value ? 1u : 0u);
+      break;
+   case HAL_REG_DISTANCE_CMD:
+      PHYsetDistance(value / 1000.0);
+      break;
+   case HAL_REG_ECHO_CMD:
+      atomic_store(&registers->reg[HAL_REG_ECHO], value);
+      break;
+   default:
+      break;
+   }
+}
+
+uint32_t HALread(halRegister_t reg)
+{
+   atomic_fetch_add_explicit(&nReads, 1, memory_order_relaxed);
+   if (!external)
+   {
+      localRead(reg);
+   }
+   return atomic_load_explicit(&registers->reg[reg], memory_order_acquire);
+}
+
+void HALwrite(halRegister_t reg, uint32_t value)
+{
+   atomic_fetch_add_explicit(&nWrites, 1, memory_order_relaxed);
+   atomic_store_explicit(&registers->reg[reg], value, memory_order_release);
+
+   if (reg > HAL_REG_ECHO_CMD)
+   {
+      return;
+   }
+   if (!external)
+   {
+      localWrite(reg, value);
+      return;
+   }
+#ifdef __linux__
+   uint64_t one = 1;
+   atomic_fetch_or(&registers->reg[HAL_REG_CMD_PENDING], 1u << reg);
+   if (write(doorbellFd, &one, sizeof(one)) == sizeof(one))
+   {
+      atomic_fetch_add_explicit(&nDoorbells, 1, memory_order_relaxed);
+   }
+#endif
+}
+
+void HALsetIrqHandler(void (*handler)(uint32_t irqBits))
+{
+   irqHandler = handler;
+}
+
+void HALgetStats(halStats_t *stats)
+{
+   stats->reads = atomic_load(&nReads);
+   stats->writes = atomic_load(&nWrites);
+   stats->doorbells = atomic_load(&nDoorbells);
+   stats->interrupts = atomic_load(&nInterrupts);
+   stats->irqLatencySumNs = atomic_load(&irqLatencySumNs);
+   stats->irqLatencyMaxNs = atomic_load(&irqLatencyMaxNs);
+   stats->external = external;
+}
+
+#ifdef __linux__
+
+static void *interruptThread(void *arg)
+{
+   struct pollfd pfd = {.fd = irqFd, .events = POLLIN};
+   uint64_t count;
+
+   (void)arg;
+   while (atomic_load(&irqRunning))
+   {
+      if (poll(&pfd, 1, 100) <= 0 || read(irqFd, &count, sizeof(count)) < 0)
+      {
+         continue;
+      }
+      uint32_t bits = atomic_exchange(&registers->reg[HAL_REG_IRQ], 0);
+      if (bits == 0)
+      {
+         continue;
+      }
+
+      // The simulator stamps the interrupt with the system wide monotonic clock
+      uint64_t stamp =
+         (uint64_t)atomic_load(&registers->reg[HAL_REG_IRQ_TIME_HI]) << 32 |
+         atomic_load(&registers->reg[HAL_REG_IRQ_TIME_LO]);
+      uint64_t latency = CLKrealNs() - stamp;
+
+      atomic_fetch_add(&nInterrupts, 1);
+      atomic_fetch_add(&irqLatencySumNs, latency);
+      if (latency > atomic_load(&irqLatencyMaxNs))
+      {
+         atomic_store(&irqLatencyMaxNs, latency);
+      }
+      if (irqHandler != NULL)
+      {
+         irqHandler(bits);
+      }
+   }
+   return NULL;
+}
+
+bool HALinitialise(unsigned int machineId)
+{
+   struct sockaddr_un addr;
+   socklen_t length = IPCsocketAddress(&addr, HAL_SOCKET_NAME, machineId);
+   int fds[3];
+   char data;
+   char control[CMSG_SPACE(sizeof(fds))];
+   struct iovec iov = {.iov_base = &data, .iov_len = 1};
+   struct msghdr msg =
+   {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+   };
+
+   int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (sock < 0)
+   {
+      return false;
+   }
+   if (connect(sock, (struct sockaddr *)&addr, length) != 0 ||
+       recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+   {
+      // No hardware simulator, the local registers stay in use
+      close(sock);
+      return false;
+   }
+   close(sock);
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+   {
+      return false;
+   }
+   memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+   void *p = mmap(NULL, sizeof(halRegisterFile_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fds[0], 0);
+   close(fds[0]);
+   halRegisterFile_t *file = p;
+   if (p == MAP_FAILED || file->magic != HAL_MAGIC ||
+       file->size != sizeof(halRegisterFile_t))
+   {
+      if (p != MAP_FAILED)
+      {
+         munmap(p, sizeof(halRegisterFile_t));
+      }
+      close(fds[1]);
+      close(fds[2]);
+      return false;
+   }
+
+   registers = file;
+   doorbellFd = fds[1];
+   irqFd = fds[2];
+   external = true;
+
+   atomic_store(&irqRunning, true);
+   if (pthread_create(&irqThread, NULL, interruptThread, NULL) != 0)
+   {
+      atomic_store(&irqRunning, false);
+   }
+   return true;
+}
+
+void HALclose(void)
+{
+   if (!external)
+   {
+      return;
+   }
+   if (atomic_exchange(&irqRunning, false))
+   {
+      pthread_join(irqThread, NULL);
+   }
+   munmap(registers, sizeof(halRegisterFile_t));
+   close(doorbellFd);
+   close(irqFd);
+   registers = &localRegisters;
+   external = false;
+}
+
+halRegisterFile_t *HALdeviceCreate(unsigned int machineId)
+{
+   struct sockaddr_un addr;
+   socklen_t length = IPCsocketAddress(&addr, HAL_SOCKET_NAME, machineId);
+
+   deviceMemFd = memfd_create("fsm-treadmill-hal", MFD_CLOEXEC);
+   if (deviceMemFd < 0 ||
+       ftruncate(deviceMemFd, sizeof(halRegisterFile_t)) != 0)
+   {
+      HALdeviceClose();
+      return NULL;
+   }
+   void *p = mmap(NULL, sizeof(halRegisterFile_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, deviceMemFd, 0);
+   if (p == MAP_FAILED)
+   {
+      HALdeviceClose();
+      return NULL;
+   }
+   deviceRegisters = p;
+   deviceRegisters->size = sizeof(halRegisterFile_t);
+   deviceRegisters->magic = HAL_MAGIC;
+
+   deviceDoorbellFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   deviceIrqFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   deviceListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (deviceDoorbellFd < 0 || deviceIrqFd < 0 || deviceListenFd < 0 ||
+       bind(deviceListenFd, (struct sockaddr *)&addr, length) != 0 ||
+       listen(deviceListenFd, 8) != 0)
+   {
+      HALdeviceClose();
+      return NULL;
+   }
+   return deviceRegisters;
+}
+
+/// Hands the register file and the eventfds to a new treadmill.
+static void deviceAccept(void)
+{
+   const int fds[3] = {deviceMemFd, deviceDoorbellFd, deviceIrqFd};
+   char data = 'H';
+   char control[CMSG_SPACE(sizeof(fds))];
+   struct iovec iov = {.iov_base = &data, .iov_len = 1};
+   struct msghdr msg =
+   {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+   };
+
+   int sock = accept4(deviceListenFd, NULL, NULL, SOCK_CLOEXEC);
+   if (sock < 0)
+   {
+      return;
+   }
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+   if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1)
+   {
+      perror("HAL: sendmsg");
+   }
+   close(sock);
+}
+
+uint32_t HALdeviceWait(int timeoutMs)
+{
+   struct pollfd pfd[2] =
+   {
+      {.fd = deviceListenFd, .events = POLLIN},
+      {.fd = deviceDoorbellFd, .events = POLLIN},
+   };
+   uint64_t count;
+
+   if (poll(pfd, 2, timeoutMs) <= 0)
+   {
+      return 0;
+   }
+   if (pfd[0].revents & POLLIN)
+   {
+      deviceAccept();
+   }
+   if ((pfd[1].revents & POLLIN) == 0 ||
+       read(deviceDoorbellFd, &count, sizeof(count)) != sizeof(count))
+   {
+      return 0;
+   }
+   return atomic_exchange(&deviceRegisters->reg[HAL_REG_CMD_PENDING], 0);
+}
+
+void HALdeviceInterrupt(uint32_t irqBits)
+{
+   uint64_t now = CLKrealNs();
+   uint64_t one = 1;
+
+   atomic_store(&deviceRegisters->reg[HAL_REG_IRQ_TIME_LO], (uint32_t)now);
+   atomic_store(&deviceRegisters->reg[HAL_REG_IRQ_TIME_HI], (uint32_t)(now >> 32));
+   atomic_fetch_or(&deviceRegisters->reg[HAL_REG_IRQ], irqBits);
+   if (write(deviceIrqFd, &one, sizeof(one)) != sizeof(one))
+   {
+      perror("HAL: interrupt");
+   }
+}
+
+void HALdeviceClose(void)
+{
+   int *fds[] = {&deviceMemFd, &deviceDoorbellFd, &deviceIrqFd, &deviceListenFd};
+
+   if (deviceRegisters != NULL)
+   {
+      munmap(deviceRegisters, sizeof(halRegisterFile_t));
+      deviceRegisters = NULL;
+   }
+   for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+   {
+      if (*fds[i] >= 0)
+      {
+         close(*fds[i]);
+         *fds[i] = -1;
+      }
+   }
+}
+
+#else
+
+bool HALinitialise(unsigned int machineId)
+{
+   (void)machineId;
+   return false;
+}
+
+void HALclose(void)
+{
+}
+
+halRegisterFile_t *HALdeviceCreate(unsigned int machineId)
+{
+   (void)machineId;
+   return NULL;
+}
+
+uint32_t HALdeviceWait(int timeoutMs)
+{
+   (void)timeoutMs;
+   return false;
+}
+
+void HALdeviceInterrupt(uint32_t irqBits)
+{
+   (void)irqBits;
+}
+
+void HALdeviceClose(void)
+{
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//-------------------------------------------------------------------------- HAL
+
+/// Hardware Abstraction Layer: the motor, brake and button I/O as a register
+/// file.
+///
+/// With a hardware simulator (tools/hwsim) the register file is a shared
+/// memory segment of the simulator. HALinitialise() connects to the UNIX
+/// socket of the simulator and receives the segment and two eventfds with
+/// SCM_RIGHTS: a doorbell that HALwrite() rings after a command register
+/// write, and an interrupt line that the simulator signals when it sets bits
+/// in HAL_REG_IRQ. Without a simulator the registers are local and the belt
+/// simulation of this process plays the devices.
+///
+/// Values are fixed point: speed in 0.01 km/h, incline in 0.01 % (signed),
+/// distance in mm.
+
+#define HAL_MAGIC       (0x314C4148u)              ///< "HAL1" in memory order
+#define HAL_SOCKET_NAME "fsm-treadmill-hal-%u"     ///< Abstract socket per machine
+#define HAL_NAME_SIZE   (32)
+
+/// Registers. CMD registers are written by the treadmill, the others by the
+/// devices.
+typedef enum {
+   HAL_REG_SPEED_CMD,      ///< Band speed motor command
+   HAL_REG_INCLINE_CMD,    ///< Incline motor command
+   HAL_REG_BRAKE_CMD,      ///< 1 engages the emergency brake
+   HAL_REG_DISTANCE_CMD,   ///< Odometer preset, applied on the doorbell
+   HAL_REG_ECHO_CMD,       ///< Copied to HAL_REG_ECHO, raises HAL_IRQ_ECHO
+   HAL_REG_CMD_PENDING,    ///< Bit (1 << reg) per written command register
+   HAL_REG_SPEED,          ///< Measured belt speed
+   HAL_REG_INCLINE,        ///< Measured incline
+   HAL_REG_BRAKE,          ///< 1 if the brake is engaged
+   HAL_REG_DISTANCE,       ///< Odometer
+   HAL_REG_BUTTONS,        ///< HAL_BUTTON_* bits
+   HAL_REG_ECHO,
+   HAL_REG_IRQ,            ///< Pending HAL_IRQ_* bits, cleared by the HAL
+   HAL_REG_IRQ_TIME_LO,    ///< CLOCK_MONOTONIC ns of the last interrupt
+   HAL_REG_IRQ_TIME_HI,
+   HAL_NOF_REGISTERS
+} halRegister_t;
+
+#define HAL_BUTTON_EMERGENCY (1u << 0)
+
+#define HAL_IRQ_BUTTON       (1u << 0)   ///< HAL_REG_BUTTONS changed
+#define HAL_IRQ_ECHO         (1u << 1)   ///< HAL_REG_ECHO written
+
+/// Shared memory layout of the register file.
+typedef struct
+{
+   uint32_t magic;
+   uint32_t size;                               ///< sizeof(halRegisterFile_t)
+   _Atomic uint32_t reg[HAL_NOF_REGISTERS];
+} halRegisterFile_t;
+
+/// I/O counters of the treadmill side.
+typedef struct
+{
+   uint64_t reads;
+   uint64_t writes;
+   uint64_t doorbells;      ///< Doorbell notifications sent
+   uint64_t interrupts;     ///< Interrupt notifications received
+   uint64_t irqLatencySumNs; ///< Device interrupt to handler call
+   uint64_t irqLatencyMaxNs;
+   bool external;           ///< Connected to a hardware simulator
+} halStats_t;
+
+/// Connects to the hardware simulator of machineId, or uses the local
+/// registers and the belt simulation when there is none.
+/// \return true if connected to a hardware simulator.
+bool HALinitialise(unsigned int machineId);
+
+/// Disconnects and stops the interrupt thread.
+void HALclose(void);
+
+/// Reads a register.
+uint32_t HALread(halRegister_t reg);
+
+/// Writes a register. A command register write marks the register in
+/// HAL_REG_CMD_PENDING and rings the doorbell.
+void HALwrite(halRegister_t reg, uint32_t value);
+
+/// Sets the interrupt handler. It is called in the interrupt thread with
+/// the pending HAL_IRQ_* bits.
+void HALsetIrqHandler(void (*handler)(uint32_t irqBits));
+
+/// Copies the I/O counters in stats.
+void HALgetStats(halStats_t *stats);
+
+/// Device side, used by the hardware simulator.
+
+/// Creates the register file, the eventfds and the socket of machineId.
+/// \return the register file, NULL on failure.
+halRegisterFile_t *HALdeviceCreate(unsigned int machineId);
+
+/// Serves new connections and waits at most timeoutMs for the doorbell.
+/// \return the HAL_REG_CMD_PENDING bits, 0 on a time-out.
+uint32_t HALdeviceWait(int timeoutMs);
+
+/// Sets irqBits in HAL_REG_IRQ and signals the interrupt line.
+void HALdeviceInterrupt(uint32_t irqBits);
+
+/// Removes the socket and releases the register file.
+void HALdeviceClose(void);
+
+#endif
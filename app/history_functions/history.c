@@ -0,0 +1,415 @@
+#define _GNU_SOURCE
+#include "history.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//---------------------------------------------------------------------- HiSTory
+
+_Static_assert(sizeof(hstSession_t) == 64, "hstSession_t is part of the file format");
+
+/// File header, the records start at HST_HEADER_SIZE.
+typedef struct
+{
+   char magic[8];
+   uint32_t recordSize;
+   uint32_t maxUsers;
+   _Atomic uint64_t count;                      ///< Complete records
+   _Atomic uint32_t lastUser[HST_MAX_USERS];    ///< Index + 1 of the last session per user
+} hstHeader_t;
+
+#define HST_PAGE_SIZE   (4096)
+#define HST_HEADER_SIZE ((sizeof(hstHeader_t) + HST_PAGE_SIZE - 1) / HST_PAGE_SIZE * HST_PAGE_SIZE)
+
+static int fd = -1;
+static bool writable = false;
+static hstHeader_t *header = NULL;
+static hstSession_t *records = NULL;
+static size_t mapSize = 0;
+static uint64_t capacity = 0;      ///< Records in the mapping
+
+uint32_t HSTpace(uint32_t distanceMm, uint32_t durationMs)
+{
+   if (distanceMm < HST_PACE_MIN_DISTANCE)
+   {
+      return HST_NO_PACE;
+   }
+   uint64_t pace = (uint64_t)durationMs * 1000000u / distanceMm;
+   return (pace < HST_NO_PACE) ? (uint32_t)pace : HST_NO_PACE - 1;
+}
+
+/// Lowest set bit of the 1 based index j, the size of its Fenwick range.
+static uint64_t lowbit(uint64_t j)
+{
+   return j & (~j + 1);
+}
+
+#ifdef __linux__
+
+/// Maps size bytes of the file, replacing a previous mapping.
+static bool map(size_t size)
+{
+   void *m;
+
+   if (header == NULL)
+   {
+      m = mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+   }
+   else
+   {
+      m = mremap(header, mapSize, size, MREMAP_MAYMOVE);
+   }
+   if (m == MAP_FAILED)
+   {
+      return false;
+   }
+   header = m;
+   records = (hstSession_t *)((char *)m + HST_HEADER_SIZE);
+   mapSize = size;
+   capacity = (size - HST_HEADER_SIZE) / sizeof(hstSession_t);
+   return true;
+}
+
+/// Reader: maps the records that another process appended since.
+static void follow(uint64_t count)
+{
+   struct stat st;
+
+   if (count > capacity && fstat(fd, &st) == 0 && (size_t)st.st_size > mapSize)
+   {
+      map((size_t)st.st_size);
+   }
+}
+
+bool HSTopen(const char path[], bool writer)
+{
+   struct stat st;
+
+   HSTclose();
+   writable = writer;
+   fd = open(path, writer ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+   if (fd < 0)
+   {
+      return false;
+   }
+   // One writer, the readers do not lock
+   if ((writer && flock(fd, LOCK_EX | LOCK_NB) != 0) || fstat(fd, &st) != 0)
+   {
+      HSTclose();
+      return false;
+   }
+
+   bool created = (st.st_size == 0);
+   if (created)
+   {
+      st.st_size = (off_t)(HST_HEADER_SIZE + HST_GROW_RECORDS * sizeof(hstSession_t));
+      if (!writer || ftruncate(fd, st.st_size) != 0)
+      {
+         HSTclose();
+         return false;
+      }
+   }
+   if ((size_t)st.st_size < HST_HEADER_SIZE || !map((size_t)st.st_size))
+   {
+      HSTclose();
+      return false;
+   }
+   if (created)
+   {
+      memcpy(header->magic, HST_MAGIC, sizeof(header->magic));
+      header->recordSize = sizeof(hstSession_t);
+      header->maxUsers = HST_MAX_USERS;
+   }
+   // The writer appends at count, the records before it must be in the file
+   if (memcmp(header->magic, HST_MAGIC, sizeof(header->magic)) != 0 ||
+       header->recordSize != sizeof(hstSession_t) || header->maxUsers != HST_MAX_USERS ||
+       (writer && atomic_load(&header->count) > capacity))
+   {
+      HSTclose();
+      return false;
+   }
+   return true;
+}
+
+void HSTclose(void)
+{
+   if (header != NULL)
+   {
+      if (writable)
+      {
+         msync(header, mapSize, MS_ASYNC);
+      }
+      munmap(header, mapSize);
+      header = NULL;
+      records = NULL;
+      mapSize = 0;
+      capacity = 0;
+   }
+   if (fd >= 0)
+   {
+      close(fd);
+      fd = -1;
+   }
+}
+
+/// Writer: adds HST_GROW_RECORDS to the file and the mapping.
+static bool grow(void)
+{
+   size_t size = mapSize + HST_GROW_RECORDS * sizeof(hstSession_t);
+
+   return ftruncate(fd, (off_t)size) == 0 && map(size);
+}
+
+#else
+
+bool HSTopen(const char path[], bool writer)
+{
+   (void)path;
+   (void)writer;
+   return false;
+}
+
+void HSTclose(void)
+{
+}
+
+static void follow(uint64_t count)
+{
+   (void)count;
+}
+
+static bool grow(void)
+{
+   return false;
+}
+
+#endif
+
+bool HSTappend(const hstSession_t *session)
+{
+   if (header == NULL || !writable || session->user >= HST_MAX_USERS)
+   {
+      return false;
+   }
+   uint64_t n = atomic_load_explicit(&header->count, memory_order_relaxed);
+   if (n >= UINT32_MAX || (n == capacity && !grow()))
+   {
+      return false;
+   }
+
+   hstSession_t r = *session;
+   const hstSession_t *previous = (n > 0) ? &records[n - 1] : NULL;
+
+   r.pace = HSTpace(r.distanceMm, r.durationMs);
+   r.prevUser = atomic_load_explicit(&header->lastUser[r.user], memory_order_relaxed);
+   r.totalDistanceMm = r.distanceMm;
+   r.totalDurationMs = r.durationMs;
+   r.totalEnergyJ = r.energyJ;
+   if (previous != NULL)
+   {
+      // The binary search needs start times in order
+      if (r.start < previous->start)
+      {
+         r.start = previous->start;
+      }
+      r.totalDistanceMm += previous->totalDistanceMm;
+      r.totalDurationMs += previous->totalDurationMs;
+      r.totalEnergyJ += previous->totalEnergyJ;
+   }
+
+   // Fenwick node j covers (j - lowbit(j), j], its children are j - 1, j - 2, j - 4...
+   uint64_t j = n + 1;
+   r.bestPace = r.pace;
+   for (uint64_t k = 1; k < lowbit(j); k <<= 1)
+   {
+      if (records[j - k - 1].bestPace < r.bestPace)
+      {
+         r.bestPace = records[j - k - 1].bestPace;
+      }
+   }
+
+   // The record is complete before a reader can see it
+   records[n] = r;
+   atomic_store_explicit(&header->count, n + 1, memory_order_release);
+   atomic_store_explicit(&header->lastUser[r.user], (uint32_t)(n + 1), memory_order_release);
+   return true;
+}
+
+uint64_t HSTcount(void)
+{
+   if (header == NULL)
+   {
+      return 0;
+   }
+   uint64_t count = atomic_load_explicit(&header->count, memory_order_acquire);
+   follow(count);
+   return (count < capacity) ? count : capacity;
+}
+
+bool HSTget(uint64_t index, hstSession_t *session)
+{
+   if (index >= HSTcount())
+   {
+      return false;
+   }
+   *session = records[index];
+   return true;
+}
+
+uint64_t HSTfind(int64_t time)
+{
+   uint64_t low = 0;
+   uint64_t high = HSTcount();
+
+   while (low < high)
+   {
+      uint64_t middle = low + (high - low) / 2;
+      if (records[middle].start < time)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+   return low;
+}
+
+/// \return the 1 based index of the first record with pace in Fenwick
+/// node j. The child with the largest k is the first in the range.
+static uint64_t locate(uint64_t j, uint32_t pace, uint64_t *visited)
+{
+   for (;;)
+   {
+      uint64_t k = lowbit(j) >> 1;
+
+      (*visited)++;
+      while (k > 0 && records[j - k - 1].bestPace != pace)
+      {
+         k >>= 1;
+      }
+      if (k == 0)
+      {
+         return j;
+      }
+      j -= k;
+   }
+}
+
+/// Best pace of the 1 based records [first, last], from the end: an equal
+/// pace earlier in the range takes over. Only a whole node is searched for
+/// its record, a node that sticks out of the range counts its own record.
+static void bestPace(uint64_t first, uint64_t last, hstTotals_t *totals)
+{
+   uint64_t node = 0;
+   uint64_t j = last;
+
+   while (j >= first && j > 0)
+   {
+      totals->visited++;
+      if (j - lowbit(j) + 1 >= first)
+      {
+         if (records[j - 1].bestPace <= totals->bestPace)
+         {
+            totals->bestPace = records[j - 1].bestPace;
+            node = j;
+         }
+         j -= lowbit(j);
+      }
+      else
+      {
+         if (records[j - 1].pace <= totals->bestPace)
+         {
+            totals->bestPace = records[j - 1].pace;
+            totals->bestIndex = j - 1;
+            node = 0;
+         }
+         j--;
+      }
+   }
+   if (node != 0)
+   {
+      totals->bestIndex = locate(node, totals->bestPace, &totals->visited) - 1;
+   }
+}
+
+void HSTquery(uint32_t user, int64_t from, int64_t to, hstTotals_t *totals)
+{
+   memset(totals, 0, sizeof(*totals));
+   totals->bestPace = HST_NO_PACE;
+
+   if (HSTcount() == 0 || from >= to)
+   {
+      return;
+   }
+
+   if (user == HST_ALL_USERS)
+   {
+      uint64_t first = HSTfind(from);
+      uint64_t last = HSTfind(to);
+      if (first >= last)
+      {
+         return;
+      }
+      const hstSession_t *end = &records[last - 1];
+      const hstSession_t *before = (first > 0) ? &records[first - 1] : NULL;
+
+      totals->sessions = last - first;
+      totals->distanceMm = end->totalDistanceMm - (before ? before->totalDistanceMm : 0);
+      totals->durationMs = end->totalDurationMs - (before ? before->totalDurationMs : 0);
+      totals->energyJ = end->totalEnergyJ - (before ? before->totalEnergyJ : 0);
+      totals->visited = 2;
+      bestPace(first + 1, last, totals);
+      return;
+   }
+
+   if (user >= HST_MAX_USERS)
+   {
+      return;
+   }
+   // Newest first along the chain of the user, until the range starts. The
+   // count is stored before the last session, read after it covers it
+   uint64_t j = atomic_load_explicit(&header->lastUser[user], memory_order_acquire);
+   if (j > HSTcount())
+   {
+      return;
+   }
+   while (j != 0)
+   {
+      const hstSession_t *r = &records[j - 1];
+
+      totals->visited++;
+      if (r->start < from)
+      {
+         break;
+      }
+      if (r->start < to)
+      {
+         totals->sessions++;
+         totals->distanceMm += r->distanceMm;
+         totals->durationMs += r->durationMs;
+         totals->energyJ += r->energyJ;
+         if (r->pace <= totals->bestPace)
+         {
+            totals->bestPace = r->pace;
+            totals->bestIndex = j - 1;
+         }
+      }
+      // The chain goes back, a corrupt file must not loop
+      if (r->prevUser >= j)
+      {
+         break;
+      }
+      j = r->prevUser;
+   }
+}
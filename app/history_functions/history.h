@@ -0,0 +1,106 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------- HiSTory
+
+/// Workout history: a summary of every finished session in an append-only
+/// memory-mapped file, queried by user and time without a database.
+///
+/// The file is a header with the record count and a table with the last
+/// session of every user, followed by fixed size records in append order.
+/// One process appends (the file is locked), any number of processes read
+/// at the same time: a record is complete before the count includes it.
+/// The file grows HST_GROW_RECORDS at a time.
+///
+/// The records are their own index:
+/// - start times never decrease (an earlier start is moved up to the
+///   previous one), a time range is found by binary search;
+/// - every record holds the running totals of distance, duration and energy
+///   up to and including itself, the totals of a range are one subtraction;
+/// - every record holds the best pace of a power of two range of records
+///   before it (a Fenwick tree), the best pace of a range takes
+///   O(log^2 n) records;
+/// - every record links to the previous session of its user, a user query
+///   only visits the sessions of that user.
+/// Totals and best pace of a date range over millions of sessions take
+/// microseconds, a user query is linear in the sessions of that user since
+/// the start of the range.
+
+#define HST_MAGIC              "TMHST1\n"     ///< 8 bytes including '\0'
+#define HST_MAX_USERS          (65536)
+#define HST_GROW_RECORDS       (65536)        ///< Records added when the file is full
+#define HST_ALL_USERS          (UINT32_MAX)   ///< Query the sessions of all users
+#define HST_NO_PACE            (UINT32_MAX)   ///< Pace of a session that is too short
+#define HST_PACE_MIN_DISTANCE  (400000)       ///< mm, shorter sessions have no pace
+
+#define HST_FLAG_PROGRAM       (1u << 0)      ///< A workout program ran
+#define HST_FLAG_EMERGENCY     (1u << 1)      ///< The session had an emergency stop
+
+/// One session, 64 bytes. The fields from prevUser on are set by
+/// HSTappend().
+typedef struct
+{
+   int64_t start;              ///< Unix time in s (UTC)
+   uint32_t user;              ///< < HST_MAX_USERS
+   uint32_t durationMs;
+   uint32_t distanceMm;
+   uint32_t energyJ;
+   uint16_t maxSpeed;          ///< 0.01 km/h
+   uint8_t flags;              ///< HST_FLAG_* bits
+   uint8_t reserved;
+   uint32_t pace;              ///< ms per km, HST_NO_PACE if too short
+   uint32_t prevUser;          ///< Index + 1 of the previous session of the user, 0 if none
+   uint32_t bestPace;          ///< Best pace of this record and the lowbit(index + 1) - 1 before it
+   uint64_t totalDistanceMm;   ///< Running totals, this session included
+   uint64_t totalDurationMs;
+   uint64_t totalEnergyJ;
+} hstSession_t;
+
+/// Result of a query.
+typedef struct
+{
+   uint64_t sessions;
+   uint64_t distanceMm;
+   uint64_t durationMs;
+   uint64_t energyJ;
+   uint32_t bestPace;          ///< ms per km, HST_NO_PACE if none
+   uint64_t bestIndex;         ///< First session with the best pace
+   uint64_t visited;           ///< Records read for the query
+} hstTotals_t;
+
+/// Opens the history file at path, a writer creates it if needed.
+/// \return false if the file cannot be opened or mapped, is not a history
+/// file, or (writer) another process appends to it.
+bool HSTopen(const char path[], bool writer);
+
+/// Unmaps and closes the file.
+void HSTclose(void);
+
+/// Appends a session, the index fields are set here.
+/// \return false if no file is open for writing, the user is out of range
+/// or the file cannot grow.
+bool HSTappend(const hstSession_t *session);
+
+/// \return sessions in the file.
+uint64_t HSTcount(void);
+
+/// Copies session index (0 is the oldest).
+/// \return false if index is not in the file.
+bool HSTget(uint64_t index, hstSession_t *session);
+
+/// \return index of the first session that starts at or after time,
+/// HSTcount() if none.
+uint64_t HSTfind(int64_t time);
+
+/// Totals and best pace of the sessions of user (or HST_ALL_USERS) that
+/// start in [from, to).
+void HSTquery(uint32_t user, int64_t from, int64_t to, hstTotals_t *totals);
+
+/// \return pace in ms per km of distanceMm in durationMs, HST_NO_PACE if
+/// the distance is below HST_PACE_MIN_DISTANCE.
+uint32_t HSTpace(uint32_t distanceMm, uint32_t durationMs);
+
+#endif
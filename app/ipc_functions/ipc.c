@@ -0,0 +1,32 @@
+#define _GNU_SOURCE
+#include "ipc.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+//-------------------------------------------------------------------------- IPC
+
+#ifdef __linux__
+
+socklen_t IPCsocketAddress(struct sockaddr_un *addr, const char *nameFormat,
+                           unsigned int machineId)
+{
+   memset(addr, 0, sizeof(*addr));
+   addr->sun_family = AF_UNIX;
+   // sun_path[0] stays 0: abstract name, not a file
+   int n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+                    nameFormat, machineId);
+   if (n < 0)
+   {
+      n = 0;
+   }
+   else if ((size_t)n > sizeof(addr->sun_path) - 2)
+   {
+      n = (int)(sizeof(addr->sun_path) - 2);
+   }
+
+   return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef IPC_H
+#define IPC_H
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+//-------------------------------------------------------------------------- IPC
+
+/// Addresses of the processes of one machine: the FSM daemon, the hardware
+/// simulator, the metrics endpoint and the gym aggregator listen on
+/// abstract UNIX sockets, a name without a file that disappears with the
+/// socket.
+
+#ifdef __linux__
+/// Fills addr with the abstract socket name of nameFormat, which contains
+/// at most one %u for machineId (e.g. DMN_SOCKET_NAME).
+/// \return the address length for bind() and connect().
+socklen_t IPCsocketAddress(struct sockaddr_un *addr, const char *nameFormat,
+                           unsigned int machineId);
+#endif
+
+#endif
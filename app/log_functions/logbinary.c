@@ -0,0 +1,378 @@
+#include "logbinary.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------- LOGging
+
+#define LOG_BINARY_FORMAT  'F'
+#define LOG_BINARY_MESSAGE 'M'
+#define LOG_BINARY_TEXT    'T' ///< Pre formatted message, format table full
+#define LOG_BINARY_LINE    (512)
+#define LOG_BINARY_STRING  (2 * LOG_BINARY_LINE) ///< Max format or text length
+
+static void putByte(logBinaryWriter_t *w, int c)
+{
+   fputc(c, w->stream);
+   w->bytes++;
+}
+
+static void putVarint(logBinaryWriter_t *w, uint64_t v)
+{
+   while (v >= 0x80)
+   {
+      putByte(w, (int)(v & 0x7F) | 0x80);
+      v >>= 7;
+   }
+   putByte(w, (int)v);
+}
+
+static void putZigzag(logBinaryWriter_t *w, int64_t v)
+{
+   putVarint(w, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void putBytes(logBinaryWriter_t *w, const void *p, size_t n)
+{
+   fwrite(p, 1, n, w->stream);
+   w->bytes += n;
+}
+
+void LOGbinaryWriterInit(logBinaryWriter_t *w, FILE *stream)
+{
+   memset(w, 0, sizeof(*w));
+   w->stream = stream;
+   putBytes(w, LOG_BINARY_MAGIC, sizeof(LOG_BINARY_MAGIC));
+}
+
+/// \return id of fmt, -1 if the table is full.
+static int formatId(logBinaryWriter_t *w, const char *fmt)
+{
+   // Format strings are literals, so the pointer identifies them
+   size_t slot = ((uintptr_t)fmt >> 3) % LOG_BINARY_MAX_FORMATS;
+
+   for (size_t probe = 0; probe < LOG_BINARY_MAX_FORMATS; probe++)
+   {
+      if (w->formats[slot] == fmt)
+      {
+         return w->ids[slot];
+      }
+      if (w->formats[slot] == NULL)
+      {
+         size_t len = strlen(fmt);
+
+         // A longer format is written as text, the decoder rejects it
+         if (w->nFormats == LOG_BINARY_MAX_FORMATS - 1 || len > LOG_BINARY_STRING)
+         {
+            return -1;
+         }
+
+         w->formats[slot] = fmt;
+         w->ids[slot] = w->nFormats++;
+         putByte(w, LOG_BINARY_FORMAT);
+         putVarint(w, w->ids[slot]);
+         putVarint(w, len);
+         putBytes(w, fmt, len);
+         return w->ids[slot];
+      }
+      slot = (slot + 1) % LOG_BINARY_MAX_FORMATS;
+   }
+   return -1;
+}
+
+void LOGbinaryWrite(logBinaryWriter_t *w, const logRecord_t *record)
+{
+   int id = formatId(w, record->fmt);
+   int64_t dt = (int64_t)(record->timestampNs - w->lastTimestampNs);
+
+   w->lastTimestampNs = record->timestampNs;
+
+   if (id < 0)
+   {
+      char line[LOG_BINARY_LINE];
+      char escaped[2 * LOG_BINARY_LINE];
+      size_t len = 0;
+
+      // The decoder uses the text as format, so '%' is escaped
+      LOGrender(record, line, sizeof(line));
+      for (const char *p = line; *p != '\0'; p++)
+      {
+         escaped[len++] = *p;
+         if (*p == '%')
+         {
+            escaped[len++] = '%';
+         }
+      }
+
+      putByte(w, LOG_BINARY_TEXT);
+      putByte(w, record->level);
+      putZigzag(w, dt);
+      putVarint(w, len);
+      putBytes(w, escaped, len);
+      return;
+   }
+
+   putByte(w, LOG_BINARY_MESSAGE);
+   putVarint(w, (uint64_t)id);
+   putByte(w, record->level);
+   putZigzag(w, dt);
+   putByte(w, record->nArgs | (record->truncated ? 0x80 : 0));
+
+   for (unsigned int a = 0; a < record->nArgs; a++)
+   {
+      const logArg_t *arg = &record->args[a];
+
+      putByte(w, record->argTypes[a]);
+      switch (record->argTypes[a])
+      {
+      case LOG_ARG_INT:
+         putZigzag(w, arg->i);
+         break;
+      case LOG_ARG_DOUBLE:
+         putBytes(w, &arg->d, sizeof(arg->d));
+         break;
+      case LOG_ARG_STRING:
+      {
+         size_t len = strlen(&record->strings[arg->u]);
+         putVarint(w, len);
+         putBytes(w, &record->strings[arg->u], len);
+         break;
+      }
+      default:
+         putVarint(w, arg->u);
+         break;
+      }
+   }
+}
+
+//---------------------------------------------------------------------- decoder
+
+static bool getVarint(FILE *stream, uint64_t *v)
+{
+   *v = 0;
+   for (unsigned int shift = 0; shift < 64; shift += 7)
+   {
+      int c = fgetc(stream);
+      if (c == EOF)
+      {
+         return false;
+      }
+      *v |= (uint64_t)(c & 0x7F) << shift;
+      if ((c & 0x80) == 0)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+static bool getZigzag(FILE *stream, int64_t *v)
+{
+   uint64_t u;
+
+   if (!getVarint(stream, &u))
+   {
+      return false;
+   }
+   *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+   return true;
+}
+
+bool LOGbinaryReaderInit(logBinaryReader_t *r, FILE *stream)
+{
+   char magic[sizeof(LOG_BINARY_MAGIC)];
+
+   memset(r, 0, sizeof(*r));
+   r->stream = stream;
+
+   return fread(magic, 1, sizeof(magic), stream) == sizeof(magic) &&
+          memcmp(magic, LOG_BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+void LOGbinaryReaderClose(logBinaryReader_t *r)
+{
+   for (size_t i = 0; i < LOG_BINARY_MAX_FORMATS; i++)
+   {
+      free(r->formats[i]);
+      r->formats[i] = NULL;
+   }
+}
+
+/// Reads a string of len bytes in a new allocated buffer.
+/// \return NULL if len is beyond LOG_BINARY_STRING, the log is corrupt.
+static char *getString(FILE *stream, uint64_t len)
+{
+   if (len > LOG_BINARY_STRING)
+   {
+      return NULL;
+   }
+   char *s = malloc(len + 1);
+
+   if (s != NULL && fread(s, 1, len, stream) != len)
+   {
+      free(s);
+      return NULL;
+   }
+   if (s != NULL)
+   {
+      s[len] = '\0';
+   }
+   return s;
+}
+
+/// Reads the arguments of a message record.
+static bool getArgs(FILE *stream, logRecord_t *record, unsigned int nArgs)
+{
+   for (unsigned int a = 0; a < nArgs; a++)
+   {
+      int type = fgetc(stream);
+      logArg_t *arg = &record->args[a];
+
+      record->argTypes[a] = (uint8_t)type;
+      switch (type)
+      {
+      case LOG_ARG_INT:
+         if (!getZigzag(stream, &arg->i))
+         {
+            return false;
+         }
+         break;
+      case LOG_ARG_UINT:
+      case LOG_ARG_POINTER:
+         if (!getVarint(stream, &arg->u))
+         {
+            return false;
+         }
+         break;
+      case LOG_ARG_DOUBLE:
+         if (fread(&arg->d, sizeof(arg->d), 1, stream) != 1)
+         {
+            return false;
+         }
+         break;
+      case LOG_ARG_STRING:
+      {
+         uint64_t len;
+         if (!getVarint(stream, &len))
+         {
+            return false;
+         }
+         if (len == 0 && record->nStringBytes == LOG_MAX_STRINGS)
+         {
+            // Captured with the strings area full, see LOGcapture()
+            arg->u = LOG_MAX_STRINGS - 1;
+            break;
+         }
+         if (record->nStringBytes >= LOG_MAX_STRINGS ||
+             len > LOG_MAX_STRINGS - record->nStringBytes - 1u ||
+             fread(&record->strings[record->nStringBytes], 1, len, stream) != len)
+         {
+            return false;
+         }
+         arg->u = record->nStringBytes;
+         record->strings[record->nStringBytes + len] = '\0';
+         record->nStringBytes = (uint8_t)(record->nStringBytes + len + 1);
+         break;
+      }
+      default:
+         return false;
+      }
+   }
+   record->nArgs = (uint8_t)nArgs;
+   return true;
+}
+
+int LOGbinaryRead(logBinaryReader_t *r, logRecord_t *record)
+{
+   for (;;)
+   {
+      int type = fgetc(r->stream);
+      uint64_t id;
+      uint64_t len;
+      int64_t dt;
+
+      switch (type)
+      {
+      case EOF:
+         return 0;
+
+      case LOG_BINARY_FORMAT:
+         if (!getVarint(r->stream, &id) || !getVarint(r->stream, &len) ||
+             id >= LOG_BINARY_MAX_FORMATS)
+         {
+            return -1;
+         }
+         free(r->formats[id]);
+         r->formats[id] = getString(r->stream, len);
+         if (r->formats[id] == NULL)
+         {
+            return -1;
+         }
+         break;
+
+      case LOG_BINARY_MESSAGE:
+      {
+         int level;
+         int nArgs;
+
+         if (!getVarint(r->stream, &id) || id >= LOG_BINARY_MAX_FORMATS ||
+             r->formats[id] == NULL)
+         {
+            return -1;
+         }
+         level = fgetc(r->stream);
+         if (level == EOF || !getZigzag(r->stream, &dt))
+         {
+            return -1;
+         }
+         nArgs = fgetc(r->stream);
+         if (nArgs == EOF || (nArgs & 0x7F) > LOG_MAX_ARGS)
+         {
+            return -1;
+         }
+
+         record->fmt = r->formats[id];
+         record->level = (uint8_t)level;
+         record->truncated = (nArgs & 0x80) != 0;
+         record->nStringBytes = 0;
+         r->lastTimestampNs += (uint64_t)dt;
+         record->timestampNs = r->lastTimestampNs;
+
+         // The arguments must be what the conversions of the format read
+         return (getArgs(r->stream, record, (unsigned int)(nArgs & 0x7F)) &&
+                 LOGcheckArgs(record)) ? 1 : -1;
+      }
+
+      case LOG_BINARY_TEXT:
+      {
+         // Formatted text with '%' escaped, returned as a format without
+         // arguments
+         int level = fgetc(r->stream);
+         if (level == EOF || !getZigzag(r->stream, &dt) ||
+             !getVarint(r->stream, &len))
+         {
+            return -1;
+         }
+         char *text = getString(r->stream, len);
+         if (text == NULL)
+         {
+            return -1;
+         }
+         // The writer never uses the last id, it holds the text
+         free(r->formats[LOG_BINARY_MAX_FORMATS - 1]);
+         r->formats[LOG_BINARY_MAX_FORMATS - 1] = text;
+         record->fmt = text;
+         record->level = (uint8_t)level;
+         record->truncated = 0;
+         record->nArgs = 0;
+         record->nStringBytes = 0;
+         r->lastTimestampNs += (uint64_t)dt;
+         record->timestampNs = r->lastTimestampNs;
+         return 1;
+      }
+
+      default:
+         return -1;
+      }
+   }
+}
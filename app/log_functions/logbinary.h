@@ -0,0 +1,60 @@
+#ifndef LOGBINARY_H
+#define LOGBINARY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "logformat.h"
+
+//---------------------------------------------------------------------- LOGging
+
+/// Binary log stream, for long runs where formatting costs too much.
+///
+/// A stream starts with LOG_BINARY_MAGIC, followed by records:
+/// - 'F' id text      defines format string id, once for every format
+/// - 'M' id level dt args  a message: format id, level, timestamp delta to
+///                         the previous message and the raw arguments
+/// Integers are written as (zigzag) varints, doubles as 8 raw bytes.
+/// The decoder turns the stream back into the text of the text mode.
+
+#define LOG_BINARY_MAGIC      "TMLOG1\n"  ///< 8 bytes including '\0'
+#define LOG_BINARY_MAX_FORMATS (1024)     ///< Distinct format strings
+
+typedef struct
+{
+   FILE *stream;
+   const char *formats[LOG_BINARY_MAX_FORMATS]; ///< Hash table of known formats
+   uint16_t ids[LOG_BINARY_MAX_FORMATS];        ///< Id of formats[i]
+   uint16_t nFormats;
+   uint64_t lastTimestampNs;
+   uint64_t bytes;                              ///< Bytes written so far
+} logBinaryWriter_t;
+
+typedef struct
+{
+   FILE *stream;
+   char *formats[LOG_BINARY_MAX_FORMATS];       ///< Format text by id
+   uint64_t lastTimestampNs;
+} logBinaryReader_t;
+
+/// Starts a binary log on stream (opened in binary mode) by writing the magic.
+void LOGbinaryWriterInit(logBinaryWriter_t *writer, FILE *stream);
+
+/// Writes record, preceded by its format string the first time it is used.
+void LOGbinaryWrite(logBinaryWriter_t *writer, const logRecord_t *record);
+
+/// Starts reading a binary log from stream.
+/// \return false if the stream does not start with LOG_BINARY_MAGIC.
+bool LOGbinaryReaderInit(logBinaryReader_t *reader, FILE *stream);
+
+/// Reads the next message in record. record->fmt points into the reader, it
+/// is valid until LOGbinaryReaderClose().
+/// \return 1 if a message was read, 0 at the end of the stream, -1 if the
+/// stream is corrupt.
+int LOGbinaryRead(logBinaryReader_t *reader, logRecord_t *record);
+
+/// Frees the format strings of reader.
+void LOGbinaryReaderClose(logBinaryReader_t *reader);
+
+#endif
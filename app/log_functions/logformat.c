@@ -0,0 +1,491 @@
+#include "logformat.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//---------------------------------------------------------------------- LOGging
+
+#define LOG_SPEC_SIZE (32) ///< Max size of one conversion specification
+
+static const char *levelPrefix[] =
+{
+   "\n-- ",
+   "\n-- SYSTEM ERROR  ",
+   "\n-- SIMULATION  ",
+   "\n-- DEBUG  ",
+};
+
+/// Length modifiers, only the ones that change the captured type matter.
+typedef enum {
+   LEN_NONE,
+   LEN_HH,
+   LEN_H,
+   LEN_L,
+   LEN_LL,
+   LEN_J,
+   LEN_Z,
+   LEN_T,
+   LEN_BIG_L
+} lengthModifier_t;
+
+/// Skips the flags, width, precision and length of a conversion
+/// specification. fmt points just after the '%'.
+/// \return pointer to the conversion character.
+static const char *skipSpecification(const char *fmt, int *nStars,
+                                     lengthModifier_t *len)
+{
+   *nStars = 0;
+   *len = LEN_NONE;
+
+   while (*fmt != '\0' && strchr("-+ #0", *fmt) != NULL)
+   {
+      fmt++;
+   }
+   for (int part = 0; part < 2; part++)
+   {
+      if (part == 1)
+      {
+         if (*fmt != '.')
+         {
+            break;
+         }
+         fmt++;
+      }
+      if (*fmt == '*')
+      {
+         (*nStars)++;
+         fmt++;
+      }
+      while (*fmt >= '0' && *fmt <= '9')
+      {
+         fmt++;
+      }
+   }
+
+   switch (*fmt)
+   {
+   case 'h':
+      *len = (fmt[1] == 'h') ? LEN_HH : LEN_H;
+      fmt += (fmt[1] == 'h') ? 2 : 1;
+      break;
+   case 'l':
+      *len = (fmt[1] == 'l') ? LEN_LL : LEN_L;
+      fmt += (fmt[1] == 'l') ? 2 : 1;
+      break;
+   case 'j':
+      *len = LEN_J;
+      fmt++;
+      break;
+   case 'z':
+      *len = LEN_Z;
+      fmt++;
+      break;
+   case 't':
+      *len = LEN_T;
+      fmt++;
+      break;
+   case 'L':
+      *len = LEN_BIG_L;
+      fmt++;
+      break;
+   default:
+      break;
+   }
+   return fmt;
+}
+
+static int64_t signedArg(va_list *arg, lengthModifier_t len)
+{
+   switch (len)
+   {
+   case LEN_HH:
+      return (signed char)va_arg(*arg, int);
+   case LEN_H:
+      return (short)va_arg(*arg, int);
+   case LEN_L:
+      return va_arg(*arg, long);
+   case LEN_LL:
+      return va_arg(*arg, long long);
+   case LEN_J:
+      return va_arg(*arg, intmax_t);
+   case LEN_Z:
+   case LEN_T:
+      return va_arg(*arg, ptrdiff_t);
+   default:
+      return va_arg(*arg, int);
+   }
+}
+
+static uint64_t unsignedArg(va_list *arg, lengthModifier_t len)
+{
+   switch (len)
+   {
+   case LEN_HH:
+      return (unsigned char)va_arg(*arg, unsigned int);
+   case LEN_H:
+      return (unsigned short)va_arg(*arg, unsigned int);
+   case LEN_L:
+      return va_arg(*arg, unsigned long);
+   case LEN_LL:
+      return va_arg(*arg, unsigned long long);
+   case LEN_J:
+      return va_arg(*arg, uintmax_t);
+   case LEN_Z:
+   case LEN_T:
+      return va_arg(*arg, size_t);
+   default:
+      return va_arg(*arg, unsigned int);
+   }
+}
+
+/// Adds one argument to record.
+/// \return 0 if the argument does not fit.
+static int addArg(logRecord_t *record, logArgType_t type, logArg_t value)
+{
+   if (record->nArgs == LOG_MAX_ARGS)
+   {
+      record->truncated = 1;
+      return 0;
+   }
+   record->argTypes[record->nArgs] = (uint8_t)type;
+   record->args[record->nArgs] = value;
+   record->nArgs++;
+   return 1;
+}
+
+void LOGcapture(logRecord_t *record, const char fmt[], va_list arg)
+{
+   va_list ap;
+   int nStars;
+   lengthModifier_t len;
+
+   record->fmt = fmt;
+   record->nArgs = 0;
+   record->nStringBytes = 0;
+   record->truncated = 0;
+
+   va_copy(ap, arg);
+   for (const char *p = fmt; *p != '\0'; p++)
+   {
+      if (*p != '%')
+      {
+         continue;
+      }
+      if (p[1] == '%')
+      {
+         p++;
+         continue;
+      }
+
+      p = skipSpecification(p + 1, &nStars, &len);
+      for (int s = 0; s < nStars; s++)
+      {
+         addArg(record, LOG_ARG_INT, (logArg_t){.i = va_arg(ap, int)});
+      }
+
+      switch (*p)
+      {
+      case 'd':
+      case 'i':
+         addArg(record, LOG_ARG_INT, (logArg_t){.i = signedArg(&ap, len)});
+         break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+         addArg(record, LOG_ARG_UINT, (logArg_t){.u = unsignedArg(&ap, len)});
+         break;
+      case 'c':
+         addArg(record, LOG_ARG_UINT,
+                (logArg_t){.u = (unsigned char)va_arg(ap, int)});
+         break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+         if (len == LEN_BIG_L)
+         {
+            addArg(record, LOG_ARG_DOUBLE,
+                   (logArg_t){.d = (double)va_arg(ap, long double)});
+         }
+         else
+         {
+            addArg(record, LOG_ARG_DOUBLE, (logArg_t){.d = va_arg(ap, double)});
+         }
+         break;
+      case 's':
+      {
+         const char *str = va_arg(ap, const char *);
+         size_t offset = record->nStringBytes;
+         size_t room = LOG_MAX_STRINGS - offset;
+
+         if (str == NULL)
+         {
+            str = "(null)";
+         }
+         if (room == 0)
+         {
+            // Full: the terminator of the last copy is an empty string, so
+            // the next arguments keep their place
+            record->truncated = 1;
+            addArg(record, LOG_ARG_STRING, (logArg_t){.u = LOG_MAX_STRINGS - 1});
+            break;
+         }
+         size_t n = strlen(str);
+         if (n + 1 > room)
+         {
+            record->truncated = 1;
+            n = room - 1;
+         }
+         if (addArg(record, LOG_ARG_STRING, (logArg_t){.u = offset}))
+         {
+            memcpy(&record->strings[offset], str, n);
+            record->strings[offset + n] = '\0';
+            record->nStringBytes = (uint8_t)(offset + n + 1);
+         }
+         break;
+      }
+      case 'p':
+         addArg(record, LOG_ARG_POINTER,
+                (logArg_t){.u = (uintptr_t)va_arg(ap, void *)});
+         break;
+      case 'n':
+         // Not supported, skip the pointer
+         (void)va_arg(ap, int *);
+         break;
+      default:
+         // Invalid specification, remaining arguments are unknown
+         p = p + strlen(p) - 1;
+         break;
+      }
+   }
+   va_end(ap);
+}
+
+/// Copies spec to out, replacing the length modifier by newLen and every '*'
+/// by the next captured int.
+static void rewriteSpecification(char out[], const char *spec, const char *conv,
+                                 const char *newLen, const logRecord_t *record,
+                                 unsigned int *argIndex)
+{
+   size_t n = 0;
+
+   out[n++] = '%';
+   for (const char *p = spec; p < conv && n < LOG_SPEC_SIZE - 8; p++)
+   {
+      if (*p == '*')
+      {
+         long long v = 0;
+         if (*argIndex < record->nArgs)
+         {
+            v = record->args[(*argIndex)++].i;
+         }
+         n += (size_t)snprintf(&out[n], LOG_SPEC_SIZE - 8 - n, "%lld", v);
+      }
+      else if (strchr("hljztL", *p) == NULL)
+      {
+         out[n++] = *p;
+      }
+   }
+   for (const char *p = newLen; *p != '\0'; p++)
+   {
+      out[n++] = *p;
+   }
+   out[n++] = *conv;
+   out[n] = '\0';
+}
+
+const char *LOGlevelPrefix(int level)
+{
+   if (level < LOG_LEVEL_NONE || level > LOG_LEVEL_DEBUG)
+   {
+      level = LOG_LEVEL_NONE;
+   }
+   return levelPrefix[level];
+}
+
+/// \return type of the argument of conversion conv, -1 if it takes none.
+static int conversionType(char conv)
+{
+   switch (conv)
+   {
+   case 'd':
+   case 'i':
+      return LOG_ARG_INT;
+   case 'u':
+   case 'o':
+   case 'x':
+   case 'X':
+   case 'c':
+      return LOG_ARG_UINT;
+   case 's':
+      return LOG_ARG_STRING;
+   case 'p':
+      return LOG_ARG_POINTER;
+   case 'f':
+   case 'F':
+   case 'e':
+   case 'E':
+   case 'g':
+   case 'G':
+   case 'a':
+   case 'A':
+      return LOG_ARG_DOUBLE;
+   default:
+      return -1;
+   }
+}
+
+bool LOGcheckArgs(const logRecord_t *record)
+{
+   unsigned int argIndex = 0;
+   int nStars;
+   lengthModifier_t len;
+
+   if (record->nArgs > LOG_MAX_ARGS)
+   {
+      return false;
+   }
+   for (const char *p = record->fmt; *p != '\0'; p++)
+   {
+      if (*p != '%')
+      {
+         continue;
+      }
+      if (p[1] == '%')
+      {
+         p++;
+         continue;
+      }
+
+      p = skipSpecification(p + 1, &nStars, &len);
+      if (*p == '\0')
+      {
+         break;
+      }
+      // LOGcapture() stops at an invalid conversion and skips %n
+      int type = conversionType(*p);
+      if (type < 0 && *p != 'n')
+      {
+         break;
+      }
+      for (int s = 0; s < nStars && argIndex < record->nArgs; s++)
+      {
+         if (record->argTypes[argIndex++] != LOG_ARG_INT)
+         {
+            return false;
+         }
+      }
+      if (type >= 0 && argIndex < record->nArgs)
+      {
+         if (record->argTypes[argIndex] != type ||
+             (type == LOG_ARG_STRING && record->args[argIndex].u >= LOG_MAX_STRINGS))
+         {
+            return false;
+         }
+         argIndex++;
+      }
+   }
+   return true;
+}
+
+size_t LOGrender(const logRecord_t *record, char buf[], size_t size)
+{
+   char spec[LOG_SPEC_SIZE];
+   unsigned int argIndex = 0;
+   size_t n = 0;
+   int nStars;
+   lengthModifier_t len;
+
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   for (const char *p = record->fmt; *p != '\0' && n + 1 < size; p++)
+   {
+      if (*p != '%')
+      {
+         buf[n++] = *p;
+         continue;
+      }
+      if (p[1] == '%')
+      {
+         buf[n++] = '%';
+         p++;
+         continue;
+      }
+
+      const char *start = p + 1;
+      const char *conv = skipSpecification(start, &nStars, &len);
+      int written = 0;
+
+      if (*conv == '\0' || strchr("diuoxXcfFeEgGaAsp", *conv) == NULL)
+      {
+         break;
+      }
+
+      // Integers are captured as 64 bits, so they are formatted with "ll"
+      if (strchr("diuoxX", *conv) != NULL)
+      {
+         rewriteSpecification(spec, start, conv, "ll", record, &argIndex);
+      }
+      else
+      {
+         rewriteSpecification(spec, start, conv, "", record, &argIndex);
+      }
+
+      if (argIndex >= record->nArgs)
+      {
+         // Argument was not captured
+         written = snprintf(&buf[n], size - n, "<?>");
+      }
+      else
+      {
+         const logArg_t *a = &record->args[argIndex++];
+
+         switch (*conv)
+         {
+         case 'd':
+         case 'i':
+            written = snprintf(&buf[n], size - n, spec, (long long)a->i);
+            break;
+         case 'c':
+            written = snprintf(&buf[n], size - n, spec, (int)a->u);
+            break;
+         case 's':
+            written = snprintf(&buf[n], size - n, spec, &record->strings[a->u]);
+            break;
+         case 'p':
+            written = snprintf(&buf[n], size - n, spec, (void *)(uintptr_t)a->u);
+            break;
+         case 'u':
+         case 'o':
+         case 'x':
+         case 'X':
+            written = snprintf(&buf[n], size - n, spec, (unsigned long long)a->u);
+            break;
+         default:
+            written = snprintf(&buf[n], size - n, spec, a->d);
+            break;
+         }
+      }
+
+      if (written > 0)
+      {
+         n += (size_t)written;
+         if (n >= size)
+         {
+            n = size - 1;
+         }
+      }
+      p = conv;
+   }
+   buf[n] = '\0';
+
+   return n;
+}
@@ -0,0 +1,68 @@
+#ifndef LOGFORMAT_H
+#define LOGFORMAT_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------- LOGging
+
+/// Log levels, a message is shown if its level <= the current level.
+#define LOG_LEVEL_NONE       (0)
+#define LOG_LEVEL_ERROR      (1) ///< DCSshowSystemError()
+#define LOG_LEVEL_SIMULATION (2) ///< DCSsimulationSystemInfo()
+#define LOG_LEVEL_DEBUG      (3) ///< DCSdebugSystemInfo()
+
+#define LOG_MAX_ARGS    (8)  ///< Max number of captured printf() arguments
+#define LOG_MAX_STRINGS (64) ///< Bytes available for copies of %s arguments
+
+/// Type of a captured argument.
+typedef enum {
+   LOG_ARG_INT,     ///< %d %i, and '*' width/precision
+   LOG_ARG_UINT,    ///< %u %o %x %X %c
+   LOG_ARG_DOUBLE,  ///< %f %e %g %a
+   LOG_ARG_STRING,  ///< %s, value is an offset in logRecord_t::strings
+   LOG_ARG_POINTER  ///< %p
+} logArgType_t;
+
+typedef union
+{
+   int64_t i;
+   uint64_t u;
+   double d;
+} logArg_t;
+
+/// A log message with its printf() arguments, but not formatted yet.
+/// Formatting is deferred to whoever consumes the record.
+typedef struct
+{
+   const char *fmt;                  ///< Format string, must be a literal
+   uint64_t timestampNs;             ///< CLKnowNs() when the record was made
+   uint8_t level;                    ///< LOG_LEVEL_*
+   uint8_t nArgs;                    ///< Number of captured arguments
+   uint8_t nStringBytes;             ///< Used bytes in strings
+   uint8_t truncated;                ///< Not all arguments fitted
+   uint8_t argTypes[LOG_MAX_ARGS];   ///< logArgType_t per argument
+   logArg_t args[LOG_MAX_ARGS];      ///< Argument values
+   char strings[LOG_MAX_STRINGS];    ///< Copies of %s arguments
+} logRecord_t;
+
+/// Captures the arguments of fmt from arg in record, without formatting.
+/// Only the argument values are copied, strings are copied into the record
+/// because they may not live as long as the record.
+void LOGcapture(logRecord_t *record, const char fmt[], va_list arg);
+
+/// \return text printed in front of a message of level, e.g. "\n-- DEBUG  ".
+const char *LOGlevelPrefix(int level);
+
+/// Checks that the arguments of record have the types that the conversions
+/// of its format read, e.g. of a record from a file.
+/// \return false if an argument does not match its conversion.
+bool LOGcheckArgs(const logRecord_t *record);
+
+/// Formats record the way vsnprintf() would have done it.
+/// \return number of characters written in buf (excluding '\0').
+size_t LOGrender(const logRecord_t *record, char buf[], size_t size);
+
+#endif
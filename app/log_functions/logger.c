@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include "logger.h"
+#include "clock_functions/clock.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+//---------------------------------------------------------------------- LOGging
+
+#define LOG_RING_MASK   (LOG_RING_SIZE - 1)
+#define LOG_LINE_SIZE   (512) ///< Max length of one formatted message
+#define LOG_IDLE_NS     (1000000) ///< Sleep of the log thread when idle
+
+#if (LOG_RING_SIZE & LOG_RING_MASK)
+#error log ring size is not a power of two
+#endif
+
+/// Single producer single consumer ring, one for every producer thread.
+/// The ring of a thread that ended is taken by the next new thread once the
+/// log thread has emptied it.
+typedef struct
+{
+   _Atomic uint32_t head;  ///< Written by the producer
+   _Atomic uint32_t tail;  ///< Written by the log thread
+   atomic_bool owned;      ///< A live thread produces in the ring
+   logRecord_t records[LOG_RING_SIZE];
+} logRing_t;
+
+static logMode_t mode = LOG_MODE_DIRECT;
+static FILE *output = NULL;
+static logBinaryWriter_t binaryWriter;
+static bool binary = false;
+static pthread_mutex_t binaryMutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic int level = LOG_LEVEL_COMPILED;
+
+static logRing_t *_Atomic rings[LOG_MAX_THREADS];
+static _Thread_local logRing_t *myRing = NULL;
+static pthread_key_t ringKey;           ///< Releases the ring at thread exit
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+static pthread_t logThread;
+static atomic_bool logThreadRun = false;
+
+static _Atomic uint64_t enqueued = 0;
+static _Atomic uint64_t dropped = 0;
+static _Atomic uint64_t written = 0;
+static _Atomic uint64_t flushed = 0;
+static _Atomic uint64_t latencySumNs = 0;
+static _Atomic uint64_t latencyMaxNs = 0;
+
+static FILE *outputStream(void)
+{
+   if (binary)
+   {
+      return binaryWriter.stream;
+   }
+   return (output != NULL) ? output : stdout;
+}
+
+/// Formats and prints one record, or encodes it in binary mode.
+static void printRecord(const logRecord_t *record)
+{
+   char line[LOG_LINE_SIZE];
+
+   if (binary)
+   {
+      LOGbinaryWrite(&binaryWriter, record);
+      return;
+   }
+   LOGrender(record, line, sizeof(line));
+   fputs(LOGlevelPrefix(record->level), outputStream());
+   fputs(line, outputStream());
+}
+
+/// Thread exit: the records in the ring are still printed, after that the
+/// ring can be taken by another thread.
+static void releaseRing(void *ring)
+{
+   atomic_store_explicit(&((logRing_t *)ring)->owned, false, memory_order_release);
+}
+
+static void createRingKey(void)
+{
+   (void)pthread_key_create(&ringKey, releaseRing);
+}
+
+/// \return the ring of the calling thread, NULL if there are no free rings.
+static logRing_t *ownRing(void)
+{
+   if (myRing != NULL)
+   {
+      return myRing;
+   }
+   pthread_once(&ringKeyOnce, createRingKey);
+
+   for (unsigned int r = 0; r < LOG_MAX_THREADS && myRing == NULL; r++)
+   {
+      logRing_t *ring = atomic_load_explicit(&rings[r], memory_order_acquire);
+      bool released = false;
+
+      if (ring == NULL)
+      {
+         ring = calloc(1, sizeof(logRing_t));
+         if (ring == NULL)
+         {
+            return NULL;
+         }
+         atomic_store(&ring->owned, true);
+         logRing_t *none = NULL;
+         if (atomic_compare_exchange_strong(&rings[r], &none, ring))
+         {
+            myRing = ring;
+         }
+         else
+         {
+            free(ring);
+         }
+      }
+      // A released ring, once the log thread printed what its thread left
+      else if (atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+               atomic_load_explicit(&ring->head, memory_order_relaxed) &&
+               atomic_compare_exchange_strong(&ring->owned, &released, true))
+      {
+         myRing = ring;
+      }
+   }
+   if (myRing != NULL)
+   {
+      (void)pthread_setspecific(ringKey, myRing);
+   }
+   return myRing;
+}
+
+/// Prints the pending records of all rings, oldest first.
+/// \return number of printed records.
+static unsigned int drainRings(void)
+{
+   unsigned int count = 0;
+
+   for (;;)
+   {
+      logRing_t *oldest = NULL;
+      uint64_t oldestTs = UINT64_MAX;
+
+      // Merge the rings on timestamp so messages of different threads
+      // are printed in the order they were logged.
+      for (unsigned int r = 0; r < LOG_MAX_THREADS; r++)
+      {
+         logRing_t *ring = atomic_load_explicit(&rings[r], memory_order_acquire);
+         if (ring == NULL)
+         {
+            continue;
+         }
+         uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+         if (tail != atomic_load_explicit(&ring->head, memory_order_acquire) &&
+             ring->records[tail & LOG_RING_MASK].timestampNs < oldestTs)
+         {
+            oldest = ring;
+            oldestTs = ring->records[tail & LOG_RING_MASK].timestampNs;
+         }
+      }
+      if (oldest == NULL)
+      {
+         return count;
+      }
+
+      uint32_t tail = atomic_load_explicit(&oldest->tail, memory_order_relaxed);
+      printRecord(&oldest->records[tail & LOG_RING_MASK]);
+      atomic_store_explicit(&oldest->tail, tail + 1, memory_order_release);
+
+      uint64_t latency = CLKrealNs() - oldestTs;
+      atomic_fetch_add_explicit(&latencySumNs, latency, memory_order_relaxed);
+      if (latency > atomic_load_explicit(&latencyMaxNs, memory_order_relaxed))
+      {
+         atomic_store_explicit(&latencyMaxNs, latency, memory_order_relaxed);
+      }
+      atomic_fetch_add_explicit(&written, 1, memory_order_release);
+      count++;
+   }
+}
+
+static void *logThreadFunction(void *arg)
+{
+   (void)arg;
+   const struct timespec idle = {0, LOG_IDLE_NS};
+
+   while (atomic_load(&logThreadRun))
+   {
+      if (drainRings() == 0)
+      {
+         nanosleep(&idle, NULL);
+      }
+      else
+      {
+         // Only this thread prints, so everything counted in written is
+         // in the stream buffer now
+         uint64_t done = atomic_load(&written);
+         fflush(outputStream());
+         atomic_store_explicit(&flushed, done, memory_order_release);
+      }
+   }
+   drainRings();
+   fflush(outputStream());
+
+   return NULL;
+}
+
+void LOGinitialise(logMode_t newMode)
+{
+   if (newMode == LOG_MODE_ASYNC && !atomic_load(&logThreadRun))
+   {
+      atomic_store(&logThreadRun, true);
+      if (pthread_create(&logThread, NULL, logThreadFunction, NULL) != 0)
+      {
+         atomic_store(&logThreadRun, false);
+         newMode = LOG_MODE_DIRECT;
+      }
+   }
+   mode = newMode;
+}
+
+void LOGclose(void)
+{
+   if (atomic_load(&logThreadRun))
+   {
+      atomic_store(&logThreadRun, false);
+      pthread_join(logThread, NULL);
+   }
+   mode = LOG_MODE_DIRECT;
+}
+
+void LOGsetOutput(FILE *stream)
+{
+   output = stream;
+}
+
+void LOGsetBinaryOutput(FILE *stream)
+{
+   binary = (stream != NULL);
+   if (binary)
+   {
+      LOGbinaryWriterInit(&binaryWriter, stream);
+   }
+}
+
+void LOGsetLevel(int newLevel)
+{
+   atomic_store_explicit(&level, newLevel, memory_order_relaxed);
+}
+
+int LOGgetLevel(void)
+{
+   return atomic_load_explicit(&level, memory_order_relaxed);
+}
+
+void LOGwrite(int msgLevel, const char fmt[], ...)
+{
+   va_list arg;
+
+   va_start(arg, fmt);
+   LOGvwrite(msgLevel, fmt, arg);
+   va_end(arg);
+}
+
+void LOGvwrite(int msgLevel, const char fmt[], va_list arg)
+{
+   if (msgLevel > LOG_LEVEL_COMPILED || msgLevel > LOGgetLevel() ||
+       msgLevel < LOG_LEVEL_NONE)
+   {
+      return;
+   }
+
+   if (mode == LOG_MODE_DIRECT && binary)
+   {
+      logRecord_t record;
+
+      LOGcapture(&record, fmt, arg);
+      record.level = (uint8_t)msgLevel;
+      record.timestampNs = CLKrealNs();
+
+      // The format table of the writer is shared by all threads
+      pthread_mutex_lock(&binaryMutex);
+      LOGbinaryWrite(&binaryWriter, &record);
+      pthread_mutex_unlock(&binaryMutex);
+
+      atomic_fetch_add_explicit(&enqueued, 1, memory_order_relaxed);
+      atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+      return;
+   }
+
+   if (mode == LOG_MODE_DIRECT)
+   {
+      fputs(LOGlevelPrefix(msgLevel), outputStream());
+      vfprintf(outputStream(), fmt, arg);
+      atomic_fetch_add_explicit(&enqueued, 1, memory_order_relaxed);
+      atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+      return;
+   }
+
+   logRing_t *ring = ownRing();
+   if (ring == NULL)
+   {
+      atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+      return;
+   }
+
+   uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+   if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+       LOG_RING_SIZE)
+   {
+      // Ring is full, never block the producer
+      atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+      return;
+   }
+
+   logRecord_t *record = &ring->records[head & LOG_RING_MASK];
+   LOGcapture(record, fmt, arg);
+   record->level = (uint8_t)msgLevel;
+   record->timestampNs = CLKrealNs();
+
+   atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+   atomic_fetch_add_explicit(&enqueued, 1, memory_order_relaxed);
+}
+
+void LOGflush(void)
+{
+   if (mode == LOG_MODE_DIRECT)
+   {
+      fflush(outputStream());
+      return;
+   }
+
+   uint64_t target = atomic_load(&enqueued);
+
+   while (atomic_load_explicit(&written, memory_order_acquire) < target ||
+          atomic_load_explicit(&flushed, memory_order_acquire) < target)
+   {
+      sched_yield();
+   }
+}
+
+void LOGgetStats(logStats_t *stats)
+{
+   stats->enqueued = atomic_load(&enqueued);
+   stats->dropped = atomic_load(&dropped);
+   stats->written = atomic_load(&written);
+   stats->latencySumNs = atomic_load(&latencySumNs);
+   stats->latencyMaxNs = atomic_load(&latencyMaxNs);
+}
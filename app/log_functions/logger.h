@@ -0,0 +1,69 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "logbinary.h"
+#include "logformat.h"
+
+//---------------------------------------------------------------------- LOGging
+
+/// Messages above this level are removed at compile time.
+/// Can be set in the .pro file, e.g. DEFINES += LOG_LEVEL_COMPILED=2
+#ifndef LOG_LEVEL_COMPILED
+#define LOG_LEVEL_COMPILED LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_RING_SIZE   (256) ///< Records per producer thread, power of two
+#define LOG_MAX_THREADS (8)   ///< Max number of live producer threads
+
+typedef enum {
+   LOG_MODE_DIRECT, ///< Format and print in the calling thread (printf path)
+   LOG_MODE_ASYNC   ///< Queue in a per-thread ring, a log thread prints
+} logMode_t;
+
+/// Logger counters.
+typedef struct
+{
+   uint64_t enqueued;      ///< Records accepted
+   uint64_t dropped;       ///< Records lost because a ring was full, or all
+                           ///< rings were owned by live threads
+   uint64_t written;       ///< Records printed
+   uint64_t latencySumNs;  ///< Sum of enqueue to print latencies
+   uint64_t latencyMaxNs;  ///< Max enqueue to print latency
+} logStats_t;
+
+/// Starts the logger. In LOG_MODE_ASYNC the log thread is started.
+/// Without calling this function the logger uses LOG_MODE_DIRECT.
+void LOGinitialise(logMode_t mode);
+
+/// Prints all pending records and stops the log thread.
+void LOGclose(void);
+
+/// Output stream for log text, default stdout.
+void LOGsetOutput(FILE *stream);
+
+/// Writes records in the binary format of logbinary.h to stream instead of
+/// text. Must be called before LOGinitialise(), NULL selects text output.
+void LOGsetBinaryOutput(FILE *stream);
+
+/// Runtime level filter, messages with a higher level are discarded
+/// before anything is queued.
+void LOGsetLevel(int level);
+int LOGgetLevel(void);
+
+/// Logs a message with printf() interface. fmt must be a string literal
+/// (or live as long as the program), it is formatted later.
+void LOGwrite(int level, const char fmt[], ...);
+void LOGvwrite(int level, const char fmt[], va_list arg);
+
+/// Waits until all records queued so far are printed and flushed.
+/// Call this before waiting for user input, so the user sees all messages.
+void LOGflush(void);
+
+/// Copies the logger counters in stats.
+void LOGgetStats(logStats_t *stats);
+
+#endif
@@ -17,6 +17,9 @@
  */
 
 /// Standard C libraries
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -30,21 +33,74 @@
 #include "console_functions/keyboard.h"
 #include "console_functions/display.h"
 #include "console_functions/devConsole.h"
+#include "console_functions/script.h"
+#include "console_functions/systemErrors.h"
+
+/// Fault monitor and handler watchdog
+#include "fault_functions/faultMonitor.h"
+#include "watchdog_functions/watchdog.h"
+
+/// Simulation, hardware, subsystems, telemetry and timing libraries
+#include "simulation_functions/physics.h"
+#include "hal_functions/hal.h"
+#include "subsystem_functions/subsystems.h"
+#include "clock_functions/clock.h"
+#include "telemetry_functions/telemetry.h"
+#include "recorder_functions/recorder.h"
+#include "program_functions/program.h"
+#include "gym_functions/gym.h"
+#include "daemon_functions/daemon.h"
+#include "metrics_functions/metrics.h"
+#include "startup_functions/startup.h"
+#include "history_functions/history.h"
+#include "analytics_functions/analytics.h"
 
 /// Protoypes and Variables
 #include "prototypes.h"
 #include "variables.h"
 
-/// Declare variables for the start and end times
-time_t start_time, end_time;
-double elapsed_time;
-
 extern char * eventEnumToText[];
 extern char * stateEnumToText[];
 
 event_t event;
 state_t state;
 
+/// Workout file of --record, NULL if not recorded
+static const char *recordPath = NULL;
+
+/// Workout program of --program, NULL if the speed is set by hand only
+static prgProgram_t *program = NULL;
+static prgRun_t programRun;
+
+/// Workout history of --history, NULL if not kept. The sessions are stored
+/// for the user of --user
+static const char *historyPath = NULL;
+static uint32_t historyUser = 0;
+static hstSession_t session;
+static uint64_t sessionStartNs;
+static phyState_t sessionStart;
+
+/// Analytics of the last running session, see analyseWorkout()
+static anaSums_t workout;
+
+/// --daemon: the events come from other processes (tools/fsmctl), not from the console
+static bool daemonMode = false;
+
+/// Transition model of --model, reloaded on SIGHUP. NULL: the model of main()
+static const char *modelPath = NULL;
+static sigset_t reloadSignals;
+
+/// Machine id of TREADMILL_ID and belt simulation rate of --physics-rate,
+/// for the startup steps
+static unsigned int machine = 0;
+static unsigned int physicsRate = PHY_DEFAULT_RATE_HZ;
+
+/// --queue-policy names, in the order of fsm_queue_policy_t
+static const char *const queuePolicyNames[] =
+{
+    "drop-newest", "drop-oldest", "block", "reject"
+};
+
 /// Subsystem initialization (simulation) functions
 event_t InitialiseSubsystems(void);
 
@@ -66,10 +122,241 @@ event_t EF_CONFIG_DONE(void);
 void delay_us(uint32_t d);
 
 /// Main function where all the c code magic happens!
-int main(void)
+/// usage: fsm-treadmill [--script file] [--physics-rate hz] [--virtual-clock]
+///                      [--record file] [--program file] [--daemon]
+///                      [--queue capacity] [--queue-policy policy] [--model file]
+///                      [--metrics-port port] [--history file] [--user id]
+///        --script file       read the console input from a script, see script.h,
+///                            implies --virtual-clock
+///        --physics-rate hz   steps per second of the belt simulation
+///        --virtual-clock     time only moves when a script advances it
+///        --record file       write the workout of each running session to file,
+///                            CSV if the name ends with .csv, else binary
+///        --program file      run the workout program of file (see program.h)
+///                            in every running session
+///        --daemon            no console input, other processes post the events
+///                            and query the state (see daemon.h)
+///        --queue capacity    events in the FSM event queue, default 128
+///        --queue-policy p    when the queue is full: drop-newest (default),
+///                            drop-oldest, block or reject
+///        --model file        transitions of file instead of the model below,
+///                            kill -HUP reloads it without a restart
+///        --metrics-port port also serve the metrics on 127.0.0.1:port,
+///                            not only on the UNIX socket (see metrics.h)
+///        --history file      add a summary of each running session to the
+///                            workout history of file (see history.h)
+///        --user id           user of the sessions in the history, default 0
+int main(int argc, char *argv[])
 {
-    /// sets all vallues to 0
-    resetStat();
+    uint16_t metricsPort = 0;
+    uint32_t queueCapacity = FSM_QUEUE_CAPACITY;
+    int queuePolicy = FSM_QUEUE_DROP_NEWEST;
+
+    /// Time to S_STANDBY is measured from here
+    STUbegin();
+
+    /// Command line options
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+        {
+            /// Regression tests run the treadmill from a script instead of the keyboard,
+            /// on virtual time so the results do not depend on the machine speed
+            CLKsetSource(CLK_VIRTUAL);
+            if (!SCRinitialise(argv[++i]))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--physics-rate") == 0 && i + 1 < argc)
+        {
+            char *end;
+            unsigned long rate = strtoul(argv[++i], &end, 10);
+
+            if (*end != '\0' || rate < 1 || rate > PHY_MAX_RATE_HZ)
+            {
+                fprintf(stderr, "%s: --physics-rate must be 1 to %u\n", argv[0], PHY_MAX_RATE_HZ);
+                return EXIT_FAILURE;
+            }
+            physicsRate = (unsigned int)rate;
+        }
+        else if (strcmp(argv[i], "--virtual-clock") == 0)
+        {
+            CLKsetSource(CLK_VIRTUAL);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--program") == 0 && i + 1 < argc)
+        {
+            /// Compiled once, the sessions only execute the schedule
+            program = PRGcompile(argv[++i]);
+            if (program == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--daemon") == 0)
+        {
+            daemonMode = true;
+        }
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+        {
+            modelPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc)
+        {
+            const char *arg = argv[++i];
+            char *end;
+            unsigned long port = strtoul(arg, &end, 10);
+
+            if (*arg < '0' || *arg > '9' || *end != '\0' || port < 1 || port > UINT16_MAX)
+            {
+                fprintf(stderr, "%s: --metrics-port must be 1 to %u\n", argv[0], UINT16_MAX);
+                return EXIT_FAILURE;
+            }
+            metricsPort = (uint16_t)port;
+        }
+        else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc)
+        {
+            historyPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--user") == 0 && i + 1 < argc)
+        {
+            const char *arg = argv[++i];
+            char *end;
+            unsigned long long user = strtoull(arg, &end, 10);
+
+            /// strtoull() saturates, so an overflow is out of range as well
+            if (*arg < '0' || *arg > '9' || *end != '\0' || user > UINT32_MAX)
+            {
+                fprintf(stderr, "%s: --user must be 0 to %lu\n", argv[0], (unsigned long)UINT32_MAX);
+                return EXIT_FAILURE;
+            }
+            historyUser = (uint32_t)user;
+        }
+        else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc)
+        {
+            queueCapacity = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--queue-policy") == 0 && i + 1 < argc)
+        {
+            const char *name = argv[++i];
+
+            for (queuePolicy = FSM_QUEUE_REJECT; queuePolicy >= 0; queuePolicy--)
+            {
+                if (strcmp(name, queuePolicyNames[queuePolicy]) == 0)
+                {
+                    break;
+                }
+            }
+            if (queuePolicy < 0)
+            {
+                fprintf(stderr, "%s: unknown queue policy %s\n", argv[0], name);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--script file] [--physics-rate hz] [--virtual-clock]"
+                            " [--record file] [--program file] [--daemon]"
+                            " [--queue capacity] [--queue-policy policy] [--model file]"
+                            " [--metrics-port port] [--history file] [--user id]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /// Sized before any thread adds events
+    if (queueCapacity == 0 ||
+        !FSM_SetEventQueue(queueCapacity, (fsm_queue_policy_t)queuePolicy))
+    {
+        fprintf(stderr, "%s: no event queue for %u events\n", argv[0], (unsigned int)queueCapacity);
+        return EXIT_FAILURE;
+    }
+
+    /// SIGHUP is taken by the model reloader only, block it before any thread starts
+    if (modelPath != NULL)
+    {
+        sigemptyset(&reloadSignals);
+        sigaddset(&reloadSignals, SIGHUP);
+        pthread_sigmask(SIG_BLOCK, &reloadSignals, NULL);
+    }
+
+    /// Long (soak) runs can log in binary format, decode with tools/logdecode
+    const char *binaryLog = getenv("TREADMILL_BINLOG");
+    if (binaryLog != NULL)
+    {
+        FILE *stream = fopen(binaryLog, "wb");
+        if (stream != NULL)
+        {
+            LOGsetBinaryOutput(stream);
+        }
+    }
+
+    /// Debug and simulation messages are printed by the log thread
+    LOGinitialise(LOG_MODE_ASYNC);
+    atexit(LOGclose);
+
+    /// One treadmill appends to a history file, tools/historyquery reads it
+    if (historyPath != NULL)
+    {
+        if (historyUser >= HST_MAX_USERS || !HSTopen(historyPath, true))
+        {
+            fprintf(stderr, "%s: no history in %s for user %u, in use or not a history file?\n",
+                    argv[0], historyPath, (unsigned int)historyUser);
+            return EXIT_FAILURE;
+        }
+        atexit(HSTclose);
+    }
+
+    /// The machine id comes from the environment
+    const char *machineId = getenv("TREADMILL_ID");
+    const unsigned int id = (machineId != NULL) ? (unsigned int)atoi(machineId) : 0;
+
+    /// HAL, clock, belt simulation, motors, telemetry and console are
+    /// started in S_INIT, see InitialiseSubsystems()
+    machine = id;
+
+    /// Report to the gym aggregator (tools/gymaggregator), not from a script run
+    if (CLKgetSource() == CLK_REAL)
+    {
+        if (GYMinitialise(id, gymTelemetry))
+        {
+            DCSdebugSystemInfo("Gym: connected to the aggregator");
+        }
+        atexit(GYMclose);
+
+        /// Prometheus metrics (tools/metricscrape)
+        METsetCollector(metricsCollector);
+        if (METstart(id, metricsPort))
+        {
+            DCSdebugSystemInfo("Metrics: machine %u%s", id, metricsPort ? ", also on loopback" : "");
+            atexit(METstop);
+        }
+        else
+        {
+            DCSdebugSystemInfo("Metrics: not served, socket or port %u in use", (unsigned int)metricsPort);
+        }
+    }
+
+    /// Event posting and state queries for other processes, they replace the console
+    if (daemonMode)
+    {
+        if (!DMNstart(id, remoteEvent))
+        {
+            DCSshowSystemError("Daemon not started, does one run for machine %u?", id);
+            return EXIT_FAILURE;
+        }
+        atexit(DMNstop);
+        DSPsetBatchMode(true);
+        KYBdetach();
+        KYBsetEventSource(DMNgetDoorbell(), DMNdrain);
+        DCSdebugSystemInfo("Daemon: machine %u, use fsmctl to post events", id);
+    }
+
+    /// Only the latest program step matters, the handler reads the setpoints
+    FSM_SetCoalescing(E_PROGRAM_STEP, true);
 
     /// Define the state machine model
     /// First the state and the pointer to the onEntry and onExit functions
@@ -99,6 +386,36 @@ int main(void)
     FSM_AddTransition(&(transition_t){ S_EMERGENCY,   E_EMERGENCY_STOP,    S_DEFAULT     });
     FSM_AddTransition(&(transition_t){ S_ALTERCONFIG, E_EMERGENCY_START,   S_EMERGENCY   });
     FSM_AddTransition(&(transition_t){ S_EMERGENCY,   E_EMERGENCY_STOP,    S_ALTERCONFIG });
+    FSM_AddTransition(&(transition_t){ S_DEFAULT,     E_PROGRAM_STEP,      S_DEFAULT     });
+
+    /// Or the transitions of a model file (tools/models), they can change at runtime
+    if (modelPath != NULL)
+    {
+        char error[160];
+        pthread_t reloader;
+
+        if (!FSM_LoadModel(modelPath, error, sizeof(error)))
+        {
+            fprintf(stderr, "%s: %s\n", argv[0], error);
+            return EXIT_FAILURE;
+        }
+        if (pthread_create(&reloader, NULL, modelReloader, NULL) != 0)
+        {
+            DCSshowSystemError("Model reloader not started");
+        }
+    }
+
+    /// Buttons that post their event directly, without a menu choice
+    KYBbindKey(KYB_KEY_ESCAPE, E_EMERGENCY_START, emergencyButton);
+
+    /// Handler time budgets, waiting for the user does not count.
+    /// A stuck handler while the belt runs stops the treadmill.
+    WDGsetBudget(S_DEFAULT, WDG_DEFAULT_BUDGET_MS, true);
+    WDGsetBudget(S_ALTERCONFIG, WDG_DEFAULT_BUDGET_MS, true);
+    if (!WDGstart())
+    {
+        DCSshowSystemError("Handler watchdog not started");
+    }
 
     FSM_RunStateMachine(S_START, E_INIT);
 
@@ -127,13 +444,16 @@ void S_initOnEntry(void)
 /// Function for executing code when entering state S_STANDBY
 void S_standbyOnEntry(void)
 {
+    /// Time to S_STANDBY, the first entry only
+    STUready();
+
     showCurrentState();
 
     /// Display information for user
-    DSPshow(2,"\tSpeed: %.1f Km/H\n"
-              "\tInclination: %.1f %%\n"
-              "\tDistance: %.1f M\n"
-              "\tChange configuration.\n", myStruct.speed, myStruct.inc, myStruct.distance);
+    DSPshow(2,"\tSpeed: %s Km/H\n"
+              "\tInclination: %s %%\n"
+              "\tDistance: %s M\n"
+              "\tChange configuration.\n", FXP_TEXT(myStruct.speed), FXP_TEXT(myStruct.inc), FXP_TEXT(myStruct.distance));
 
     /// Show user options
     event_t nextevent;
@@ -153,6 +473,8 @@ void S_standbyOnEntry(void)
         nextevent = EF_RUNNING_START();
         FSM_AddEvent(nextevent);
         break;
+    case '\0':      /// A button posted an event directly
+        break;
     default:        /// Show warning here about invalid input
         DSPshow(1,"Invalid input!\nPlease try again!");
         break;
@@ -162,16 +484,28 @@ void S_standbyOnEntry(void)
 /// Function for executing code when entering state S_DEFAULT
 void S_defaultOnEntry(void)
 {
-    /// start timer to keep track of time
-    keepTimeStart();
+    /// A workout program step changes the setpoints
+    float speed, incline;
+    if (PRGtakeSetpoint(&programRun, &speed, &incline))
+    {
+        myStruct.speed = FXPfromFloat(speed);
+        myStruct.inc = FXPfromFloat(incline);
+        updateDis();
+    }
 
     showCurrentState();
 
     /// Display information for user
-    DSPshow(2,"\tSpeed: %.1f Km/H\n"
-              "\tInclination: %.1f %%\n"
-              "\tDistance: %.1f M\n"
-              "\tSystem ready!\n", myStruct.speed, myStruct.inc, myStruct.distance);
+    DSPshow(2,"\tSpeed: %s Km/H\n"
+              "\tInclination: %s %%\n"
+              "\tDistance: %s M\n"
+              "\tSystem ready!\n", FXP_TEXT(myStruct.speed), FXP_TEXT(myStruct.inc), FXP_TEXT(myStruct.distance));
+    if (program != NULL)
+    {
+        DSPshow(3, "Program: %u of %u s%s", PRGelapsedMs(&programRun) / 1000,
+                program->durationMs / 1000,
+                (PRGgetStatus(&programRun) == PRG_DONE) ? ", done" : "");
+    }
 
     /// Show user options
     event_t nextevent;
@@ -188,37 +522,36 @@ void S_defaultOnEntry(void)
     switch (navigation)
     {
     case 'P':
-        /// Function call to update Distance based on time.
-        keepTimeStop();
+        /// Take over the distance of the belt simulation.
         updateDis();
 
         nextevent = EF_PAUSE();
         FSM_AddEvent(nextevent);
         break;
     case 'C':
-        /// Function call to update Distance based on time.
-        keepTimeStop();
+        /// Take over the distance of the belt simulation.
         updateDis();
 
         nextevent = EF_CONFIG_CHANGE();
         FSM_AddEvent(nextevent);
         break;
     case 'E':
-        /// Function call to update Distance based on time.
-        keepTimeStop();
+        /// Take over the distance of the belt simulation.
         updateDis();
 
         nextevent = EF_EMERGENCY_START();
         FSM_AddEvent(nextevent);
         break;
     case 'Q':
-        /// Function call to update Distance based on time.
-        keepTimeStop();
+        /// Take over the distance of the belt simulation.
         updateDis();
 
         nextevent = EF_RUNNING_STOP();
         FSM_AddEvent(nextevent);
         break;
+    case '\0':
+        /// A button posted an event directly
+        break;
     default:
         DSPshow(1,"Invalid input!\nPlease try again!");
         break;
@@ -231,11 +564,11 @@ void S_diagnosticsOnEntry(void)
     showCurrentState();
 
     /// Show user information
-    DSPshow(2,"\tSpeed: %.1f Km/H\n"
-              "\tInclination: %.1f %%\n"
-              "\tDistance: %.1f M\n"
+    DSPshow(2,"\tSpeed: %s Km/H\n"
+              "\tInclination: %s %%\n"
+              "\tDistance: %s M\n"
               "\tDiagnostic mode\n"
-              "\tCleared for maintenance duties.\n", myStruct.speed, myStruct.inc, myStruct.distance);
+              "\tCleared for maintenance duties.\n", FXP_TEXT(myStruct.speed), FXP_TEXT(myStruct.inc), FXP_TEXT(myStruct.distance));
 
     /// Show user options
     event_t nextevent;
@@ -253,6 +586,11 @@ void S_diagnosticsOnEntry(void)
         break;
     case 'O':
         /// Other things here that are Diagnostics related
+        showDiagnostics();
+        S_diagnosticsOnEntry();
+        break;
+    case '\0':
+        /// A button posted an event directly
         break;
     default:
         DSPshow(1,"Invalid input!\nPlease try again!");
@@ -263,16 +601,13 @@ void S_diagnosticsOnEntry(void)
 /// Function for executing code when entering state S_ALTERCONFIG
 void S_alterconfigOnEntry(void)
 {
-    /// start timer to keep track of time
-    keepTimeStart();
-
     showCurrentState();
 
     /// Display information for user
-    DSPshow(2,"\tSpeed: %.1f Km/H\n"
-              "\tInclination: %.1f %%\n"
-              "\tDistance: %.1f M\n"
-              "\tChange configuration.\n", myStruct.speed, myStruct.inc, myStruct.distance);
+    DSPshow(2,"\tSpeed: %s Km/H\n"
+              "\tInclination: %s %%\n"
+              "\tDistance: %s M\n"
+              "\tChange configuration.\n", FXP_TEXT(myStruct.speed), FXP_TEXT(myStruct.inc), FXP_TEXT(myStruct.distance));
 
     /// Show user information
     int navigation;
@@ -294,52 +629,56 @@ void S_alterconfigOnEntry(void)
     case 'S':
         /// change speed here
         printf("Enter a float value: ");
-        fgets(input, sizeof(input), stdin); /// get user input
+        KYBgetline(input, sizeof(input)); /// get user input
 
-        myStruct.speed = atof(input); /// convert input string to float and assign to struct value
+        myStruct.speed = FXPparse(input); /// convert input string to a value and assign to struct value
 
-        printf("Struct value: %f\n", myStruct.speed);
+        printf("Struct value: %s\n", FXP_TEXT(myStruct.speed));
 
         S_alterconfigOnEntry();
         break;
     case 'I':
         /// change Incline here
         printf("Enter a float value: ");
-        fgets(input, sizeof(input), stdin); /// get user input
+        KYBgetline(input, sizeof(input)); /// get user input
 
-        myStruct.inc = atof(input); /// convert input string to float and assign to struct value
+        myStruct.inc = FXPparse(input); /// convert input string to a value and assign to struct value
 
-        printf("Struct value: %f\n", myStruct.inc);
+        printf("Struct value: %s\n", FXP_TEXT(myStruct.inc));
 
         S_alterconfigOnEntry();
         break;
     case 'D':
         /// change Incline here
         printf("Enter a float value: ");
-        fgets(input, sizeof(input), stdin); /// get user input
+        KYBgetline(input, sizeof(input)); /// get user input
 
-        myStruct.distance = atof(input); /// convert input string to float and assign to struct value
+        myStruct.distance = FXPparse(input); /// convert input string to a value and assign to struct value
+        /// odometer in mm, the register holds 0 .. UINT32_MAX
+        int64_t odometer = FXPtoMilli(myStruct.distance);
+        HALwrite(HAL_REG_DISTANCE_CMD, (uint32_t)((odometer < 0) ? 0 : (odometer > UINT32_MAX) ? UINT32_MAX : odometer));
 
-        printf("Struct value: %f\n", myStruct.distance);
+        printf("Struct value: %s\n", FXP_TEXT(myStruct.distance));
 
         S_alterconfigOnEntry();
         break;
     case 'E':
-        /// Function call to update Distance based on time.
-        keepTimeStop();
+        /// Take over the distance of the belt simulation.
         updateDis();
 
         nextevent = EF_EMERGENCY_START();
         FSM_AddEvent(nextevent);
         break;
     case 'C':
-        /// Function call to update Distance based on time.
-        keepTimeStop();
+        /// Take over the distance of the belt simulation.
         updateDis();
 
         nextevent = EF_CONFIG_DONE();
         FSM_AddEvent(nextevent);
         break;
+    case '\0':
+        /// A button posted an event directly
+        break;
     default:
         DSPshow(1,"Invalid input!\nPlease try again!");
         break;
@@ -349,14 +688,21 @@ void S_alterconfigOnEntry(void)
 /// Function for executing code when entering state S_EMERGENCY
 void S_emergencyOnEntry(void)
 {
+    /// Ends the fault to emergency latency measurement
+    FLTemergencyEntered();
+
+    /// The workout program waits until the emergency is over
+    PRGsuspend(&programRun);
+    session.flags |= HST_FLAG_EMERGENCY;
+
     showCurrentState();
 
     /// Show user information
-    DSPshow(2,"\tSpeed: %.1f Km/H\n"
-              "\tInclination: %.1f %%\n"
-              "\tDistance: %.1f M\n"
+    DSPshow(2,"\tSpeed: %s Km/H\n"
+              "\tInclination: %s %%\n"
+              "\tDistance: %s M\n"
               "\tEmergency mode\n",
-            myStruct.speed, myStruct.inc, myStruct.distance);
+            FXP_TEXT(myStruct.speed), FXP_TEXT(myStruct.inc), FXP_TEXT(myStruct.distance));
 
     /// Show user options
     event_t nextevent;
@@ -379,6 +725,9 @@ void S_emergencyOnEntry(void)
         S_emergencyOnEntry();
         /// Other things here that are Emergency related
         break;
+    case '\0':
+        /// A button posted an event directly
+        break;
     default:
         DSPshow(1,"Invalid input!\nPlease try again!");
         break;
@@ -407,6 +756,9 @@ void S_pauseOnEntry(void)
         nextevent = EF_RESUME();
         FSM_AddEvent(nextevent);
         break;
+    case '\0':
+        /// A button posted an event directly
+        break;
     default:
         DCSdebugSystemInfo("Undefined this should not happen");
         DCSdebugSystemInfo("Go to emergency state");
@@ -418,17 +770,126 @@ void S_pauseOnEntry(void)
 /// Subsystem (simulation) functions
 event_t InitialiseSubsystems(void)
 {
-    /// state_t state;       /// Deze moet misschien blijven staan? Comment Colin: exces function? look if time allows.
-    DSPinitialise();
-    DSPshowDisplay();
-    KYBinitialise();
+    /// The startup graph, a step only waits for the steps in its After column.
+    /// Independent steps run at the same time, see startup.h. Without a
+    /// hardware simulator the belt simulation plays the motors.
+    enum { STEP_HAL, STEP_CLOCK, STEP_BELT, STEP_MOTORS, STEP_TELEMETRY, STEP_DISPLAY, STEP_KEYBOARD };
+    static const stuStep_t steps[] =
+    {
+        /// Name         Init and self-test  Error bit            After
+        { "hal",         startHal,           ERR_INIT_HAL,        0 },
+        { "clock",       startClock,         STU_NO_ERROR,        0 },
+        { "belt",        startBelt,          ERR_INIT_MOTORS,     1u << STEP_CLOCK },
+        { "motors",      startMotors,        ERR_INIT_MOTORS,     (1u << STEP_HAL) | (1u << STEP_BELT) },
+        { "telemetry",   startTelemetry,     ERR_INIT_TELEMETRY,  0 },
+        { "display",     startDisplay,       STU_NO_ERROR,        0 },
+        { "keyboard",    startKeyboard,      STU_NO_ERROR,        0 },
+    };
+
+    bool passed = STUrun(steps, sizeof(steps) / sizeof(steps[0]));
 
-    DSPshow(2,"System Initialized No errors");
+    /// sets all vallues to 0
+    resetStat();
+
+    showStartup();
+
+    /// The display is drawn once, with the result of the self-tests
+    if (passed)
+    {
+        DSPshow(2,"System Initialized No errors");
+    }
+    else
+    {
+        DSPshow(2,"System Initialized with errors %s", getSystemErrorBitsString());
+    }
 
     showCurrentState();
     return(E_TREADMILL);        /// Volgens mij moet dit E_INIT zijn, maar dan werkt het niet
 }
 
+/// Startup step: motor and brake I/O, a hardware simulator (tools/hwsim) if
+/// one runs for this machine, else the belt simulation of this process plays
+/// the devices. Self-test: a value written to the echo register comes back.
+bool startHal(void)
+{
+    if (HALinitialise(machine))
+    {
+        DCSdebugSystemInfo("HAL: connected to hardware simulator %u", machine);
+        atexit(HALclose);
+    }
+    HALsetIrqHandler(halInterrupt);
+
+    /// The hardware simulator copies the echo when it answers the doorbell
+    const uint32_t pattern = 0xA5000000u | (uint32_t)(CLKrealNs() & 0xFFFFFFu);
+    const uint64_t deadline = CLKrealNs() + 100 * CLK_NS_PER_MS;
+
+    HALwrite(HAL_REG_ECHO_CMD, pattern);
+    while (HALread(HAL_REG_ECHO) != pattern)
+    {
+        if (CLKrealNs() > deadline)
+        {
+            return false;
+        }
+        usleep(100);
+    }
+    return true;
+}
+
+/// Startup step: the timers run in the clock thread, or on CLKadvance()
+/// with the virtual clock.
+bool startClock(void)
+{
+    return CLKstart();
+}
+
+/// Startup step: the belt simulation runs on a clock timer at a fixed rate.
+/// Self-test: the belt stands still.
+bool startBelt(void)
+{
+    phyState_t belt;
+
+    if (!PHYstart(physicsRate))
+    {
+        return false;
+    }
+    PHYgetState(&belt);
+    return belt.speed == 0.0f;
+}
+
+/// Startup step: the motor controllers run in their own control thread, on
+/// the HAL registers. Self-test: no motor faults and no motor command.
+bool startMotors(void)
+{
+    subStatus_t motors;
+
+    if (!SUBstart(SUB_DEFAULT_RATE_HZ))
+    {
+        return false;
+    }
+    SUBgetStatus(&motors);
+    return motors.faults == 0 && motors.speedCommand == 0.0f && motors.inclineCommand == 0.0f;
+}
+
+/// Startup step: publish telemetry in shared memory.
+bool startTelemetry(void)
+{
+    return TLMinitialise(machine);
+}
+
+/// Startup step: the display buffer, InitialiseSubsystems() draws it.
+bool startDisplay(void)
+{
+    DSPinitialise();
+    return true;
+}
+
+/// Startup step: the keyboard in raw mode if stdin is a terminal.
+bool startKeyboard(void)
+{
+    KYBinitialise();
+    return true;
+}
+
 /// Event for transitioning from S_INIT to S_STANDBY
 event_t	TREADMILL(void)
 {
@@ -465,9 +926,17 @@ event_t EF_RUNNING_START(void)
 {
     /// Allows access to Variables in Struct Note:Use s1. before variable
     /// setting starting values
-    myStruct.speed = 0.8;
+    myStruct.speed = FXP_CONSTANT(0.8);
     myStruct.inc = 0;
 
+    /// A new session, the recorder samples in the clock thread
+    RECstart(REC_DEFAULT_INTERVAL_MS);
+    if (program != NULL)
+    {
+        PRGstart(&programRun, program, programStep, NULL);
+    }
+    historyStart();
+
     showCurrentState();
     return (E_RUNNING_START);
 }
@@ -478,6 +947,20 @@ event_t EF_RUNNING_STOP(void)
     /// stopping treadmill with this function
     saveStat();
 
+    /// End of the session
+    PRGstop(&programRun);
+    if (program != NULL)
+    {
+        DSPshow(3, "");
+    }
+    RECstop();
+    if (recordPath != NULL && !RECexport(recordPath))
+    {
+        DCSshowSystemError("Workout not written to %s", recordPath);
+    }
+    analyseWorkout();
+    historyEnd();
+
     showCurrentState();
     return (E_RUNNING_STOP);
 }
@@ -487,6 +970,7 @@ event_t EF_PAUSE(void)
 {    
     /// Set speed of treadmill to zero. Keep other options the same.
     saveStat();
+    PRGsuspend(&programRun);
 
     showCurrentState();
     return (E_PAUSE);
@@ -497,6 +981,7 @@ event_t EF_RESUME(void)
 {
     /// Restore user configured speed here
     getStat();
+    PRGresume(&programRun);
 
     showCurrentState();
     return (E_RESUME);
@@ -522,6 +1007,7 @@ event_t EF_EMERGENCY_STOP(void)
 
     /// Save running stats for continuing running after emergency.
     saveStat();
+    PRGresume(&programRun);
 
     showCurrentState();
     return (E_EMERGENCY_STOP);
@@ -569,6 +1055,424 @@ void showCurrentState(void)
 
     /// Show current state to user
     DCSdebugSystemInfo("State: %s", stateEnumToText[state]);
+
+    /// Speed and inclination may have been changed, the motors follow them.
+    /// The emergency brake is engaged as long as the FSM is in S_EMERGENCY.
+    SUBsetSetpoint(FXPtoFloat(myStruct.speed), FXPtoFloat(myStruct.inc));
+    SUBsetBrake(state == S_EMERGENCY);
+    updateDis();
+
+    /// Every state change passes here, so this is where external dashboards get updated
+    publishTelemetry();
+}
+
+/// Function for publishing the current stats and state in shared memory
+void publishTelemetry(void)
+{
+    tlmSnapshot_t snapshot =
+    {
+        .speed = FXPtoFloat(myStruct.speed),
+        .inc = FXPtoFloat(myStruct.inc),
+        .distance = FXPtoFloat(myStruct.distance),
+        .tSpeed = FXPtoFloat(myStruct.tSpeed),
+        .tInc = FXPtoFloat(myStruct.tInc),
+        .state = FSM_GetState(),
+        .event = event,
+        .errorBits = getSystemErrorBits(),
+        .timestampNs = CLKnowNs(),
+    };
+
+    TLMpublish(&snapshot);
+
+    /// The gym aggregator gets the state changes
+    static state_t publishedState = S_NO;
+    if (snapshot.state != publishedState)
+    {
+        GYMstateChange((uint8_t)publishedState, (uint8_t)event, (uint8_t)snapshot.state);
+        DMNpublish(snapshot.state, event);
+        publishedState = snapshot.state;
+    }
+}
+
+/// Telemetry frame for the gym aggregator, called in the clock thread
+void gymTelemetry(gymTelemetryFrame_t *frame)
+{
+    frame->speed = (int32_t)HALread(HAL_REG_SPEED);
+    frame->incline = (int32_t)HALread(HAL_REG_INCLINE);
+    frame->distance = (int32_t)HALread(HAL_REG_DISTANCE);
+    frame->errorBits = getSystemErrorBits();
+    frame->state = (uint8_t)FSM_GetState();
+}
+
+/// Function for showing diagnostic counters of the subsystems
+void showDiagnostics(void)
+{
+    showStartup();
+
+    fsm_queue_stats_t queue;
+
+    FSM_GetQueueStats(&queue);
+    DCSdebugSystemInfo("Events: %u of %u queued, high water %u, %s, %llu overflows, %llu dropped, %llu rejected, %llu blocked",
+                       queue.queued, queue.capacity, queue.highWater,
+                       queuePolicyNames[queue.policy], (unsigned long long)queue.overflows,
+                       (unsigned long long)queue.dropped, (unsigned long long)queue.rejected,
+                       (unsigned long long)queue.blocked);
+    DCSdebugSystemInfo("Events: %llu coalesced with a pending event, as many dispatches saved",
+                       (unsigned long long)queue.coalesced);
+
+    fsm_model_stats_t model;
+
+    FSM_GetModelStats(&model);
+    DCSdebugSystemInfo("Model: %u transitions, version %u, %llu not valid, swap grace max %.1f us",
+                       (unsigned int)model.transitions, model.version,
+                       (unsigned long long)model.failures, model.graceMaxNs / 1e3);
+
+    kybStats_t kyb;
+
+    KYBgetStats(&kyb);
+    DCSdebugSystemInfo("Keyboard: %llu keys in %llu reads, %llu button events",
+                       (unsigned long long)kyb.keys, (unsigned long long)kyb.reads,
+                       (unsigned long long)kyb.events);
+    DCSdebugSystemInfo("Keyboard: key to event latency avg %.1f us, max %.1f us",
+                       kyb.events ? kyb.latencySumNs / 1e3 / kyb.events : 0.0,
+                       kyb.latencyMaxNs / 1e3);
+
+    phyStats_t phy;
+    phyState_t belt;
+
+    PHYgetStats(&phy);
+    PHYgetState(&belt);
+    DCSdebugSystemInfo("Belt: %.2f km/h, %.2f %%, %.1f m, %.0f J, simulated %.1f s",
+                       belt.speed, belt.incline, belt.distance, belt.energy, belt.time);
+    DCSdebugSystemInfo("Belt: %llu steps at %u Hz, %llu missed, step avg %.0f ns max %.0f ns, late max %.1f us",
+                       (unsigned long long)phy.steps, phy.rateHz,
+                       (unsigned long long)phy.missed,
+                       phy.steps ? (double)phy.costSumNs / phy.steps : 0.0,
+                       (double)phy.costMaxNs, phy.lateMaxNs / 1e3);
+
+    subStats_t sub;
+    subStatus_t motors;
+
+    SUBgetStats(&sub);
+    SUBgetStatus(&motors);
+    DCSdebugSystemInfo("Motors: speed set %.2f cmd %.2f km/h, incline set %.2f cmd %.2f %%, brake %s, faults %02X",
+                       motors.speedSetpoint, motors.speedCommand,
+                       motors.inclineSetpoint, motors.inclineCommand,
+                       motors.brake ? "on" : "off", (unsigned int)motors.faults);
+    DCSdebugSystemInfo("Control: %llu steps at %u Hz%s, %llu missed, jitter avg %.1f us max %.1f us",
+                       (unsigned long long)sub.steps, sub.rateHz,
+                       sub.realtime ? " SCHED_FIFO" : "", (unsigned long long)sub.missed,
+                       sub.steps ? sub.jitterSumNs / 1e3 / sub.steps : 0.0,
+                       sub.jitterMaxNs / 1e3);
+    DCSdebugSystemInfo("Control: setpoint to motor command latency avg %.1f us, max %.1f us",
+                       sub.setpoints ? sub.latencySumNs / 1e3 / sub.setpoints : 0.0,
+                       sub.latencyMaxNs / 1e3);
+
+    fltStats_t flt;
+
+    FLTgetStats(&flt);
+    DCSdebugSystemInfo("Faults: %llu raised, %llu emergencies, fault to S_EMERGENCY avg %.1f us max %.1f us",
+                       (unsigned long long)flt.raised, (unsigned long long)flt.emergencies,
+                       flt.emergencies ? flt.latencySumNs / 1e3 / flt.emergencies : 0.0,
+                       flt.latencyMaxNs / 1e3);
+
+    for (int s = 0; s < NOF_STATES; s++)
+    {
+        wdgStats_t wdg;
+
+        WDGgetStats((state_t)s, &wdg);
+        if (wdg.runs == 0)
+        {
+            continue;
+        }
+        DCSdebugSystemInfo("Watchdog: %-14s %llu handlers, %llu overruns, busy avg %.1f us max %.1f us, budget %u ms%s",
+                           stateEnumToText[s], (unsigned long long)wdg.runs,
+                           (unsigned long long)wdg.overruns,
+                           wdg.busySumNs / 1e3 / wdg.runs, wdg.busyMaxNs / 1e3,
+                           wdg.budgetMs, wdg.escalate ? " (stops)" : "");
+    }
+
+    recStats_t rec;
+
+    RECgetStats(&rec);
+    DCSdebugSystemInfo("Recorder: %u samples every %u ms, %u keyframes, %u downsamples, %llu dropped",
+                       rec.samples, rec.intervalMs, rec.blocks, rec.downsamples,
+                       (unsigned long long)rec.dropped);
+    DCSdebugSystemInfo("Recorder: sample in clock thread avg %.1f us, max %.1f us",
+                       rec.appended ? rec.appendSumNs / 1e3 / rec.appended : 0.0,
+                       rec.appendMaxNs / 1e3);
+
+    gymStats_t gym;
+
+    GYMgetStats(&gym);
+    DCSdebugSystemInfo("Gym: %s, %llu messages in %llu datagrams, %llu sendmmsg calls, %llu dropped",
+                       gym.connected ? "connected" : "no aggregator",
+                       (unsigned long long)gym.frames, (unsigned long long)gym.datagrams,
+                       (unsigned long long)gym.sendCalls, (unsigned long long)gym.dropped);
+
+    dmnStats_t dmn;
+
+    DMNgetStats(&dmn);
+    DCSdebugSystemInfo("Daemon: %u clients, %u events posted, %u taken, %llu rejected, %llu ring full, %llu doorbells",
+                       dmn.clients, dmn.posted, dmn.taken, (unsigned long long)dmn.rejected,
+                       (unsigned long long)dmn.full, (unsigned long long)dmn.doorbells);
+
+    halStats_t hal;
+
+    HALgetStats(&hal);
+    DCSdebugSystemInfo("HAL: %s, %llu reads, %llu writes, %llu doorbells, %llu interrupts",
+                       hal.external ? "hardware simulator" : "local",
+                       (unsigned long long)hal.reads, (unsigned long long)hal.writes,
+                       (unsigned long long)hal.doorbells, (unsigned long long)hal.interrupts);
+    DCSdebugSystemInfo("HAL: interrupt latency avg %.1f us, max %.1f us",
+                       hal.interrupts ? hal.irqLatencySumNs / 1e3 / hal.interrupts : 0.0,
+                       hal.irqLatencyMaxNs / 1e3);
+
+    DCSdebugSystemInfo("Analytics: %s kernels", ANAkernelText(ANAgetKernel()));
+
+    if (historyPath != NULL)
+    {
+        hstTotals_t user;
+
+        HSTquery(historyUser, INT64_MIN, INT64_MAX, &user);
+        DCSdebugSystemInfo("History: %llu sessions, user %u %llu sessions %.1f km, %llu records read",
+                           (unsigned long long)HSTcount(), (unsigned int)historyUser,
+                           (unsigned long long)user.sessions, user.distanceMm / 1e6,
+                           (unsigned long long)user.visited);
+    }
+}
+
+/// Function for showing the startup timeline and the time to S_STANDBY
+void showStartup(void)
+{
+    stuTimeline_t startup;
+
+    STUgetTimeline(&startup);
+    for (unsigned int i = 0; i < startup.nSteps; i++)
+    {
+        const stuTiming_t *step = &startup.steps[i];
+
+        DCSdebugSystemInfo("Startup: %-10s %-7s %8.3f ms to %8.3f ms, %7.3f ms",
+                           step->name, STUresultText(step->result),
+                           step->startNs / 1e6, step->endNs / 1e6,
+                           (step->endNs - step->startNs) / 1e6);
+    }
+    DCSdebugSystemInfo("Startup: steps %.3f ms (%.3f ms one by one), %u failed, %u skipped, S_STANDBY %s%.3f ms",
+                       (startup.runEndNs - startup.runStartNs) / 1e6, startup.serialNs / 1e6,
+                       startup.failed, startup.skipped,
+                       startup.readyNs ? "after " : "not yet, ", startup.readyNs / 1e6);
+}
+
+/// Function for keeping the start of a running session for the history
+void historyStart(void)
+{
+    memset(&session, 0, sizeof(session));
+    session.start = (int64_t)time(NULL);
+    session.user = historyUser;
+    session.flags = (program != NULL) ? HST_FLAG_PROGRAM : 0;
+    sessionStartNs = CLKnowNs();
+    PHYgetState(&sessionStart);
+}
+
+/// Function for the workout figures of the recorded session, after RECstop()
+void analyseWorkout(void)
+{
+    static int32_t speed[REC_CAPACITY];
+    static int32_t incline[REC_CAPACITY];
+    int32_t *columns[REC_NOF_COLUMNS] = {[REC_SPEED] = speed, [REC_INCLINE] = incline};
+    anaSeries_t series = {speed, incline, 0, 0};
+    anaReport_t report;
+
+    series.n = RECgetColumns(columns, REC_CAPACITY, &series.intervalMs);
+    ANAsum(&series, &workout);
+    ANAreport(&workout, series.intervalMs, phyDefaultConfig.userMass, &report);
+    DCSdebugSystemInfo("Workout: %.2f km in %.1f min, avg %.1f km/h, max %.1f km/h, climbed %.1f m, %.0f kcal",
+                       report.distanceM / 1e3, report.movingS / 60.0, report.averageSpeed,
+                       report.maxSpeed, report.climbM, report.kcal);
+}
+
+/// Function for a session figure in the history, clamped to 0 .. UINT32_MAX:
+/// S_ALTERCONFIG can lower the distance of the belt during the session.
+uint32_t historyValue(double value)
+{
+    if (!(value > 0.0))
+    {
+        return 0;
+    }
+    return (value < (double)UINT32_MAX) ? (uint32_t)value : UINT32_MAX;
+}
+
+/// Function for adding the summary of the running session to the history,
+/// after analyseWorkout()
+void historyEnd(void)
+{
+    if (historyPath == NULL)
+    {
+        return;
+    }
+
+    phyState_t belt;
+    int32_t maxSpeed = (workout.maxSpeed > 0) ? workout.maxSpeed : 0;
+
+    PHYgetState(&belt);
+    session.durationMs = historyValue((double)(CLKnowNs() - sessionStartNs) / 1e6);
+    session.distanceMm = historyValue((belt.distance - sessionStart.distance) * 1000.0);
+    session.energyJ = historyValue(belt.energy - sessionStart.energy);
+    session.maxSpeed = (uint16_t)((maxSpeed < UINT16_MAX) ? maxSpeed : UINT16_MAX);
+    if (!HSTappend(&session))
+    {
+        DCSshowSystemError("Session not added to the history in %s", historyPath);
+    }
+}
+
+/// Emergency stop button, bound to the Escape key.
+/// Does what S_DEFAULT does before E_EMERGENCY_START, the keyboard posts the event.
+void emergencyButton(void)
+{
+    /// Take over the distance of the belt simulation.
+    updateDis();
+
+    (void)EF_EMERGENCY_START();
+}
+
+/// HAL interrupt handler, runs in the HAL interrupt thread.
+/// The emergency button of the hardware posts E_EMERGENCY_START.
+void halInterrupt(uint32_t irqBits)
+{
+    if ((irqBits & HAL_IRQ_BUTTON) &&
+        (HALread(HAL_REG_BUTTONS) & HAL_BUTTON_EMERGENCY) &&
+        FSM_HasTransition(FSM_GetState(), E_EMERGENCY_START))
+    {
+        FSM_AddEvent(E_EMERGENCY_START);
+        KYBwake();
+    }
+}
+
+/// Workout program step, called in the clock thread. The FSM takes the new
+/// setpoints when it enters S_DEFAULT again, so it stays their only writer.
+void programStep(void *ctx, float speed, float incline)
+{
+    (void)ctx;
+    (void)speed;
+    (void)incline;
+
+    /// Steps while the FSM is busy are taken together (coalesced)
+    if (FSM_HasTransition(FSM_GetState(), E_PROGRAM_STEP) &&
+        FSM_AddEvent(E_PROGRAM_STEP) == FSM_EVENT_QUEUED)
+    {
+        KYBwake();
+    }
+}
+
+/// Metrics of the subsystems for the metrics endpoint, runs in the metrics
+/// thread. Only counters that are read without locks.
+void metricsCollector(metWriter_t *writer)
+{
+    char labels[64];
+
+    METfamily(writer, "treadmill_watchdog_overruns_total", "counter", "Handler calls over budget");
+    for (int s = 1; s < NOF_STATES; s++)
+    {
+        wdgStats_t wdg;
+
+        WDGgetStats((state_t)s, &wdg);
+        snprintf(labels, sizeof(labels), "state=\"%s\"", stateEnumToText[s]);
+        METsample(writer, "treadmill_watchdog_overruns_total", labels, (double)wdg.overruns);
+    }
+
+    fltStats_t flt;
+
+    FLTgetStats(&flt);
+    METfamily(writer, "treadmill_faults_total", "counter", "Faults raised");
+    METsample(writer, "treadmill_faults_total", NULL, (double)flt.raised);
+    METfamily(writer, "treadmill_emergencies_total", "counter", "Emergency stops posted by faults");
+    METsample(writer, "treadmill_emergencies_total", NULL, (double)flt.emergencies);
+
+    dmnStats_t dmn;
+
+    DMNgetStats(&dmn);
+    METfamily(writer, "treadmill_daemon_events_posted", "gauge", "Events posted by clients, wraps");
+    METsample(writer, "treadmill_daemon_events_posted", NULL, dmn.posted);
+    METfamily(writer, "treadmill_daemon_events_rejected_total", "counter", "Client events not accepted");
+    METsample(writer, "treadmill_daemon_events_rejected_total", NULL, (double)dmn.rejected);
+    METfamily(writer, "treadmill_daemon_ring_full_total", "counter", "DMNpost() on a full ring");
+    METsample(writer, "treadmill_daemon_ring_full_total", NULL, (double)dmn.full);
+
+    stuTimeline_t startup;
+
+    STUgetTimeline(&startup);
+    METfamily(writer, "treadmill_startup_ready_seconds", "gauge", "Process start to S_STANDBY, 0 before");
+    METsample(writer, "treadmill_startup_ready_seconds", NULL, startup.readyNs / 1e9);
+    METfamily(writer, "treadmill_startup_step_seconds", "gauge", "Time of the startup step");
+    METfamily(writer, "treadmill_startup_step_passed", "gauge", "1 if the startup step passed");
+    for (unsigned int i = 0; i < startup.nSteps; i++)
+    {
+        snprintf(labels, sizeof(labels), "step=\"%s\"", startup.steps[i].name);
+        METsample(writer, "treadmill_startup_step_seconds", labels,
+                  (startup.steps[i].endNs - startup.steps[i].startNs) / 1e9);
+        METsample(writer, "treadmill_startup_step_passed", labels,
+                  startup.steps[i].result == STU_PASSED ? 1.0 : 0.0);
+    }
+}
+
+/// Reloads the model of --model on every SIGHUP. Parsing and validation run
+/// in this thread, the FSM only sees the swap of the matrix.
+void *modelReloader(void *arg)
+{
+    int signal;
+
+    (void)arg;
+    while (sigwait(&reloadSignals, &signal) == 0)
+    {
+        char error[160];
+        fsm_model_stats_t model;
+
+        if (FSM_LoadModel(modelPath, error, sizeof(error)))
+        {
+            FSM_GetModelStats(&model);
+            DCSdebugSystemInfo("Model: %s version %u, %u transitions",
+                               modelPath, model.version, (unsigned int)model.transitions);
+        }
+        else
+        {
+            DCSdebugSystemInfo("Model: not reloaded, %s", error);
+        }
+    }
+    return NULL;
+}
+
+/// Event of a client of the daemon, called in the FSM thread while a handler
+/// waits for input. Does what the menu choice of the event does.
+bool remoteEvent(event_t remote)
+{
+    static event_t (*const eventFunctions[NOF_EVENTS])(void) =
+    {
+        [E_TREADMILL]         = TREADMILL,
+        [E_RUNNING_START]     = EF_RUNNING_START,
+        [E_RUNNING_STOP]      = EF_RUNNING_STOP,
+        [E_DIAGNOSTICS_START] = EF_DIAGNOSTICS_START,
+        [E_DIAGNOSTICS_STOP]  = EF_DIAGNOSTICS_STOP,
+        [E_CONFIG_CHANGE]     = EF_CONFIG_CHANGE,
+        [E_CONFIG_DONE]       = EF_CONFIG_DONE,
+        [E_PAUSE]             = EF_PAUSE,
+        [E_RESUME]            = EF_RESUME,
+        [E_EMERGENCY_START]   = EF_EMERGENCY_START,
+        [E_EMERGENCY_STOP]    = EF_EMERGENCY_STOP,
+    };
+
+    if (!FSM_HasTransition(FSM_GetState(), remote))
+    {
+        return false;
+    }
+
+    /// Take over the distance of the belt simulation.
+    updateDis();
+
+    /// A full queue rejects, the daemon counts the event as rejected
+    fsm_add_result_t result =
+        FSM_AddEvent((eventFunctions[remote] != NULL) ? eventFunctions[remote]() : remote);
+
+    return (result != FSM_EVENT_DROPPED && result != FSM_EVENT_REJECTED);
 }
 
 /// Function for keeping track of current stats
@@ -596,18 +1500,9 @@ void getStat(void)
 /// Function for keeping track of distance
 void updateDis(void)
 {
-    /// unfortionatly due to time constrains this function will not be impletemented
-    /// my knowledge of keeping track of timers in C is limited and will take to long
-    /// to learn/ implement in thi project. (Colin)
-
-    /// Initialize a temporary float variable for calculating the distance.
-    float TDistance;
-
-    /// Calculate distance by dividing elapsed time with current speed.
-    TDistance = elapsed_time * (myStruct.speed / 3.6);
-
-    /// Add the temporary distance calculation to the saved distance in struct myStruct.
-    myStruct.distance = myStruct.distance + TDistance;
+    /// The odometer counts continuously, also when the speed changes in the
+    /// middle of a state.
+    myStruct.distance = FXPfromMilli((int64_t)HALread(HAL_REG_DISTANCE));
 }
 
 /// Function to reset all stats
@@ -619,21 +1514,6 @@ void resetStat(void)
     myStruct.speed =0;
     myStruct.inc =0;
     myStruct.distance =0;
-}
-
-/// Function for recording the start time
-void keepTimeStart(void)
-{
-    /// Record the start time
-    time(&start_time);
-}
-
-/// Function for recording stop time and measuring difference between start and stop time
-void keepTimeStop(void)
-{
-    /// Record the end time
-    time(&end_time);
 
-    /// Calculate the elapsed time
-    elapsed_time = difftime(end_time, start_time);
+    HALwrite(HAL_REG_DISTANCE_CMD, 0);
 }
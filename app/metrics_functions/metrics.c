@@ -0,0 +1,356 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+#include "fsm_functions/fsm.h"
+#include "clock_functions/clock.h"
+#include "ipc_functions/ipc.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//---------------------------------------------------------------------- Metrics
+
+extern char * stateEnumToText[];
+
+static void (*_Atomic collector)(metWriter_t *writer) = NULL;
+
+static atomic_ullong scrapes = 0;
+static atomic_ullong errors = 0;
+static atomic_ullong scrapeSumNs = 0;
+static _Atomic uint64_t scrapeMaxNs = 0;
+
+void METsetCollector(void (*collect)(metWriter_t *writer))
+{
+   atomic_store(&collector, collect);
+}
+
+void METgetStats(metStats_t *stats)
+{
+   stats->scrapes = atomic_load(&scrapes);
+   stats->errors = atomic_load(&errors);
+   stats->scrapeSumNs = atomic_load(&scrapeSumNs);
+   stats->scrapeMaxNs = atomic_load(&scrapeMaxNs);
+}
+
+/// Appends to the text, a full buffer truncates the scrape and marks it.
+static void append(metWriter_t *writer, const char *fmt, ...)
+{
+   va_list arg;
+
+   if (writer->length >= writer->size)
+   {
+      writer->truncated = true;
+      return;
+   }
+   va_start(arg, fmt);
+   int n = vsnprintf(writer->text + writer->length, writer->size - writer->length, fmt, arg);
+   va_end(arg);
+   if (n > 0)
+   {
+      writer->length += (size_t)n;
+      if (writer->length >= writer->size)
+      {
+         writer->length = writer->size - 1;
+         writer->truncated = true;
+      }
+   }
+}
+
+void METfamily(metWriter_t *writer, const char *name, const char *type,
+               const char *help)
+{
+   append(writer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void METsample(metWriter_t *writer, const char *name, const char *labels,
+               double value)
+{
+   if (labels != NULL)
+   {
+      append(writer, "%s{%s} %.17g\n", name, labels, value);
+   }
+   else
+   {
+      append(writer, "%s %.17g\n", name, value);
+   }
+}
+
+/// A family with one sample.
+static void single(metWriter_t *writer, const char *name, const char *type,
+                   const char *help, double value)
+{
+   METfamily(writer, name, type, help);
+   METsample(writer, name, NULL, value);
+}
+
+void METcollect(metWriter_t *writer)
+{
+   static const char *const policyNames[] = {"drop_newest", "drop_oldest", "block", "reject"};
+   fsm_dispatch_stats_t dispatch;
+   fsm_queue_stats_t queue;
+   fsm_model_stats_t model;
+   char labels[64];
+
+   FSM_GetDispatchStats(&dispatch);
+   FSM_GetQueueStats(&queue);
+   FSM_GetModelStats(&model);
+
+   single(writer, "fsm_events_dispatched_total", "counter", "Events handled by the FSM",
+          (double)dispatch.events);
+   single(writer, "fsm_events_unexpected_total", "counter",
+          "Events without a transition in the current state", (double)dispatch.unexpected);
+
+   METfamily(writer, "fsm_state", "gauge", "1 for the current state");
+   METfamily(writer, "fsm_state_entries_total", "counter", "Transitions into the state");
+   METfamily(writer, "fsm_state_seconds_total", "counter", "Time spent in the state");
+   for (int s = 1; s < NOF_STATES; s++)
+   {
+      snprintf(labels, sizeof(labels), "state=\"%s\"", stateEnumToText[s]);
+      METsample(writer, "fsm_state", labels, (dispatch.state == (state_t)s) ? 1.0 : 0.0);
+      METsample(writer, "fsm_state_entries_total", labels, (double)dispatch.entries[s]);
+      METsample(writer, "fsm_state_seconds_total", labels, dispatch.timeNs[s] / 1e9);
+   }
+
+   single(writer, "fsm_queue_capacity", "gauge", "Events the queue holds", queue.capacity);
+   single(writer, "fsm_queue_depth", "gauge", "Events in the queue", queue.queued);
+   single(writer, "fsm_queue_high_water", "gauge", "Max events in the queue", queue.highWater);
+   METfamily(writer, "fsm_queue_policy", "gauge", "1 for the policy when the queue is full");
+   for (int p = FSM_QUEUE_DROP_NEWEST; p <= FSM_QUEUE_REJECT; p++)
+   {
+      snprintf(labels, sizeof(labels), "policy=\"%s\"", policyNames[p]);
+      METsample(writer, "fsm_queue_policy", labels, (queue.policy == (fsm_queue_policy_t)p) ? 1.0 : 0.0);
+   }
+   single(writer, "fsm_queue_overflows_total", "counter", "FSM_AddEvent() on a full queue",
+          (double)queue.overflows);
+   single(writer, "fsm_queue_dropped_total", "counter", "Events lost on a full queue",
+          (double)queue.dropped);
+   single(writer, "fsm_queue_rejected_total", "counter", "Events rejected on a full queue",
+          (double)queue.rejected);
+   single(writer, "fsm_queue_blocked_total", "counter", "FSM_AddEvent() calls that waited",
+          (double)queue.blocked);
+   single(writer, "fsm_queue_coalesced_total", "counter", "Events merged with a pending one",
+          (double)queue.coalesced);
+
+   single(writer, "fsm_model_version", "gauge", "Swaps of the transition matrix", model.version);
+   single(writer, "fsm_model_transitions", "gauge", "Transitions in the matrix", model.transitions);
+   single(writer, "fsm_model_failures_total", "counter", "Models that were not valid",
+          (double)model.failures);
+
+   void (*collect)(metWriter_t *writer) = atomic_load(&collector);
+   if (collect != NULL)
+   {
+      collect(writer);
+   }
+
+   single(writer, "fsm_metrics_scrapes_total", "counter", "Scrapes served before this one",
+          (double)atomic_load(&scrapes));
+}
+
+#ifdef __linux__
+
+#define MET_REQUEST_SIZE (1024)
+
+static int unixFd = -1;
+static int tcpFd = -1;
+static pthread_t thread;
+static atomic_bool serving = false;
+
+/// Reads the request and answers it, one request per connection.
+static void serve(int sock)
+{
+   static char text[MET_BUFFER_SIZE];
+   char request[MET_REQUEST_SIZE];
+   char header[160];
+   size_t length = 0;
+   const struct timeval timeout = {.tv_sec = 0, .tv_usec = 200000};
+
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+   while (length < sizeof(request) - 1)
+   {
+      ssize_t n = read(sock, request + length, sizeof(request) - 1 - length);
+      if (n <= 0)
+      {
+         break;
+      }
+      length += (size_t)n;
+      request[length] = '\0';
+      if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+      {
+         break;
+      }
+   }
+   request[length] = '\0';
+
+   if (strncmp(request, "GET /metrics ", 13) != 0 && strncmp(request, "GET / ", 6) != 0)
+   {
+      static const char notFound[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+      atomic_fetch_add(&errors, 1);
+      (void)!write(sock, notFound, sizeof(notFound) - 1);
+      close(sock);
+      return;
+   }
+
+   metWriter_t writer = {.text = text, .size = sizeof(text), .length = 0};
+   uint64_t t0 = CLKrealNs();
+   METcollect(&writer);
+   uint64_t ns = CLKrealNs() - t0;
+
+   atomic_fetch_add(&scrapes, 1);
+   atomic_fetch_add(&scrapeSumNs, ns);
+   if (ns > atomic_load(&scrapeMaxNs))
+   {
+      atomic_store(&scrapeMaxNs, ns);
+   }
+
+   // A partial scrape would look like metrics that disappeared
+   if (writer.truncated)
+   {
+      static const char tooLarge[] = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+      atomic_fetch_add(&errors, 1);
+      (void)!write(sock, tooLarge, sizeof(tooLarge) - 1);
+      close(sock);
+      return;
+   }
+
+   int n = snprintf(header, sizeof(header),
+                    "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: %zu\r\n\r\n", writer.length);
+   struct iovec iov[2] =
+   {
+      {.iov_base = header, .iov_len = (size_t)n},
+      {.iov_base = text, .iov_len = writer.length},
+   };
+   struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2};
+   if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)(iov[0].iov_len + iov[1].iov_len))
+   {
+      atomic_fetch_add(&errors, 1);
+   }
+   close(sock);
+}
+
+static void *metricsThread(void *arg)
+{
+   struct pollfd pfds[2] =
+   {
+      {.fd = unixFd, .events = POLLIN},
+      {.fd = tcpFd, .events = POLLIN},
+   };
+
+   (void)arg;
+   while (atomic_load(&serving))
+   {
+      if (poll(pfds, 2, 100) <= 0)
+      {
+         continue;
+      }
+      for (int i = 0; i < 2; i++)
+      {
+         if (pfds[i].revents & POLLIN)
+         {
+            int sock = accept4(pfds[i].fd, NULL, NULL, SOCK_CLOEXEC);
+            if (sock >= 0)
+            {
+               serve(sock);
+            }
+         }
+      }
+   }
+   return NULL;
+}
+
+bool METstart(unsigned int machineId, uint16_t tcpPort)
+{
+   struct sockaddr_un addr;
+
+   if (atomic_load(&serving))
+   {
+      return true;
+   }
+
+   socklen_t length = IPCsocketAddress(&addr, MET_SOCKET_NAME, machineId);
+
+   unixFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (unixFd < 0 || bind(unixFd, (struct sockaddr *)&addr, length) != 0 ||
+       listen(unixFd, 8) != 0)
+   {
+      METstop();
+      return false;
+   }
+
+   // Loopback only, the endpoint has no authentication
+   if (tcpPort != 0)
+   {
+      struct sockaddr_in in =
+      {
+         .sin_family = AF_INET,
+         .sin_port = htons(tcpPort),
+         .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+      };
+      const int on = 1;
+
+      tcpFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (tcpFd >= 0)
+      {
+         setsockopt(tcpFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      }
+      if (tcpFd < 0 || bind(tcpFd, (struct sockaddr *)&in, sizeof(in)) != 0 ||
+          listen(tcpFd, 8) != 0)
+      {
+         METstop();
+         return false;
+      }
+   }
+
+   atomic_store(&serving, true);
+   if (pthread_create(&thread, NULL, metricsThread, NULL) != 0)
+   {
+      atomic_store(&serving, false);
+      METstop();
+      return false;
+   }
+   return true;
+}
+
+void METstop(void)
+{
+   if (atomic_exchange(&serving, false))
+   {
+      pthread_join(thread, NULL);
+   }
+   if (unixFd >= 0)
+   {
+      close(unixFd);
+      unixFd = -1;
+   }
+   if (tcpFd >= 0)
+   {
+      close(tcpFd);
+      tcpFd = -1;
+   }
+}
+
+#else
+
+bool METstart(unsigned int machineId, uint16_t tcpPort)
+{
+   (void)machineId;
+   (void)tcpPort;
+   return false;
+}
+
+void METstop(void)
+{
+}
+
+#endif
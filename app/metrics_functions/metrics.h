@@ -0,0 +1,67 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------- Metrics
+
+/// Metrics endpoint: the FSM and event queue counters in the Prometheus
+/// text format, for Prometheus, curl or tools/metricscrape.
+///
+/// A metrics thread serves HTTP GET /metrics on the abstract UNIX socket of
+/// the machine and, if a port is given, on 127.0.0.1:port. A scrape only
+/// reads counters that their writers update without locks
+/// (FSM_GetDispatchStats(), FSM_GetQueueStats(), FSM_GetModelStats() and
+/// the collector of the application), it never stops the FSM thread.
+
+#define MET_SOCKET_NAME "fsm-treadmill-metrics-%u"  ///< Abstract socket per machine
+#define MET_BUFFER_SIZE (32768)                     ///< Max size of a scrape, a larger one is answered with 500
+
+/// Text of one scrape.
+typedef struct
+{
+   char *text;
+   size_t size;
+   size_t length;
+   bool truncated;   ///< The text did not fit in size
+} metWriter_t;
+
+/// Endpoint counters.
+typedef struct
+{
+   uint64_t scrapes;
+   uint64_t errors;         ///< Bad requests, too large scrapes, failed writes
+   uint64_t scrapeSumNs;    ///< Time to collect and format
+   uint64_t scrapeMaxNs;
+} metStats_t;
+
+/// Starts the metrics thread on the socket of machineId and, if tcpPort is
+/// not 0, on 127.0.0.1:tcpPort.
+/// \return false if a socket cannot be bound, e.g. the port is in use.
+bool METstart(unsigned int machineId, uint16_t tcpPort);
+
+/// Stops the metrics thread and closes the sockets.
+void METstop(void);
+
+/// collect() adds the metrics of the application to every scrape, it runs
+/// in the metrics thread.
+void METsetCollector(void (*collect)(metWriter_t *writer));
+
+/// Starts a metric family: type is "counter" or "gauge".
+void METfamily(metWriter_t *writer, const char *name, const char *type,
+               const char *help);
+
+/// Adds a sample of the family name, labels e.g. "state=\"S_DEFAULT\"" or
+/// NULL.
+void METsample(metWriter_t *writer, const char *name, const char *labels,
+               double value);
+
+/// Formats a complete scrape in writer, what the endpoint serves.
+void METcollect(metWriter_t *writer);
+
+/// Copies the endpoint counters in stats.
+void METgetStats(metStats_t *stats);
+
+#endif
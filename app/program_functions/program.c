@@ -0,0 +1,394 @@
+#include "program.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------- PRoGram
+
+#define PRG_MAX_LINE (256)          ///< Max length of a program line
+#define PRG_MAX_MS   (86400000u)    ///< Max length of a program, one day
+
+/// Compiler state.
+typedef struct
+{
+   const char *path;
+   int lineNumber;
+   prgProgram_t *program;
+   uint32_t capacity;
+   uint32_t atMs;                          ///< End of the compiled segments
+   float speed;                            ///< Setpoints of the last step
+   float incline;
+   int depth;                              ///< Open repeat blocks
+   uint32_t repeatFirst[PRG_MAX_NESTING];  ///< First step of the block
+   uint32_t repeatAtMs[PRG_MAX_NESTING];   ///< Start time of the block
+   long repeatCount[PRG_MAX_NESTING];
+} prgCompiler_t;
+
+/// Guards all runs. The timers of all runs expire in the same thread, the
+/// FSM only takes it to suspend, resume or read a run.
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void stepTimer(void *ctx, uint64_t dueNs);
+
+static bool error(const prgCompiler_t *cc, const char *message)
+{
+   fprintf(stderr, "%s:%d: %s\n", cc->path, cc->lineNumber, message);
+   return false;
+}
+
+/// Appends a step, steps that do not change the setpoints are left out.
+static bool addStep(prgCompiler_t *cc, uint32_t atMs, float speed, float incline)
+{
+   prgProgram_t *p = cc->program;
+
+   if (p->nSteps > 0 && speed == cc->speed && incline == cc->incline)
+   {
+      return true;
+   }
+   if (p->nSteps == PRG_MAX_STEPS)
+   {
+      return error(cc, "program too long");
+   }
+   if (p->nSteps == cc->capacity)
+   {
+      cc->capacity *= 2;
+      p = realloc(p, sizeof(*p) + cc->capacity * sizeof(p->steps[0]));
+      if (p == NULL)
+      {
+         return error(cc, "out of memory");
+      }
+      cc->program = p;
+   }
+   p->steps[p->nSteps++] = (prgStep_t){atMs, speed, incline};
+   cc->speed = speed;
+   cc->incline = incline;
+   return true;
+}
+
+/// Compiles a segment from (speed0, incline0) to (speed1, incline1).
+static bool addSegment(prgCompiler_t *cc, double seconds, float speed0,
+                       float speed1, float incline0, float incline1)
+{
+   // Negated compares, so that NaN fails them
+   if (!(seconds > 0.0) || !(seconds * 1000.0 <= PRG_MAX_MS - cc->atMs))
+   {
+      return error(cc, "segment time out of range");
+   }
+   if (!isfinite(speed0) || !isfinite(speed1) || !isfinite(incline0) ||
+       !isfinite(incline1) || speed0 < 0.0f || speed1 < 0.0f ||
+       incline0 < 0.0f || incline1 < 0.0f)
+   {
+      return error(cc, "speed or incline out of range");
+   }
+
+   uint32_t durationMs = (uint32_t)(seconds * 1000.0 + 0.5);
+   uint32_t nSteps = (speed0 == speed1 && incline0 == incline1) ? 1 :
+                     (durationMs + PRG_RAMP_STEP_MS - 1) / PRG_RAMP_STEP_MS;
+   for (uint32_t i = 0; i < nSteps; i++)
+   {
+      // A ramp reaches its end value at the start of its last step
+      float f = (nSteps > 1) ? (float)i / (float)(nSteps - 1) : 0.0f;
+
+      if (!addStep(cc, cc->atMs + i * PRG_RAMP_STEP_MS,
+                   speed0 + f * (speed1 - speed0),
+                   incline0 + f * (incline1 - incline0)))
+      {
+         return false;
+      }
+   }
+   cc->atMs += durationMs;
+   return true;
+}
+
+/// Closes a repeat block by copying its steps count - 1 times.
+static bool endRepeat(prgCompiler_t *cc)
+{
+   if (cc->depth == 0)
+   {
+      return error(cc, "end without repeat");
+   }
+   cc->depth--;
+
+   uint32_t first = cc->repeatFirst[cc->depth];
+   uint32_t last = cc->program->nSteps;
+   uint32_t blockMs = cc->atMs - cc->repeatAtMs[cc->depth];
+
+   if ((uint64_t)blockMs * cc->repeatCount[cc->depth] > PRG_MAX_MS - cc->repeatAtMs[cc->depth])
+   {
+      return error(cc, "program longer than a day");
+   }
+   for (long r = 1; r < cc->repeatCount[cc->depth]; r++)
+   {
+      for (uint32_t s = first; s < last; s++)
+      {
+         prgStep_t step = cc->program->steps[s];
+
+         if (!addStep(cc, step.atMs + (uint32_t)r * blockMs, step.speed,
+                      step.incline))
+         {
+            return false;
+         }
+      }
+   }
+   cc->atMs += (uint32_t)(cc->repeatCount[cc->depth] - 1) * blockMs;
+   return true;
+}
+
+static bool compileLine(prgCompiler_t *cc, const char *p)
+{
+   double seconds;
+   float v[4];
+   long count;
+   int n;
+
+   if (sscanf(p, "hold %lf %f %f %n", &seconds, &v[0], &v[1], &n) == 3 &&
+       p[n] == '\0')
+   {
+      return addSegment(cc, seconds, v[0], v[0], v[1], v[1]);
+   }
+   if (sscanf(p, "ramp %lf %f %f %f %f %n", &seconds, &v[0], &v[1], &v[2],
+              &v[3], &n) == 5 && p[n] == '\0')
+   {
+      return addSegment(cc, seconds, v[0], v[1], v[2], v[3]);
+   }
+   if (sscanf(p, "repeat %ld %n", &count, &n) == 1 && p[n] == '\0')
+   {
+      if (count < 1 || count > 1000)
+      {
+         return error(cc, "repeat count out of range");
+      }
+      if (cc->depth == PRG_MAX_NESTING)
+      {
+         return error(cc, "repeat nested too deep");
+      }
+      cc->repeatFirst[cc->depth] = cc->program->nSteps;
+      cc->repeatAtMs[cc->depth] = cc->atMs;
+      cc->repeatCount[cc->depth] = count;
+      cc->depth++;
+      // The block must start with its own step, also when it repeats the
+      // setpoints before it
+      cc->speed = -1.0f;
+      return true;
+   }
+   if (strncmp(p, "end", 3) == 0 && p[3 + strspn(p + 3, " \t")] == '\0')
+   {
+      return endRepeat(cc);
+   }
+   return error(cc, "invalid program line");
+}
+
+prgProgram_t *PRGcompile(const char path[])
+{
+   FILE *stream = fopen(path, "r");
+   char line[PRG_MAX_LINE];
+   prgCompiler_t cc = {.path = path, .capacity = 64};
+   bool ok = true;
+
+   if (stream == NULL)
+   {
+      perror(path);
+      return NULL;
+   }
+   cc.program = calloc(1, sizeof(prgProgram_t) + cc.capacity * sizeof(prgStep_t));
+
+   while (ok && cc.program != NULL && fgets(line, sizeof(line), stream) != NULL)
+   {
+      cc.lineNumber++;
+      line[strcspn(line, "\r\n#")] = '\0';
+
+      char *p = line + strspn(line, " \t");
+      if (*p != '\0')
+      {
+         ok = compileLine(&cc, p);
+      }
+   }
+   fclose(stream);
+
+   if (ok && cc.depth > 0)
+   {
+      ok = error(&cc, "repeat without end");
+   }
+   if (ok && cc.program != NULL && cc.program->nSteps == 0)
+   {
+      ok = error(&cc, "empty program");
+   }
+   if (!ok || cc.program == NULL)
+   {
+      free(cc.program);
+      return NULL;
+   }
+   cc.program->durationMs = cc.atMs;
+   return cc.program;
+}
+
+void PRGfree(prgProgram_t *program)
+{
+   free(program);
+}
+
+/// Arms the timer for the next step. Called with the mutex locked.
+static void schedule(prgRun_t *run)
+{
+   if (run->next == run->program->nSteps)
+   {
+      run->status = PRG_DONE;
+      return;
+   }
+
+   uint64_t dueNs = run->startNs + run->program->steps[run->next].atMs * CLK_NS_PER_MS;
+   uint64_t now = CLKnowNs();
+
+   CLKtimerStart(&run->timer, (dueNs > now) ? dueNs - now : 0, 0, stepTimer, run);
+}
+
+/// Executes the next step. Called with the mutex locked.
+static const prgStep_t *execute(prgRun_t *run)
+{
+   const prgStep_t *step = &run->program->steps[run->next++];
+
+   run->speed = step->speed;
+   run->incline = step->incline;
+   run->changed = true;
+   schedule(run);
+
+   return step;
+}
+
+/// Timer callback: executes the next step.
+static void stepTimer(void *ctx, uint64_t dueNs)
+{
+   prgRun_t *run = ctx;
+
+   (void)dueNs;
+   pthread_mutex_lock(&mutex);
+   // Suspended or stopped while the timer expired, or an expiry from before
+   // a suspend: the resumed timer executes the step
+   if (run->status != PRG_RUNNING ||
+       CLKnowNs() < run->startNs + run->program->steps[run->next].atMs * CLK_NS_PER_MS)
+   {
+      pthread_mutex_unlock(&mutex);
+      return;
+   }
+
+   const prgStep_t *step = execute(run);
+   pthread_mutex_unlock(&mutex);
+
+   if (run->step != NULL)
+   {
+      run->step(run->ctx, step->speed, step->incline);
+   }
+}
+
+void PRGstart(prgRun_t *run, const prgProgram_t *program,
+              void (*step)(void *ctx, float speed, float incline), void *ctx)
+{
+   PRGstop(run);
+
+   pthread_mutex_lock(&mutex);
+   run->program = program;
+   run->next = 0;
+   run->startNs = CLKnowNs();
+   run->elapsedNs = 0;
+   run->status = PRG_RUNNING;
+   run->changed = false;
+   run->step = step;
+   run->ctx = ctx;
+   // The first step starts at 0, its setpoints are there at once
+   const prgStep_t *first = execute(run);
+   pthread_mutex_unlock(&mutex);
+
+   if (step != NULL)
+   {
+      step(ctx, first->speed, first->incline);
+   }
+}
+
+void PRGstop(prgRun_t *run)
+{
+   pthread_mutex_lock(&mutex);
+   if (run->status != PRG_IDLE)
+   {
+      CLKtimerStop(&run->timer);
+      run->status = PRG_IDLE;
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+void PRGsuspend(prgRun_t *run)
+{
+   pthread_mutex_lock(&mutex);
+   if (run->status == PRG_RUNNING)
+   {
+      CLKtimerStop(&run->timer);
+      run->elapsedNs = CLKnowNs() - run->startNs;
+      run->status = PRG_SUSPENDED;
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+void PRGresume(prgRun_t *run)
+{
+   pthread_mutex_lock(&mutex);
+   if (run->status == PRG_SUSPENDED)
+   {
+      // Move the start, the remaining steps keep their distance
+      run->startNs = CLKnowNs() - run->elapsedNs;
+      run->status = PRG_RUNNING;
+      schedule(run);
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+bool PRGtakeSetpoint(prgRun_t *run, float *speed, float *incline)
+{
+   bool changed;
+
+   pthread_mutex_lock(&mutex);
+   changed = run->changed;
+   if (changed)
+   {
+      *speed = run->speed;
+      *incline = run->incline;
+      run->changed = false;
+   }
+   pthread_mutex_unlock(&mutex);
+
+   return changed;
+}
+
+prgStatus_t PRGgetStatus(prgRun_t *run)
+{
+   pthread_mutex_lock(&mutex);
+   prgStatus_t status = run->status;
+   pthread_mutex_unlock(&mutex);
+
+   return status;
+}
+
+uint32_t PRGelapsedMs(prgRun_t *run)
+{
+   uint64_t ns;
+
+   pthread_mutex_lock(&mutex);
+   switch (run->status)
+   {
+   case PRG_RUNNING:
+      ns = CLKnowNs() - run->startNs;
+      break;
+   case PRG_SUSPENDED:
+      ns = run->elapsedNs;
+      break;
+   case PRG_DONE:
+      ns = (uint64_t)run->program->durationMs * CLK_NS_PER_MS;
+      break;
+   default:
+      ns = 0;
+      break;
+   }
+   pthread_mutex_unlock(&mutex);
+
+   return (uint32_t)(ns / CLK_NS_PER_MS);
+}
@@ -0,0 +1,110 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "clock_functions/clock.h"
+
+//---------------------------------------------------------------------- PRoGram
+
+/// Workout programs: intervals, hills and ramps from a program file,
+/// compiled once into a flat schedule of timed setpoints. A run executes
+/// a schedule with a clock timer, one timer expiry per setpoint change and
+/// no parsing at runtime. A compiled program is read-only, any number of
+/// runs may share it (fleet simulation).
+///
+/// Program file, one segment per line, times in seconds, speed in km/h and
+/// incline in %:
+///
+///     # comment
+///     hold 300 5.0 1.0              constant speed and incline
+///     ramp 120 5.0 10.0 1.0 4.0     speed 5 to 10, incline 1 to 4
+///     repeat 8                      the lines up to "end" 8 times
+///     hold 60 12.0 1.0
+///     hold 90 6.0 1.0
+///     end
+///
+/// A ramp changes the setpoints every PRG_RAMP_STEP_MS. After the last
+/// segment the run is done and the last setpoints stay. A program lasts at
+/// most a day, speed and incline are not negative.
+
+#define PRG_RAMP_STEP_MS  (1000)  ///< Setpoint change interval of a ramp
+#define PRG_MAX_NESTING   (4)     ///< Nested repeat blocks
+#define PRG_MAX_STEPS     (65536) ///< Steps of a compiled program
+
+/// One setpoint change, atMs after the start of the program.
+typedef struct
+{
+   uint32_t atMs;
+   float speed;
+   float incline;
+} prgStep_t;
+
+/// Compiled program, one allocation.
+typedef struct
+{
+   uint32_t durationMs;
+   uint32_t nSteps;
+   prgStep_t steps[];
+} prgProgram_t;
+
+typedef enum {
+   PRG_IDLE,
+   PRG_RUNNING,
+   PRG_SUSPENDED,
+   PRG_DONE
+} prgStatus_t;
+
+/// One execution of a program. The memory is owned by the user, it must
+/// stay valid while the run is active. Zero initialised is PRG_IDLE.
+typedef struct
+{
+   const prgProgram_t *program;
+   uint32_t next;                 ///< Index of the next step
+   uint64_t startNs;              ///< CLKnowNs() of the program start
+   uint64_t elapsedNs;            ///< Program time when suspended
+   prgStatus_t status;
+   bool changed;                  ///< A step since PRGtakeSetpoint()
+   float speed;                   ///< Setpoints of the last step
+   float incline;
+   void (*step)(void *ctx, float speed, float incline);
+   void *ctx;
+   clkTimer_t timer;
+} prgRun_t;
+
+/// Compiles the program file path. Errors are printed with their line.
+/// \return the program (free with PRGfree()), NULL on an error.
+prgProgram_t *PRGcompile(const char path[]);
+
+/// Frees a compiled program.
+void PRGfree(prgProgram_t *program);
+
+/// Starts program in run. The first step is executed at once, in the caller.
+/// step(ctx, speed, incline) is called for every step, for the next ones in
+/// the timer thread (clock thread or CLKadvance()). step may be NULL.
+/// A run that is still active is stopped first.
+void PRGstart(prgRun_t *run, const prgProgram_t *program,
+              void (*step)(void *ctx, float speed, float incline), void *ctx);
+
+/// Stops run, PRGstart() can start it again.
+void PRGstop(prgRun_t *run);
+
+/// Holds the program time of a running run, e.g. during a pause or an
+/// emergency.
+void PRGsuspend(prgRun_t *run);
+
+/// Continues a suspended run where it was suspended.
+void PRGresume(prgRun_t *run);
+
+/// Takes the setpoints of the last step, if there was a step since the
+/// previous call.
+/// \return false if no step was executed since the previous call.
+bool PRGtakeSetpoint(prgRun_t *run, float *speed, float *incline);
+
+/// \return the status of run.
+prgStatus_t PRGgetStatus(prgRun_t *run);
+
+/// \return the program time of run in ms.
+uint32_t PRGelapsedMs(prgRun_t *run);
+
+#endif
@@ -5,12 +5,33 @@
 
 // Function prototypes related to code efficiency
 void showCurrentState(void);
+void publishTelemetry(void);
+void showDiagnostics(void);
+void showStartup(void);
+void emergencyButton(void);
+void halInterrupt(uint32_t irqBits);
+void programStep(void *ctx, float speed, float incline);
+void gymTelemetry(gymTelemetryFrame_t *frame);
+bool remoteEvent(event_t remote);
+void *modelReloader(void *arg);
+void metricsCollector(metWriter_t *writer);
 void saveStat(void);
 void getStat(void);
 void updateDis(void);
 void resetStat(void);
-void keepTimeStart(void);
-void keepTimeStop(void);
+void historyStart(void);
+uint32_t historyValue(double value);
+void historyEnd(void);
+void analyseWorkout(void);
+
+// Startup steps, see InitialiseSubsystems()
+bool startHal(void);
+bool startClock(void);
+bool startBelt(void);
+bool startMotors(void);
+bool startTelemetry(void);
+bool startDisplay(void);
+bool startKeyboard(void);
 
 // Local function prototypes State related
 void S_initOnEntry(void);
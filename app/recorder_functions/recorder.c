@@ -0,0 +1,318 @@
+#include "recorder.h"
+#include "clock_functions/clock.h"
+#include "hal_functions/hal.h"
+
+#include <pthread.h>
+#include <string.h>
+
+//--------------------------------------------------------------------- RECorder
+
+/// Keyframe: absolute values of the first sample of a block.
+typedef struct
+{
+   uint32_t first;                       ///< Index of the first sample
+   int32_t value[REC_NOF_COLUMNS];
+} recBlock_t;
+
+/// Encoder or decoder position: last value and its change per sample.
+typedef struct
+{
+   uint32_t block;                       ///< Block of the next sample
+   int32_t last[REC_NOF_COLUMNS];
+   int32_t slope[REC_NOF_COLUMNS];
+} recCursor_t;
+
+extern char * stateEnumToText[];
+
+/// The columns, delta[c][i] is the change of the slope of column c
+static int16_t delta[REC_NOF_COLUMNS][REC_CAPACITY];
+static uint8_t states[REC_CAPACITY];
+static recBlock_t blocks[REC_MAX_BLOCKS];
+static recBlock_t oldBlocks[REC_MAX_BLOCKS];   ///< Scratch of downsample()
+static recCursor_t encoder;
+
+static recStats_t stats;
+static uint64_t tick = 0;                     ///< Intervals since RECstart()
+static uint32_t factor = 1;                   ///< Ticks per sample
+static uint32_t baseIntervalMs = REC_DEFAULT_INTERVAL_MS;
+static clkTimer_t timer;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// Encodes sample at the end of the buffer.
+/// \return false if there is no room.
+static bool encode(const recSample_t *sample)
+{
+   uint32_t n = stats.samples;
+   int16_t d[REC_NOF_COLUMNS];
+   bool keyframe = (n == 0);
+
+   if (n == REC_CAPACITY)
+   {
+      return false;
+   }
+   for (int c = 0; c < REC_NOF_COLUMNS && !keyframe; c++)
+   {
+      int64_t dd = (int64_t)sample->value[c] - encoder.last[c] - encoder.slope[c];
+
+      keyframe = (dd < INT16_MIN || dd > INT16_MAX);
+      d[c] = (int16_t)dd;
+   }
+
+   if (keyframe)
+   {
+      if (stats.blocks == REC_MAX_BLOCKS)
+      {
+         return false;
+      }
+      recBlock_t *b = &blocks[stats.blocks++];
+      b->first = n;
+      for (int c = 0; c < REC_NOF_COLUMNS; c++)
+      {
+         b->value[c] = sample->value[c];
+         encoder.slope[c] = 0;
+         d[c] = 0;
+      }
+   }
+   else
+   {
+      for (int c = 0; c < REC_NOF_COLUMNS; c++)
+      {
+         encoder.slope[c] = sample->value[c] - encoder.last[c];
+      }
+   }
+   for (int c = 0; c < REC_NOF_COLUMNS; c++)
+   {
+      delta[c][n] = d[c];
+      encoder.last[c] = sample->value[c];
+   }
+   states[n] = (uint8_t)sample->state;
+   stats.samples = n + 1;
+
+   return true;
+}
+
+/// Decodes sample index of the blocks b, the cursor moves to the next one.
+/// Call with index 0, 1, 2...
+static void decode(const recBlock_t b[], uint32_t nBlocks, recCursor_t *cursor,
+                   uint32_t index, recSample_t *sample)
+{
+   if (cursor->block < nBlocks && b[cursor->block].first == index)
+   {
+      for (int c = 0; c < REC_NOF_COLUMNS; c++)
+      {
+         cursor->last[c] = b[cursor->block].value[c];
+         cursor->slope[c] = 0;
+      }
+      cursor->block++;
+   }
+   else
+   {
+      for (int c = 0; c < REC_NOF_COLUMNS; c++)
+      {
+         cursor->slope[c] += delta[c][index];
+         cursor->last[c] += cursor->slope[c];
+      }
+   }
+   for (int c = 0; c < REC_NOF_COLUMNS; c++)
+   {
+      sample->value[c] = cursor->last[c];
+   }
+   sample->state = (state_t)states[index];
+}
+
+/// Keeps the even samples and doubles the interval. The samples are
+/// encoded again in place, the writer never passes the reader.
+static void downsample(void)
+{
+   uint32_t n = stats.samples;
+   uint32_t nBlocks = stats.blocks;
+   recCursor_t reader = {0};
+   recSample_t sample;
+
+   memcpy(oldBlocks, blocks, nBlocks * sizeof(blocks[0]));
+   stats.samples = 0;
+   stats.blocks = 0;
+   for (uint32_t i = 0; i < n; i++)
+   {
+      decode(oldBlocks, nBlocks, &reader, i, &sample);
+      if (i % 2 == 0)
+      {
+         encode(&sample);
+      }
+   }
+   factor *= 2;
+   stats.intervalMs *= 2;
+   stats.downsamples++;
+}
+
+void RECappend(const recSample_t *sample)
+{
+   uint64_t t0 = CLKrealNs();
+
+   pthread_mutex_lock(&mutex);
+   // After downsampling only every factor-th interval has a sample
+   if (tick++ % factor == 0)
+   {
+      stats.appended++;
+      if (!encode(sample))
+      {
+         downsample();
+         // The sample is not on the new grid, or the keyframes did not shrink
+         if ((tick - 1) % factor != 0 || !encode(sample))
+         {
+            stats.dropped++;
+         }
+      }
+
+      uint64_t ns = CLKrealNs() - t0;
+      stats.appendSumNs += ns;
+      stats.appendMaxNs = (ns > stats.appendMaxNs) ? ns : stats.appendMaxNs;
+   }
+   pthread_mutex_unlock(&mutex);
+}
+
+/// Timer callback: samples the HAL registers and the FSM state.
+static void sampleTick(void *ctx, uint64_t dueNs)
+{
+   recSample_t sample =
+   {
+      .value =
+      {
+         [REC_SPEED] = (int32_t)HALread(HAL_REG_SPEED),
+         [REC_INCLINE] = (int32_t)HALread(HAL_REG_INCLINE),
+         [REC_DISTANCE] = (int32_t)HALread(HAL_REG_DISTANCE),
+      },
+      .state = FSM_GetState(),
+   };
+
+   (void)ctx;
+   (void)dueNs;
+   RECappend(&sample);
+}
+
+void RECstart(uint32_t intervalMs)
+{
+   RECstop();
+
+   pthread_mutex_lock(&mutex);
+   baseIntervalMs = intervalMs ? intervalMs : REC_DEFAULT_INTERVAL_MS;
+   stats = (recStats_t){.intervalMs = baseIntervalMs};
+   encoder = (recCursor_t){0};
+   tick = 0;
+   factor = 1;
+   pthread_mutex_unlock(&mutex);
+
+   // The first sample right away
+   CLKtimerStart(&timer, 0, baseIntervalMs * CLK_NS_PER_MS, sampleTick, NULL);
+}
+
+void RECstop(void)
+{
+   CLKtimerStop(&timer);
+}
+
+bool RECgetSample(uint32_t index, recSample_t *sample)
+{
+   recCursor_t cursor = {0};
+   bool found;
+
+   pthread_mutex_lock(&mutex);
+   found = (index < stats.samples);
+   for (uint32_t i = 0; found && i <= index; i++)
+   {
+      decode(blocks, stats.blocks, &cursor, i, sample);
+   }
+   pthread_mutex_unlock(&mutex);
+
+   return found;
+}
+
+uint32_t RECgetColumns(int32_t *columns[REC_NOF_COLUMNS], uint32_t max,
+                       uint32_t *intervalMs)
+{
+   recCursor_t cursor = {0};
+   recSample_t s;
+   uint32_t n;
+
+   pthread_mutex_lock(&mutex);
+   n = (stats.samples < max) ? stats.samples : max;
+   for (uint32_t i = 0; i < n; i++)
+   {
+      decode(blocks, stats.blocks, &cursor, i, &s);
+      for (int c = 0; c < REC_NOF_COLUMNS; c++)
+      {
+         if (columns[c] != NULL)
+         {
+            columns[c][i] = s.value[c];
+         }
+      }
+   }
+   *intervalMs = stats.intervalMs;
+   pthread_mutex_unlock(&mutex);
+
+   return n;
+}
+
+bool RECexportCsv(FILE *stream)
+{
+   recCursor_t cursor = {0};
+   recSample_t s;
+   bool ok;
+
+   pthread_mutex_lock(&mutex);
+   ok = fprintf(stream, "time_s,speed_kmh,incline_pct,distance_m,state\n") > 0;
+   for (uint32_t i = 0; ok && i < stats.samples; i++)
+   {
+      decode(blocks, stats.blocks, &cursor, i, &s);
+      ok = fprintf(stream, "%.3f,%.2f,%.2f,%.3f,%s\n",
+                   (double)i * stats.intervalMs / 1000.0,
+                   s.value[REC_SPEED] / 100.0, s.value[REC_INCLINE] / 100.0,
+                   s.value[REC_DISTANCE] / 1000.0, stateEnumToText[s.state]) > 0;
+   }
+   pthread_mutex_unlock(&mutex);
+
+   return ok;
+}
+
+bool RECexportBinary(FILE *stream)
+{
+   bool ok;
+
+   pthread_mutex_lock(&mutex);
+   uint32_t n = stats.samples;
+   uint32_t header[3] = {stats.intervalMs, n, stats.blocks};
+
+   ok = fwrite(REC_BINARY_MAGIC, 8, 1, stream) == 1 &&
+        fwrite(header, sizeof(header), 1, stream) == 1 &&
+        fwrite(blocks, sizeof(blocks[0]), stats.blocks, stream) == stats.blocks;
+   for (int c = 0; ok && c < REC_NOF_COLUMNS; c++)
+   {
+      ok = fwrite(delta[c], sizeof(delta[c][0]), n, stream) == n;
+   }
+   ok = ok && fwrite(states, sizeof(states[0]), n, stream) == n;
+   pthread_mutex_unlock(&mutex);
+
+   return ok;
+}
+
+bool RECexport(const char path[])
+{
+   size_t length = strlen(path);
+   bool csv = (length >= 4 && strcmp(path + length - 4, ".csv") == 0);
+   FILE *stream = fopen(path, csv ? "w" : "wb");
+
+   if (stream == NULL)
+   {
+      return false;
+   }
+
+   bool ok = csv ? RECexportCsv(stream) : RECexportBinary(stream);
+   return (fclose(stream) == 0) && ok;
+}
+
+void RECgetStats(recStats_t *s)
+{
+   pthread_mutex_lock(&mutex);
+   *s = stats;
+   pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,97 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "fsm_functions/fsm.h"
+
+//--------------------------------------------------------------------- RECorder
+
+/// Workout recorder: belt speed, incline, distance and FSM state of one
+/// session, sampled by a clock timer (the clock thread in real mode), so
+/// the FSM thread does not pay for it.
+///
+/// The samples are stored in fixed memory, one array per column. Speed,
+/// incline and distance are integers in HAL register units (0.01 km/h,
+/// 0.01 %, mm), stored as int16 delta of delta to the previous sample:
+/// a constant speed or a constant ramp stores 0. A keyframe with the
+/// absolute values starts a block, when a value does not fit in 16 bit.
+/// When the buffer or the keyframes are full, every second sample is
+/// dropped and the sample interval doubles.
+///
+/// Memory: 7 bytes per sample (3 x int16 + state), 25.2 kB per hour at the
+/// default 1 s interval. REC_CAPACITY samples hold 68 minutes at 1 s,
+/// 2 h 16 min at 2 s, 4 h 33 min at 4 s... in 36 kB in total (columns,
+/// keyframes and the scratch copy of the keyframes for downsampling).
+
+#define REC_CAPACITY           (4096)  ///< Samples in the buffer
+#define REC_MAX_BLOCKS         (256)   ///< Keyframes in the buffer
+#define REC_DEFAULT_INTERVAL_MS (1000) ///< Sample interval at the start
+#define REC_BINARY_MAGIC       "TMREC1\n" ///< 8 bytes including '\0'
+
+/// Columns of the delta encoded samples.
+typedef enum {
+   REC_SPEED,      ///< 0.01 km/h
+   REC_INCLINE,    ///< 0.01 %
+   REC_DISTANCE,   ///< mm
+   REC_NOF_COLUMNS
+} recColumn_t;
+
+/// One decoded sample.
+typedef struct
+{
+   int32_t value[REC_NOF_COLUMNS];
+   state_t state;
+} recSample_t;
+
+/// Recorder counters.
+typedef struct
+{
+   uint32_t samples;          ///< Samples in the buffer
+   uint32_t blocks;           ///< Keyframes in the buffer
+   uint32_t intervalMs;       ///< Time between two samples in the buffer
+   uint32_t downsamples;      ///< Times the interval doubled
+   uint64_t appended;         ///< Samples recorded since RECstart()
+   uint64_t dropped;          ///< Samples without room after downsampling
+   uint64_t appendSumNs;      ///< Sum of RECappend() execution times
+   uint64_t appendMaxNs;      ///< Max RECappend() execution time
+} recStats_t;
+
+/// Forgets the previous session and samples every intervalMs.
+void RECstart(uint32_t intervalMs);
+
+/// Stops sampling, the samples stay until the next RECstart().
+void RECstop(void);
+
+/// Adds the sample of the next interval, the timer of RECstart() calls this.
+/// After downsampling only every second (fourth...) sample is kept.
+void RECappend(const recSample_t *sample);
+
+/// Decodes sample index (0 is the oldest).
+/// \return false if index is not in the buffer.
+bool RECgetSample(uint32_t index, recSample_t *sample);
+
+/// Decodes the samples in one pass into columns, one array of max values
+/// per column (NULL: column not needed), e.g. for the analytics.
+/// \return samples decoded, intervalMs is set to the sample interval.
+uint32_t RECgetColumns(int32_t *columns[REC_NOF_COLUMNS], uint32_t max,
+                       uint32_t *intervalMs);
+
+/// Writes the samples as CSV: time, speed, incline, distance and state.
+/// \return false on a write error.
+bool RECexportCsv(FILE *stream);
+
+/// Writes the encoded buffer: REC_BINARY_MAGIC, interval, sample and block
+/// counts (uint32), the blocks, then the columns, in host byte order.
+/// \return false on a write error.
+bool RECexportBinary(FILE *stream);
+
+/// Writes the samples to path, as CSV if the name ends with ".csv".
+/// \return false if the file cannot be written.
+bool RECexport(const char path[]);
+
+/// Copies the counters in stats.
+void RECgetStats(recStats_t *stats);
+
+#endif
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include "physics.h"
+#include "clock_functions/clock.h"
+#include "sync_functions/seqlock.h"
+
+#include <math.h>
+#include <stdatomic.h>
+
+#ifdef FXP_FIXED_POINT
+#include "fixed_functions/fixedpoint.h"
+#endif
+
+//---------------------------------------------------------------------- PHYsics
+
+#define PHY_GRAVITY (9.81)  ///< m/s^2
+#define PHY_KMH_TO_MS (1.0 / 3.6)
+
+const phyConfig_t phyDefaultConfig =
+{
+   .acceleration = 2.0f,
+   .deceleration = 4.0f,
+   .inclineRate = 0.5f,
+   .userMass = 75.0f,
+};
+
+static phyState_t state;
+static _Atomic uint32_t stateSeq = 0;   ///< Seqlock of state
+
+static _Atomic float targetSpeed = 0.0f;
+static _Atomic float targetIncline = 0.0f;
+static double newDistance = 0.0;
+static atomic_bool distancePending = false;
+
+static clkTimer_t timer;
+static atomic_bool running = false;
+static bool onDemand = false;           ///< Advanced exactly, virtual clock
+static uint64_t lastNs = 0;             ///< Clock time of state, on demand
+static phyStats_t stats;
+static _Atomic uint32_t statsSeq = 0;   ///< Seqlock of stats
+
+#ifdef FXP_FIXED_POINT
+/// Distance in Q47.16 mm, written with state
+static fxpIntegralQ_t odometer;
+#endif
+
+/// Moves value towards target with at most maxChange.
+static float ramp(float value, float target, float maxUp, float maxDown)
+{
+   if (target > value)
+   {
+      return (target - value > maxUp) ? value + maxUp : target;
+   }
+   return (value - target > maxDown) ? value - maxDown : target;
+}
+
+void PHYstep(phyState_t *s, const phyConfig_t *config, float speed,
+             float incline, double dt)
+{
+   float oldSpeed = s->speed;
+   float oldIncline = s->incline;
+
+   s->speed = ramp(s->speed, speed, config->acceleration * (float)dt,
+                   config->deceleration * (float)dt);
+   s->incline = ramp(s->incline, incline, config->inclineRate * (float)dt,
+                     config->inclineRate * (float)dt);
+
+   // Trapezoidal integration, exact for the linear ramps
+   double v = 0.5 * (oldSpeed + s->speed) * PHY_KMH_TO_MS;
+   double grade = 0.5 * (oldIncline + s->incline) / 100.0;
+
+   s->distance += v * dt;
+   if (grade > 0.0)
+   {
+      s->energy += config->userMass * PHY_GRAVITY * v * grade * dt;
+   }
+   s->time += dt;
+}
+
+/// Value at time t of a ramp from value towards target.
+static double rampAt(double value, double target, double up, double down,
+                     double t)
+{
+   if (target > value)
+   {
+      return fmin(value + up * t, target);
+   }
+   return fmax(value - down * t, target);
+}
+
+/// Time for a ramp from value to reach target, INFINITY if never.
+static double rampTime(double value, double target, double up, double down)
+{
+   double rate = (target > value) ? up : down;
+
+   if (target == value)
+   {
+      return 0.0;
+   }
+   return (rate > 0.0) ? fabs(target - value) / rate : INFINITY;
+}
+
+void PHYadvance(phyState_t *s, const phyConfig_t *config, float speed,
+                float incline, double dt)
+{
+   const double v0 = s->speed;
+   const double g0 = s->incline;
+   const double acc = config->acceleration;
+   const double dec = config->deceleration;
+   const double inc = config->inclineRate;
+   double bounds[4] = {0.0};
+   int nBounds = 0;
+
+   // Breakpoints inside the interval, both ramps are linear in between
+   bounds[nBounds++] = rampTime(v0, speed, acc, dec);
+   bounds[nBounds++] = rampTime(g0, incline, inc, inc);
+   if ((g0 < 0.0 && incline > 0.0) || (g0 > 0.0 && incline < 0.0))
+   {
+      bounds[nBounds++] = rampTime(g0, 0.0, inc, inc);
+   }
+   bounds[nBounds++] = dt;
+   for (int i = 1; i < nBounds; i++)
+   {
+      for (int j = i; j > 0 && bounds[j] < bounds[j - 1]; j--)
+      {
+         double tmp = bounds[j];
+         bounds[j] = bounds[j - 1];
+         bounds[j - 1] = tmp;
+      }
+   }
+
+   double a = 0.0;
+   double va = v0 * PHY_KMH_TO_MS;
+   double ga = g0 / 100.0;
+
+   for (int i = 0; i < nBounds && a < dt; i++)
+   {
+      double b = fmin(bounds[i], dt);
+      double h = b - a;
+
+      if (h <= 0.0)
+      {
+         continue;
+      }
+      double vb = rampAt(v0, speed, acc, dec, b) * PHY_KMH_TO_MS;
+      double gb = rampAt(g0, incline, inc, inc, b) / 100.0;
+
+      // Speed and grade linear: exact integrals of v and v * grade
+      s->distance += 0.5 * (va + vb) * h;
+      if (ga + gb > 0.0)
+      {
+         s->energy += config->userMass * PHY_GRAVITY * h *
+                      (2.0 * va * ga + va * gb + vb * ga + 2.0 * vb * gb) / 6.0;
+      }
+      a = b;
+      va = vb;
+      ga = gb;
+   }
+   s->speed = (float)rampAt(v0, speed, acc, dec, dt);
+   s->incline = (float)rampAt(g0, incline, inc, inc, dt);
+   s->time += dt;
+}
+
+/// Sets the distance of s, e.g. after PHYsetDistance().
+static void setDistance(phyState_t *s, double distance)
+{
+#ifdef FXP_FIXED_POINT
+   odometer = (fxpIntegralQ_t){FXPfromMilliQ(llround(distance * 1000.0)), 0};
+   s->distance = (double)FXPtoMilliQ(odometer.value) / 1000.0;
+#else
+   s->distance = distance;
+#endif
+}
+
+/// Fixed point build: integrates the distance of s, advanced dt seconds
+/// from before, with integers. The mean belt speed of the interval in um/s
+/// times its length in us is added to the odometer, so the distance does
+/// not drift with the length of the session. The float build keeps the
+/// distance of PHYstep() and PHYadvance().
+static void integrateDistance(phyState_t *s, const phyState_t *before, double dt)
+{
+#ifdef FXP_FIXED_POINT
+   int32_t rate = (int32_t)lround((s->distance - before->distance) * 1e6 / dt);
+   uint64_t us = (uint64_t)llround(dt * 1e6);
+
+   while (us > 0)
+   {
+      uint32_t part = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+
+      FXPintegrateQ(&odometer, rate, part, 1000000000u);   // um * us / 1e9 = mm
+      us -= part;
+   }
+   s->distance = (double)odometer.value / FXP_ONE / 1000.0;
+#else
+   (void)s;
+   (void)before;
+   (void)dt;
+#endif
+}
+
+/// Periodic clock timer of the fixed step simulation.
+static void simulationTick(void *ctx, uint64_t dueNs)
+{
+   const uint64_t start = CLKrealNs();
+   const uint64_t late = (start > dueNs) ? start - dueNs : 0;
+   phyState_t s = state;
+
+   (void)ctx;
+   if (atomic_exchange_explicit(&distancePending, false, memory_order_acquire))
+   {
+      setDistance(&s, newDistance);
+   }
+
+   const phyState_t before = s;
+   const float speed = atomic_load_explicit(&targetSpeed, memory_order_relaxed);
+   const float incline = atomic_load_explicit(&targetIncline, memory_order_relaxed);
+   // Periods skipped by the clock when the timer was more than a period
+   // late, the belt kept moving: catch up in one exact step
+   const uint64_t missed = timer.missed;
+   if (missed > stats.missed)
+   {
+      PHYadvance(&s, &phyDefaultConfig, speed, incline,
+                 (double)(missed - stats.missed) / stats.rateHz);
+   }
+   PHYstep(&s, &phyDefaultConfig, speed, incline, 1.0 / stats.rateHz);
+   integrateDistance(&s, &before, (double)(missed - stats.missed + 1) / stats.rateHz);
+   SEQwrite(&stateSeq, &state, &s, sizeof(s));
+
+   phyStats_t st = stats;
+   uint64_t cost = CLKrealNs() - start;
+   st.steps++;
+   st.missed = missed;
+   st.costSumNs += cost;
+   st.costMaxNs = (cost > st.costMaxNs) ? cost : st.costMaxNs;
+   st.lateMaxNs = (late > st.lateMaxNs) ? late : st.lateMaxNs;
+   SEQwrite(&statsSeq, &stats, &st, sizeof(st));
+}
+
+/// Virtual clock: advances the state exactly up to the clock time.
+static void advanceToNow(void)
+{
+   const uint64_t now = CLKnowNs();
+
+   if (!onDemand || now <= lastNs)
+   {
+      return;
+   }
+
+   const uint64_t start = CLKrealNs();
+   const double dt = (double)(now - lastNs) / CLK_NS_PER_S;
+   const phyState_t before = state;
+   phyState_t s = state;
+
+   PHYadvance(&s, &phyDefaultConfig,
+              atomic_load_explicit(&targetSpeed, memory_order_relaxed),
+              atomic_load_explicit(&targetIncline, memory_order_relaxed),
+              dt);
+   integrateDistance(&s, &before, dt);
+   lastNs = now;
+   SEQwrite(&stateSeq, &state, &s, sizeof(s));
+
+   phyStats_t st = stats;
+   uint64_t cost = CLKrealNs() - start;
+   st.steps++;
+   st.costSumNs += cost;
+   st.costMaxNs = (cost > st.costMaxNs) ? cost : st.costMaxNs;
+   SEQwrite(&statsSeq, &stats, &st, sizeof(st));
+}
+
+bool PHYstart(unsigned int rateHz)
+{
+   if (atomic_load(&running) || rateHz == 0)
+   {
+      return false;
+   }
+   phyStats_t st = {.rateHz = rateHz};
+   SEQwrite(&statsSeq, &stats, &st, sizeof(st));
+
+   if (CLKgetSource() == CLK_VIRTUAL)
+   {
+      // Nobody else writes the state, it is advanced in the reading thread
+      onDemand = true;
+      lastNs = CLKnowNs();
+   }
+   else
+   {
+      atomic_store(&running, true);
+      CLKtimerStart(&timer, CLK_NS_PER_S / rateHz, CLK_NS_PER_S / rateHz,
+                    simulationTick, NULL);
+   }
+   return true;
+}
+
+void PHYstop(void)
+{
+   advanceToNow();
+   onDemand = false;
+   if (atomic_load(&running))
+   {
+      CLKtimerStop(&timer);
+      atomic_store(&running, false);
+   }
+}
+
+void PHYsetTarget(float speed, float incline)
+{
+   // The old targets apply up to now
+   advanceToNow();
+   atomic_store_explicit(&targetSpeed, speed, memory_order_relaxed);
+   atomic_store_explicit(&targetIncline, incline, memory_order_relaxed);
+}
+
+void PHYsetDistance(double distance)
+{
+   advanceToNow();
+   newDistance = distance;
+   atomic_store_explicit(&distancePending, true, memory_order_release);
+
+   if (!atomic_load(&running))
+   {
+      // No simulation timer, nobody else writes the state
+      phyState_t s = state;
+      setDistance(&s, distance);
+      atomic_store(&distancePending, false);
+      SEQwrite(&stateSeq, &state, &s, sizeof(s));
+   }
+}
+
+void PHYgetState(phyState_t *s)
+{
+   advanceToNow();
+   SEQread(&stateSeq, s, &state, sizeof(*s));
+}
+
+void PHYgetStats(phyStats_t *s)
+{
+   SEQread(&statsSeq, s, &stats, sizeof(*s));
+}
@@ -0,0 +1,84 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------- PHYsics
+
+/// Belt physics simulation.
+/// The belt speed and incline follow their targets with limited ramps,
+/// distance and energy are integrated. With the real clock a periodic clock
+/// timer integrates with a fixed time step, periods the timer skipped are
+/// caught up with PHYadvance(). With the virtual clock the state
+/// is advanced exactly up to the clock time whenever it is read or the
+/// targets change, so the clock can jump over long intervals at no cost.
+
+#define PHY_DEFAULT_RATE_HZ (1000)   ///< Default simulation rate
+#define PHY_MAX_RATE_HZ     (100000) ///< Highest simulation rate, a period of 10 us
+
+/// Mechanical properties of the treadmill and the runner.
+typedef struct
+{
+   float acceleration;   ///< Max belt speed increase in km/h per s
+   float deceleration;   ///< Max belt speed decrease in km/h per s
+   float inclineRate;    ///< Max incline change in % per s
+   float userMass;       ///< Mass of the runner in kg
+} phyConfig_t;
+
+/// Simulated state of the treadmill.
+typedef struct
+{
+   double time;          ///< Simulated time in s
+   float speed;          ///< Actual belt speed in km/h
+   float incline;        ///< Actual incline in %
+   double distance;      ///< Distance in m
+   double energy;        ///< Work done lifting the runner in J
+} phyState_t;
+
+/// Simulation loop counters.
+typedef struct
+{
+   uint64_t steps;       ///< Executed steps or advancements
+   uint64_t missed;      ///< Steps skipped because the loop was too late, integrated by the next step
+   uint64_t costSumNs;   ///< Sum of step execution times
+   uint64_t costMaxNs;   ///< Max step execution time
+   uint64_t lateMaxNs;   ///< Max wake up delay after the step deadline
+   unsigned int rateHz;  ///< Step rate
+} phyStats_t;
+
+/// Default configuration: a typical treadmill and a runner of 75 kg.
+extern const phyConfig_t phyDefaultConfig;
+
+/// Advances state by dt seconds towards the target speed and incline.
+/// Pure function, used by the simulation loop and by the benchmark.
+void PHYstep(phyState_t *state, const phyConfig_t *config, float targetSpeed,
+             float targetIncline, double dt);
+
+/// Advances state by dt seconds towards the target speed and incline in one
+/// go, exact for the ramps: the interval is split where a ramp reaches its
+/// target and where the incline crosses zero. Pure function.
+void PHYadvance(phyState_t *state, const phyConfig_t *config, float targetSpeed,
+                float targetIncline, double dt);
+
+/// Starts the simulation: rateHz steps per second on a clock timer, or
+/// exact advancement on demand if the clock is virtual.
+/// \return false if already started or rateHz is 0.
+bool PHYstart(unsigned int rateHz);
+
+/// Stops the simulation loop.
+void PHYstop(void);
+
+/// Sets the target belt speed (km/h) and incline (%).
+void PHYsetTarget(float speed, float incline);
+
+/// Overrides the distance, e.g. after a reset or a manual change.
+void PHYsetDistance(double distance);
+
+/// Reads a consistent copy of the simulated state.
+void PHYgetState(phyState_t *state);
+
+/// Copies the simulation loop counters in stats.
+void PHYgetStats(phyStats_t *stats);
+
+#endif
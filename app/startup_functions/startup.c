@@ -0,0 +1,177 @@
+#include "startup.h"
+#include "clock_functions/clock.h"
+#include "fault_functions/faultMonitor.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+//---------------------------------------------------------------------- STartUp
+
+static uint64_t beginNs = 0;
+static _Atomic uint64_t readyNs = 0;
+
+/// The run, the steps write their own entry of timing under lock
+static const stuStep_t *table = NULL;
+static stuTiming_t timing[STU_MAX_STEPS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+/// Published timeline, the copy of timing after the run
+static stuTimeline_t timeline;
+static _Atomic unsigned int published = 0;
+
+void STUbegin(void)
+{
+   beginNs = CLKrealNs();
+}
+
+static uint64_t sinceBegin(void)
+{
+   return CLKrealNs() - beginNs;
+}
+
+/// \return true if all steps of mask have a result.
+static bool finished(uint32_t mask)
+{
+   for (unsigned int i = 0; mask != 0; i++, mask >>= 1)
+   {
+      if ((mask & 1u) && timing[i].result == STU_PENDING)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+/// \return true if all steps of mask passed.
+static bool passed(uint32_t mask)
+{
+   for (unsigned int i = 0; mask != 0; i++, mask >>= 1)
+   {
+      if ((mask & 1u) && timing[i].result != STU_PASSED)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+/// Waits for the dependencies of the step, runs it and records the result.
+static void *stepThread(void *arg)
+{
+   const unsigned int i = (unsigned int)(uintptr_t)arg;
+   const stuStep_t *step = &table[i];
+
+   pthread_mutex_lock(&lock);
+   while (!finished(step->after))
+   {
+      pthread_cond_wait(&done, &lock);
+   }
+   bool skip = !passed(step->after);
+   pthread_mutex_unlock(&lock);
+
+   uint64_t startNs = sinceBegin();
+   stuResult_t result = skip ? STU_SKIPPED : (step->run() ? STU_PASSED : STU_FAILED);
+   uint64_t endNs = sinceBegin();
+
+   if (result != STU_PASSED && step->error != STU_NO_ERROR)
+   {
+      FLTraise(step->error);
+   }
+
+   pthread_mutex_lock(&lock);
+   timing[i].startNs = startNs;
+   timing[i].endNs = endNs;
+   timing[i].result = result;
+   pthread_cond_broadcast(&done);
+   pthread_mutex_unlock(&lock);
+   return NULL;
+}
+
+bool STUrun(const stuStep_t steps[], unsigned int nSteps)
+{
+   pthread_t threads[STU_MAX_STEPS];
+   bool started[STU_MAX_STEPS];
+
+   if (nSteps == 0 || nSteps > STU_MAX_STEPS)
+   {
+      return false;
+   }
+   for (unsigned int i = 0; i < nSteps; i++)
+   {
+      if (steps[i].after >> i != 0)
+      {
+         return false;
+      }
+   }
+
+   table = steps;
+   for (unsigned int i = 0; i < nSteps; i++)
+   {
+      timing[i] = (stuTiming_t){.name = steps[i].name, .result = STU_PENDING};
+   }
+   uint64_t runStartNs = sinceBegin();
+
+   // A step that gets no thread runs here, the steps it waits for are
+   // running or done already
+   for (unsigned int i = 0; i < nSteps; i++)
+   {
+      started[i] = (pthread_create(&threads[i], NULL, stepThread, (void *)(uintptr_t)i) == 0);
+      if (!started[i])
+      {
+         stepThread((void *)(uintptr_t)i);
+      }
+   }
+   for (unsigned int i = 0; i < nSteps; i++)
+   {
+      if (started[i])
+      {
+         pthread_join(threads[i], NULL);
+      }
+   }
+
+   timeline.runStartNs = runStartNs;
+   timeline.runEndNs = sinceBegin();
+   timeline.serialNs = 0;
+   timeline.failed = 0;
+   timeline.skipped = 0;
+   for (unsigned int i = 0; i < nSteps; i++)
+   {
+      timeline.steps[i] = timing[i];
+      timeline.serialNs += timing[i].endNs - timing[i].startNs;
+      timeline.failed += (timing[i].result == STU_FAILED);
+      timeline.skipped += (timing[i].result == STU_SKIPPED);
+   }
+   atomic_store_explicit(&published, nSteps, memory_order_release);
+
+   return timeline.failed == 0 && timeline.skipped == 0;
+}
+
+void STUready(void)
+{
+   uint64_t none = 0;
+
+   atomic_compare_exchange_strong(&readyNs, &none, sinceBegin());
+}
+
+const char *STUresultText(stuResult_t result)
+{
+   static const char *const names[] = {"pending", "passed", "failed", "skipped"};
+
+   return (result <= STU_SKIPPED) ? names[result] : "?";
+}
+
+void STUgetTimeline(stuTimeline_t *t)
+{
+   unsigned int nSteps = atomic_load_explicit(&published, memory_order_acquire);
+
+   memset(t, 0, sizeof(*t));
+   if (nSteps != 0)
+   {
+      *t = timeline;
+   }
+   t->nSteps = nSteps;
+   t->readyNs = atomic_load(&readyNs);
+}
@@ -0,0 +1,79 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "console_functions/systemErrors.h"
+
+//---------------------------------------------------------------------- STartUp
+
+/// Startup orchestrator: runs the initialisation and self-test steps of the
+/// subsystems concurrently, in the order of their dependencies.
+///
+/// Every step runs in its own thread as soon as the steps it depends on have
+/// passed. A step that fails, or is skipped because a step it depends on
+/// failed, raises its system error bit in the fault monitor. The start and
+/// end of every step are kept as the startup timeline, relative to
+/// STUbegin(), and so is the time to STUready() (S_STANDBY entered).
+
+#define STU_MAX_STEPS (16)
+#define STU_NO_ERROR  (NOF_ERRORS)   ///< Error bit of a step that has none
+
+/// Result of a step.
+typedef enum {
+   STU_PENDING,
+   STU_PASSED,
+   STU_FAILED,    ///< The step returned false
+   STU_SKIPPED    ///< A step it depends on did not pass
+} stuResult_t;
+
+/// A startup step. A step only depends on steps before it in the table, so
+/// the graph has no cycles.
+typedef struct
+{
+   const char *name;
+   bool (*run)(void);      ///< Initialisation and self-test, false if failed
+   error_t error;          ///< Raised if the step does not pass, or STU_NO_ERROR
+   uint32_t after;         ///< Bit (1u << index) per step that must pass first
+} stuStep_t;
+
+/// Timing of a step, ns since STUbegin().
+typedef struct
+{
+   const char *name;
+   stuResult_t result;
+   uint64_t startNs;
+   uint64_t endNs;
+} stuTiming_t;
+
+/// Startup timeline.
+typedef struct
+{
+   unsigned int nSteps;       ///< 0 until STUrun() has returned
+   stuTiming_t steps[STU_MAX_STEPS];
+   uint64_t runStartNs;       ///< STUrun() called
+   uint64_t runEndNs;         ///< Last step done
+   uint64_t serialNs;         ///< Sum of the step times, a run one by one
+   uint64_t readyNs;          ///< STUbegin() to STUready(), 0 before
+   unsigned int failed;
+   unsigned int skipped;
+} stuTimeline_t;
+
+/// Starts the startup clock, call first thing in main().
+void STUbegin(void);
+
+/// Runs the steps and waits until all are done. Call once.
+/// \return true if all steps passed, false if one did not or the table is
+/// not valid (too many steps, a dependency on itself or a later step).
+bool STUrun(const stuStep_t steps[], unsigned int nSteps);
+
+/// Marks the application ready for use, only the first call counts.
+void STUready(void);
+
+/// \return text of result, e.g. "passed".
+const char *STUresultText(stuResult_t result);
+
+/// Copies the timeline in timeline, without locks.
+void STUgetTimeline(stuTimeline_t *timeline);
+
+#endif
@@ -14,4 +14,6 @@ typedef enum {
     //end
 } state_t;
 
+#define NOF_STATES (S_PAUSE + 1)   ///< Number of states, keep up to date with //end
+
 #endif
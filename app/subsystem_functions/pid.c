@@ -0,0 +1,60 @@
+#include "pid.h"
+
+//-------------------------------------------------------------------------- PID
+
+void PIDinitialise(pidController_t *pid, float kp, float ki, float kd,
+                   float rampUp, float rampDown, float outMin, float outMax,
+                   float measurement)
+{
+   pid->kp = kp;
+   pid->ki = ki;
+   pid->kd = kd;
+   pid->rampUp = rampUp;
+   pid->rampDown = rampDown;
+   pid->outMin = outMin;
+   pid->outMax = outMax;
+   PIDreset(pid, measurement);
+}
+
+void PIDreset(pidController_t *pid, float measurement)
+{
+   pid->setpoint = measurement;
+   pid->integral = 0.0f;
+   pid->lastMeasurement = measurement;
+}
+
+float PIDupdate(pidController_t *pid, float target, float measurement,
+                float dt)
+{
+   // Ramp limited setpoint
+   if (target > pid->setpoint)
+   {
+      float max = pid->setpoint + pid->rampUp * dt;
+      pid->setpoint = (target < max) ? target : max;
+   }
+   else
+   {
+      float min = pid->setpoint - pid->rampDown * dt;
+      pid->setpoint = (target > min) ? target : min;
+   }
+
+   float error = pid->setpoint - measurement;
+   float derivative = (dt > 0.0f) ? (measurement - pid->lastMeasurement) / dt
+                                  : 0.0f;
+   float integral = pid->integral + error * dt;
+   float output = pid->setpoint + pid->kp * error + pid->ki * integral -
+                  pid->kd * derivative;
+
+   pid->lastMeasurement = measurement;
+   if (output > pid->outMax)
+   {
+      return pid->outMax;
+   }
+   if (output < pid->outMin)
+   {
+      return pid->outMin;
+   }
+   pid->integral = integral;
+
+   return output;
+}
@@ -0,0 +1,40 @@
+#ifndef PID_H
+#define PID_H
+
+//-------------------------------------------------------------------------- PID
+
+/// PID controller with a ramp limited setpoint.
+/// The setpoint follows the target with at most rampUp / rampDown units per
+/// second. The output is the ramped setpoint (feed forward) plus the PID
+/// correction, clamped to outMin..outMax. The integral stops growing while
+/// the output is clamped (anti-windup), the derivative acts on the
+/// measurement so setpoint steps give no kick.
+typedef struct
+{
+   float kp;
+   float ki;             ///< per s
+   float kd;             ///< s
+   float rampUp;         ///< Max setpoint increase per s
+   float rampDown;       ///< Max setpoint decrease per s
+   float outMin;
+   float outMax;
+
+   float setpoint;       ///< Ramped setpoint
+   float integral;
+   float lastMeasurement;
+} pidController_t;
+
+/// Sets the gains and limits and resets the controller at measurement.
+void PIDinitialise(pidController_t *pid, float kp, float ki, float kd,
+                   float rampUp, float rampDown, float outMin, float outMax,
+                   float measurement);
+
+/// Restarts the controller from measurement, e.g. after an emergency stop.
+void PIDreset(pidController_t *pid, float measurement);
+
+/// One control step of dt seconds towards target.
+/// \return the actuator command.
+float PIDupdate(pidController_t *pid, float target, float measurement,
+                float dt);
+
+#endif
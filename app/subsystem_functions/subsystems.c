@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include "subsystems.h"
+#include "pid.h"
+#include "clock_functions/clock.h"
+#include "fault_functions/faultMonitor.h"
+#include "hal_functions/hal.h"
+#include "sync_functions/seqlock.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+//------------------------------------------------------------------- SUBsystems
+
+#define SUB_SPEED_MAX        (25.0f)  ///< Band speed motor limit in km/h
+#define SUB_INCLINE_MIN      (-3.0f)  ///< Incline motor limits in %
+#define SUB_INCLINE_MAX      (15.0f)
+#define SUB_TRACKING_SPEED   (1.0f)   ///< Max speed error in km/h
+#define SUB_TRACKING_INCLINE (1.0f)   ///< Max incline error in %
+#define SUB_TRACKING_TIME_S  (2.0f)   ///< Max time above the error limit
+
+/// Setpoints written by the FSM, read by the control loop.
+typedef struct
+{
+   float speed;
+   float incline;
+   bool brake;
+   uint64_t writtenNs;   ///< CLKrealNs() of the write, for the latency
+} subMailbox_t;
+
+static subMailbox_t mailbox;
+static _Atomic uint32_t mailboxSeq = 0;  ///< Seqlock of mailbox
+
+static subStatus_t status;
+static _Atomic uint32_t statusSeq = 0;   ///< Seqlock of status
+static subStats_t stats;
+static _Atomic uint32_t statsSeq = 0;    ///< Seqlock of stats
+
+/// Control loop state, only used by the control loop.
+static pidController_t speedPid;
+static pidController_t inclinePid;
+static subMailbox_t setpoint;
+static uint32_t lastMailboxSeq = 0;
+static float speedErrorTime = 0.0f;
+static float inclineErrorTime = 0.0f;
+
+static pthread_t thread;
+static clkTimer_t timer;
+static atomic_bool running = false;
+static bool realtime = false;
+
+/// Integrates how long error is above limit.
+/// \return true when it is above limit for too long.
+static bool tracking(float *errorTime, float error, float limit, float dt)
+{
+   *errorTime = (fabsf(error) > limit) ? *errorTime + dt : 0.0f;
+
+   return *errorTime > SUB_TRACKING_TIME_S;
+}
+
+/// Measured belt speed and incline from the HAL registers.
+static void measure(float *speed, float *incline)
+{
+   *speed = (int32_t)HALread(HAL_REG_SPEED) / 100.0f;
+   *incline = (int32_t)HALread(HAL_REG_INCLINE) / 100.0f;
+}
+
+static uint32_t toRegister(float value)
+{
+   return (uint32_t)(int32_t)lroundf(value * 100.0f);
+}
+
+/// One control step: mailbox, PID controllers, motor commands and faults.
+static void controlStep(float dt, uint64_t lateNs)
+{
+   subStatus_t st = status;
+   subStats_t sst = stats;
+   float speed;
+   float incline;
+   subMailbox_t m;
+   bool newSetpoint = false;
+
+   uint32_t seq = SEQread(&mailboxSeq, &m, &mailbox, sizeof(m));
+   if (seq != lastMailboxSeq)
+   {
+      lastMailboxSeq = seq;
+      newSetpoint = true;
+      if (setpoint.brake && !m.brake)
+      {
+         // Start again from standstill, forget the faults
+         measure(&speed, &incline);
+         PIDreset(&speedPid, speed);
+         PIDreset(&inclinePid, incline);
+         st.faults = 0;
+         FLTclear(ERR_MOTOR_SPEED);
+         FLTclear(ERR_MOTOR_INCLINE);
+      }
+      if (setpoint.brake != m.brake)
+      {
+         HALwrite(HAL_REG_BRAKE_CMD, m.brake);
+      }
+      setpoint = m;
+   }
+
+   measure(&speed, &incline);
+   if (setpoint.brake)
+   {
+      // The brake overrides the controller: stop now, keep the incline
+      PIDreset(&speedPid, speed);
+      st.speedCommand = 0.0f;
+   }
+   else
+   {
+      st.speedCommand = PIDupdate(&speedPid,
+                                  fminf(fmaxf(setpoint.speed, 0.0f), SUB_SPEED_MAX),
+                                  speed, dt);
+   }
+   st.inclineCommand = PIDupdate(&inclinePid,
+                                 fminf(fmaxf(setpoint.incline, SUB_INCLINE_MIN),
+                                       SUB_INCLINE_MAX),
+                                 incline, dt);
+   HALwrite(HAL_REG_SPEED_CMD, toRegister(st.speedCommand));
+   HALwrite(HAL_REG_INCLINE_CMD, toRegister(st.inclineCommand));
+
+   if (newSetpoint)
+   {
+      uint64_t latency = CLKrealNs() - setpoint.writtenNs;
+      sst.setpoints++;
+      sst.latencySumNs += latency;
+      sst.latencyMaxNs = (latency > sst.latencyMaxNs) ? latency : sst.latencyMaxNs;
+   }
+
+   uint32_t faults = st.faults;
+   if (!setpoint.brake &&
+       tracking(&speedErrorTime, speedPid.setpoint - speed,
+                SUB_TRACKING_SPEED, dt))
+   {
+      faults |= SUB_FAULT_SPEED;
+   }
+   if (tracking(&inclineErrorTime, inclinePid.setpoint - incline,
+                SUB_TRACKING_INCLINE, dt))
+   {
+      faults |= SUB_FAULT_INCLINE;
+   }
+   // The fault monitor stops the treadmill
+   if ((faults & ~st.faults) & SUB_FAULT_SPEED)
+   {
+      FLTraise(ERR_MOTOR_SPEED);
+      sst.faultsRaised++;
+   }
+   if ((faults & ~st.faults) & SUB_FAULT_INCLINE)
+   {
+      FLTraise(ERR_MOTOR_INCLINE);
+      sst.faultsRaised++;
+   }
+
+   st.faults = faults;
+   st.speedSetpoint = speedPid.setpoint;
+   st.speed = speed;
+   st.inclineSetpoint = inclinePid.setpoint;
+   st.incline = incline;
+   st.brake = setpoint.brake;
+   SEQwrite(&statusSeq, &status, &st, sizeof(st));
+
+   sst.realtime = realtime;
+   sst.steps++;
+   sst.jitterSumNs += lateNs;
+   sst.jitterMaxNs = (lateNs > sst.jitterMaxNs) ? lateNs : sst.jitterMaxNs;
+   SEQwrite(&statsSeq, &stats, &sst, sizeof(sst));
+}
+
+static void *controlThread(void *arg)
+{
+   const uint64_t periodNs = CLK_NS_PER_S / stats.rateHz;
+   const float dt = 1.0f / stats.rateHz;
+   uint64_t deadline = CLKrealNs();
+   struct sched_param param;
+   int policy;
+
+   (void)arg;
+   pthread_getschedparam(pthread_self(), &policy, &param);
+   realtime = (policy == SCHED_FIFO);
+   while (atomic_load_explicit(&running, memory_order_relaxed))
+   {
+      deadline += periodNs;
+      struct timespec ts =
+      {
+         .tv_sec = (time_t)(deadline / CLK_NS_PER_S),
+         .tv_nsec = (long)(deadline % CLK_NS_PER_S),
+      };
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+      uint64_t now = CLKrealNs();
+      uint64_t late = (now > deadline) ? now - deadline : 0;
+
+      controlStep(dt, late);
+
+      // More than a period late: skip the missed periods, no burst
+      if (late > periodNs)
+      {
+         subStats_t sst = stats;
+         sst.missed += late / periodNs;
+         deadline += (late / periodNs) * periodNs;
+         SEQwrite(&statsSeq, &stats, &sst, sizeof(sst));
+      }
+   }
+   return NULL;
+}
+
+/// Periodic clock timer of the control loop, virtual clock.
+static void controlTick(void *ctx, uint64_t dueNs)
+{
+   (void)ctx;
+   (void)dueNs;
+   controlStep(1.0f / stats.rateHz, 0);
+}
+
+bool SUBstart(unsigned int rateHz)
+{
+   float speed;
+   float incline;
+
+   if (atomic_load(&running) || rateHz == 0)
+   {
+      return false;
+   }
+
+   measure(&speed, &incline);
+   // Gains for the belt simulation: the motors follow a command with their
+   // own acceleration limit, the feed forward does most of the work
+   PIDinitialise(&speedPid, 0.8f, 0.4f, 0.0f, 1.5f, 3.0f, 0.0f, SUB_SPEED_MAX,
+                 speed);
+   PIDinitialise(&inclinePid, 0.5f, 0.2f, 0.0f, 0.4f, 0.4f, SUB_INCLINE_MIN,
+                 SUB_INCLINE_MAX, incline);
+
+   subStats_t sst = {.rateHz = rateHz};
+   SEQwrite(&statsSeq, &stats, &sst, sizeof(sst));
+   atomic_store(&running, true);
+
+   if (CLKgetSource() == CLK_VIRTUAL)
+   {
+      CLKtimerStart(&timer, CLK_NS_PER_S / rateHz, CLK_NS_PER_S / rateHz,
+                    controlTick, NULL);
+      return true;
+   }
+
+   pthread_attr_t attr;
+   struct sched_param param = {.sched_priority = sched_get_priority_min(SCHED_FIFO)};
+
+   // Real-time priority needs CAP_SYS_NICE, else run as a normal thread
+   pthread_attr_init(&attr);
+   pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+   pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+   pthread_attr_setschedparam(&attr, &param);
+   bool started = (pthread_create(&thread, &attr, controlThread, NULL) == 0);
+   pthread_attr_destroy(&attr);
+   if (!started && pthread_create(&thread, NULL, controlThread, NULL) != 0)
+   {
+      atomic_store(&running, false);
+      return false;
+   }
+   return true;
+}
+
+void SUBstop(void)
+{
+   if (!atomic_load(&running))
+   {
+      return;
+   }
+   atomic_store(&running, false);
+   if (CLKgetSource() == CLK_VIRTUAL)
+   {
+      CLKtimerStop(&timer);
+   }
+   else
+   {
+      pthread_join(thread, NULL);
+   }
+}
+
+void SUBsetSetpoint(float speed, float incline)
+{
+   subMailbox_t m = mailbox;
+
+   m.speed = speed;
+   m.incline = incline;
+   m.writtenNs = CLKrealNs();
+   SEQwrite(&mailboxSeq, &mailbox, &m, sizeof(m));
+}
+
+void SUBsetBrake(bool engaged)
+{
+   subMailbox_t m = mailbox;
+
+   if (m.brake == engaged)
+   {
+      return;
+   }
+   m.brake = engaged;
+   m.writtenNs = CLKrealNs();
+   SEQwrite(&mailboxSeq, &mailbox, &m, sizeof(m));
+}
+
+void SUBgetStatus(subStatus_t *s)
+{
+   SEQread(&statusSeq, s, &status, sizeof(*s));
+}
+
+void SUBgetStats(subStats_t *s)
+{
+   SEQread(&statsSeq, s, &stats, sizeof(*s));
+}
@@ -0,0 +1,71 @@
+#ifndef SUBSYSTEMS_H
+#define SUBSYSTEMS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//------------------------------------------------------------------- SUBsystems
+
+/// Subsystems layer of uml/treadmill-architecture.puml: band speed motor,
+/// incline motor and emergency brake.
+/// The motors are PID controllers with ramp limits, running at a fixed rate
+/// in a control thread (SCHED_FIFO if allowed). The motors and the brake are
+/// accessed through the HAL registers. The FSM writes setpoints in a lock-free mailbox, the control loop
+/// never waits for the FSM. Motor faults are raised in the fault monitor.
+/// With the virtual clock the control loop is a periodic clock timer.
+
+#define SUB_DEFAULT_RATE_HZ (100)        ///< Default control loop rate
+
+#define SUB_FAULT_SPEED     (1u << 0)    ///< Belt speed does not follow
+#define SUB_FAULT_INCLINE   (1u << 1)    ///< Incline does not follow
+
+/// Status of the motors and the brake, updated every control step.
+typedef struct
+{
+   float speedSetpoint;      ///< Ramped speed setpoint in km/h
+   float speedCommand;       ///< Band speed motor command in km/h
+   float speed;              ///< Measured belt speed in km/h
+   float inclineSetpoint;    ///< Ramped incline setpoint in %
+   float inclineCommand;     ///< Incline motor command in %
+   float incline;            ///< Measured incline in %
+   bool brake;               ///< Emergency brake engaged
+   uint32_t faults;          ///< SUB_FAULT_* bits, cleared on brake release
+} subStatus_t;
+
+/// Control loop counters.
+typedef struct
+{
+   uint64_t steps;           ///< Executed control steps
+   uint64_t missed;          ///< Periods skipped because the loop was late
+   uint64_t jitterSumNs;     ///< Sum of wake up delays after the deadline
+   uint64_t jitterMaxNs;     ///< Max wake up delay after the deadline
+   uint64_t setpoints;       ///< Mailbox updates applied
+   uint64_t latencySumNs;    ///< Sum of setpoint write to motor command times
+   uint64_t latencyMaxNs;    ///< Max setpoint write to motor command time
+   uint64_t faultsRaised;    ///< Faults raised in the fault monitor
+   unsigned int rateHz;      ///< Control loop rate
+   bool realtime;            ///< Control thread runs SCHED_FIFO
+} subStats_t;
+
+/// Starts the control loop, rateHz steps per second.
+/// Initialise the HAL first.
+/// \return false if already started or the thread cannot be started.
+bool SUBstart(unsigned int rateHz);
+
+/// Stops the control loop.
+void SUBstop(void);
+
+/// Sets the belt speed (km/h) and incline (%) setpoints.
+void SUBsetSetpoint(float speed, float incline);
+
+/// Engages or releases the emergency brake. An engaged brake stops the belt
+/// as fast as the motor can, releasing clears the faults.
+void SUBsetBrake(bool engaged);
+
+/// Reads a consistent copy of the motor status.
+void SUBgetStatus(subStatus_t *status);
+
+/// Copies the control loop counters in stats.
+void SUBgetStats(subStats_t *stats);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//---------------------------------------------------------------------- SEQlock
+
+/// Sequence lock of one writer and any number of readers, also across
+/// processes in shared memory. The writer makes the counter odd while it
+/// writes and never waits. A reader copies the data and retries if the
+/// counter was odd or changed meanwhile.
+/// Inline, the physics and subsystem threads use it every tick.
+
+/// Starts a write: readers retry until SEQwriteEnd().
+static inline void SEQwriteBegin(_Atomic uint32_t *seq)
+{
+   // Single writer: a relaxed load of its own counter is sufficient
+   uint32_t s = atomic_load_explicit(seq, memory_order_relaxed);
+
+   atomic_store_explicit(seq, s + 1, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+}
+
+/// Ends a write, the data is consistent again.
+static inline void SEQwriteEnd(_Atomic uint32_t *seq)
+{
+   uint32_t s = atomic_load_explicit(seq, memory_order_relaxed);
+
+   atomic_store_explicit(seq, s + 1, memory_order_release);
+}
+
+/// Starts a read.
+/// \return the counter to pass to SEQreadRetry().
+static inline uint32_t SEQreadBegin(const _Atomic uint32_t *seq)
+{
+   return atomic_load_explicit(seq, memory_order_acquire);
+}
+
+/// Ends a read that started with begin.
+/// \return true if the copy may be torn and must be read again.
+static inline bool SEQreadRetry(const _Atomic uint32_t *seq, uint32_t begin)
+{
+   atomic_thread_fence(memory_order_acquire);
+   return (begin & 1u) != 0 ||
+          atomic_load_explicit(seq, memory_order_relaxed) != begin;
+}
+
+/// Publishes a copy of size bytes of src in dst.
+static inline void SEQwrite(_Atomic uint32_t *seq, void *dst, const void *src,
+                            size_t size)
+{
+   SEQwriteBegin(seq);
+   memcpy(dst, src, size);
+   SEQwriteEnd(seq);
+}
+
+/// Copies a consistent copy of size bytes of src in dst.
+/// \return the counter of the copy, it changes with every write.
+static inline uint32_t SEQread(const _Atomic uint32_t *seq, void *dst,
+                               const void *src, size_t size)
+{
+   uint32_t s;
+
+   do
+   {
+      s = SEQreadBegin(seq);
+      memcpy(dst, src, size);
+   } while (SEQreadRetry(seq, s));
+
+   return s;
+}
+
+#endif
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include "telemetry.h"
+#include "sync_functions/seqlock.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//-------------------------------------------------------------------- TeLeMetry
+
+static tlmSegment_t *segment = NULL;
+static char segmentName[TLM_NAME_SIZE] = {0};
+
+#ifndef _WIN32
+
+/// \return true if process pid still runs.
+static bool publisherAlive(uint32_t pid)
+{
+   return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+bool TLMinitialise(unsigned int machineId)
+{
+   struct stat st;
+
+   snprintf(segmentName, sizeof(segmentName), TLM_NAME_FORMAT, machineId);
+
+   // Create the segment, or open the one a previous publisher left behind
+   int fd = shm_open(segmentName, O_CREAT | O_EXCL | O_RDWR, 0644);
+   if (fd < 0 && errno == EEXIST)
+   {
+      fd = shm_open(segmentName, O_RDWR, 0);
+   }
+   if (fd < 0)
+   {
+      return false;
+   }
+   // A segment of another size is not ours to resize
+   if (fstat(fd, &st) != 0 ||
+       (st.st_size != 0 && st.st_size != (off_t)sizeof(tlmSegment_t)) ||
+       (st.st_size == 0 && ftruncate(fd, sizeof(tlmSegment_t)) != 0))
+   {
+      close(fd);
+      return false;
+   }
+
+   void *p = mmap(NULL, sizeof(tlmSegment_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+   close(fd);
+   if (p == MAP_FAILED)
+   {
+      return false;
+   }
+
+   // Take the segment over only from a publisher that is gone. Of two
+   // processes that start at the same time only one wins the exchange.
+   tlmSegment_t *s = p;
+   uint32_t owner = atomic_load(&s->pid);
+   uint32_t self = (uint32_t)getpid();
+   if ((owner != 0 && publisherAlive(owner)) ||
+       !atomic_compare_exchange_strong(&s->pid, &owner, self))
+   {
+      munmap(p, sizeof(tlmSegment_t));
+      return false;
+   }
+
+   // Readers that are still attached see an invalid segment, then a seq
+   // change that makes them retry
+   s->magic = 0;
+   atomic_thread_fence(memory_order_release);
+   s->size = sizeof(tlmSegment_t);
+   s->machineId = machineId;
+   s->reserved = 0;
+   atomic_store_explicit(&s->publishCount, 0, memory_order_relaxed);
+   memset(&s->snapshot, 0, sizeof(tlmSnapshot_t));
+   atomic_store_explicit(&s->seq, 0, memory_order_relaxed);
+
+   // Readers check magic last, so publish it after the header is complete
+   atomic_thread_fence(memory_order_release);
+   s->magic = TLM_MAGIC;
+   segment = s;
+
+   return true;
+}
+
+void TLMclose(void)
+{
+   if (segment != NULL)
+   {
+      // Owned since TLMinitialise(), nobody else removes or recreates it
+      if (atomic_load(&segment->pid) == (uint32_t)getpid())
+      {
+         shm_unlink(segmentName);
+      }
+      munmap(segment, sizeof(tlmSegment_t));
+      segment = NULL;
+   }
+}
+
+const tlmSegment_t *TLMattach(unsigned int machineId)
+{
+   char name[TLM_NAME_SIZE];
+
+   snprintf(name, sizeof(name), TLM_NAME_FORMAT, machineId);
+
+   int fd = shm_open(name, O_RDONLY, 0);
+   if (fd < 0)
+   {
+      return NULL;
+   }
+
+   void *p = mmap(NULL, sizeof(tlmSegment_t), PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (p == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   const tlmSegment_t *s = p;
+   if (s->magic != TLM_MAGIC || s->size != sizeof(tlmSegment_t))
+   {
+      munmap(p, sizeof(tlmSegment_t));
+      return NULL;
+   }
+   return s;
+}
+
+void TLMdetach(const tlmSegment_t *s)
+{
+   if (s != NULL)
+   {
+      munmap((void *)s, sizeof(tlmSegment_t));
+   }
+}
+
+#else // _WIN32: no POSIX shared memory, publishing is disabled
+
+bool TLMinitialise(unsigned int machineId)
+{
+   (void)machineId;
+   return false;
+}
+
+void TLMclose(void)
+{
+}
+
+const tlmSegment_t *TLMattach(unsigned int machineId)
+{
+   (void)machineId;
+   return NULL;
+}
+
+void TLMdetach(const tlmSegment_t *s)
+{
+   (void)s;
+}
+
+#endif
+
+void TLMpublish(const tlmSnapshot_t *snapshot)
+{
+   if (segment == NULL)
+   {
+      return;
+   }
+
+   SEQwriteBegin(&segment->seq);
+   segment->snapshot = *snapshot;
+   atomic_store_explicit(&segment->publishCount,
+                         atomic_load_explicit(&segment->publishCount,
+                                              memory_order_relaxed) + 1,
+                         memory_order_relaxed);
+   SEQwriteEnd(&segment->seq);
+}
+
+unsigned int TLMread(const tlmSegment_t *s, tlmSnapshot_t *snapshot)
+{
+   unsigned int retries = 0;
+   uint32_t seq;
+
+   for (;;)
+   {
+      seq = SEQreadBegin(&s->seq);
+      // Odd sequence: the publisher is writing, do not copy
+      if ((seq & 1u) == 0)
+      {
+         memcpy(snapshot, (const void *)&s->snapshot, sizeof(tlmSnapshot_t));
+         if (!SEQreadRetry(&s->seq, seq))
+         {
+            return retries;
+         }
+      }
+      retries++;
+   }
+}
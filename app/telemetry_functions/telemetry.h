@@ -0,0 +1,68 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//-------------------------------------------------------------------- TeLeMetry
+
+#define TLM_MAGIC       (0x314D4C54u)         ///< "TLM1" in memory order
+#define TLM_NAME_FORMAT "/fsm-treadmill-%u"  ///< shm_open() name per machine
+#define TLM_NAME_SIZE   (32)                 ///< Buffer size for a segment name
+
+/// Values published by one treadmill, a copy of struct Variables extended
+/// with the FSM state.
+typedef struct
+{
+   float speed;          ///< Current speed in km/h
+   float inc;            ///< Current inclination in %
+   float distance;       ///< Distance in m
+   float tSpeed;         ///< Saved speed (pause, diagnostics)
+   float tInc;           ///< Saved inclination (pause, diagnostics)
+   uint32_t state;       ///< Current FSM state (state_t)
+   uint32_t event;       ///< Last handled FSM event (event_t)
+   uint32_t errorBits;   ///< System error bits
+   uint64_t timestampNs; ///< CLKnowNs() at the moment of publishing
+} tlmSnapshot_t;
+
+/// Layout of the shared memory segment.
+/// The snapshot is protected by a seqlock: seq is odd while the publisher
+/// is writing. Readers never block the publisher, they retry instead.
+typedef struct
+{
+   uint32_t magic;          ///< TLM_MAGIC when the segment is valid
+   uint32_t size;           ///< sizeof(tlmSegment_t), layout check
+   uint32_t machineId;      ///< Machine id as used in the segment name
+   _Atomic uint32_t pid;    ///< Process id of the publisher, 0 if none
+   _Atomic uint32_t seq;    ///< Seqlock sequence counter
+   uint32_t reserved;
+   _Atomic uint64_t publishCount; ///< Number of published snapshots
+   tlmSnapshot_t snapshot;  ///< Last published values
+} tlmSegment_t;
+
+/// Creates the shared memory segment for machineId and maps it. An existing
+/// segment is taken over only if its publisher process is gone.
+/// \return false if another running treadmill publishes as machineId, or
+/// the segment cannot be created.
+bool TLMinitialise(unsigned int machineId);
+
+/// Unmaps and removes the shared memory segment of this machine.
+void TLMclose(void);
+
+/// Publishes a new snapshot. Wait free, never blocks on readers.
+/// Does nothing if TLMinitialise() failed.
+void TLMpublish(const tlmSnapshot_t *snapshot);
+
+/// Maps the segment of machineId read only, for readers in other processes.
+/// \return pointer to the segment or NULL if it does not exist.
+const tlmSegment_t *TLMattach(unsigned int machineId);
+
+/// Unmaps a segment returned by TLMattach().
+void TLMdetach(const tlmSegment_t *segment);
+
+/// Reads a consistent snapshot from segment.
+/// \return number of retries needed because the publisher was writing.
+unsigned int TLMread(const tlmSegment_t *segment, tlmSnapshot_t *snapshot);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+//------------------------------------------------------------------------ TRaCe
+
+/// USDT (user statically defined tracing) probes for perf, bpftrace and
+/// other eBPF tools, see tools/bpftrace.
+///
+/// With <sys/sdt.h> (package systemtap-sdt-dev or systemtap-sdt-devel) a
+/// probe is a nop instruction and an ELF note with the places of its
+/// arguments, a tracer replaces the nop while it is attached. Arguments
+/// must be cheap: they are evaluated, also without a tracer. Without
+/// <sys/sdt.h>, or with DEFINES += TRC_NO_PROBES, the probes are removed.
+///
+///    perf probe -x fsm-treadmill sdt_fsm:dispatch_start
+///    bpftrace -l 'usdt:./fsm-treadmill:*'
+
+#if !defined(TRC_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRC_PROBES
+#endif
+#endif
+
+#ifdef TRC_PROBES
+#define TRC_PROBE0(provider, name)          DTRACE_PROBE(provider, name)
+#define TRC_PROBE1(provider, name, a)       DTRACE_PROBE1(provider, name, a)
+#define TRC_PROBE2(provider, name, a, b)    DTRACE_PROBE2(provider, name, a, b)
+#define TRC_PROBE3(provider, name, a, b, c) DTRACE_PROBE3(provider, name, a, b, c)
+#else
+#define TRC_PROBE0(provider, name)          ((void)0)
+#define TRC_PROBE1(provider, name, a)       ((void)0)
+#define TRC_PROBE2(provider, name, a, b)    ((void)0)
+#define TRC_PROBE3(provider, name, a, b, c) ((void)0)
+#endif
+
+#endif
@@ -3,6 +3,8 @@
 
 #endif // VARIABLES_H
 
+#include "fixed_functions/fixedpoint.h"
+
 typedef enum {
     INIT,                ///< Used for initialisation of an event variable
     STANDBY,
@@ -25,9 +27,10 @@ char * treadmillStatusToText[] =
 };
 
 // Struct for vallues. Comment Colin: couldn't find out how to pass refferense to state. had to resolve to global struct. if time allow fix.
+/// float, or Q47.16 fixed point with FXP_FIXED_POINT (see fixedpoint.h)
 struct Variables
 {
-    float
+    fxpValue_t
     speed,
     inc,
     distance,
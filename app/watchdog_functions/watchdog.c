@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include "watchdog.h"
+#include "clock_functions/clock.h"
+#include "console_functions/keyboard.h"
+#include "fault_functions/faultMonitor.h"
+#include "log_functions/logger.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+//--------------------------------------------------------------------- WatchDoG
+
+#define WDG_NO_STATE (-1)
+
+extern char * stateEnumToText[];
+
+/// Handler that runs now, written by the FSM thread.
+static _Atomic int activeState = WDG_NO_STATE;
+static _Atomic uint32_t invocation = 0;     ///< Counts handler calls
+static _Atomic uint64_t spentNs = 0;        ///< Busy time before since
+static _Atomic uint64_t sinceNs = 0;        ///< Busy since, 0 while waiting
+static int waitDepth = 0;                   ///< Nested keyboard waits
+
+static _Atomic uint32_t budgetMs[NOF_STATES];
+static atomic_bool escalate[NOF_STATES];
+static _Atomic uint64_t runs[NOF_STATES];
+static _Atomic uint64_t overruns[NOF_STATES];
+static _Atomic uint64_t busySumNs[NOF_STATES];
+static _Atomic uint64_t busyMaxNs[NOF_STATES];
+
+static pthread_t thread;
+static atomic_bool running = false;
+
+/// Overrun reports, of the watchdog thread and of the handler end
+static pthread_mutex_t overrunMutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint32_t flagged = 0;   ///< Invocation that already overran
+static bool overrunSet = false;        ///< ERR_WATCHDOG is set by flagged
+
+/// Counts and reports the overrun of invocation call, once.
+static void reportOverrun(int state, uint32_t call, uint32_t budget)
+{
+   pthread_mutex_lock(&overrunMutex);
+   if (atomic_load(&flagged) != call)
+   {
+      atomic_store(&flagged, call);
+      // The bit of a previous overrun is cleared first, so that
+      // FLTescalate() posts the emergency again
+      if (overrunSet)
+      {
+         FLTclear(ERR_WATCHDOG);
+      }
+      overrunSet = true;
+      atomic_fetch_add(&overruns[state], 1);
+      LOGwrite(LOG_LEVEL_ERROR, "Watchdog: %s handler busy for more than %u ms",
+               stateEnumToText[state], budget);
+      if (atomic_load(&escalate[state]))
+      {
+         FLTescalate(ERR_WATCHDOG);
+      }
+      else
+      {
+         FLTraise(ERR_WATCHDOG);
+      }
+   }
+   pthread_mutex_unlock(&overrunMutex);
+}
+
+/// Clears ERR_WATCHDOG when the handler that overran no longer runs.
+static void endOverrun(int state, uint32_t call)
+{
+   pthread_mutex_lock(&overrunMutex);
+   if (overrunSet && (state == WDG_NO_STATE || call != atomic_load(&flagged)))
+   {
+      FLTclear(ERR_WATCHDOG);
+      overrunSet = false;
+   }
+   pthread_mutex_unlock(&overrunMutex);
+}
+
+/// FSM handler hook.
+static void handler(state_t state, bool begin)
+{
+   if (begin)
+   {
+      atomic_store(&spentNs, 0);
+      atomic_store(&sinceNs, CLKrealNs());
+      waitDepth = 0;
+      atomic_fetch_add(&invocation, 1);
+      atomic_store(&activeState, (int)state);
+      return;
+   }
+
+   uint64_t since = atomic_load(&sinceNs);
+   uint64_t busy = atomic_load(&spentNs) + (since ? CLKrealNs() - since : 0);
+   uint32_t budget = atomic_load(&budgetMs[state]);
+
+   // An overrun that ended between two checks of the watchdog thread
+   if (atomic_load(&running) && busy > budget * CLK_NS_PER_MS)
+   {
+      reportOverrun((int)state, atomic_load(&invocation), budget);
+   }
+   atomic_store(&activeState, WDG_NO_STATE);
+   atomic_fetch_add(&runs[state], 1);
+   atomic_fetch_add(&busySumNs[state], busy);
+   if (busy > atomic_load(&busyMaxNs[state]))
+   {
+      atomic_store(&busyMaxNs[state], busy);
+   }
+}
+
+/// Keyboard wait hooks: the time waiting for the user does not count.
+static void waitBegin(void)
+{
+   if (waitDepth++ == 0)
+   {
+      uint64_t since = atomic_load(&sinceNs);
+      // The checker reads spentNs before sinceNs: clear sinceNs first, so it
+      // never counts the same interval twice
+      atomic_store(&sinceNs, 0);
+      if (since != 0)
+      {
+         atomic_fetch_add(&spentNs, CLKrealNs() - since);
+      }
+   }
+}
+
+static void waitEnd(void)
+{
+   if (waitDepth > 0 && --waitDepth == 0)
+   {
+      atomic_store(&sinceNs, CLKrealNs());
+   }
+}
+
+static void *watchdogThread(void *arg)
+{
+   const struct timespec period = {.tv_nsec = WDG_CHECK_PERIOD_MS * (long)CLK_NS_PER_MS};
+
+   (void)arg;
+   while (atomic_load(&running))
+   {
+      nanosleep(&period, NULL);
+
+      int state = atomic_load(&activeState);
+      uint32_t call = atomic_load(&invocation);
+      // The overrun ends with its handler: clear the bit, so that the next
+      // overrun raises (and escalates) again
+      endOverrun(state, call);
+      if (state == WDG_NO_STATE || call == atomic_load(&flagged))
+      {
+         continue;
+      }
+
+      uint64_t spent = atomic_load(&spentNs);
+      uint64_t since = atomic_load(&sinceNs);
+      uint64_t busy = spent + (since ? CLKrealNs() - since : 0);
+      uint32_t budget = atomic_load(&budgetMs[state]);
+
+      if (busy > budget * CLK_NS_PER_MS && call == atomic_load(&invocation))
+      {
+         reportOverrun(state, call, budget);
+      }
+   }
+   return NULL;
+}
+
+bool WDGstart(void)
+{
+   if (atomic_load(&running))
+   {
+      return false;
+   }
+   for (int s = 0; s < NOF_STATES; s++)
+   {
+      if (atomic_load(&budgetMs[s]) == 0)
+      {
+         atomic_store(&budgetMs[s], WDG_DEFAULT_BUDGET_MS);
+      }
+   }
+
+   atomic_store(&running, true);
+   if (pthread_create(&thread, NULL, watchdogThread, NULL) != 0)
+   {
+      atomic_store(&running, false);
+      return false;
+   }
+   FSM_SetHandlerHook(handler);
+   KYBsetWaitHooks(waitBegin, waitEnd);
+
+   return true;
+}
+
+void WDGstop(void)
+{
+   if (atomic_exchange(&running, false))
+   {
+      FSM_SetHandlerHook(NULL);
+      KYBsetWaitHooks(NULL, NULL);
+      pthread_join(thread, NULL);
+   }
+}
+
+void WDGsetBudget(state_t state, uint32_t budget, bool escalateOverrun)
+{
+   atomic_store(&budgetMs[state], budget);
+   atomic_store(&escalate[state], escalateOverrun);
+}
+
+void WDGgetStats(state_t state, wdgStats_t *stats)
+{
+   stats->runs = atomic_load(&runs[state]);
+   stats->overruns = atomic_load(&overruns[state]);
+   stats->busySumNs = atomic_load(&busySumNs[state]);
+   stats->busyMaxNs = atomic_load(&busyMaxNs[state]);
+   stats->budgetMs = atomic_load(&budgetMs[state]);
+   stats->escalate = atomic_load(&escalate[state]);
+}
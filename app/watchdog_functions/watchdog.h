@@ -0,0 +1,46 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fsm_functions/fsm.h"
+
+//--------------------------------------------------------------------- WatchDoG
+
+/// Handler deadline watchdog.
+/// The FSM reports the begin and end of every onEntry() and onExit(), the
+/// keyboard reports when it waits for the user. A watchdog thread checks
+/// that the time a handler spends outside user input waits stays within
+/// the budget of its state. An overrun sets ERR_WATCHDOG, or stops the
+/// treadmill (FLTescalate()) if the budget says so, and is counted per state.
+/// ERR_WATCHDOG is cleared when the handler that overran returns.
+
+#define WDG_DEFAULT_BUDGET_MS (100)  ///< Budget of states without WDGsetBudget()
+#define WDG_CHECK_PERIOD_MS   (5)    ///< Watchdog thread period
+
+/// Counters of one state.
+typedef struct
+{
+   uint64_t runs;          ///< Handler calls (onEntry and onExit)
+   uint64_t overruns;      ///< Handler calls over budget
+   uint64_t busySumNs;     ///< Sum of handler times without input waits
+   uint64_t busyMaxNs;     ///< Max handler time without input waits
+   uint32_t budgetMs;
+   bool escalate;          ///< An overrun stops the treadmill
+} wdgStats_t;
+
+/// Installs the FSM and keyboard hooks and starts the watchdog thread.
+/// \return false if the thread cannot be started.
+bool WDGstart(void);
+
+/// Stops the watchdog thread.
+void WDGstop(void);
+
+/// Sets the handler time budget of state. With escalate an overrun posts
+/// E_EMERGENCY_START through the fault monitor.
+void WDGsetBudget(state_t state, uint32_t budgetMs, bool escalate);
+
+/// Copies the counters of state in stats.
+void WDGgetStats(state_t state, wdgStats_t *stats);
+
+#endif
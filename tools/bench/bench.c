@@ -0,0 +1,1234 @@
+/*!
+ * Micro benchmarks for the treadmill subsystems.
+ *
+ * usage: bench [case ...]
+ *
+ * Without arguments all cases are executed. Each case prints one line per
+ * measurement with the average cost per operation.
+ */
+#define _GNU_SOURCE
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "analytics_functions/analytics.h"
+#include "clock_functions/clock.h"
+#include "daemon_functions/daemon.h"
+#include "fixed_functions/fixedpoint.h"
+#include "fsm_functions/fsm.h"
+#include "log_functions/logger.h"
+#include "metrics_functions/metrics.h"
+#include "gym_functions/gym.h"
+#include "hal_functions/hal.h"
+#include "history_functions/history.h"
+#include "program_functions/program.h"
+#include "simulation_functions/physics.h"
+#include "telemetry_functions/telemetry.h"
+
+#define BENCH_MACHINE_ID (4242u) ///< Telemetry segment used by the benchmark
+
+typedef struct
+{
+   const char *name;
+   void (*run)(void);
+} benchCase_t;
+
+/// Prints one result line.
+static void report(const char *caseName, const char *what, uint64_t ns,
+                   uint64_t ops)
+{
+   printf("%-12s %-36s %10llu ops %9.1f ns/op\n", caseName, what,
+          (unsigned long long)ops, ops ? (double)ns / (double)ops : 0.0);
+}
+
+//-------------------------------------------------------------------- telemetry
+
+static atomic_bool readerRun;
+static atomic_ullong readerReads;
+static atomic_ullong readerRetries;
+
+static void *telemetryReader(void *arg)
+{
+   const tlmSegment_t *s = arg;
+   tlmSnapshot_t snapshot;
+   unsigned long long reads = 0;
+   unsigned long long retries = 0;
+
+   while (atomic_load_explicit(&readerRun, memory_order_relaxed))
+   {
+      retries += TLMread(s, &snapshot);
+      reads++;
+   }
+   atomic_store(&readerReads, reads);
+   atomic_store(&readerRetries, retries);
+   return NULL;
+}
+
+static void benchTelemetry(void)
+{
+   const uint64_t n = 10000000;
+   tlmSnapshot_t snapshot = {.speed = 8.0f, .inc = 2.0f, .state = 4};
+
+   if (!TLMinitialise(BENCH_MACHINE_ID))
+   {
+      printf("telemetry    shared memory not available, skipped\n");
+      return;
+   }
+
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      snapshot.distance = (float)i;
+      TLMpublish(&snapshot);
+   }
+   report("telemetry", "publish, no readers", CLKrealNs() - t0, n);
+
+   const tlmSegment_t *s = TLMattach(BENCH_MACHINE_ID);
+   pthread_t reader;
+
+   atomic_store(&readerRun, true);
+   pthread_create(&reader, NULL, telemetryReader, (void *)s);
+   usleep(10000);
+
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      snapshot.distance = (float)i;
+      TLMpublish(&snapshot);
+   }
+   uint64_t ns = CLKrealNs() - t0;
+
+   atomic_store(&readerRun, false);
+   pthread_join(reader, NULL);
+   report("telemetry", "publish, one reader spinning", ns, n);
+   printf("%-12s %-36s %10llu reads %7llu retries\n", "telemetry",
+          "reader", atomic_load(&readerReads), atomic_load(&readerRetries));
+
+   TLMdetach(s);
+   TLMclose();
+}
+
+//-------------------------------------------------------------------------- log
+
+/// Logs n messages, with pauseNs between the messages.
+static uint64_t logMessages(uint64_t n, uint64_t pauseNs)
+{
+   uint64_t busy = 0;
+
+   for (uint64_t i = 0; i < n; i++)
+   {
+      uint64_t t0 = CLKrealNs();
+      LOGwrite(LOG_LEVEL_DEBUG, "State: %s speed %.1f event %d", "S_DEFAULT",
+               8.5, (int)i);
+      uint64_t t1 = CLKrealNs();
+
+      busy += t1 - t0;
+      while (CLKrealNs() - t1 < pauseNs)
+      {
+         // Simulate the FSM doing other work
+      }
+   }
+   return busy;
+}
+
+static void reportLog(const char *what, uint64_t busy, uint64_t n)
+{
+   logStats_t stats;
+
+   LOGgetStats(&stats);
+   report("log", what, busy, n);
+   printf("%-12s %-36s %10llu dropped %5.1f us avg %8.1f us max latency\n",
+          "log", "", (unsigned long long)stats.dropped,
+          stats.written ? (double)stats.latencySumNs / stats.written / 1e3 : 0.0,
+          (double)stats.latencyMaxNs / 1e3);
+}
+
+static void benchLog(void)
+{
+   const uint64_t burst = 1000000;
+   const uint64_t paced = 20000;
+   FILE *sink = fopen("/dev/null", "w");
+
+   if (sink == NULL)
+   {
+      return;
+   }
+   LOGsetOutput(sink);
+
+   // Direct path: vfprintf() in the calling thread
+   LOGinitialise(LOG_MODE_DIRECT);
+   uint64_t busy = logMessages(burst, 0);
+   report("log", "direct printf, burst", busy, burst);
+
+   // Asynchronous path, producer cost only
+   LOGinitialise(LOG_MODE_ASYNC);
+   busy = logMessages(burst, 0);
+   LOGflush();
+   LOGclose();
+   reportLog("async, burst (ring overflows)", busy, burst);
+
+   LOGinitialise(LOG_MODE_ASYNC);
+   logStats_t before;
+   LOGgetStats(&before);
+   busy = logMessages(paced, 20000);
+   LOGflush();
+   LOGclose();
+   logStats_t after;
+   LOGgetStats(&after);
+   report("log", "async, one message per 20 us", busy, paced);
+   uint64_t nWritten = after.written - before.written;
+   printf("%-12s %-36s %10llu dropped %5.1f us avg latency\n", "log", "",
+          (unsigned long long)(after.dropped - before.dropped),
+          nWritten ? (double)(after.latencySumNs - before.latencySumNs) /
+                        nWritten / 1e3 : 0.0);
+
+   LOGsetOutput(NULL);
+   fclose(sink);
+}
+
+//----------------------------------------------------------------------- binlog
+
+/// Captures a record like the logger does.
+static void captureRecord(logRecord_t *record, int level, const char fmt[], ...)
+{
+   va_list arg;
+
+   va_start(arg, fmt);
+   LOGcapture(record, fmt, arg);
+   va_end(arg);
+   record->level = (uint8_t)level;
+}
+
+static void benchBinaryLog(void)
+{
+   const uint64_t n = 1000000;
+   logRecord_t records[4];
+   char line[512];
+   FILE *sink = fopen("/dev/null", "wb");
+
+   if (sink == NULL)
+   {
+      return;
+   }
+
+   // Typical messages of the treadmill
+   captureRecord(&records[0], LOG_LEVEL_DEBUG, "State: %s", "S_ALTERCONFIG");
+   captureRecord(&records[1], LOG_LEVEL_DEBUG,
+                 "** Press <Enter>, for update display **");
+   captureRecord(&records[2], LOG_LEVEL_DEBUG, "Display %dx%d: initialised",
+                 70, 10);
+   captureRecord(&records[3], LOG_LEVEL_SIMULATION,
+                 "Speed %.1f Km/H inclination %.1f %% distance %.1f M",
+                 12.5, 3.0, 1234.5);
+
+   // Text: what the log thread does for every record in text mode
+   uint64_t textBytes = 0;
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      logRecord_t *r = &records[i & 3];
+      r->timestampNs = t0 + i * 1000;
+      fputs(LOGlevelPrefix(r->level), sink);
+      textBytes += strlen(LOGlevelPrefix(r->level));
+      textBytes += LOGrender(r, line, sizeof(line));
+      fputs(line, sink);
+   }
+   report("binlog", "text render + write", CLKrealNs() - t0, n);
+
+   logBinaryWriter_t writer;
+   LOGbinaryWriterInit(&writer, sink);
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      logRecord_t *r = &records[i & 3];
+      r->timestampNs = t0 + i * 1000;
+      LOGbinaryWrite(&writer, r);
+   }
+   report("binlog", "binary encode + write", CLKrealNs() - t0, n);
+
+   printf("%-12s %-36s %6.1f text %6.1f binary bytes/msg\n", "binlog", "",
+          (double)textBytes / n, (double)writer.bytes / n);
+   fclose(sink);
+}
+
+//---------------------------------------------------------------------- physics
+
+static void benchPhysics(void)
+{
+   const unsigned int rates[] = {1000, 10000};
+
+   for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+   {
+      const uint64_t n = 3600ULL * rates[r]; // One hour of simulated time
+      const double dt = 1.0 / rates[r];
+      phyState_t s = {0};
+      char what[64];
+
+      // Ramp up to 10 km/h and 5 %, then run at constant speed
+      uint64_t t0 = CLKrealNs();
+      for (uint64_t i = 0; i < n; i++)
+      {
+         PHYstep(&s, &phyDefaultConfig, 10.0f, 5.0f, dt);
+      }
+      uint64_t ns = CLKrealNs() - t0;
+
+      snprintf(what, sizeof(what), "step, one hour at %u Hz", rates[r]);
+      report("physics", what, ns, n);
+      printf("%-12s %-36s %9.4f %% of the step period\n", "physics", "",
+             (double)ns / n / (1e9 / rates[r]) * 100.0);
+      printf("%-12s %-36s %9.1f m (10 km/h: 10000 m minus ramp)\n",
+             "physics", "", s.distance);
+   }
+
+   // Virtual clock: the same hour in one exact advancement
+   const uint64_t n = 100000;
+   phyState_t s = {0};
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      s = (phyState_t){0};
+      PHYadvance(&s, &phyDefaultConfig, 10.0f, 5.0f, 3600.0);
+   }
+   report("physics", "advance, one hour exact", CLKrealNs() - t0, n);
+   printf("%-12s %-36s %9.1f m\n", "physics", "", s.distance);
+}
+
+//------------------------------------------------------------------------ fixed
+
+static void benchFixed(void)
+{
+   static const char *const inputs[] = {"8.5", "12.75", "0.8", "-3.25", "42195.0", "2"};
+   const size_t nInputs = sizeof(inputs) / sizeof(inputs[0]);
+   const uint64_t n = 2000000;
+   volatile float floatSink = 0.0f;
+   volatile fxpQ_t fixedSink = 0;
+   char text[FXP_TEXT_SIZE];
+
+   // Console input, the atof() and "%.1f" of the float build
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      floatSink = (float)atof(inputs[i % nInputs]);
+   }
+   report("fixed", "parse, atof() float", CLKrealNs() - t0, n);
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      fixedSink = FXPparseQ(inputs[i % nInputs]);
+   }
+   report("fixed", "parse, FXPparseQ() Q47.16", CLKrealNs() - t0, n);
+
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      FXPformatFloat(floatSink + (float)(i & 0xFF), text, sizeof(text));
+   }
+   report("fixed", "format, \"%.1f\" float", CLKrealNs() - t0, n);
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      FXPformatQ(fixedSink + (fxpQ_t)(i & 0xFF) * FXP_ONE, text, sizeof(text));
+   }
+   report("fixed", "format, FXPformatQ() Q47.16", CLKrealNs() - t0, n);
+
+   // Distance of a 12 hour session at 12.34 km/h in 10 ms steps: exactly
+   // 1234 * 43200000 / 360000 = 148080 m
+   const uint64_t nSteps = 12ULL * 3600 * 100;
+   const double exact = 148080.0;
+   float floatDistance = 0.0f;
+   fxpIntegralQ_t fixedDistance = {0};
+
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < nSteps; i++)
+   {
+      floatDistance += 12.34f * 10.0f / 3600.0f;
+   }
+   report("fixed", "integrate, float", CLKrealNs() - t0, nSteps);
+   printf("%-12s %-36s %12.3f m off after 12 h\n", "fixed", "",
+          fabs(floatDistance - exact));
+
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < nSteps; i++)
+   {
+      FXPintegrateQ(&fixedDistance, 1234, 10, 360000);
+   }
+   report("fixed", "integrate, FXPintegrateQ() Q47.16", CLKrealNs() - t0, nSteps);
+   printf("%-12s %-36s %12.6f m off after 12 h\n", "fixed", "",
+          fabs((double)fixedDistance.value / FXP_ONE - exact));
+}
+
+//-------------------------------------------------------------------------- hal
+
+static atomic_bool deviceRun;
+static _Atomic uint32_t echoSeen;
+
+/// Device side of the register file, like tools/hwsim without the belt.
+static void *halDevice(void *arg)
+{
+   halRegisterFile_t *file = arg;
+
+   while (atomic_load_explicit(&deviceRun, memory_order_relaxed))
+   {
+      if (HALdeviceWait(10) & (1u << HAL_REG_ECHO_CMD))
+      {
+         atomic_store(&file->reg[HAL_REG_ECHO], atomic_load(&file->reg[HAL_REG_ECHO_CMD]));
+         HALdeviceInterrupt(HAL_IRQ_ECHO);
+      }
+   }
+   return NULL;
+}
+
+static void echoHandler(uint32_t irqBits)
+{
+   if (irqBits & HAL_IRQ_ECHO)
+   {
+      atomic_store(&echoSeen, HALread(HAL_REG_ECHO));
+   }
+}
+
+static void benchHal(void)
+{
+   const uint64_t n = 10000000;
+   const uint64_t nEcho = 20000;
+   uint32_t sum = 0;
+
+   // Local registers: no simulator, a read refreshes from the belt simulation
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      sum += HALread(HAL_REG_BUTTONS);
+   }
+   report("hal", "read, local", CLKrealNs() - t0, n);
+
+   halRegisterFile_t *file = HALdeviceCreate(BENCH_MACHINE_ID);
+   pthread_t device;
+
+   if (file == NULL)
+   {
+      printf("hal          device not available, skipped\n");
+      return;
+   }
+   atomic_store(&deviceRun, true);
+   pthread_create(&device, NULL, halDevice, file);
+   if (!HALinitialise(BENCH_MACHINE_ID))
+   {
+      printf("hal          connect failed, skipped\n");
+      return;
+   }
+   HALsetIrqHandler(echoHandler);
+
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      sum += HALread(HAL_REG_SPEED);
+   }
+   report("hal", "read, shared memory", CLKrealNs() - t0, n);
+
+   t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n / 100; i++)
+   {
+      HALwrite(HAL_REG_SPEED_CMD, (uint32_t)i);
+   }
+   report("hal", "command write + doorbell", CLKrealNs() - t0, n / 100);
+   usleep(10000);
+
+   // Doorbell -> device -> interrupt -> handler, one at a time
+   uint64_t maxNs = 0;
+   t0 = CLKrealNs();
+   for (uint32_t i = 1; i <= nEcho; i++)
+   {
+      uint64_t t1 = CLKrealNs();
+      HALwrite(HAL_REG_ECHO_CMD, i);
+      while (atomic_load(&echoSeen) != i)
+      {
+      }
+      uint64_t rtt = CLKrealNs() - t1;
+      maxNs = (rtt > maxNs) ? rtt : maxNs;
+   }
+   report("hal", "echo round trip", CLKrealNs() - t0, nEcho);
+
+   halStats_t st;
+   HALgetStats(&st);
+   printf("%-12s %-36s %9.1f us max, interrupt latency avg %.1f us max %.1f us\n",
+          "hal", "", maxNs / 1e3,
+          st.interrupts ? st.irqLatencySumNs / 1e3 / st.interrupts : 0.0,
+          st.irqLatencyMaxNs / 1e3);
+
+   HALclose();
+   atomic_store(&deviceRun, false);
+   pthread_join(device, NULL);
+   HALdeviceClose();
+   (void)sum;
+}
+
+//---------------------------------------------------------------------- program
+
+#define BENCH_RUNS (10000) ///< Treadmills of the fleet
+
+static prgRun_t runs[BENCH_RUNS];
+static uint64_t steps = 0;
+
+static void countStep(void *ctx, float speed, float incline)
+{
+   (void)ctx;
+   (void)speed;
+   (void)incline;
+   steps++;
+}
+
+static void benchProgram(void)
+{
+   static const char text[] =
+      "hold 300 5.0 1.0\n"
+      "repeat 8\n"
+      "hold 60 12.0 1.0\n"
+      "ramp 90 12.0 6.0 1.0 3.0\n"
+      "end\n"
+      "ramp 100 6.0 3.0 1.0 0.0\n";
+   char path[] = "/tmp/benchprgXXXXXX";
+   int fd = mkstemp(path);
+
+   if (fd < 0 || write(fd, text, sizeof(text) - 1) != (ssize_t)sizeof(text) - 1)
+   {
+      printf("program      temporary file failed, skipped\n");
+      return;
+   }
+   close(fd);
+
+   const uint64_t n = 1000;
+   prgProgram_t *program = NULL;
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      PRGfree(program);
+      program = PRGcompile(path);
+   }
+   report("program", "compile", CLKrealNs() - t0, n);
+   unlink(path);
+   if (program == NULL)
+   {
+      return;
+   }
+   printf("%-12s %-36s %9u steps, %u s\n", "program", "", program->nSteps,
+          program->durationMs / 1000);
+
+   // A fleet on the virtual clock, a treadmill starts every 0.1 s
+   CLKsetSource(CLK_VIRTUAL);
+   t0 = CLKrealNs();
+   for (int r = 0; r < BENCH_RUNS; r++)
+   {
+      PRGstart(&runs[r], program, countStep, NULL);
+      CLKadvance(CLK_NS_PER_S / 10);
+   }
+   CLKadvance((uint64_t)program->durationMs * CLK_NS_PER_MS);
+   uint64_t ns = CLKrealNs() - t0;
+
+   char what[64];
+   snprintf(what, sizeof(what), "step, %d concurrent runs", BENCH_RUNS);
+   report("program", what, ns, steps);
+   PRGfree(program);
+}
+
+//-------------------------------------------------------------------------- gym
+
+static gymBatch_t gymBatch;
+static atomic_bool gymRun;
+static atomic_ullong gymFrames;
+static atomic_ullong gymCalls;
+
+static void *gymReceiver(void *arg)
+{
+   int fd = *(int *)arg;
+
+   while (atomic_load(&gymRun))
+   {
+      int n = GYMreceive(fd, &gymBatch, 10);
+
+      if (n > 0)
+      {
+         atomic_fetch_add(&gymCalls, 1);
+      }
+      for (int i = 0; i < n; i++)
+      {
+         gymFrame_t frame;
+         size_t offset = 0;
+         uint64_t frames = 0;
+
+         while (GYMnextFrame(gymBatch.data[i], gymBatch.length[i], &offset, &frame) != NULL)
+         {
+            frames++;
+         }
+         atomic_fetch_add(&gymFrames, frames);
+      }
+   }
+   return NULL;
+}
+
+static void benchGym(void)
+{
+   const uint64_t n = 2000000;
+   int fd = GYMserverOpen();
+   pthread_t receiver;
+
+   if (fd < 0)
+   {
+      printf("gym          socket in use (aggregator running?), skipped\n");
+      return;
+   }
+   atomic_store(&gymRun, true);
+   pthread_create(&receiver, NULL, gymReceiver, &fd);
+   GYMinitialise(BENCH_MACHINE_ID, NULL);
+
+   uint64_t t0 = CLKrealNs();
+   for (uint64_t i = 0; i < n; i++)
+   {
+      GYMstateChange(1, 2, 3);
+   }
+   GYMflush();
+   uint64_t sendNs = CLKrealNs() - t0;
+
+   // Wait until the receiver has everything that was sent
+   gymStats_t st;
+   GYMgetStats(&st);
+   while (atomic_load(&gymFrames) < st.frames - st.dropped &&
+          CLKrealNs() - t0 < 10 * CLK_NS_PER_S)
+   {
+      usleep(1000);
+   }
+   uint64_t ns = CLKrealNs() - t0;
+   atomic_store(&gymRun, false);
+   pthread_join(receiver, NULL);
+   GYMclose();
+   close(fd);
+
+   report("gym", "add state frame + send", sendNs, n);
+   uint64_t received = atomic_load(&gymFrames);
+   printf("%-12s %-36s %9.0f messages/s received, %llu dropped\n", "gym", "",
+          received / ((double)ns / CLK_NS_PER_S), (unsigned long long)st.dropped);
+   printf("%-12s %-36s %9.0f messages per sendmmsg, %.0f per recvmmsg\n", "gym", "",
+          st.sendCalls ? (double)st.frames / st.sendCalls : 0.0,
+          atomic_load(&gymCalls) ? (double)received / atomic_load(&gymCalls) : 0.0);
+}
+
+//----------------------------------------------------------------------- daemon
+
+event_t event;   ///< Needed by fsm.c, the benchmark does not run the FSM
+
+static atomic_bool fsmRun;
+static atomic_ullong fsmTaken;
+
+static bool takeEvent(event_t e)
+{
+   (void)e;
+   atomic_fetch_add_explicit(&fsmTaken, 1, memory_order_relaxed);
+   return true;
+}
+
+/// Plays the FSM thread, takes the events of the FSM queue or the ring.
+static void *fsmConsumer(void *arg)
+{
+   bool ring = (arg != NULL);
+
+   while (atomic_load_explicit(&fsmRun, memory_order_relaxed))
+   {
+      // Empty, let the producer run on a single CPU
+      if (ring ? !DMNdrain() : (FSM_GetEvent() == E_NO))
+      {
+         sched_yield();
+      }
+      else if (!ring)
+      {
+         atomic_fetch_add_explicit(&fsmTaken, 1, memory_order_relaxed);
+      }
+   }
+   return NULL;
+}
+
+#define BENCH_BURST (64)   ///< Events per burst, fits in both queues
+
+/// Posts n events in bursts, the consumer empties the queue between the
+/// bursts like an FSM that handles the events of a UI.
+/// \return the time spent in posting.
+static uint64_t postBursts(uint64_t n, bool ring)
+{
+   uint64_t busy = 0;
+
+   for (uint64_t i = 0; i < n; i += BENCH_BURST)
+   {
+      uint64_t t0 = CLKrealNs();
+      for (int b = 0; b < BENCH_BURST; b++)
+      {
+         if (ring)
+         {
+            DMNpost(E_PAUSE);
+         }
+         else
+         {
+            FSM_AddEvent(E_PAUSE);
+         }
+      }
+      busy += CLKrealNs() - t0;
+
+      dmnStats_t st;
+      do
+      {
+         sched_yield();
+         DMNgetStats(&st);
+      } while (ring ? (st.taken != st.posted) : !FSM_NoEvents());
+   }
+   return busy;
+}
+
+static void benchDaemon(void)
+{
+   const uint64_t n = 1000000;
+   pthread_t consumer;
+
+   // Reference: FSM_AddEvent() in the process
+   atomic_store(&fsmRun, true);
+   pthread_create(&consumer, NULL, fsmConsumer, NULL);
+   report("daemon", "FSM_AddEvent, same process", postBursts(n, false), n);
+   atomic_store(&fsmRun, false);
+   pthread_join(consumer, NULL);
+
+   if (!DMNstart(BENCH_MACHINE_ID, takeEvent))
+   {
+      printf("daemon       socket in use, skipped\n");
+      return;
+   }
+   atomic_store(&fsmRun, true);
+   pthread_create(&consumer, NULL, fsmConsumer, &fsmRun);
+   atomic_store(&fsmTaken, 0);
+
+   // The client is another process
+   fflush(stdout);
+   pid_t client = fork();
+   if (client == 0)
+   {
+      if (!DMNconnect(BENCH_MACHINE_ID))
+      {
+         _exit(EXIT_FAILURE);
+      }
+      report("daemon", "DMNpost, other process", postBursts(n, true), n);
+      fflush(stdout);
+      _exit(EXIT_SUCCESS);
+   }
+   waitpid(client, NULL, 0);
+   atomic_store(&fsmRun, false);
+   pthread_join(consumer, NULL);
+
+   dmnStats_t st;
+   DMNgetStats(&st);
+   printf("%-12s %-36s %9llu taken, %llu doorbells\n", "daemon", "",
+          (unsigned long long)atomic_load(&fsmTaken), (unsigned long long)st.doorbells);
+   DMNstop();
+}
+
+//------------------------------------------------------------------------ queue
+
+#define BENCH_QUEUE_CAPACITY (64)
+
+static void benchQueue(void)
+{
+   static const char *const names[] = {"drop newest", "drop oldest", "block", "reject"};
+   const uint64_t n = 1000000;
+
+   // Bursts of twice the capacity. Block first: it waits for a consumer
+   // thread, after FSM_GetEvent() this thread would be the consumer itself.
+   static const fsm_queue_policy_t policies[] =
+   {
+      FSM_QUEUE_BLOCK, FSM_QUEUE_DROP_NEWEST, FSM_QUEUE_DROP_OLDEST, FSM_QUEUE_REJECT
+   };
+
+   for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+   {
+      const fsm_queue_policy_t p = policies[i];
+      pthread_t consumer;
+      fsm_queue_stats_t before;
+      fsm_queue_stats_t after;
+      uint64_t busy = 0;
+      char what[40];
+
+      FSM_SetEventQueue(BENCH_QUEUE_CAPACITY, p);
+      FSM_GetQueueStats(&before);
+      if (p == FSM_QUEUE_BLOCK)
+      {
+         atomic_store(&fsmRun, true);
+         pthread_create(&consumer, NULL, fsmConsumer, NULL);
+      }
+      for (uint64_t e = 0; e < n; e += 2 * BENCH_QUEUE_CAPACITY)
+      {
+         uint64_t t0 = CLKrealNs();
+         for (int b = 0; b < 2 * BENCH_QUEUE_CAPACITY; b++)
+         {
+            FSM_AddEvent(E_PAUSE);
+         }
+         busy += CLKrealNs() - t0;
+
+         while (!FSM_NoEvents())
+         {
+            if (p == FSM_QUEUE_BLOCK)
+            {
+               sched_yield();
+            }
+            else
+            {
+               FSM_GetEvent();
+            }
+         }
+      }
+      if (p == FSM_QUEUE_BLOCK)
+      {
+         atomic_store(&fsmRun, false);
+         pthread_join(consumer, NULL);
+      }
+      FSM_GetQueueStats(&after);
+
+      snprintf(what, sizeof(what), "FSM_AddEvent, %s", names[p]);
+      report("queue", what, busy, n);
+      printf("%-12s %-36s %9llu overflows, %llu dropped, %llu rejected, %llu blocked\n",
+             "queue", "", (unsigned long long)(after.overflows - before.overflows),
+             (unsigned long long)(after.dropped - before.dropped),
+             (unsigned long long)(after.rejected - before.rejected),
+             (unsigned long long)(after.blocked - before.blocked));
+   }
+   FSM_SetEventQueue(FSM_QUEUE_CAPACITY, FSM_QUEUE_DROP_NEWEST);
+
+   // Program steps, latest value wins: one entry per burst
+   fsm_queue_stats_t before;
+   fsm_queue_stats_t after;
+   uint64_t busy = 0;
+
+   FSM_SetCoalescing(E_PROGRAM_STEP, true);
+   FSM_GetQueueStats(&before);
+   for (uint64_t e = 0; e < n; e += 2 * BENCH_QUEUE_CAPACITY)
+   {
+      uint64_t t0 = CLKrealNs();
+      for (int b = 0; b < 2 * BENCH_QUEUE_CAPACITY; b++)
+      {
+         FSM_AddEvent(E_PROGRAM_STEP);
+      }
+      busy += CLKrealNs() - t0;
+      FSM_GetEvent();
+   }
+   FSM_GetQueueStats(&after);
+   FSM_SetCoalescing(E_PROGRAM_STEP, false);
+
+   report("queue", "FSM_AddEvent, coalesced", busy, n);
+   printf("%-12s %-36s %9llu coalesced, %u taken, high water %u\n", "queue", "",
+          (unsigned long long)(after.coalesced - before.coalesced),
+          after.taken - before.taken, after.highWater);
+}
+
+//----------------------------------------------------------------------- reload
+
+static atomic_bool swapRun;
+static atomic_ullong swaps;
+
+/// Swaps between two models as fast as it can.
+static void *modelSwapper(void *arg)
+{
+   static const transition_t models[2][3] =
+   {
+      {{S_STANDBY, E_RUNNING_START, S_DEFAULT}, {S_DEFAULT, E_RUNNING_STOP, S_STANDBY},
+       {S_DEFAULT, E_PAUSE, S_DEFAULT}},
+      {{S_STANDBY, E_RUNNING_START, S_DEFAULT}, {S_DEFAULT, E_RUNNING_STOP, S_STANDBY},
+       {S_STANDBY, E_PAUSE, S_STANDBY}},
+   };
+   uint64_t *busy = arg;
+   unsigned long long n = 0;
+
+   while (atomic_load_explicit(&swapRun, memory_order_relaxed))
+   {
+      uint64_t t0 = CLKrealNs();
+      FSM_SwapModel(models[n & 1], 3, NULL, 0);
+      *busy += CLKrealNs() - t0;
+      n++;
+      sched_yield();
+   }
+   atomic_store(&swaps, n);
+   return NULL;
+}
+
+/// Dispatches n events.
+/// \return the time spent, the longest dispatch in maxNs.
+static uint64_t dispatchEvents(uint64_t n, uint64_t *maxNs)
+{
+   static const event_t round[] = {E_RUNNING_START, E_PAUSE, E_RUNNING_STOP, E_PAUSE};
+   state_t state = S_STANDBY;
+   uint64_t busy = 0;
+
+   *maxNs = 0;
+   for (uint64_t i = 0; i < n; i++)
+   {
+      uint64_t t0 = CLKrealNs();
+      state = FSM_EventHandler(state, round[i & 3]);
+      uint64_t ns = CLKrealNs() - t0;
+
+      busy += ns;
+      if (ns > *maxNs)
+      {
+         *maxNs = ns;
+      }
+   }
+   return busy;
+}
+
+static void benchReload(void)
+{
+   const uint64_t n = 2000000;
+   const transition_t start[] = {{S_STANDBY, E_RUNNING_START, S_DEFAULT},
+                                 {S_DEFAULT, E_RUNNING_STOP, S_STANDBY}};
+   uint64_t maxNs;
+   uint64_t swapBusy = 0;
+   pthread_t swapper;
+   fsm_model_stats_t model;
+
+   FSM_AddState(S_STANDBY, &(state_funcs_t){NULL, NULL});
+   FSM_AddState(S_DEFAULT, &(state_funcs_t){NULL, NULL});
+   FSM_FlushEnexpectedEvents(true);
+   FSM_SwapModel(start, 2, NULL, 0);
+
+   report("reload", "FSM_EventHandler, no swaps", dispatchEvents(n, &maxNs), n);
+   printf("%-12s %-36s %9.1f us max dispatch\n", "reload", "", maxNs / 1e3);
+
+   // On one CPU the swapper runs when the dispatcher is preempted
+   atomic_store(&swapRun, true);
+   pthread_create(&swapper, NULL, modelSwapper, &swapBusy);
+   uint64_t busy = dispatchEvents(n, &maxNs);
+   atomic_store(&swapRun, false);
+   pthread_join(swapper, NULL);
+   FSM_GetModelStats(&model);
+
+   report("reload", "FSM_EventHandler, during swaps", busy, n);
+   printf("%-12s %-36s %9.1f us max dispatch\n", "reload", "", maxNs / 1e3);
+   report("reload", "FSM_SwapModel", swapBusy, atomic_load(&swaps));
+   printf("%-12s %-36s %9.1f us max grace period\n", "reload", "", model.graceMaxNs / 1e3);
+   FSM_FlushEnexpectedEvents(false);
+}
+
+//---------------------------------------------------------------------- metrics
+
+static atomic_bool scrapeRun;
+
+/// Formats scrapes as fast as it can, as a scraper in a loop would.
+static void *metricsScraper(void *arg)
+{
+   static char text[MET_BUFFER_SIZE];
+   uint64_t *n = arg;
+
+   while (atomic_load_explicit(&scrapeRun, memory_order_relaxed))
+   {
+      metWriter_t writer = {.text = text, .size = sizeof(text), .length = 0};
+      METcollect(&writer);
+      (*n)++;
+      sched_yield();
+   }
+   return NULL;
+}
+
+static void benchMetrics(void)
+{
+   const uint64_t n = 2000000;
+   const transition_t model[] = {{S_STANDBY, E_RUNNING_START, S_DEFAULT},
+                                 {S_DEFAULT, E_RUNNING_STOP, S_STANDBY}};
+   static char text[MET_BUFFER_SIZE];
+   uint64_t maxNs;
+   uint64_t scrapes = 0;
+   pthread_t scraper;
+
+   FSM_AddState(S_STANDBY, &(state_funcs_t){NULL, NULL});
+   FSM_AddState(S_DEFAULT, &(state_funcs_t){NULL, NULL});
+   FSM_FlushEnexpectedEvents(true);
+   FSM_SwapModel(model, 2, NULL, 0);
+
+   uint64_t t0 = CLKrealNs();
+   for (int i = 0; i < 1000; i++)
+   {
+      metWriter_t writer = {.text = text, .size = sizeof(text), .length = 0};
+      METcollect(&writer);
+   }
+   report("metrics", "METcollect", CLKrealNs() - t0, 1000);
+
+   report("metrics", "FSM_EventHandler, no scrapes", dispatchEvents(n, &maxNs), n);
+   atomic_store(&scrapeRun, true);
+   pthread_create(&scraper, NULL, metricsScraper, &scrapes);
+   uint64_t busy = dispatchEvents(n, &maxNs);
+   atomic_store(&scrapeRun, false);
+   pthread_join(scraper, NULL);
+   report("metrics", "FSM_EventHandler, during scrapes", busy, n);
+   printf("%-12s %-36s %9llu scrapes\n", "metrics", "", (unsigned long long)scrapes);
+   FSM_FlushEnexpectedEvents(false);
+}
+
+//---------------------------------------------------------------------- history
+
+#define HISTORY_SESSIONS (2000000ull)   ///< 38 years at one session per 10 minutes
+#define HISTORY_USERS    (1000u)
+#define HISTORY_QUERIES  (1000u)
+
+/// Query by reading every session of the range, the reference of HSTquery().
+static void scanHistory(uint32_t user, int64_t from, int64_t to, hstTotals_t *totals)
+{
+   hstSession_t s;
+
+   memset(totals, 0, sizeof(*totals));
+   totals->bestPace = HST_NO_PACE;
+   for (uint64_t i = HSTfind(from); HSTget(i, &s) && s.start < to; i++)
+   {
+      if (user == HST_ALL_USERS || s.user == user)
+      {
+         totals->sessions++;
+         totals->distanceMm += s.distanceMm;
+         totals->durationMs += s.durationMs;
+         totals->energyJ += s.energyJ;
+         if (s.pace < totals->bestPace)
+         {
+            totals->bestPace = s.pace;
+            totals->bestIndex = i;
+         }
+      }
+      totals->visited++;
+   }
+}
+
+static bool sameTotals(const hstTotals_t *a, const hstTotals_t *b)
+{
+   return a->sessions == b->sessions && a->distanceMm == b->distanceMm &&
+          a->durationMs == b->durationMs && a->energyJ == b->energyJ &&
+          a->bestPace == b->bestPace &&
+          (a->bestPace == HST_NO_PACE || a->bestIndex == b->bestIndex);
+}
+
+/// Queries of one kind on random ranges of days, checked against a scan.
+static void queryHistory(const char *what, uint32_t user, int64_t first, uint32_t days)
+{
+   const uint32_t span = (uint32_t)(HISTORY_SESSIONS * 600u / 86400u) - days;
+   hstTotals_t totals;
+   hstTotals_t scanned;
+   uint64_t visited = 0;
+   uint64_t sessions = 0;
+   uint64_t ns = 0;
+   uint32_t differ = 0;
+
+   srand(7);
+   for (uint32_t q = 0; q < HISTORY_QUERIES; q++)
+   {
+      int64_t from = first + (int64_t)(rand() % span) * 86400;
+      uint32_t u = (user == HST_ALL_USERS) ? user : (uint32_t)rand() % HISTORY_USERS;
+
+      uint64_t t0 = CLKrealNs();
+      HSTquery(u, from, from + (int64_t)days * 86400, &totals);
+      ns += CLKrealNs() - t0;
+      visited += totals.visited;
+      sessions += totals.sessions;
+      scanHistory(u, from, from + (int64_t)days * 86400, &scanned);
+      if (!sameTotals(&totals, &scanned) && differ++ == 0)
+      {
+         printf("%-12s %s: query %u differs from the scan\n", "history", what, q);
+      }
+   }
+   if (differ > 0)
+   {
+      printf("%-12s %s: %u of %u queries differ from the scan\n", "history", what,
+             differ, HISTORY_QUERIES);
+   }
+   report("history", what, ns, HISTORY_QUERIES);
+   printf("%-12s %-36s %10.0f sessions %6.0f records read\n", "history", "",
+          (double)sessions / HISTORY_QUERIES, (double)visited / HISTORY_QUERIES);
+}
+
+static void benchHistory(void)
+{
+   char path[] = "/tmp/bench-historyXXXXXX";
+   int fd = mkstemp(path);
+
+   if (fd < 0)
+   {
+      printf("%-12s no temporary file\n", "history");
+      return;
+   }
+   close(fd);
+   if (!HSTopen(path, true))
+   {
+      printf("%-12s %s is not a history\n", "history", path);
+      unlink(path);
+      return;
+   }
+
+   // One session every 10 minutes, random users, 1 to 10 km at 6 to 18 km/h
+   const int64_t first = 946684800;   // 2000-01-01
+   uint64_t t0 = CLKrealNs();
+   srand(1);
+   for (uint64_t i = 0; i < HISTORY_SESSIONS; i++)
+   {
+      uint32_t speed = 600u + (uint32_t)(rand() % 1200);
+      uint32_t distance = 1000000u + (uint32_t)(rand() % 9000) * 1000u;
+      hstSession_t s =
+      {
+         .start = first + (int64_t)i * 600,
+         .user = (uint32_t)rand() % HISTORY_USERS,
+         .distanceMm = distance,
+         .durationMs = (uint32_t)((uint64_t)distance * 360u / speed),
+         .energyJ = distance / 20u,
+      };
+      HSTappend(&s);
+   }
+   report("history", "append", CLKrealNs() - t0, HISTORY_SESSIONS);
+
+   hstTotals_t scanned;
+   t0 = CLKrealNs();
+   scanHistory(HST_ALL_USERS, first, first + 365 * 86400, &scanned);
+   report("history", "year, all users, scan", CLKrealNs() - t0, 1);
+
+   queryHistory("year, all users", HST_ALL_USERS, first, 365);
+   queryHistory("day, all users", HST_ALL_USERS, first, 1);
+   queryHistory("month, one user", 0, first, 30);
+
+   HSTclose();
+   unlink(path);
+}
+
+//-------------------------------------------------------------------- analytics
+
+#define FLEET_SESSIONS (1000u)
+#define FLEET_SAMPLES  (3600u)      ///< An hour at 1 s
+#define FLEET_WINDOW   (30u)        ///< 30 s moving average
+
+static void benchAnalytics(void)
+{
+   const uint32_t n = FLEET_SESSIONS * FLEET_SAMPLES;
+   int32_t *speed = malloc(n * sizeof(*speed));
+   int32_t *incline = malloc(n * sizeof(*incline));
+   float *average[ANA_NOF_KERNELS] = {NULL};
+   anaSums_t fleet[ANA_NOF_KERNELS];
+   uint64_t sumNs[ANA_NOF_KERNELS] = {0};
+   uint64_t averageNs[ANA_NOF_KERNELS] = {0};
+   const anaKernel_t best = ANAbestKernel();
+
+   if (speed == NULL || incline == NULL)
+   {
+      printf("%-12s no memory\n", "analytics");
+      free(speed);
+      free(incline);
+      return;
+   }
+
+   // Sessions of intervals: ramps between walking and running, hills
+   srand(1);
+   for (uint32_t i = 0; i < n; i++)
+   {
+      uint32_t t = i % FLEET_SAMPLES;
+      speed[i] = (t < 60) ? (int32_t)(t * 10) : 500 + (int32_t)((t / 120) % 2) * 600 + rand() % 50;
+      incline[i] = (int32_t)((t / 300) % 3) * 200 + rand() % 20 - 10;
+   }
+
+   for (int k = 0; k <= (int)best; k++)
+   {
+      ANAsetKernel((anaKernel_t)k);
+      average[k] = malloc(FLEET_SAMPLES * sizeof(float) * FLEET_SESSIONS);
+      memset(&fleet[k], 0, sizeof(fleet[k]));
+
+      // A fleet report, one session at a time like the recorder hands them
+      for (uint32_t s = 0; s < FLEET_SESSIONS; s++)
+      {
+         anaSeries_t series = {&speed[s * FLEET_SAMPLES], &incline[s * FLEET_SAMPLES],
+                               FLEET_SAMPLES, 1000};
+         anaSums_t sums;
+
+         uint64_t t0 = CLKrealNs();
+         ANAsum(&series, &sums);
+         sumNs[k] += CLKrealNs() - t0;
+         fleet[k].speed += sums.speed;
+         fleet[k].climb += sums.climb;
+         fleet[k].runSpeed += sums.runSpeed;
+         fleet[k].runClimb += sums.runClimb;
+         fleet[k].moving += sums.moving;
+         fleet[k].running += sums.running;
+         fleet[k].samples += sums.samples;
+
+         if (average[k] != NULL)
+         {
+            t0 = CLKrealNs();
+            ANAmovingAverage(series.speed, FLEET_SAMPLES, FLEET_WINDOW,
+                             &average[k][s * FLEET_SAMPLES]);
+            averageNs[k] += CLKrealNs() - t0;
+         }
+      }
+
+      char what[48];
+      snprintf(what, sizeof(what), "sums, %s", ANAkernelText((anaKernel_t)k));
+      report("analytics", what, sumNs[k], n);
+      snprintf(what, sizeof(what), "moving average %u, %s", FLEET_WINDOW, ANAkernelText((anaKernel_t)k));
+      report("analytics", what, averageNs[k], n);
+      if (k > 0)
+      {
+         bool same = memcmp(&fleet[k], &fleet[0], sizeof(fleet[0])) == 0 &&
+                     average[k] != NULL && average[0] != NULL &&
+                     memcmp(average[k], average[0], (size_t)n * sizeof(float)) == 0;
+         printf("%-12s %-36s %9.1fx sums, %5.1fx average, %s the scalar results\n",
+                "analytics", "", (double)sumNs[0] / (double)sumNs[k],
+                (double)averageNs[0] / (double)averageNs[k], same ? "same as" : "NOT");
+      }
+   }
+
+   anaReport_t fleetReport;
+   ANAreport(&fleet[0], 1000, 75.0, &fleetReport);
+   printf("%-12s %-36s %10.0f km %8.1f km climbed %10.0f kcal\n", "analytics", "fleet",
+          fleetReport.distanceM / 1e3, fleetReport.climbM / 1e3, fleetReport.kcal);
+
+   ANAsetKernel(best);
+   for (int k = 0; k < ANA_NOF_KERNELS; k++)
+   {
+      free(average[k]);
+   }
+   free(speed);
+   free(incline);
+}
+
+//------------------------------------------------------------------------- main
+
+static const benchCase_t cases[] =
+{
+   {"telemetry", benchTelemetry},
+   {"log", benchLog},
+   {"binlog", benchBinaryLog},
+   {"physics", benchPhysics},
+   {"fixed", benchFixed},
+   {"hal", benchHal},
+   {"program", benchProgram},
+   {"gym", benchGym},
+   {"daemon", benchDaemon},
+   {"queue", benchQueue},
+   {"reload", benchReload},
+   {"metrics", benchMetrics},
+   {"history", benchHistory},
+   {"analytics", benchAnalytics},
+};
+
+int main(int argc, char *argv[])
+{
+   const size_t nCases = sizeof(cases) / sizeof(cases[0]);
+
+   for (size_t c = 0; c < nCases; c++)
+   {
+      bool selected = (argc < 2);
+      for (int a = 1; a < argc; a++)
+      {
+         selected |= (strcmp(argv[a], cases[c].name) == 0);
+      }
+      if (selected)
+      {
+         cases[c].run();
+      }
+   }
+   return 0;
+}
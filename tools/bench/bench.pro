@@ -0,0 +1,49 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/analytics_functions/analytics.c \
+        ../../app/clock_functions/clock.c \
+        ../../app/daemon_functions/daemon.c \
+        ../../app/events.c \
+        ../../app/fixed_functions/fixedpoint.c \
+        ../../app/fsm_functions/fsm.c \
+        ../../app/gym_functions/gym.c \
+        ../../app/hal_functions/hal.c \
+        ../../app/history_functions/history.c \
+        ../../app/ipc_functions/ipc.c \
+        ../../app/log_functions/logbinary.c \
+        ../../app/log_functions/logformat.c \
+        ../../app/log_functions/logger.c \
+        ../../app/metrics_functions/metrics.c \
+        ../../app/program_functions/program.c \
+        ../../app/simulation_functions/physics.c \
+        ../../app/states.c \
+        ../../app/telemetry_functions/telemetry.c \
+        bench.c
+
+HEADERS += \
+   ../../app/analytics_functions/analytics.h \
+   ../../app/clock_functions/clock.h \
+   ../../app/daemon_functions/daemon.h \
+   ../../app/fixed_functions/fixedpoint.h \
+   ../../app/fsm_functions/fsm.h \
+   ../../app/gym_functions/gym.h \
+   ../../app/hal_functions/hal.h \
+   ../../app/history_functions/history.h \
+   ../../app/ipc_functions/ipc.h \
+   ../../app/log_functions/logbinary.h \
+   ../../app/log_functions/logformat.h \
+   ../../app/log_functions/logger.h \
+   ../../app/metrics_functions/metrics.h \
+   ../../app/program_functions/program.h \
+   ../../app/simulation_functions/physics.h \
+   ../../app/sync_functions/seqlock.h \
+   ../../app/telemetry_functions/telemetry.h
+
+unix: LIBS += -lpthread -lm
+unix:!macx: LIBS += -lrt
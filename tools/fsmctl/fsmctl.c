@@ -0,0 +1,190 @@
+/*!
+ * FSM control: posts events to and queries the state of a treadmill that
+ * runs as a daemon (fsm-treadmill --daemon, see daemon_functions/daemon.h).
+ *
+ * usage: fsmctl [-m machine_id] [-t timeout_ms] command
+ *
+ * state              prints the current state
+ * post event ...     posts the events in order, e.g. post running_start pause
+ * wait state         waits until the FSM is in state, fails after the timeout
+ * watch              prints every state change
+ * stats              prints the counters of the daemon
+ *
+ * Events and states are named as in the model, the E_ and S_ prefixes and
+ * the case are optional. Without -m the machine id comes from TREADMILL_ID.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "clock_functions/clock.h"
+#include "daemon_functions/daemon.h"
+
+extern char * stateEnumToText[];
+extern char * eventEnumToText[];
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: fsmctl [-m machine_id] [-t timeout_ms]"
+                   " state | post event ... | wait state | watch | stats\n");
+   exit(EXIT_FAILURE);
+}
+
+/// \return the index of name in names, with or without prefix, -1 if unknown.
+static int lookup(const char *name, char *names[], int n, const char *prefix)
+{
+   size_t length = strlen(prefix);
+
+   for (int i = 1; i < n; i++)
+   {
+      if (strcasecmp(name, names[i]) == 0 ||
+          (strncmp(names[i], prefix, length) == 0 &&
+           strcasecmp(name, names[i] + length) == 0))
+      {
+         return i;
+      }
+   }
+   return -1;
+}
+
+static int post(int argc, char *argv[])
+{
+   for (int a = 0; a < argc; a++)
+   {
+      int event = lookup(argv[a], eventEnumToText, NOF_EVENTS, "E_");
+
+      if (event < 0)
+      {
+         fprintf(stderr, "fsmctl: unknown event %s\n", argv[a]);
+         return EXIT_FAILURE;
+      }
+      if (!DMNpost((event_t)event))
+      {
+         fprintf(stderr, "fsmctl: event queue of the daemon is full\n");
+         return EXIT_FAILURE;
+      }
+   }
+   return EXIT_SUCCESS;
+}
+
+static int waitFor(const char *name, int timeoutMs)
+{
+   int state = lookup(name, stateEnumToText, NOF_STATES, "S_");
+   uint64_t deadline = CLKrealNs() + (uint64_t)timeoutMs * CLK_NS_PER_MS;
+
+   if (state < 0)
+   {
+      fprintf(stderr, "fsmctl: unknown state %s\n", name);
+      return EXIT_FAILURE;
+   }
+   for (;;)
+   {
+      dmnStats_t stats;
+
+      // Read the change number first, a change after the check wakes us
+      DMNgetStats(&stats);
+      if (DMNgetState() == (state_t)state)
+      {
+         return EXIT_SUCCESS;
+      }
+      uint64_t now = CLKrealNs();
+      if (timeoutMs >= 0 && now >= deadline)
+      {
+         fprintf(stderr, "fsmctl: still in %s\n", stateEnumToText[DMNgetState()]);
+         return EXIT_FAILURE;
+      }
+      DMNwaitChange(stats.changes,
+                    (timeoutMs < 0) ? -1 : (int)((deadline - now) / CLK_NS_PER_MS) + 1);
+   }
+}
+
+static void watch(void)
+{
+   dmnStats_t stats;
+
+   DMNgetStats(&stats);
+   printf("%s\n", stateEnumToText[DMNgetState()]);
+   fflush(stdout);
+   for (uint32_t seen = stats.changes;;)
+   {
+      uint32_t changes = DMNwaitChange(seen, -1);
+
+      if (changes != seen)
+      {
+         // Changes in between are lost, the last state counts
+         printf("%s%s\n", stateEnumToText[DMNgetState()],
+                (changes - seen > 1) ? " (skipped changes)" : "");
+         fflush(stdout);
+         seen = changes;
+      }
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   const char *machineId = getenv("TREADMILL_ID");
+   unsigned int id = (machineId != NULL) ? (unsigned int)atoi(machineId) : 0;
+   int timeoutMs = -1;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "+m:t:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'm':
+         id = (unsigned int)atoi(optarg);
+         break;
+      case 't':
+         timeoutMs = atoi(optarg);
+         break;
+      default:
+         usage();
+      }
+   }
+   if (optind >= argc)
+   {
+      usage();
+   }
+   if (!DMNconnect(id))
+   {
+      fprintf(stderr, "fsmctl: no daemon runs for machine %u\n", id);
+      return EXIT_FAILURE;
+   }
+
+   const char *command = argv[optind];
+   if (strcmp(command, "state") == 0)
+   {
+      printf("%s\n", stateEnumToText[DMNgetState()]);
+   }
+   else if (strcmp(command, "post") == 0 && optind + 1 < argc)
+   {
+      return post(argc - optind - 1, &argv[optind + 1]);
+   }
+   else if (strcmp(command, "wait") == 0 && optind + 1 < argc)
+   {
+      return waitFor(argv[optind + 1], timeoutMs);
+   }
+   else if (strcmp(command, "watch") == 0)
+   {
+      watch();
+   }
+   else if (strcmp(command, "stats") == 0)
+   {
+      dmnStats_t stats;
+
+      DMNgetStats(&stats);
+      printf("%u events posted, %u taken, %llu rejected, %llu ring full, %llu doorbells,"
+             " %u state changes\n", stats.posted, stats.taken,
+             (unsigned long long)stats.rejected, (unsigned long long)stats.full,
+             (unsigned long long)stats.doorbells, stats.changes);
+   }
+   else
+   {
+      usage();
+   }
+   DMNdisconnect();
+   return EXIT_SUCCESS;
+}
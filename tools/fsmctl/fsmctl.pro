@@ -0,0 +1,22 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/clock_functions/clock.c \
+        ../../app/daemon_functions/daemon.c \
+        ../../app/events.c \
+        ../../app/ipc_functions/ipc.c \
+        ../../app/states.c \
+        fsmctl.c
+
+HEADERS += \
+   ../../app/clock_functions/clock.h \
+   ../../app/daemon_functions/daemon.h \
+   ../../app/ipc_functions/ipc.h
+
+unix: LIBS += -lpthread
+unix:!macx: LIBS += -lrt
@@ -0,0 +1,164 @@
+/*!
+ * Compiled FSM model: the treadmill model declared with the C++ front end
+ * (see fsm_functions/fsm.hpp) and driven through the C FSM API. Walks the
+ * model and compares the compiled dispatch with the lookup in the
+ * transition matrix.
+ *
+ * usage: fsmmodel [-n events] [-u]
+ *
+ * -u prints the installed model as PlantUML.
+ *
+ * Build with -DFSMMODEL_CONFLICT to see the compiler reject the second
+ * S_EMERGENCY, E_EMERGENCY_STOP transition of app/main.c, which the
+ * matrix never fires.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "fsm_functions/fsm.hpp"
+
+extern "C"
+{
+#include "clock_functions/clock.h"
+
+extern char * stateEnumToText[];
+extern char * eventEnumToText[];
+
+event_t event;   ///< Needed by fsm.c
+}
+
+static uint64_t entries[NOF_STATES];
+
+template <state_t S>
+static void countEntry(void)
+{
+   entries[S]++;
+}
+
+using namespace fsm;
+
+using Treadmill = Model<
+   States<State<S_START>,
+          State<S_INIT,        countEntry<S_INIT>>,
+          State<S_STANDBY,     countEntry<S_STANDBY>>,
+          State<S_DEFAULT,     countEntry<S_DEFAULT>>,
+          State<S_DIAGNOSTICS, countEntry<S_DIAGNOSTICS>>,
+          State<S_ALTERCONFIG, countEntry<S_ALTERCONFIG>>,
+          State<S_EMERGENCY,   countEntry<S_EMERGENCY>>,
+          State<S_PAUSE,       countEntry<S_PAUSE>>>,
+   Transitions<Transition<S_START,       E_INIT,              S_INIT>,
+               Transition<S_INIT,        E_TREADMILL,         S_STANDBY>,
+               Transition<S_STANDBY,     E_RUNNING_START,     S_DEFAULT>,
+               Transition<S_DEFAULT,     E_RUNNING_STOP,      S_STANDBY>,
+               Transition<S_STANDBY,     E_DIAGNOSTICS_START, S_DIAGNOSTICS>,
+               Transition<S_DIAGNOSTICS, E_DIAGNOSTICS_STOP,  S_STANDBY>,
+               Transition<S_DEFAULT,     E_PAUSE,             S_PAUSE>,
+               Transition<S_PAUSE,       E_RESUME,            S_DEFAULT>,
+               Transition<S_DEFAULT,     E_CONFIG_CHANGE,     S_ALTERCONFIG>,
+               Transition<S_ALTERCONFIG, E_CONFIG_DONE,       S_DEFAULT>,
+               Transition<S_DEFAULT,     E_EMERGENCY_START,   S_EMERGENCY>,
+               Transition<S_EMERGENCY,   E_EMERGENCY_STOP,    S_DEFAULT>,
+               Transition<S_ALTERCONFIG, E_EMERGENCY_START,   S_EMERGENCY>,
+#ifdef FSMMODEL_CONFLICT
+               Transition<S_EMERGENCY,   E_EMERGENCY_STOP,    S_ALTERCONFIG>,
+#endif
+               Transition<S_DEFAULT,     E_PROGRAM_STEP,      S_DEFAULT>>>;
+
+static_assert(Treadmill::has(S_DEFAULT, E_EMERGENCY_START));
+static_assert(!Treadmill::has(S_PAUSE, E_EMERGENCY_START));
+
+/// One round through all states, from S_STANDBY back to S_STANDBY.
+static const event_t round[] =
+{
+   E_RUNNING_START, E_PAUSE, E_RESUME, E_CONFIG_CHANGE, E_CONFIG_DONE,
+   E_PROGRAM_STEP, E_EMERGENCY_START, E_EMERGENCY_STOP, E_RUNNING_STOP,
+   E_DIAGNOSTICS_START, E_DIAGNOSTICS_STOP,
+};
+static const size_t roundLength = sizeof(round) / sizeof(round[0]);
+
+static void printTransition(state_t from, event_t e, state_t to)
+{
+   printf("   %-14s %-20s -> %s\n", stateEnumToText[from], eventEnumToText[e],
+          stateEnumToText[to]);
+}
+
+/// Handles n events (whole rounds), through the event queue as the FSM does.
+/// \return the ns per event.
+static double walk(uint64_t n)
+{
+   state_t state = S_STANDBY;
+   uint64_t t0 = CLKrealNs();
+
+   for (uint64_t i = 0; i < n; i++)
+   {
+      FSM_AddEvent(round[i % roundLength]);
+      state = FSM_EventHandler(state, FSM_GetEvent());
+   }
+   double ns = (double)(CLKrealNs() - t0) / (double)n;
+
+   if (state != S_STANDBY)
+   {
+      fprintf(stderr, "fsmmodel: lost the way in %s\n", stateEnumToText[state]);
+      exit(EXIT_FAILURE);
+   }
+   return ns;
+}
+
+int main(int argc, char *argv[])
+{
+   uint64_t n = 1000000 * roundLength;
+   bool uml = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:u")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         n = (strtoull(optarg, NULL, 10) + roundLength - 1) / roundLength * roundLength;
+         break;
+      case 'u':
+         uml = true;
+         break;
+      default:
+         fprintf(stderr, "usage: fsmmodel [-n events] [-u]\n");
+         return EXIT_FAILURE;
+      }
+   }
+
+   Treadmill::install();
+   if (uml)
+   {
+      FSM_RevertModel();
+      return EXIT_SUCCESS;
+   }
+
+   // Unexpected events are dropped, a walk must not stall
+   FSM_FlushEnexpectedEvents(true);
+
+   printf("One round, compiled dispatch:\n");
+   FSM_SetTransitionHook(printTransition);
+   walk(roundLength);
+   FSM_SetTransitionHook(NULL);
+
+   uint64_t before = entries[S_DEFAULT];
+   double compiled = walk(n);
+   uint64_t compiledEntries = entries[S_DEFAULT] - before;
+
+   FSM_SetDispatcher(NULL);
+   double matrix = walk(n);
+   uint64_t matrixEntries = entries[S_DEFAULT] - before - compiledEntries;
+
+   printf("%llu events: compiled dispatch %.1f ns/event, matrix lookup %.1f ns/event\n",
+          (unsigned long long)n, compiled, matrix);
+
+   // Both walks must have entered the states equally often
+   if (compiledEntries != matrixEntries)
+   {
+      fprintf(stderr, "fsmmodel: %llu compiled and %llu matrix S_DEFAULT entries\n",
+              (unsigned long long)compiledEntries, (unsigned long long)matrixEntries);
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
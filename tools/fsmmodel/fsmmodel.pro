@@ -0,0 +1,21 @@
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/clock_functions/clock.c \
+        ../../app/events.c \
+        ../../app/fsm_functions/fsm.c \
+        ../../app/states.c \
+        fsmmodel.cpp
+
+HEADERS += \
+   ../../app/clock_functions/clock.h \
+   ../../app/fsm_functions/fsm.h \
+   ../../app/fsm_functions/fsm.hpp
+
+unix: LIBS += -lpthread
+unix:!macx: LIBS += -lrt
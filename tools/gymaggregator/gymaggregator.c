@@ -0,0 +1,288 @@
+/*!
+ * Gym aggregator: receives the state changes and telemetry of all
+ * treadmills of a gym (see gym_functions/gym.h), keeps the live state of the
+ * fleet and reports the ingest rate.
+ *
+ * usage: gymaggregator [-i report_interval_ms] [-n count] [-v]
+ *
+ * -v also shows the table of machines at every report.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "clock_functions/clock.h"
+#include "gym_functions/gym.h"
+#include "events.h"
+#include "states.h"
+
+#define MAX_MACHINES (1024)   ///< Power of two, open addressing
+
+/// Live state of one treadmill.
+typedef struct
+{
+   bool used;
+   uint32_t id;
+   uint32_t nextSequence;
+   uint64_t frames;
+   uint64_t datagrams;
+   uint64_t lost;                ///< Datagrams missing in the sequence
+   uint64_t restarts;            ///< Sequence went back: the treadmill restarted
+   uint64_t stateChanges;
+   uint64_t lastSeenNs;          ///< CLKrealNs() of the last datagram
+   uint8_t lastEvent;
+   gymTelemetryFrame_t telemetry;
+   uint8_t state;
+} machine_t;
+
+/// Ingest counters of one report interval.
+typedef struct
+{
+   uint64_t frames;
+   uint64_t datagrams;
+   uint64_t calls;               ///< recvmmsg() calls
+   uint64_t bytes;
+   uint64_t corrupt;
+} ingest_t;
+
+extern char * stateEnumToText[];
+extern char * eventEnumToText[];
+
+static machine_t machines[MAX_MACHINES];
+static int nMachines = 0;
+static gymBatch_t batch;
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: gymaggregator [-i report_interval_ms] [-n count] [-v]\n");
+   exit(EXIT_FAILURE);
+}
+
+/// \return name of a state byte of a sender, "?" if not a state.
+static const char *stateText(uint8_t state)
+{
+   return (state < NOF_STATES) ? stateEnumToText[state] : "?";
+}
+
+/// \return name of an event byte of a sender, "?" if not an event.
+static const char *eventText(uint8_t event)
+{
+   return (event < NOF_EVENTS) ? eventEnumToText[event] : "?";
+}
+
+/// \return the entry of id, a new one if id is new, NULL if the table is full.
+static machine_t *lookup(uint32_t id)
+{
+   uint32_t i = (id * 2654435761u) & (MAX_MACHINES - 1);
+
+   for (int probe = 0; probe < MAX_MACHINES; probe++)
+   {
+      machine_t *m = &machines[(i + (uint32_t)probe) & (MAX_MACHINES - 1)];
+
+      if (!m->used)
+      {
+         *m = (machine_t){.used = true, .id = id};
+         nMachines++;
+         return m;
+      }
+      if (m->id == id)
+      {
+         return m;
+      }
+   }
+   return NULL;
+}
+
+static void ingest(const uint8_t datagram[], size_t length, ingest_t *in)
+{
+   gymHeader_t header;
+   gymFrame_t frame;
+   size_t offset = 0;
+   const uint8_t *payload;
+
+   in->datagrams++;
+   in->bytes += length;
+   if (length < sizeof(header))
+   {
+      in->corrupt++;
+      return;
+   }
+   memcpy(&header, datagram, sizeof(header));
+   if (header.magic != GYM_MAGIC)
+   {
+      // Not a treadmill, no entry for it
+      in->corrupt++;
+      return;
+   }
+
+   machine_t *m = lookup(header.machineId);
+   if (m == NULL)
+   {
+      in->corrupt++;
+      return;
+   }
+   if (m->datagrams > 0 && header.sequence != m->nextSequence)
+   {
+      // Ahead: datagrams were lost. Back: the treadmill started again at 0
+      int32_t gap = (int32_t)(header.sequence - m->nextSequence);
+      if (gap > 0)
+      {
+         m->lost += (uint64_t)gap;
+      }
+      else
+      {
+         m->restarts++;
+      }
+   }
+   m->nextSequence = header.sequence + 1;
+   m->datagrams++;
+   m->lastSeenNs = CLKrealNs();
+
+   while ((payload = GYMnextFrame(datagram, length, &offset, &frame)) != NULL)
+   {
+      in->frames++;
+      m->frames++;
+      if (frame.type == GYM_FRAME_STATE && frame.length == sizeof(gymStateFrame_t))
+      {
+         gymStateFrame_t s;
+
+         memcpy(&s, payload, sizeof(s));
+         m->state = s.to;
+         m->lastEvent = s.event;
+         m->stateChanges++;
+      }
+      else if (frame.type == GYM_FRAME_TELEMETRY &&
+               frame.length == sizeof(gymTelemetryFrame_t))
+      {
+         memcpy(&m->telemetry, payload, sizeof(m->telemetry));
+         m->state = m->telemetry.state;
+      }
+   }
+   if (offset != length)
+   {
+      in->corrupt++;
+   }
+}
+
+static void report(const ingest_t *in, uint64_t ns, bool verbose)
+{
+   double s = (double)ns / CLK_NS_PER_S;
+   uint64_t lost = 0;
+   uint64_t restarts = 0;
+
+   for (int i = 0; i < MAX_MACHINES; i++)
+   {
+      lost += machines[i].lost;
+      restarts += machines[i].restarts;
+   }
+   printf("%d machines, %.0f messages/s, %.0f datagrams/s, %.0f recvmmsg/s, "
+          "%.1f messages per call, %.1f kB/s, %llu lost, %llu restarts, %llu corrupt\n",
+          nMachines, in->frames / s, in->datagrams / s, in->calls / s,
+          in->calls ? (double)in->frames / in->calls : 0.0, in->bytes / s / 1e3,
+          (unsigned long long)lost, (unsigned long long)restarts,
+          (unsigned long long)in->corrupt);
+
+   if (!verbose)
+   {
+      return;
+   }
+   printf("%6s %-14s %-20s %7s %7s %9s %8s %9s %6s %8s\n", "id", "state",
+          "last event", "km/h", "inc %", "dist m", "errors", "messages",
+          "lost", "seen s");
+   for (int i = 0; i < MAX_MACHINES; i++)
+   {
+      const machine_t *m = &machines[i];
+
+      if (!m->used)
+      {
+         continue;
+      }
+      printf("%6u %-14s %-20s %7.2f %7.2f %9.1f %08x %9llu %6llu %8.1f\n",
+             m->id, stateText(m->state), eventText(m->lastEvent),
+             m->telemetry.speed / 100.0, m->telemetry.incline / 100.0,
+             m->telemetry.distance / 1000.0, m->telemetry.errorBits,
+             (unsigned long long)m->frames, (unsigned long long)m->lost,
+             (double)(CLKrealNs() - m->lastSeenNs) / CLK_NS_PER_S);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   long interval = 1000;
+   long count = -1;
+   bool verbose = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "i:n:v")) != -1)
+   {
+      switch (opt)
+      {
+      case 'i':
+         interval = atol(optarg);
+         break;
+      case 'n':
+         count = atol(optarg);
+         break;
+      case 'v':
+         verbose = true;
+         break;
+      default:
+         usage();
+      }
+   }
+   if (optind != argc || interval <= 0)
+   {
+      usage();
+   }
+
+   int fd = GYMserverOpen();
+   if (fd < 0)
+   {
+      fprintf(stderr, "gymaggregator: socket %s not available, "
+              "another aggregator runs?\n", GYM_SOCKET_NAME);
+      return EXIT_FAILURE;
+   }
+
+   ingest_t in = {0};
+   uint64_t reportNs = CLKrealNs();
+
+   while (count != 0)
+   {
+      uint64_t now = CLKrealNs();
+      uint64_t dueNs = reportNs + (uint64_t)interval * CLK_NS_PER_MS;
+      int timeoutMs = (now < dueNs) ? (int)((dueNs - now) / CLK_NS_PER_MS) + 1 : 0;
+
+      int n = GYMreceive(fd, &batch, timeoutMs);
+      if (n < 0)
+      {
+         perror("gymaggregator");
+         break;
+      }
+      if (n > 0)
+      {
+         in.calls++;
+      }
+      for (int i = 0; i < n; i++)
+      {
+         ingest(batch.data[i], batch.length[i], &in);
+      }
+
+      now = CLKrealNs();
+      if (now >= dueNs)
+      {
+         report(&in, now - reportNs, verbose);
+         fflush(stdout);
+         in = (ingest_t){0};
+         reportNs = now;
+         if (count > 0)
+         {
+            count--;
+         }
+      }
+   }
+
+   close(fd);
+   return 0;
+}
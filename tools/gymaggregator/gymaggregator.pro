@@ -0,0 +1,22 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/clock_functions/clock.c \
+        ../../app/events.c \
+        ../../app/gym_functions/gym.c \
+        ../../app/ipc_functions/ipc.c \
+        ../../app/states.c \
+        gymaggregator.c
+
+HEADERS += \
+   ../../app/clock_functions/clock.h \
+   ../../app/gym_functions/gym.h \
+   ../../app/ipc_functions/ipc.h
+
+unix: LIBS += -lpthread
+unix:!macx: LIBS += -lrt
@@ -0,0 +1,207 @@
+/*!
+ * History query: totals and best pace of the sessions in a workout history
+ * (see history_functions/history.h), e.g. of fsm-treadmill --history file.
+ *
+ * usage: historyquery [-u user] [-f date] [-t date] [-l] [-g sessions] file
+ *
+ * -u only queries the sessions of user, -f and -t limit the query to the
+ * sessions that start from date up to (not including) date, as YYYY-MM-DD
+ * in UTC. -l also lists the sessions of the query. -g first appends
+ * synthetic sessions of 64 users, one every 10 minutes up to now, to try
+ * the queries on a large history. The file can be read while a treadmill
+ * appends to it.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock_functions/clock.h"
+#include "history_functions/history.h"
+
+#define GENERATE_USERS     (64)
+#define GENERATE_STEP_S    (600)
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: historyquery [-u user] [-f date] [-t date] [-l] [-g sessions] file\n");
+   exit(EXIT_FAILURE);
+}
+
+/// \return YYYY-MM-DD as unix time, midnight UTC.
+static int64_t parseDate(const char *text)
+{
+   struct tm tm = {0};
+   int year, month, day;
+
+   if (sscanf(text, "%d-%d-%d", &year, &month, &day) != 3)
+   {
+      usage();
+   }
+   tm.tm_year = year - 1900;
+   tm.tm_mon = month - 1;
+   tm.tm_mday = day;
+   return (int64_t)timegm(&tm);
+}
+
+/// Formats a pace in ms per km as m:ss /km.
+static const char *formatPace(uint32_t pace, char *text, size_t size)
+{
+   if (pace == HST_NO_PACE)
+   {
+      snprintf(text, size, "-");
+   }
+   else
+   {
+      snprintf(text, size, "%u:%02u /km", pace / 60000u, pace / 1000u % 60u);
+   }
+   return text;
+}
+
+static void printSession(uint64_t index, const hstSession_t *s)
+{
+   char date[32];
+   char pace[32];
+   time_t start = (time_t)s->start;
+
+   strftime(date, sizeof(date), "%Y-%m-%d %H:%M", gmtime(&start));
+   printf("%10llu %s user %5u %6.2f km %7.1f min %7u J %5.1f km/h max, pace %s%s%s\n",
+          (unsigned long long)index, date, (unsigned int)s->user,
+          s->distanceMm / 1e6, s->durationMs / 60000.0, (unsigned int)s->energyJ,
+          s->maxSpeed / 100.0, formatPace(s->pace, pace, sizeof(pace)),
+          (s->flags & HST_FLAG_PROGRAM) ? ", program" : "",
+          (s->flags & HST_FLAG_EMERGENCY) ? ", emergency" : "");
+}
+
+/// Appends n sessions of GENERATE_USERS users with a random distance and
+/// speed, the last one starts now.
+static bool generate(const char *path, unsigned long n)
+{
+   if (!HSTopen(path, true))
+   {
+      return false;
+   }
+   int64_t start = (int64_t)time(NULL) - (int64_t)n * GENERATE_STEP_S;
+   uint64_t begin = CLKrealNs();
+
+   srand(1);
+   for (unsigned long i = 0; i < n; i++)
+   {
+      uint32_t speed = 600u + (uint32_t)(rand() % 1200);          // 0.01 km/h
+      uint32_t distance = 1000000u + (uint32_t)(rand() % 9000) * 1000u;
+      hstSession_t s =
+      {
+         .start = start + (int64_t)i * GENERATE_STEP_S,
+         .user = (uint32_t)(rand() % GENERATE_USERS),
+         .distanceMm = distance,
+         .durationMs = (uint32_t)((uint64_t)distance * 360u / speed),
+         .energyJ = distance / 20u,
+         .maxSpeed = (uint16_t)(speed + 100u),
+      };
+      if (!HSTappend(&s))
+      {
+         HSTclose();
+         return false;
+      }
+   }
+   double s = (double)(CLKrealNs() - begin) / 1e9;
+   printf("Generated %lu sessions in %.2f s, %.0f sessions/s\n", n, s, (s > 0) ? n / s : 0.0);
+   HSTclose();
+   return true;
+}
+
+int main(int argc, char *argv[])
+{
+   uint32_t user = HST_ALL_USERS;
+   int64_t from = INT64_MIN;
+   int64_t to = INT64_MAX;
+   bool list = false;
+   unsigned long sessions = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "u:f:t:lg:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'u':
+         user = (uint32_t)strtoul(optarg, NULL, 10);
+         break;
+      case 'f':
+         from = parseDate(optarg);
+         break;
+      case 't':
+         to = parseDate(optarg);
+         break;
+      case 'l':
+         list = true;
+         break;
+      case 'g':
+         sessions = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         usage();
+      }
+   }
+   if (optind + 1 != argc)
+   {
+      usage();
+   }
+   const char *path = argv[optind];
+
+   if (sessions > 0 && !generate(path, sessions))
+   {
+      fprintf(stderr, "historyquery: cannot append to %s\n", path);
+      return EXIT_FAILURE;
+   }
+   if (!HSTopen(path, false))
+   {
+      fprintf(stderr, "historyquery: %s is not a workout history\n", path);
+      return EXIT_FAILURE;
+   }
+
+   hstTotals_t totals;
+   uint64_t begin = CLKrealNs();
+   HSTquery(user, from, to, &totals);
+   uint64_t queryNs = CLKrealNs() - begin;
+
+   char pace[32];
+   printf("Sessions:   %llu of %llu\n", (unsigned long long)totals.sessions,
+          (unsigned long long)HSTcount());
+   printf("Distance:   %.2f km\n", totals.distanceMm / 1e6);
+   printf("Duration:   %.1f h\n", totals.durationMs / 3.6e6);
+   printf("Energy:     %.1f kJ\n", totals.energyJ / 1e3);
+   printf("Best pace:  %s\n", formatPace(totals.bestPace, pace, sizeof(pace)));
+   printf("Query:      %.3f ms, %llu records read\n", queryNs / 1e6,
+          (unsigned long long)totals.visited);
+
+   if (totals.bestPace != HST_NO_PACE)
+   {
+      hstSession_t s;
+
+      if (HSTget(totals.bestIndex, &s))
+      {
+         printf("Best:       ");
+         printSession(totals.bestIndex, &s);
+      }
+   }
+
+   if (list)
+   {
+      for (uint64_t i = HSTfind(from); i < HSTcount(); i++)
+      {
+         hstSession_t s;
+
+         if (!HSTget(i, &s) || s.start >= to)
+         {
+            break;
+         }
+         if (user == HST_ALL_USERS || s.user == user)
+         {
+            printSession(i, &s);
+         }
+      }
+   }
+   HSTclose();
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/clock_functions/clock.c \
+        ../../app/history_functions/history.c \
+        historyquery.c
+
+HEADERS += \
+   ../../app/clock_functions/clock.h \
+   ../../app/history_functions/history.h
+
+unix: LIBS += -lpthread
+unix:!macx: LIBS += -lrt
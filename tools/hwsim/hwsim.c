@@ -0,0 +1,152 @@
+/*!
+ * Hardware simulator: plays the band speed motor, the incline motor, the
+ * emergency brake and the emergency button of one treadmill behind the HAL
+ * register file (see hal_functions/hal.h). Start it before fsm-treadmill
+ * with the same TREADMILL_ID.
+ *
+ * usage: hwsim [-r physics_rate_hz] [-i status_interval_ms] [id]
+ *
+ * Commands on stdin: "e" presses the emergency button, "r" releases it.
+ */
+#define _GNU_SOURCE
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "clock_functions/clock.h"
+#include "hal_functions/hal.h"
+#include "simulation_functions/physics.h"
+
+static halRegisterFile_t *file;
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: hwsim [-r physics_rate_hz] [-i status_interval_ms] [id]\n");
+   exit(EXIT_FAILURE);
+}
+
+static uint32_t get(halRegister_t reg)
+{
+   return atomic_load_explicit(&file->reg[reg], memory_order_acquire);
+}
+
+static void set(halRegister_t reg, uint32_t value)
+{
+   atomic_store_explicit(&file->reg[reg], value, memory_order_release);
+}
+
+/// Applies the written command registers to the devices.
+static void applyCommands(uint32_t pending)
+{
+   const bool brake = get(HAL_REG_BRAKE_CMD) != 0;
+
+   // The brake stops the belt whatever the band speed motor is told
+   PHYsetTarget(brake ? 0.0f : (int32_t)get(HAL_REG_SPEED_CMD) / 100.0f,
+                (int32_t)get(HAL_REG_INCLINE_CMD) / 100.0f);
+   set(HAL_REG_BRAKE, brake);
+
+   if (pending & (1u << HAL_REG_DISTANCE_CMD))
+   {
+      PHYsetDistance(get(HAL_REG_DISTANCE_CMD) / 1000.0);
+   }
+   if (pending & (1u << HAL_REG_ECHO_CMD))
+   {
+      set(HAL_REG_ECHO, get(HAL_REG_ECHO_CMD));
+      HALdeviceInterrupt(HAL_IRQ_ECHO);
+   }
+}
+
+/// Updates the sensor registers from the belt simulation.
+static void updateSensors(void)
+{
+   phyState_t belt;
+
+   PHYgetState(&belt);
+   set(HAL_REG_SPEED, (uint32_t)(int32_t)lroundf(belt.speed * 100.0f));
+   set(HAL_REG_INCLINE, (uint32_t)(int32_t)lroundf(belt.incline * 100.0f));
+   set(HAL_REG_DISTANCE, (uint32_t)llround(belt.distance * 1000.0));
+}
+
+/// Emergency button commands on stdin.
+static void readButtons(void)
+{
+   struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+   char line[16];
+
+   if (poll(&pfd, 1, 0) <= 0 || fgets(line, sizeof(line), stdin) == NULL)
+   {
+      return;
+   }
+   if (line[0] == 'e' || line[0] == 'r')
+   {
+      set(HAL_REG_BUTTONS, (line[0] == 'e') ? HAL_BUTTON_EMERGENCY : 0);
+      HALdeviceInterrupt(HAL_IRQ_BUTTON);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned int rate = PHY_DEFAULT_RATE_HZ;
+   long interval = 1000;
+   unsigned int id = 0;
+   uint64_t commands = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "r:i:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'r':
+         rate = (unsigned int)atoi(optarg);
+         break;
+      case 'i':
+         interval = atol(optarg);
+         break;
+      default:
+         usage();
+      }
+   }
+   if (optind < argc)
+   {
+      id = (unsigned int)atoi(argv[optind]);
+   }
+
+   file = HALdeviceCreate(id);
+   if (file == NULL)
+   {
+      perror("hwsim");
+      return EXIT_FAILURE;
+   }
+   if (!CLKstart() || !PHYstart(rate))
+   {
+      fprintf(stderr, "hwsim: belt simulation not started\n");
+      return EXIT_FAILURE;
+   }
+   printf("hwsim: machine %u, belt simulation at %u Hz\n", id, rate);
+
+   uint64_t nextStatus = CLKrealNs() + (uint64_t)interval * CLK_NS_PER_MS;
+   for (;;)
+   {
+      // Commands are applied on the doorbell, sensors refresh every ms
+      uint32_t pending = HALdeviceWait(1);
+      if (pending != 0)
+      {
+         applyCommands(pending);
+         commands++;
+      }
+      updateSensors();
+      readButtons();
+
+      if (interval > 0 && CLKrealNs() >= nextStatus)
+      {
+         nextStatus += (uint64_t)interval * CLK_NS_PER_MS;
+         printf("speed %6.2f km/h  incline %5.2f %%  distance %9.3f m  brake %u  buttons %02X  commands %llu\n",
+                (int32_t)get(HAL_REG_SPEED) / 100.0, (int32_t)get(HAL_REG_INCLINE) / 100.0,
+                get(HAL_REG_DISTANCE) / 1000.0, get(HAL_REG_BRAKE),
+                get(HAL_REG_BUTTONS), (unsigned long long)commands);
+         fflush(stdout);
+      }
+   }
+}
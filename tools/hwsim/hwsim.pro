@@ -0,0 +1,23 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/clock_functions/clock.c \
+        ../../app/hal_functions/hal.c \
+        ../../app/ipc_functions/ipc.c \
+        ../../app/simulation_functions/physics.c \
+        hwsim.c
+
+HEADERS += \
+   ../../app/clock_functions/clock.h \
+   ../../app/hal_functions/hal.h \
+   ../../app/ipc_functions/ipc.h \
+   ../../app/simulation_functions/physics.h \
+   ../../app/sync_functions/seqlock.h
+
+unix: LIBS += -lpthread -lm
+unix:!macx: LIBS += -lrt
@@ -0,0 +1,90 @@
+/*!
+ * Log decoder: turns a binary log (TREADMILL_BINLOG) back into the text
+ * that the treadmill prints in text mode.
+ *
+ * usage: logdecode [-t] [file]
+ *
+ *    -t  show the time of every message in seconds since the first message
+ *
+ * Without file the binary log is read from stdin.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "log_functions/logbinary.h"
+
+#define LINE_SIZE (512)
+
+int main(int argc, char *argv[])
+{
+   bool showTime = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "t")) != -1)
+   {
+      if (opt != 't')
+      {
+         fprintf(stderr, "usage: logdecode [-t] [file]\n");
+         return EXIT_FAILURE;
+      }
+      showTime = true;
+   }
+
+   FILE *stream = stdin;
+   if (optind < argc)
+   {
+      stream = fopen(argv[optind], "rb");
+      if (stream == NULL)
+      {
+         perror(argv[optind]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   logBinaryReader_t reader;
+   if (!LOGbinaryReaderInit(&reader, stream))
+   {
+      fprintf(stderr, "logdecode: not a binary treadmill log\n");
+      return EXIT_FAILURE;
+   }
+
+   logRecord_t record;
+   char line[LINE_SIZE];
+   uint64_t firstNs = 0;
+   unsigned long long nRecords = 0;
+   int result;
+
+   while ((result = LOGbinaryRead(&reader, &record)) == 1)
+   {
+      const char *prefix = LOGlevelPrefix(record.level);
+
+      if (nRecords++ == 0)
+      {
+         firstNs = record.timestampNs;
+      }
+      LOGrender(&record, line, sizeof(line));
+      if (showTime)
+      {
+         // The prefix starts with a newline, the time goes after it
+         printf("\n[%12.6f] %s%s", (double)(record.timestampNs - firstNs) / 1e9,
+                prefix + 1, line);
+      }
+      else
+      {
+         printf("%s%s", prefix, line);
+      }
+   }
+   putchar('\n');
+
+   LOGbinaryReaderClose(&reader);
+   if (result < 0)
+   {
+      fprintf(stderr, "logdecode: corrupt record after %llu messages\n",
+              nRecords);
+      return EXIT_FAILURE;
+   }
+   return 0;
+}
@@ -0,0 +1,15 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/log_functions/logbinary.c \
+        ../../app/log_functions/logformat.c \
+        logdecode.c
+
+HEADERS += \
+   ../../app/log_functions/logbinary.h \
+   ../../app/log_functions/logformat.h
@@ -0,0 +1,210 @@
+/*!
+ * Metrics scraper: reads the metrics of a treadmill (see
+ * metrics_functions/metrics.h) as Prometheus would and prints them.
+ *
+ * usage: metricscrape [-m machine_id] [-p port] [-i interval_ms] [-n count] [prefix ...]
+ *
+ * Without -p the UNIX socket of the machine is used, with -p the endpoint
+ * on 127.0.0.1:port. With -i the endpoint is scraped every interval and the
+ * counters (_total) are shown as rates per second. Only metrics that start
+ * with one of the prefixes are printed, e.g. fsm_queue.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "clock_functions/clock.h"
+#include "ipc_functions/ipc.h"
+#include "metrics_functions/metrics.h"
+
+#define MAX_SERIES (256)
+
+/// A sample of the previous scrape, for the rates.
+typedef struct
+{
+   char name[128];
+   double value;
+} series_t;
+
+static series_t previous[MAX_SERIES];
+static int nPrevious = 0;
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: metricscrape [-m machine_id] [-p port] [-i interval_ms]"
+                   " [-n count] [prefix ...]\n");
+   exit(EXIT_FAILURE);
+}
+
+/// Scrapes the endpoint, the body in text.
+/// \return false if the endpoint does not answer.
+static bool scrape(unsigned int id, uint16_t port, char *text, size_t size)
+{
+   static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+   int sock;
+
+   if (port != 0)
+   {
+      struct sockaddr_in in =
+      {
+         .sin_family = AF_INET,
+         .sin_port = htons(port),
+         .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+      };
+
+      sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (sock < 0 || connect(sock, (struct sockaddr *)&in, sizeof(in)) != 0)
+      {
+         return false;
+      }
+   }
+   else
+   {
+      struct sockaddr_un addr;
+      socklen_t length = IPCsocketAddress(&addr, MET_SOCKET_NAME, id);
+
+      sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (sock < 0 || connect(sock, (struct sockaddr *)&addr, length) != 0)
+      {
+         return false;
+      }
+   }
+
+   size_t length = 0;
+   ssize_t n;
+   if (write(sock, request, sizeof(request) - 1) != (ssize_t)(sizeof(request) - 1))
+   {
+      close(sock);
+      return false;
+   }
+   while (length < size - 1 && (n = read(sock, text + length, size - 1 - length)) > 0)
+   {
+      length += (size_t)n;
+   }
+   close(sock);
+   text[length] = '\0';
+
+   char *body = strstr(text, "\r\n\r\n");
+   if (strncmp(text, "HTTP/1.0 200", 12) != 0 || body == NULL)
+   {
+      return false;
+   }
+   memmove(text, body + 4, strlen(body + 4) + 1);
+   return true;
+}
+
+static bool selected(const char *line, int nPrefixes, char *prefixes[])
+{
+   for (int p = 0; p < nPrefixes; p++)
+   {
+      if (strncmp(line, prefixes[p], strlen(prefixes[p])) == 0)
+      {
+         return true;
+      }
+   }
+   return nPrefixes == 0;
+}
+
+/// Prints the samples, the counters as rates if a previous scrape is known.
+static void print(char *text, double seconds, int nPrefixes, char *prefixes[])
+{
+   series_t current[MAX_SERIES];
+   int nCurrent = 0;
+
+   for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n"))
+   {
+      char name[128];
+      double value;
+
+      if (line[0] == '#' || !selected(line, nPrefixes, prefixes) ||
+          sscanf(line, "%127s %lf", name, &value) != 2)
+      {
+         continue;
+      }
+      if (seconds <= 0.0 || strstr(name, "_total") == NULL)
+      {
+         printf("%-64s %16.6g\n", name, value);
+      }
+      else
+      {
+         double rate = 0.0;
+         for (int i = 0; i < nPrevious; i++)
+         {
+            if (strcmp(previous[i].name, name) == 0)
+            {
+               rate = (value - previous[i].value) / seconds;
+               break;
+            }
+         }
+         printf("%-64s %16.6g %12.1f/s\n", name, value, rate);
+      }
+      if (nCurrent < MAX_SERIES)
+      {
+         strcpy(current[nCurrent].name, name);
+         current[nCurrent].value = value;
+         nCurrent++;
+      }
+   }
+   memcpy(previous, current, (size_t)nCurrent * sizeof(series_t));
+   nPrevious = nCurrent;
+}
+
+int main(int argc, char *argv[])
+{
+   static char text[MET_BUFFER_SIZE + 1024];
+   const char *machineId = getenv("TREADMILL_ID");
+   unsigned int id = (machineId != NULL) ? (unsigned int)atoi(machineId) : 0;
+   uint16_t port = 0;
+   int intervalMs = 0;
+   long count = 1;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "m:p:i:n:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'm':
+         id = (unsigned int)atoi(optarg);
+         break;
+      case 'p':
+         port = (uint16_t)atoi(optarg);
+         break;
+      case 'i':
+         intervalMs = atoi(optarg);
+         count = 0;
+         break;
+      case 'n':
+         count = atol(optarg);
+         break;
+      default:
+         usage();
+      }
+   }
+
+   uint64_t lastNs = 0;
+   for (long n = 0; count == 0 || n < count; n++)
+   {
+      if (n > 0)
+      {
+         usleep((useconds_t)intervalMs * 1000u);
+         printf("\n");
+      }
+      uint64_t now = CLKrealNs();
+      if (!scrape(id, port, text, sizeof(text)))
+      {
+         fprintf(stderr, "metricscrape: no metrics endpoint for machine %u\n", id);
+         return EXIT_FAILURE;
+      }
+      print(text, (lastNs != 0) ? (double)(now - lastNs) / 1e9 : 0.0,
+            argc - optind, &argv[optind]);
+      fflush(stdout);
+      lastNs = now;
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,19 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/clock_functions/clock.c \
+        ../../app/ipc_functions/ipc.c \
+        metricscrape.c
+
+HEADERS += \
+   ../../app/clock_functions/clock.h \
+   ../../app/ipc_functions/ipc.h \
+   ../../app/metrics_functions/metrics.h
+
+unix: LIBS += -lpthread
+unix:!macx: LIBS += -lrt
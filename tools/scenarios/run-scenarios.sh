@@ -0,0 +1,31 @@
+#!/bin/sh
+# Runs scenario scripts in parallel, one treadmill process per script.
+#
+# usage: run-scenarios.sh fsm-treadmill [script ...]
+#
+# Without scripts all *.scr files next to this file are run. The console
+# output of the treadmills is discarded, the result of every script and the
+# total run time are shown. Exit status is 1 if a script failed.
+
+if [ $# -lt 1 ]; then
+   echo "usage: $0 fsm-treadmill [script ...]" >&2
+   exit 2
+fi
+
+treadmill=$1
+shift
+if [ $# -eq 0 ]; then
+   set -- "$(dirname "$0")"/*.scr
+fi
+
+jobs=$(nproc 2>/dev/null || echo 4)
+start=$(date +%s%N)
+
+printf '%s\n' "$@" |
+   xargs -P "$jobs" -I{} sh -c '"$0" --script "$1" >/dev/null' "$treadmill" {}
+status=$?
+
+end=$(date +%s%N)
+echo "$# scripts in $(( (end - start) / 1000000 )) ms" >&2
+
+[ $status -eq 0 ] || exit 1
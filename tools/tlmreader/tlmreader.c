@@ -0,0 +1,103 @@
+/*!
+ * Telemetry reader: shows the values that treadmills publish in shared
+ * memory (see telemetry_functions/telemetry.h).
+ *
+ * usage: tlmreader [-i interval_ms] [-n count] id [id ...]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry_functions/telemetry.h"
+
+#define MAX_MACHINES (64)
+
+extern char * stateEnumToText[];
+extern char * eventEnumToText[];
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: tlmreader [-i interval_ms] [-n count] id [id ...]\n");
+   exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+   long interval = 500;
+   long count = -1;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "i:n:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'i':
+         interval = atol(optarg);
+         break;
+      case 'n':
+         count = atol(optarg);
+         break;
+      default:
+         usage();
+      }
+   }
+   if (optind >= argc || argc - optind > MAX_MACHINES)
+   {
+      usage();
+   }
+
+   int nMachines = argc - optind;
+   unsigned int ids[MAX_MACHINES];
+   const tlmSegment_t *segments[MAX_MACHINES];
+
+   for (int i = 0; i < nMachines; i++)
+   {
+      ids[i] = (unsigned int)atoi(argv[optind + i]);
+      segments[i] = TLMattach(ids[i]);
+      if (segments[i] == NULL)
+      {
+         fprintf(stderr, "machine %u: no telemetry segment\n", ids[i]);
+      }
+   }
+
+   printf("%4s %-14s %-20s %7s %7s %9s %8s %10s %7s\n", "id", "state",
+          "event", "km/h", "inc %", "dist m", "errors", "published",
+          "retries");
+
+   while (count != 0)
+   {
+      for (int i = 0; i < nMachines; i++)
+      {
+         if (segments[i] == NULL)
+         {
+            continue;
+         }
+
+         tlmSnapshot_t s;
+         unsigned int retries = TLMread(segments[i], &s);
+
+         printf("%4u %-14s %-20s %7.1f %7.1f %9.1f %08x %10llu %7u\n",
+                ids[i], stateEnumToText[s.state], eventEnumToText[s.event],
+                s.speed, s.inc, s.distance, s.errorBits,
+                (unsigned long long)atomic_load(&segments[i]->publishCount), retries);
+      }
+      fflush(stdout);
+
+      if (count > 0)
+      {
+         count--;
+      }
+      if (count != 0)
+      {
+         usleep((useconds_t)interval * 1000);
+      }
+   }
+
+   for (int i = 0; i < nMachines; i++)
+   {
+      TLMdetach(segments[i]);
+   }
+   return 0;
+}
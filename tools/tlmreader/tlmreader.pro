@@ -0,0 +1,18 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ../../app
+
+SOURCES += \
+        ../../app/events.c \
+        ../../app/states.c \
+        ../../app/telemetry_functions/telemetry.c \
+        tlmreader.c
+
+HEADERS += \
+   ../../app/sync_functions/seqlock.h \
+   ../../app/telemetry_functions/telemetry.h
+
+unix:!macx: LIBS += -lrt